@@ -0,0 +1,99 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_AGGREGATOR_SERVER_AGGREGATOR_CONFIG_HPP__
+#define __ZECALE_AGGREGATOR_SERVER_AGGREGATOR_CONFIG_HPP__
+
+// Types and parameters shared by the aggregator server and the setup tool.
+// Read the zecale config, include the appropriate pairing selector and define
+// the corresponding pairing parameters type.
+
+#include "libzecale/circuits/aggregator_circuit_family.hpp"
+#include "zecale_config.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Set the wrapper curve type (wpp) based on the build configuration.
+#if defined(ZECALE_CURVE_MNT6)
+#include <libsnark/gadgetlib1/gadgets/pairing/mnt/mnt_pairing_params.hpp>
+using wpp = libff::mnt6_pp;
+static const char wpp_name[] = "mnt6";
+#elif defined(ZECALE_CURVE_BW6_761)
+#include <libsnark/gadgetlib1/gadgets/pairing/bw6_761_bls12_377/bw6_761_pairing_params.hpp>
+using wpp = libff::bw6_761_pp;
+static const char wpp_name[] = "bw6_761";
+#else
+#error "ZECALE_CURVE_* variable not set to supported curve"
+#endif
+
+// The nested curve type (npp)
+using npp = libsnark::other_curve<wpp>;
+
+// Set both wrapper and nested snark schemes based on the build configuration.
+#if defined(ZECALE_SNARK_PGHR13)
+#include <libzecale/circuits/pghr13_verifier/pghr13_verifier_parameters.hpp>
+#include <libzeth/snarks/pghr13/pghr13_api_handler.hpp>
+using wsnark = libzeth::pghr13_snark<wpp>;
+using wapi_handler = libzeth::pghr13_api_handler<wpp>;
+using nverifier = libzecale::pghr13_verifier_parameters<wpp>;
+using napi_handler = libzeth::pghr13_api_handler<npp>;
+static const char snark_name[] = "pghr13";
+#elif defined(ZECALE_SNARK_GROTH16)
+#include <libzecale/circuits/groth16_verifier/groth16_verifier_parameters.hpp>
+#include <libzeth/snarks/groth16/groth16_api_handler.hpp>
+using wsnark = libzeth::groth16_snark<wpp>;
+using wapi_handler = libzeth::groth16_api_handler<wpp>;
+using nverifier = libzecale::groth16_verifier_parameters<wpp>;
+using napi_handler = libzeth::groth16_api_handler<npp>;
+static const char snark_name[] = "groth16";
+#else
+#error "ZECALE_SNARK_* variable not set to supported ZK snark"
+#endif
+
+using nsnark = typename nverifier::snark;
+
+static const size_t num_inputs_per_nested_proof = 1;
+
+// Batch sizes supported when none are specified on the command line. The first
+// listed size is the default batch size of the server.
+static const char default_batch_sizes[] = "2";
+
+// All batch sizes which can be selected at runtime. Each has its own circuit
+// and keypair.
+using aggregator_family = libzecale::
+    aggregator_circuit_family<wpp, wsnark, nverifier, 2, 4, 8, 16, 32>;
+using aggregator_circuit = aggregator_family::circuit_interface;
+
+/// Parse a comma-separated list of batch sizes, each of which must be
+/// supported by the aggregator_family.
+inline std::vector<size_t> parse_batch_sizes(const std::string &batch_sizes_str)
+{
+    std::vector<size_t> batch_sizes;
+    std::istringstream in(batch_sizes_str);
+    std::string entry;
+    while (std::getline(in, entry, ',')) {
+        const size_t batch_size = std::stoul(entry);
+        if (!aggregator_family::supports_batch_size(batch_size)) {
+            throw std::invalid_argument(
+                "unsupported batch size: " + std::to_string(batch_size));
+        }
+        if (std::find(batch_sizes.begin(), batch_sizes.end(), batch_size) !=
+            batch_sizes.end()) {
+            throw std::invalid_argument(
+                "duplicate batch size: " + std::to_string(batch_size));
+        }
+        batch_sizes.push_back(batch_size);
+    }
+
+    if (batch_sizes.empty()) {
+        throw std::invalid_argument("no batch sizes given");
+    }
+    return batch_sizes;
+}
+
+#endif // __ZECALE_AGGREGATOR_SERVER_AGGREGATOR_CONFIG_HPP__
@@ -2,17 +2,31 @@
 //
 // SPDX-License-Identifier: LGPL-3.0+
 
-// Read the zecale config, include the appropriate pairing selector and define
-// the corresponding pairing parameters type.
-
-#include "libzecale/circuits/aggregator_circuit.hpp"
+#include "aggregator_server/aggregator_config.hpp"
+#include "aggregator_server/keypair_files.hpp"
 #include "libzecale/core/application_pool.hpp"
+#include "libzecale/core/application_registry.hpp"
+#include "libzecale/core/logger.hpp"
+#include "libzecale/core/metrics.hpp"
+#include "libzecale/core/nested_proof_verifier.hpp"
+#include "libzecale/core/transaction_dedup_index.hpp"
+#include "libzecale/core/verification_key_hash_cache.hpp"
+#include "libzecale/core/worker_pool.hpp"
+#include "libzecale/core/write_ahead_log.hpp"
 #include "libzecale/serialization/proto_utils.hpp"
-#include "zecale_config.h"
+#include "libzecale/serialization/r1cs_binary.hpp"
 
+#include <algorithm>
 #include <boost/program_options.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <grpc/grpc.h>
+#include <grpcpp/resource_quota.h>
 #include <grpcpp/security/server_credentials.h>
 #include <grpcpp/server.h>
 #include <grpcpp/server_builder.h>
@@ -22,57 +36,66 @@
 #include <libzeth/circuits/circuit_types.hpp>
 #include <libzeth/core/utils.hpp>
 #include <libzeth/serialization/proto_utils.hpp>
-#include <libzeth/serialization/r1cs_serialization.hpp>
 #include <libzeth/zeth_constants.hpp>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <zecale/api/aggregator.grpc.pb.h>
 
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
 namespace proto = google::protobuf;
 namespace po = boost::program_options;
 
-// Set the wrapper curve type (wpp) based on the build configuration.
-#if defined(ZECALE_CURVE_MNT6)
-#include <libsnark/gadgetlib1/gadgets/pairing/mnt/mnt_pairing_params.hpp>
-using wpp = libff::mnt6_pp;
-#elif defined(ZECALE_CURVE_BW6_761)
-#include <libsnark/gadgetlib1/gadgets/pairing/bw6_761_bls12_377/bw6_761_pairing_params.hpp>
-using wpp = libff::bw6_761_pp;
-#else
-#error "ZECALE_CURVE_* variable not set to supported curve"
-#endif
+using libzecale::log_level;
+using libzecale::log_record;
 
-// The nested curve type (npp)
-using npp = libsnark::other_curve<wpp>;
-
-// Set both wrapper and nested snark schemes based on the build configuration.
-#if defined(ZECALE_SNARK_PGHR13)
-#include <libzecale/circuits/pghr13_verifier/pghr13_verifier_parameters.hpp>
-#include <libzeth/snarks/pghr13/pghr13_api_handler.hpp>
-using wsnark = libzeth::pghr13_snark<wpp>;
-using wapi_handler = libzeth::pghr13_api_handler<wpp>;
-using nverifier = libzecale::pghr13_verifier_parameters<wpp>;
-using napi_handler = libzeth::pghr13_api_handler<npp>;
-#elif defined(ZECALE_SNARK_GROTH16)
-#include <libzecale/circuits/groth16_verifier/groth16_verifier_parameters.hpp>
-#include <libzeth/snarks/groth16/groth16_api_handler.hpp>
-using wsnark = libzeth::groth16_snark<wpp>;
-using wapi_handler = libzeth::groth16_api_handler<wpp>;
-using nverifier = libzecale::groth16_verifier_parameters<wpp>;
-using napi_handler = libzeth::groth16_api_handler<npp>;
-#else
-#error "ZECALE_SNARK_* variable not set to supported ZK snark"
-#endif
+// Maximum number of finished batches for which the status (and aggregated
+// transaction) is retained by the server.
+static const size_t max_finished_batches = 1024;
 
-using nsnark = typename nverifier::snark;
+// Interval at which threads waiting for batches check whether the client has
+// cancelled the call.
+static const std::chrono::milliseconds batch_wait_poll_interval(500);
 
-static const size_t batch_size = 2;
-static const size_t num_inputs_per_nested_proof = 1;
+// Interval at which the batch scheduler (if enabled) checks the application
+// pools, in the absence of other events.
+static const std::chrono::milliseconds scheduler_poll_interval(100);
 
-using aggregator_circuit =
-    libzecale::aggregator_circuit<wpp, wsnark, nverifier, batch_size>;
+// Maximum number of submitted proofs which are verified together (if
+// verification at submission is enabled).
+static const size_t max_verification_batch = 64;
+
+// Number of asynchronous SubmitNestedTransaction calls awaiting an incoming
+// request on each completion queue, so that bursts of calls can be matched
+// without waiting for a completion queue thread.
+static const size_t pending_submit_calls_per_queue = 32;
+
+// Maximum number of transactions from a single SubmitNestedTransactions
+// stream being processed at once. Reading from the stream pauses when this
+// is reached, so that a fast client cannot exhaust memory.
+static const size_t max_stream_submissions_in_flight = 64;
+
+// Types of the entries in the write-ahead log (if enabled), each holding the
+// serialized request.
+static const uint32_t log_application_registration = 1;
+static const uint32_t log_nested_transaction = 2;
+
+using keypair_map = std::map<size_t, wsnark::keypair>;
+
+/// Loads (or generates) the keypair for a batch size, reporting progress (if
+/// known) to the given callback.
+using keypair_loader = std::function<void(
+    size_t batch_size,
+    wsnark::keypair &keypair,
+    const libzecale::setup_progress_callback &progress)>;
 
 static void load_keypair(
     wsnark::keypair &keypair, const boost::filesystem::path &keypair_file)
@@ -84,267 +107,2213 @@ static void load_keypair(
     wsnark::keypair_read_bytes(keypair, in);
 }
 
-static void write_keypair(
-    const typename wsnark::keypair &keypair,
-    const boost::filesystem::path &keypair_file)
+static void write_constraint_system(
+    const libsnark::r1cs_constraint_system<libff::Fr<wpp>> &constraint_system,
+    const boost::filesystem::path &r1cs_file)
 {
-    std::ofstream out_s(
-        keypair_file.c_str(), std::ios_base::out | std::ios_base::binary);
-    wsnark::keypair_write_bytes(keypair, out_s);
+    std::ofstream r1cs_stream(
+        r1cs_file.c_str(), std::ios_base::out | std::ios_base::binary);
+    r1cs_stream.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+    libzecale::r1cs_write_binary(constraint_system, r1cs_stream);
 }
 
-static void write_constraint_system(
-    const aggregator_circuit &aggregator,
-    const boost::filesystem::path &r1cs_file)
+/// Parse a comma-separated list of log sample rates, each of the form
+/// <category>=<rate>.
+static std::map<std::string, size_t> parse_log_sample_rates(
+    const std::string &sample_rates_str)
 {
-    std::ofstream r1cs_stream(r1cs_file.c_str());
-    libzeth::r1cs_write_json(aggregator.get_constraint_system(), r1cs_stream);
+    std::map<std::string, size_t> sample_rates;
+    std::istringstream in(sample_rates_str);
+    std::string entry;
+    while (std::getline(in, entry, ',')) {
+        const size_t separator = entry.find('=');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("invalid log sample rate: " + entry);
+        }
+        const size_t rate = std::stoul(entry.substr(separator + 1));
+        if (rate == 0) {
+            throw std::invalid_argument("invalid log sample rate: " + entry);
+        }
+        sample_rates[entry.substr(0, separator)] = rate;
+    }
+    return sample_rates;
+}
+
+/// Load or generate the keypair for a batch size. If there is no keypair,
+/// one is generated (see generate_keypair_file and aggregator-setup). For
+/// Groth16, the mapped form of the keypair is used if present. If not, the
+/// keypair is loaded and its mapped form is written for the next start.
+static void load_or_generate_keypair(
+    const size_t batch_size,
+    wsnark::keypair &keypair,
+    const boost::filesystem::path &keypair_dir,
+    const bool prefault,
+    const bool verify_checksum,
+    const libzecale::setup_progress_callback &progress)
+{
+    const boost::filesystem::path keypair_file =
+        keypair_path(keypair_dir, batch_size, ".bin");
+    const boost::filesystem::path generated_keypair_file =
+        generated_keypair_path(keypair_dir, batch_size);
+    if (!boost::filesystem::exists(generated_keypair_file) &&
+        !boost::filesystem::exists(keypair_file)) {
+        std::cout << "[INFO] No keypair file " << generated_keypair_file
+                  << ". Generating.\n";
+        generate_keypair_file(
+            batch_size,
+            generated_keypair_file,
+            libzecale::default_setup_chunk_size,
+            progress);
+    }
+
+#if defined(ZECALE_SNARK_GROTH16)
+    const boost::filesystem::path &mapped_keypair_file = generated_keypair_file;
+    if (boost::filesystem::exists(mapped_keypair_file)) {
+        std::cout << "[INFO] Loading mapped keypair: " << mapped_keypair_file
+                  << "\n";
+        load_mapped_keypair(
+            keypair,
+            batch_size,
+            mapped_keypair_file,
+            prefault,
+            verify_checksum);
+    } else {
+        std::cout << "[INFO] Loading keypair: " << keypair_file << "\n";
+        load_keypair(keypair, keypair_file);
+        std::cout << "[INFO] Writing mapped keypair to " << mapped_keypair_file
+                  << "\n";
+        write_mapped_keypair(keypair, batch_size, mapped_keypair_file);
+    }
+#else
+    (void)prefault;
+    (void)verify_checksum;
+    std::cout << "[INFO] Loading keypair: " << keypair_file << "\n";
+    load_keypair(keypair, keypair_file);
+#endif
 }
 
 /// The aggregator_server class inherits from the Aggregator service defined in
 /// the proto files, and provides an implementation of the service.
-class aggregator_server final : public zecale_proto::Aggregator::Service
+///
+/// Proving is performed in the background. Requests for aggregated
+/// transactions queue a batch job and are given a batch id. Prover worker
+/// threads pop jobs from the queue, take a batch of transactions from the
+/// relevant application_pool, generate the wrapping proof and store the
+/// resulting aggregated transaction, from where it can be retrieved by
+/// clients.
+///
+/// If automatic batching is enabled, a scheduler thread also queues batch jobs
+/// without client requests (see scheduler_loop), and clients receive the
+/// results via SubscribeBatches.
+///
+/// The server supports a set of batch sizes, each with its own keypair. A batch
+/// request may name one of these sizes, or leave the choice to the server, in
+/// which case the largest batch that can be filled from the pool is used
+/// (reducing the per-transaction cost of proving and verification as the load
+/// increases).
+///
+/// Each worker owns an aggregator_circuit instance (its "prover context") for
+/// each batch size, created when first required. All contexts for a given
+/// size share the same proving key (and the constraint system it holds), so
+/// that several batches (for the same or different applications) can be
+/// proven in parallel. The available cores are split between the workers.
+///
+/// The part of the witness which depends only on an application's nested
+/// verification key is computed when the application is registered, and
+/// held with its pool, so that it is only copied into the prover context for
+/// each batch.
+///
+/// If a log directory is given, registered applications and pooled
+/// transactions are recorded in a write-ahead log, and restored when the
+/// server restarts. Transactions are removed from the log once their batch is
+/// finished.
+///
+/// The server accepts requests as soon as it starts. Keypairs are loaded (or
+/// generated) in the background by a warmup thread, during which applications
+/// can be registered and transactions submitted, while requests requiring the
+/// keypairs fail with UNAVAILABLE (see GetReadiness).
+///
+/// Optionally, nested proofs are verified natively when submitted, so that
+/// invalid proofs are rejected before they occupy a slot in a batch. This is
+/// performed by a pool of verifier threads, which verify proofs submitted at
+/// around the same time for the same application together (see
+/// libzecale::nested_proof_verifier).
+///
+/// Counters and latency histograms are kept in a metrics_registry, and
+/// reported (along with the occupancy of each pool) by GetMetrics and, if
+/// configured, periodically written to a file in the Prometheus text format.
+///
+/// SubmitNestedTransaction is served asynchronously, so that the number of
+/// concurrent submissions is not bounded by the number of threads. Incoming
+/// calls are accepted by a small number of completion queue threads, and
+/// handed to a pool of submission workers which decode, check and pool the
+/// transactions (see submit_call). All other methods are synchronous, and
+/// each call holds a gRPC server thread while it runs. This includes the
+/// long-running WaitBatch, SubscribeBatches and SubmitNestedTransactions calls,
+/// so the number of these threads is bounded (see --max-sync-threads), and
+/// synchronous calls beyond the limit fail with RESOURCE_EXHAUSTED.
+///
+/// Duplicate transactions (with the same proof, inputs and parameters as a
+/// transaction in the pool, or one aggregated within the deduplication TTL)
+/// are rejected at submission with ALREADY_EXISTS.
+///
+/// The size of each pool, and the total size of all pools, may be bounded.
+/// When a pool is full, submitted transactions evict lower-fee transactions,
+/// or are rejected with RESOURCE_EXHAUSTED if there are none (see
+/// GetPoolStatus). Transactions may also expire after a TTL. Evicted and
+/// expired transactions are removed from the log, and may be resubmitted.
+class aggregator_server final
+    : public zecale_proto::Aggregator::WithAsyncMethod_SubmitNestedTransaction<
+          zecale_proto::Aggregator::Service>
 {
 private:
-    using application_pool =
-        libzecale::application_pool<npp, nsnark, batch_size>;
+    /// Pool of transactions for an application, with the witness for its
+    /// nested verification key (valid for aggregator circuits of any size),
+    /// a verifier for its nested proofs, and an index of its pending and
+    /// recently aggregated transactions. The witness is computed at
+    /// registration or, for applications registered during warmup, once the
+    /// keypairs are loaded. It is written under registration_mutex, and only
+    /// read by prover workers once the server is ready.
+    class application_pool : public libzecale::application_pool<npp, nsnark>
+    {
+    public:
+        libzecale::nested_vk_witness<wpp> vk_witness;
+        const libzecale::nested_proof_verifier<npp, nsnark> proof_verifier;
+        libzecale::transaction_dedup_index dedup_index;
+        libzecale::metrics_counter &num_aggregated_transactions;
+
+        application_pool(
+            const std::string &name,
+            const typename nsnark::verification_key &vk,
+            const std::chrono::milliseconds max_batch_wait,
+            const std::chrono::milliseconds dedup_ttl,
+            const libzecale::application_pool_limits &limits,
+            const std::shared_ptr<libzecale::pool_capacity> &total_capacity,
+            libzecale::metrics_counter &num_aggregated_transactions)
+            : libzecale::application_pool<npp, nsnark>(
+                  name, vk, max_batch_wait, 0, limits, total_capacity)
+            , vk_witness()
+            , proof_verifier(vk)
+            , dedup_index(dedup_ttl)
+            , num_aggregated_transactions(num_aggregated_transactions)
+        {
+        }
+    };
+
+    using application_registry =
+        libzecale::application_registry<application_pool>;
+
+    /// A submitted nested proof, waiting to be verified.
+    struct pending_verification {
+        std::shared_ptr<application_pool> app_pool;
+        const libzeth::extended_proof<npp, nsnark> *proof;
+        std::promise<bool> result;
+    };
+
+    /// A request to aggregate a batch of transactions for an application.
+    /// (A batch_size of 0 means the largest supported batch that can be
+    /// filled when the job is processed. If allow_partial is set, a partial
+    /// batch, padded with dummy proofs, is created if no batch can be filled.
+    /// The proof of the aggregated transaction is in the given encoding.)
+    struct batch_job {
+        uint64_t batch_id;
+        std::shared_ptr<application_pool> app_pool;
+        size_t batch_size;
+        bool allow_partial;
+        zecale_proto::ProofEncoding proof_encoding;
+    };
+
+    /// State of an asynchronous SubmitNestedTransaction call. Each instance
+    /// first waits for an incoming call on a completion queue. The request
+    /// is then processed by a submission worker, which sends the response.
+    /// The instance deletes itself once the response has been sent (or the
+    /// queue is shut down).
+    class submit_call
+    {
+    public:
+        submit_call(aggregator_server &server, grpc::ServerCompletionQueue &cq)
+            : server(server)
+            , cq(cq)
+            , responder(&context)
+            , state(awaiting_request)
+        {
+            server.RequestSubmitNestedTransaction(
+                &context, &request, &responder, &cq, &cq, this);
+        }
+
+        /// Called by the completion queue thread when the pending operation
+        /// for this call completes. `ok` is false if the queue is shutting
+        /// down.
+        void proceed(const bool ok)
+        {
+            if (state == finishing || !ok) {
+                delete this;
+                return;
+            }
+
+            // Wait for the next call, and process this one on a worker.
+            server.request_submit_call(cq);
+            state = finishing;
+            server.submit_workers->post([this]() {
+                const grpc::Status status =
+                    server.submit_nested_transaction(request);
+                responder.Finish(response, status, this);
+            });
+        }
+
+    private:
+        enum call_state { awaiting_request, finishing };
+
+        aggregator_server &server;
+        grpc::ServerCompletionQueue &cq;
+        grpc::ServerContext context;
+        zecale_proto::NestedTransaction request;
+        proto::Empty response;
+        grpc::ServerAsyncResponseWriter<proto::Empty> responder;
+        call_state state;
+    };
+
+    // Log for all server activity (written asynchronously).
+    libzecale::logger &log;
+
+    // Metrics. Those updated for every submission or batch are looked up
+    // once, so that only their atomic counters are touched on these paths.
+    // (Submission counters are indexed by SubmissionOutcome, and proving time
+    // histograms by batch size.)
+    libzecale::metrics_registry metrics;
+    libzecale::metrics_histogram &submit_latency;
+    const std::vector<libzecale::metrics_counter *> submission_counters;
+    libzecale::metrics_counter &num_done_batches;
+    libzecale::metrics_counter &num_failed_batches;
+    const std::map<size_t, libzecale::metrics_histogram *> proving_time;
+
+    // Supported batch sizes, as configured. The first is the default.
+    const std::vector<size_t> &batch_sizes;
+
+    // Keypairs (the result of the setup for the aggregation circuit) for each
+    // supported batch size. Populated by the warmup thread, and only accessed
+    // by other threads once the server is ready.
+    keypair_map keypairs;
+
+    // Smallest and largest supported batch sizes.
+    const size_t min_batch_size;
+    const size_t max_batch_size;
+
+    // If set, the scheduler thread queues batch jobs automatically.
+    const bool auto_batch;
+
+    // Maximum wait (see application_pool::max_batch_wait) for applications
+    // which do not specify one at registration.
+    const std::chrono::milliseconds default_max_batch_wait;
+
+    // Time for which aggregated transactions are remembered, in order to
+    // reject duplicates.
+    const std::chrono::milliseconds dedup_ttl;
+
+    // Limits for each application pool.
+    const libzecale::application_pool_limits pool_limits;
+
+    // Space used by all application pools (and the limits on their total).
+    const std::shared_ptr<libzecale::pool_capacity> total_pool_capacity;
+
+    // Number of threads used by each worker to generate proofs.
+    const size_t threads_per_context;
+
+    // Pools of transactions (and nested verification keys) for each
+    // registered application. Accessed concurrently by all handler threads and
+    // the prover worker.
+    application_registry application_pools;
+
+    // Log of registered applications and pooled transactions (null if
+    // disabled).
+    std::unique_ptr<libzecale::write_ahead_log> tx_log;
+
+    // Hashes of nested verification keys, for GetNestedVerificationKeyHash
+    // and RegisterApplication.
+    libzecale::verification_key_hash_cache<wpp, nverifier> vk_hash_cache;
+
+    // Witness-only context used to compute the nested verification key
+    // witness for new applications, protected by registration_mutex (which
+    // also serializes registrations). Created by the warmup thread once the
+    // keypairs are loaded.
+    std::unique_ptr<aggregator_circuit> registration_context;
+    std::mutex registration_mutex;
+
+    // Protects the warmup state below.
+    mutable std::mutex warmup_mutex;
+
+    // Set once the keypairs are loaded and batches can be aggregated.
+    bool ready;
+
+    // Description of the current warmup stage, and progress within it.
+    std::string warmup_stage;
+    size_t warmup_stage_progress;
+    size_t warmup_stage_total;
+
+    size_t num_keypairs_loaded;
+
+    // Set if warmup failed.
+    std::string warmup_error;
+
+    std::thread warmup_thread;
+
+    // Protects all batch-related state below.
+    std::mutex batch_mutex;
+
+    // Signalled when a job is queued, or when the server is stopping.
+    std::condition_variable batch_job_queued;
+
+    // Signalled whenever a batch is finished (successfully or not).
+    std::condition_variable batch_finished;
+
+    // Signalled to trigger the scheduler to check the application pools.
+    std::condition_variable scheduler_wakeup;
+
+    // Set when the server is stopping, to terminate the worker and any
+    // waiting threads.
+    bool stopping;
+
+    uint64_t next_batch_id;
+
+    // Jobs waiting to be picked up by a prover worker.
+    std::deque<batch_job> batch_jobs;
+
+    // Number of jobs in batch_jobs for each application (applications with no
+    // queued jobs are not present).
+    std::map<std::string, size_t> queued_jobs_per_app;
+
+    // Number of workers currently proving a batch.
+    size_t num_busy_workers;
+
+    // Status of all queued, in-progress and recently finished batches.
+    std::map<uint64_t, zecale_proto::BatchStatus> batch_results;
+
+    // Ids of the most recently finished batches, in order of completion.
+    // Used to bound the size of batch_results and to notify subscribers.
+    std::deque<uint64_t> finished_batches;
+
+    // Total number of batches finished since the server started.
+    uint64_t num_finished_batches;
+
+    std::vector<std::thread> prover_workers;
+
+    std::thread scheduler;
+
+    // Signalled to wake the metrics writer when the server is stopping.
+    std::condition_variable metrics_writer_wakeup;
+
+    // File to which metrics are periodically written (empty if disabled),
+    // and the interval between writes.
+    const std::string metrics_file;
+    const std::chrono::milliseconds metrics_interval;
+
+    std::thread metrics_writer;
+
+    // Protects all verification-related state below.
+    std::mutex verification_mutex;
+
+    // Signalled when a proof is queued for verification, or when the server is
+    // stopping.
+    std::condition_variable verification_queued;
+
+    bool verifiers_stopping;
+
+    // Proofs waiting to be verified, in order of submission.
+    std::list<pending_verification> pending_verifications;
+
+    // Threads verifying nested proofs at submission (empty if disabled).
+    std::vector<std::thread> verifier_threads;
+
+    // Threads processing submitted transactions.
+    std::unique_ptr<libzecale::worker_pool> submit_workers;
+
+    // Protects the completion queue state below.
+    std::mutex submit_queues_mutex;
+
+    // Set once the completion queues are shutting down, after which no new
+    // calls are requested.
+    bool submit_queues_stopping;
+
+    // Completion queues for asynchronous SubmitNestedTransaction calls, each
+    // polled by its own thread.
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> submit_queues;
+    std::vector<std::thread> submit_queue_threads;
+
+public:
+    aggregator_server(
+        libzecale::logger &log,
+        const std::vector<size_t> &batch_sizes,
+        const keypair_loader &load_keypair,
+        const size_t num_prover_contexts,
+        const size_t threads_per_context,
+        const bool auto_batch,
+        const std::chrono::milliseconds default_max_batch_wait,
+        const size_t num_verifier_threads,
+        const std::string &log_dir,
+        const size_t log_snapshot_interval,
+        const std::chrono::milliseconds dedup_ttl,
+        const libzecale::application_pool_limits &pool_limits,
+        const size_t max_total_pool_transactions,
+        const size_t max_total_pool_bytes,
+        const size_t num_submit_threads,
+        const std::string &metrics_file,
+        const std::chrono::milliseconds metrics_interval)
+        : log(log)
+        , metrics()
+        , submit_latency(metrics.histogram("zecale_submit_latency_us"))
+        , submission_counters(create_submission_counters(metrics))
+        , num_done_batches(
+              metrics.counter("zecale_batches_total", {{"outcome", "done"}}))
+        , num_failed_batches(
+              metrics.counter("zecale_batches_total", {{"outcome", "failed"}}))
+        , proving_time(create_proving_time_histograms(metrics, batch_sizes))
+        , batch_sizes(batch_sizes)
+        , keypairs()
+        , min_batch_size(
+              *std::min_element(batch_sizes.begin(), batch_sizes.end()))
+        , max_batch_size(
+              *std::max_element(batch_sizes.begin(), batch_sizes.end()))
+        , auto_batch(auto_batch)
+        , default_max_batch_wait(default_max_batch_wait)
+        , dedup_ttl(dedup_ttl)
+        , pool_limits(pool_limits)
+        , total_pool_capacity(std::make_shared<libzecale::pool_capacity>(
+              max_total_pool_transactions, max_total_pool_bytes))
+        , threads_per_context(threads_per_context)
+        , tx_log()
+        , vk_hash_cache(num_inputs_per_nested_proof)
+        , registration_context()
+        , ready(false)
+        , warmup_stage("starting")
+        , warmup_stage_progress(0)
+        , warmup_stage_total(0)
+        , num_keypairs_loaded(0)
+        , stopping(false)
+        , next_batch_id(1)
+        , num_busy_workers(0)
+        , num_finished_batches(0)
+        , metrics_file(metrics_file)
+        , metrics_interval(metrics_interval)
+        , verifiers_stopping(false)
+        , submit_workers(new libzecale::worker_pool(num_submit_threads))
+        , submit_queues_stopping(false)
+    {
+        if (!log_dir.empty()) {
+            tx_log.reset(
+                new libzecale::write_ahead_log(log_dir, log_snapshot_interval));
+            tx_log->set_snapshot_failure_handler(
+                [this](const std::string &error) {
+                    log_record(log, log_level::error, "tx_log")
+                        << "Failed to write log snapshot (retried later): "
+                        << error;
+                });
+            restore_from_log();
+        }
+
+        for (size_t i = 0; i < num_prover_contexts; ++i) {
+            prover_workers.emplace_back([this]() { prover_worker_loop(); });
+        }
+        if (auto_batch ||
+            pool_limits.tx_ttl != std::chrono::milliseconds::zero()) {
+            scheduler = std::thread([this]() { scheduler_loop(); });
+        }
+        for (size_t i = 0; i < num_verifier_threads; ++i) {
+            verifier_threads.emplace_back([this]() { verifier_loop(); });
+        }
+        if (!metrics_file.empty()) {
+            metrics_writer = std::thread([this]() { metrics_writer_loop(); });
+        }
+        warmup_thread =
+            std::thread([this, load_keypair]() { warmup(load_keypair); });
+    }
+
+    virtual ~aggregator_server()
+    {
+        stop_submissions();
+        warmup_thread.join();
+
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            stopping = true;
+        }
+        batch_job_queued.notify_all();
+        batch_finished.notify_all();
+        scheduler_wakeup.notify_all();
+        metrics_writer_wakeup.notify_all();
+        if (scheduler.joinable()) {
+            scheduler.join();
+        }
+        if (metrics_writer.joinable()) {
+            metrics_writer.join();
+        }
+        for (std::thread &worker : prover_workers) {
+            worker.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(verification_mutex);
+            verifiers_stopping = true;
+        }
+        verification_queued.notify_all();
+        for (std::thread &verifier : verifier_threads) {
+            verifier.join();
+        }
+    }
+
+    grpc::Status GetConfiguration(
+        grpc::ServerContext * /*context*/,
+        const proto::Empty * /*request*/,
+        zecale_proto::AggregatorConfiguration *response) override
+    {
+        log_record(log, log_level::info, "keys") << "Request for configuration";
+        libzecale::aggregator_configuration_to_proto<npp, wpp, nsnark, wsnark>(
+            batch_sizes, *response);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetReadiness(
+        grpc::ServerContext * /*context*/,
+        const proto::Empty * /*request*/,
+        zecale_proto::Readiness *response) override
+    {
+        std::lock_guard<std::mutex> lock(warmup_mutex);
+        response->set_ready(ready);
+        response->set_stage(warmup_stage);
+        response->set_stage_progress(warmup_stage_progress);
+        response->set_stage_total(warmup_stage_total);
+        response->set_num_keypairs_loaded((uint32_t)num_keypairs_loaded);
+        response->set_num_keypairs((uint32_t)batch_sizes.size());
+        response->set_error(warmup_error);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetVerificationKey(
+        grpc::ServerContext * /*context*/,
+        const proto::Empty * /*request*/,
+        zeth_proto::VerificationKey *response) override
+    {
+        log_record(log, log_level::info, "keys")
+            << "Received the request to get the verification key";
+        const grpc::Status ready_status = check_ready();
+        if (!ready_status.ok()) {
+            return ready_status;
+        }
+        log_record(log, log_level::debug, "keys")
+            << "Preparing verification key for response...";
+        try {
+            wapi_handler::verification_key_to_proto(
+                keypairs.at(batch_sizes[0]).vk, response);
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "keys") << e.what();
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+        } catch (...) {
+            log_record(log, log_level::error, "keys") << "In catch all";
+            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+        }
+
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetBatchVerificationKey(
+        grpc::ServerContext * /*context*/,
+        const zecale_proto::BatchVerificationKeyRequest *request,
+        zeth_proto::VerificationKey *response) override
+    {
+        log_record(log, log_level::info, "keys")
+            << "Received the request to get the verification key "
+            << "for batch size " << std::to_string(request->batch_size());
+        const grpc::Status ready_status = check_ready();
+        if (!ready_status.ok()) {
+            return ready_status;
+        }
+        const auto it = keypairs.find(request->batch_size());
+        if (it == keypairs.end()) {
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, "unsupported batch size");
+        }
+
+        try {
+            wapi_handler::verification_key_to_proto(it->second.vk, response);
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "keys") << e.what();
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+        } catch (...) {
+            log_record(log, log_level::error, "keys") << "In catch all";
+            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+        }
+
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetNestedVerificationKeyHash(
+        grpc::ServerContext * /*context*/,
+        const zeth_proto::VerificationKey *request,
+        zecale_proto::VerificationKeyHash *response) override
+    {
+        typename nsnark::verification_key vk =
+            napi_handler::verification_key_from_proto(*request);
+        const libff::Fr<wpp> vk_hash = vk_hash_cache.get_hash(vk);
+        const std::string vk_hash_str = libzeth::field_element_to_json(vk_hash);
+        response->set_hash(vk_hash_str);
+
+        log_record record(log, log_level::trace, "keys");
+        if (record.enabled()) {
+            record << "GetNestedVerificationKeyHash: vk:\n";
+            nsnark::verification_key_write_json(vk, record.stream());
+            record << "\n VK hash: " << vk_hash_str;
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status RegisterApplication(
+        grpc::ServerContext * /*context*/,
+        const zecale_proto::ApplicationDescription *registration,
+        zecale_proto::VerificationKeyHash *response) override
+    {
+        log_record(log, log_level::info, "registration")
+            << "Received 'register application' request";
+        log_record(log, log_level::debug, "registration")
+            << "Registering application...";
+
+        try {
+            // Add the application to the list of supported applications on the
+            // aggregator server, ensuring an app of the same name has not
+            // already been registered.
+            const std::string &name = registration->application_name();
+            const std::shared_ptr<application_pool> app_pool =
+                add_application(*registration, true);
+            if (!app_pool) {
+                return grpc::Status(
+                    grpc::StatusCode::INVALID_ARGUMENT,
+                    grpc::string("application already registered"));
+            }
+
+            const typename nsnark::verification_key &vk =
+                app_pool->verification_key();
+            const libff::Fr<wpp> vk_hash = vk_hash_cache.get_hash(vk);
+            const std::string vk_hash_str =
+                libzeth::field_element_to_json(vk_hash);
+            response->set_hash(vk_hash_str);
+
+            log_record(log, log_level::debug, "registration")
+                << "Registered application '" << name << "', VK hash: "
+                << vk_hash_str;
+            log_record record(log, log_level::trace, "registration");
+            if (record.enabled()) {
+                record << "Application '" << name << "' VK:\n";
+                nsnark::verification_key_write_json(vk, record.stream());
+            }
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "registration") << e.what();
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+        } catch (...) {
+            log_record(log, log_level::error, "registration") << "In catch all";
+            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+        }
+
+        return grpc::Status::OK;
+    }
+
+    grpc::Status SubmitNestedTransactions(
+        grpc::ServerContext * /*context*/,
+        grpc::ServerReader<zecale_proto::NestedTransaction> *reader,
+        zecale_proto::SubmissionSummary *response) override
+    {
+        log_record(log, log_level::info, "submission")
+            << "Received nested transaction stream";
+
+        // Each transaction is handed to a submission worker as it is read,
+        // so that decoding and checks for successive transactions overlap
+        // with each other and with reading the stream. Workers record the
+        // status for each transaction at its index.
+        std::mutex statuses_mutex;
+        std::condition_variable status_recorded;
+        std::deque<grpc::Status> statuses;
+        size_t num_in_flight = 0;
+        for (;;) {
+            std::shared_ptr<zecale_proto::NestedTransaction> transaction =
+                std::make_shared<zecale_proto::NestedTransaction>();
+            if (!reader->Read(transaction.get())) {
+                break;
+            }
+
+            size_t idx;
+            {
+                std::unique_lock<std::mutex> lock(statuses_mutex);
+                status_recorded.wait(lock, [&]() {
+                    return num_in_flight < max_stream_submissions_in_flight;
+                });
+                idx = statuses.size();
+                statuses.emplace_back();
+                ++num_in_flight;
+            }
+
+            submit_workers->post([&, transaction, idx]() {
+                const grpc::Status status =
+                    submit_nested_transaction(*transaction);
+                std::lock_guard<std::mutex> lock(statuses_mutex);
+                statuses[idx] = status;
+                --num_in_flight;
+                status_recorded.notify_all();
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(statuses_mutex);
+        status_recorded.wait(lock, [&]() { return num_in_flight == 0; });
+        for (const grpc::Status &status : statuses) {
+            submission_result_to_proto(status, *response->add_results());
+            if (status.ok()) {
+                response->set_num_accepted(response->num_accepted() + 1);
+            } else {
+                response->set_num_not_accepted(
+                    response->num_not_accepted() + 1);
+            }
+        }
+
+        return grpc::Status::OK;
+    }
+
+    /// Start serving asynchronous SubmitNestedTransaction calls on the given
+    /// completion queues (obtained from the ServerBuilder), each polled by
+    /// its own thread. Called once the server is started.
+    void serve_submissions(
+        std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> &&queues)
+    {
+        submit_queues = std::move(queues);
+        for (const std::unique_ptr<grpc::ServerCompletionQueue> &cq :
+             submit_queues) {
+            for (size_t i = 0; i < pending_submit_calls_per_queue; ++i) {
+                request_submit_call(*cq);
+            }
+            grpc::ServerCompletionQueue *cq_ptr = cq.get();
+            submit_queue_threads.emplace_back(
+                [this, cq_ptr]() { submit_queue_loop(*cq_ptr); });
+        }
+    }
+
+    /// Stop serving asynchronous calls. Must be called after the server has
+    /// been shut down (which waits for calls already received to be
+    /// answered). Safe to call more than once.
+    void stop_submissions()
+    {
+        {
+            std::lock_guard<std::mutex> lock(submit_queues_mutex);
+            if (submit_queues_stopping) {
+                return;
+            }
+            submit_queues_stopping = true;
+        }
+
+        submit_workers.reset();
+        for (const std::unique_ptr<grpc::ServerCompletionQueue> &cq :
+             submit_queues) {
+            cq->Shutdown();
+        }
+        for (std::thread &thread : submit_queue_threads) {
+            thread.join();
+        }
+    }
+
+    grpc::Status GenerateAggregatedTransaction(
+        grpc::ServerContext *context,
+        const zecale_proto::AggregatedTransactionRequest *request,
+        zecale_proto::AggregatedTransaction *response) override
+    {
+        try {
+            const std::string &app_name = request->application_name();
+            log_record(log, log_level::info, "batch")
+                << "Aggregation tx request, app name: " << app_name;
+            const grpc::Status ready_status = check_ready();
+            if (!ready_status.ok()) {
+                return ready_status;
+            }
+
+            // Queue the batch and wait for the worker to prove it.
+            const uint64_t batch_id = queue_batch(
+                app_name,
+                request->batch_size(),
+                request->allow_partial(),
+                request->proof_encoding());
+            zecale_proto::BatchStatus status;
+            const grpc::Status wait_status =
+                wait_batch(context, batch_id, status);
+            if (!wait_status.ok()) {
+                return wait_status;
+            }
+            if (status.state() != zecale_proto::BATCH_DONE) {
+                throw std::runtime_error(status.error());
+            }
+
+            response->Swap(status.mutable_aggregated_transaction());
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "batch") << e.what();
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+        } catch (...) {
+            log_record(log, log_level::error, "batch") << "In catch all";
+            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+        }
+
+        return grpc::Status::OK;
+    }
+
+    grpc::Status SubmitBatchRequest(
+        grpc::ServerContext * /*context*/,
+        const zecale_proto::AggregatedTransactionRequest *request,
+        zecale_proto::BatchId *response) override
+    {
+        try {
+            const std::string &app_name = request->application_name();
+            log_record(log, log_level::info, "batch")
+                << "Batch request, app name: " << app_name;
+            const grpc::Status ready_status = check_ready();
+            if (!ready_status.ok()) {
+                return ready_status;
+            }
+            response->set_batch_id(queue_batch(
+                app_name,
+                request->batch_size(),
+                request->allow_partial(),
+                request->proof_encoding()));
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "batch") << e.what();
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+        } catch (...) {
+            log_record(log, log_level::error, "batch") << "In catch all";
+            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+        }
+
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetBatch(
+        grpc::ServerContext * /*context*/,
+        const zecale_proto::BatchId *request,
+        zecale_proto::BatchStatus *response) override
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        const auto it = batch_results.find(request->batch_id());
+        if (it == batch_results.end()) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "unknown batch");
+        }
+
+        *response = it->second;
+        return grpc::Status::OK;
+    }
+
+    grpc::Status WaitBatch(
+        grpc::ServerContext *context,
+        const zecale_proto::BatchId *request,
+        zecale_proto::BatchStatus *response) override
+    {
+        return wait_batch(context, request->batch_id(), *response);
+    }
+
+    grpc::Status SubscribeBatches(
+        grpc::ServerContext *context,
+        const zecale_proto::BatchSubscription *request,
+        grpc::ServerWriter<zecale_proto::BatchStatus> *writer) override
+    {
+        const std::string &app_name = request->application_name();
+        log_record(log, log_level::info, "batch")
+            << "Batch subscription, app name: '" << app_name << "'";
+
+        // Index (in the sequence of all finished batches) of the next batch to
+        // be sent to this subscriber.
+        uint64_t next_finished_idx;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            next_finished_idx = num_finished_batches;
+        }
+
+        std::vector<zecale_proto::BatchStatus> statuses;
+        while (!context->IsCancelled()) {
+            statuses.clear();
+            {
+                std::unique_lock<std::mutex> lock(batch_mutex);
+                batch_finished.wait_for(
+                    lock, batch_wait_poll_interval, [&]() {
+                        return stopping ||
+                               num_finished_batches > next_finished_idx;
+                    });
+                if (stopping) {
+                    break;
+                }
+
+                // Skip any batches which have already been dropped from the
+                // store (if the subscriber has fallen behind).
+                const uint64_t first_finished_idx =
+                    num_finished_batches - finished_batches.size();
+                next_finished_idx =
+                    std::max(next_finished_idx, first_finished_idx);
+                for (; next_finished_idx < num_finished_batches;
+                     ++next_finished_idx) {
+                    const size_t idx = next_finished_idx - first_finished_idx;
+                    const uint64_t batch_id = finished_batches[idx];
+                    const zecale_proto::BatchStatus &status =
+                        batch_results.at(batch_id);
+                    if (app_name.empty() ||
+                        status.application_name() == app_name) {
+                        statuses.push_back(status);
+                    }
+                }
+            }
+
+            for (const zecale_proto::BatchStatus &status : statuses) {
+                if (!writer->Write(status)) {
+                    // Stream closed by the client.
+                    return grpc::Status::OK;
+                }
+            }
+        }
+
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetPoolStatus(
+        grpc::ServerContext * /*context*/,
+        const zecale_proto::PoolStatusRequest *request,
+        zecale_proto::PoolStatus *response) override
+    {
+        const std::shared_ptr<application_pool> app_pool =
+            application_pools.get(request->application_name());
+        if (!app_pool) {
+            return grpc::Status(
+                grpc::StatusCode::NOT_FOUND, "unknown application");
+        }
+
+        uint32_t min_fee_wei = 0;
+        const bool accepting = app_pool->min_accepted_fee(min_fee_wei);
+        response->set_application_name(app_pool->name());
+        response->set_num_transactions(app_pool->tx_pool_size());
+        response->set_num_bytes(app_pool->tx_pool_bytes());
+        response->set_max_transactions(pool_limits.max_transactions);
+        response->set_max_bytes(pool_limits.max_bytes);
+        response->set_total_num_transactions(
+            total_pool_capacity->num_transactions());
+        response->set_total_num_bytes(total_pool_capacity->num_bytes());
+        response->set_max_total_transactions(
+            total_pool_capacity->max_transactions());
+        response->set_max_total_bytes(total_pool_capacity->max_bytes());
+        response->set_accepting(accepting);
+        response->set_min_fee_wei(min_fee_wei);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetMetrics(
+        grpc::ServerContext * /*context*/,
+        const proto::Empty * /*request*/,
+        zecale_proto::Metrics *response) override
+    {
+        std::vector<libzecale::metrics_sample> samples;
+        collect_metrics(samples);
+        for (const libzecale::metrics_sample &sample : samples) {
+            zecale_proto::Metric *metric = response->add_metrics();
+            metric->set_name(sample.name);
+            metric->mutable_labels()->insert(
+                sample.labels.begin(), sample.labels.end());
+            switch (sample.type) {
+            case libzecale::metrics_sample::counter:
+                metric->set_counter(sample.counter_value);
+                break;
+            case libzecale::metrics_sample::gauge:
+                metric->set_gauge(sample.gauge_value);
+                break;
+            case libzecale::metrics_sample::histogram: {
+                const libzecale::metrics_histogram_snapshot &h =
+                    sample.histogram_value;
+                zecale_proto::HistogramSummary *summary =
+                    metric->mutable_histogram();
+                summary->set_count(h.count);
+                summary->set_sum(h.sum);
+                summary->set_max(h.max);
+                summary->set_p50(h.p50);
+                summary->set_p90(h.p90);
+                summary->set_p99(h.p99);
+                summary->set_p999(h.p999);
+                break;
+            }
+            }
+        }
+        return grpc::Status::OK;
+    }
+
+private:
+    /// Wait for an incoming SubmitNestedTransaction call on the given queue,
+    /// unless the queues are shutting down.
+    void request_submit_call(grpc::ServerCompletionQueue &cq)
+    {
+        std::lock_guard<std::mutex> lock(submit_queues_mutex);
+        if (!submit_queues_stopping) {
+            new submit_call(*this, cq);
+        }
+    }
+
+    /// Handle the events of a completion queue, until it is shut down.
+    void submit_queue_loop(grpc::ServerCompletionQueue &cq)
+    {
+        void *tag;
+        bool ok;
+        while (cq.Next(&tag, &ok)) {
+            static_cast<submit_call *>(tag)->proceed(ok);
+        }
+    }
+
+    /// Process a submitted transaction (see admit_nested_transaction),
+    /// recording its latency and outcome. Runs on a submission worker.
+    grpc::Status submit_nested_transaction(
+        const zecale_proto::NestedTransaction &transaction)
+    {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        const grpc::Status status = admit_nested_transaction(transaction);
+        submit_latency.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+
+        submission_counters[submission_outcome(status)]->increment();
+        return status;
+    }
+
+    /// Decode and check a submitted transaction, and add it to the pool for
+    /// its application. May block (while the proof is verified, or the
+    /// transaction is logged).
+    grpc::Status admit_nested_transaction(
+        const zecale_proto::NestedTransaction &transaction)
+    {
+        try {
+            // Get the application_pool if it exists (otherwise an exception is
+            // thrown, returning an error to the client).
+            const std::string &app_name = transaction.application_name();
+            log_record(log, log_level::info, "submission")
+                << "Received nested transaction, app name: " << app_name;
+            const std::shared_ptr<application_pool> app_pool =
+                application_pools.at(app_name);
+
+            // Decode the transaction (sharing the application name held by
+            // the pool) and sanity-check it (number of inputs, and that the
+            // proof elements are valid group elements). From here, the
+            // transaction is moved, rather than copied, into the pool.
+            libzecale::nested_transaction<npp, nsnark> tx =
+                libzecale::nested_transaction_from_proto<npp, napi_handler>(
+                    transaction, app_pool->interned_name());
+            if (tx.extended_proof().get_primary_inputs().size() !=
+                num_inputs_per_nested_proof) {
+                throw std::invalid_argument("invalid number of inputs");
+            }
+            if (!libzecale::nested_proof_verifier<npp, nsnark>::check_points(
+                    tx.extended_proof().get_proof())) {
+                throw std::invalid_argument("invalid proof elements");
+            }
+
+            // Reject transactions which the pool would not accept, before
+            // verifying them.
+            if (!pool_accepts(*app_pool, tx.fee_wei())) {
+                return pool_full_status(*app_pool);
+            }
+
+            // Reject duplicates. The transaction is held in the index from
+            // here, and removed if it is subsequently rejected.
+            const libzecale::transaction_hash tx_hash =
+                libzecale::nested_transaction_hash(tx);
+            if (!app_pool->dedup_index.add_pending(tx_hash)) {
+                log_record(log, log_level::info, "submission")
+                    << "duplicate transaction";
+                return grpc::Status(
+                    grpc::StatusCode::ALREADY_EXISTS,
+                    grpc::string("duplicate transaction"));
+            }
+
+            try {
+                // If enabled, verify the nested proof before accepting it.
+                if (!verifier_threads.empty() &&
+                    !verify_nested_proof(app_pool, tx.extended_proof())) {
+                    throw std::invalid_argument("invalid nested proof");
+                }
+
+                // If enabled, log the transaction (which becomes durable
+                // along with those of any concurrent submissions), so that
+                // it is restored to the pool after a restart.
+                if (tx_log) {
+                    tx.set_id(tx_log->add(
+                        log_nested_transaction,
+                        transaction.SerializeAsString()));
+                }
+            } catch (...) {
+                app_pool->dedup_index.remove(tx_hash);
+                throw;
+            }
+
+            {
+                log_record record(log, log_level::trace, "submission");
+                if (record.enabled()) {
+                    record << "Adding tx with ext proof:\n";
+                    tx.extended_proof().write_json(record.stream());
+                }
+            }
+
+            // Move the proof into the pool for the named application,
+            // evicting lower-fee transactions if the pool is full. (The pool
+            // may have filled since the check above.)
+            const uint64_t tx_id = tx.id();
+            std::vector<libzecale::nested_transaction<npp, nsnark>> evicted;
+            if (!app_pool->add_tx(std::move(tx), evicted)) {
+                app_pool->dedup_index.remove(tx_hash);
+                if (tx_log) {
+                    tx_log->remove({tx_id});
+                }
+                return pool_full_status(*app_pool);
+            }
+            if (!evicted.empty()) {
+                log_record(log, log_level::info, "submission")
+                    << "Evicted " << std::to_string(evicted.size())
+                    << " transaction(s) from the pool for app " << app_name;
+                release_transactions(*app_pool, evicted, false);
+            }
+            if (auto_batch) {
+                scheduler_wakeup.notify_one();
+            }
+
+            log_record(log, log_level::debug, "submission")
+                << std::to_string(app_pool->tx_pool_size()) << " txs in pool";
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "submission") << e.what();
+            return grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+        } catch (...) {
+            log_record(log, log_level::error, "submission") << "In catch all";
+            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+        }
+
+        return grpc::Status::OK;
+    }
+
+    /// Describe the outcome of a submission, given the status returned by
+    /// submit_nested_transaction.
+    static void submission_result_to_proto(
+        const grpc::Status &status, zecale_proto::SubmissionResult &result)
+    {
+        result.set_outcome(submission_outcome(status));
+        if (!status.ok()) {
+            result.set_reason(status.error_message());
+        }
+    }
+
+    /// The outcome of a submission, given the status returned by
+    /// admit_nested_transaction.
+    static zecale_proto::SubmissionOutcome submission_outcome(
+        const grpc::Status &status)
+    {
+        switch (status.error_code()) {
+        case grpc::StatusCode::OK:
+            return zecale_proto::SUBMISSION_ACCEPTED;
+        case grpc::StatusCode::ALREADY_EXISTS:
+            return zecale_proto::SUBMISSION_DUPLICATE;
+        case grpc::StatusCode::RESOURCE_EXHAUSTED:
+            return zecale_proto::SUBMISSION_POOL_FULL;
+        default:
+            return zecale_proto::SUBMISSION_REJECTED;
+        }
+    }
+
+    /// Create the counter for each submission outcome, indexed by outcome.
+    static std::vector<libzecale::metrics_counter *> create_submission_counters(
+        libzecale::metrics_registry &metrics)
+    {
+        std::vector<libzecale::metrics_counter *> counters(
+            zecale_proto::SubmissionOutcome_ARRAYSIZE, nullptr);
+        for (int outcome = 0; outcome < (int)counters.size(); ++outcome) {
+            if (!zecale_proto::SubmissionOutcome_IsValid(outcome)) {
+                continue;
+            }
+            counters[outcome] =
+                (outcome == zecale_proto::SUBMISSION_ACCEPTED)
+                    ? &metrics.counter("zecale_submissions_accepted_total")
+                    : &metrics.counter(
+                          "zecale_submissions_rejected_total",
+                          {{"reason",
+                            zecale_proto::SubmissionOutcome_Name(
+                                (zecale_proto::SubmissionOutcome)outcome)}});
+        }
+        return counters;
+    }
+
+    /// Create the proving time histogram for each supported batch size.
+    static std::map<size_t, libzecale::metrics_histogram *>
+    create_proving_time_histograms(
+        libzecale::metrics_registry &metrics,
+        const std::vector<size_t> &batch_sizes)
+    {
+        std::map<size_t, libzecale::metrics_histogram *> histograms;
+        for (const size_t batch_size : batch_sizes) {
+            histograms[batch_size] = &metrics.histogram(
+                "zecale_batch_proving_time_us",
+                {{"batch_size", std::to_string(batch_size)}});
+        }
+        return histograms;
+    }
+
+    /// Create the pool for an application and add it to the registry.
+    /// Returns null if an application of the same name is already registered.
+    /// If `log_registration` is set (and the log is enabled), the
+    /// registration is logged before the application is added, so that no
+    /// transactions for it are accepted unless the registration is durable.
+    std::shared_ptr<application_pool> add_application(
+        const zecale_proto::ApplicationDescription &registration,
+        const bool log_registration)
+    {
+        // Registrations are serialized, so that duplicates can be rejected
+        // before the witness is computed.
+        std::lock_guard<std::mutex> lock(registration_mutex);
+        if (application_pools.get(registration.application_name())) {
+            return nullptr;
+        }
+
+        const typename nsnark::verification_key vk =
+            libzecale::verification_key_from_proto<npp, napi_handler>(
+                registration);
+        const std::chrono::milliseconds max_batch_wait =
+            (registration.max_batch_wait_ms() != 0)
+                ? std::chrono::milliseconds(registration.max_batch_wait_ms())
+                : default_max_batch_wait;
+        const std::shared_ptr<application_pool> app_pool =
+            std::make_shared<application_pool>(
+                registration.application_name(),
+                vk,
+                max_batch_wait,
+                dedup_ttl,
+                pool_limits,
+                total_pool_capacity,
+                metrics.counter(
+                    "zecale_aggregated_transactions_total",
+                    {{"application", registration.application_name()}}));
+
+        // If the server is still warming up, the witness is computed once the
+        // keypairs are loaded (see warmup).
+        if (registration_context) {
+            app_pool->vk_witness =
+                registration_context->compute_nested_vk_witness(vk);
+        }
+        if (log_registration && tx_log) {
+            tx_log->add(
+                log_application_registration,
+                registration.SerializeAsString());
+        }
+        if (!application_pools.add(app_pool)) {
+            return nullptr;
+        }
+        return app_pool;
+    }
 
-    aggregator_circuit &aggregator;
+    /// Restore the registered applications and pooled transactions recorded
+    /// in the log. Transactions are decoded in parallel, and are not verified
+    /// again. The time each transaction has spent in the pool is preserved.
+    void restore_from_log()
+    {
+        const std::vector<libzecale::write_ahead_log::entry> entries =
+            tx_log->replay();
+
+        // Applications are registered first, so that the pools exist when
+        // the transactions are decoded.
+        std::vector<const libzecale::write_ahead_log::entry *> tx_entries;
+        size_t num_applications = 0;
+        for (const libzecale::write_ahead_log::entry &entry : entries) {
+            if (entry.type == log_application_registration) {
+                zecale_proto::ApplicationDescription registration;
+                if (!registration.ParseFromString(*entry.payload) ||
+                    !add_application(registration, false)) {
+                    throw std::runtime_error("invalid registration in log");
+                }
+                ++num_applications;
+            } else if (entry.type == log_nested_transaction) {
+                tx_entries.push_back(&entry);
+            }
+        }
+
+        const uint64_t now_us =
+            (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        std::vector<libzecale::nested_transaction<npp, nsnark>> txs(
+            tx_entries.size());
+        std::vector<libzecale::transaction_hash> hashes(tx_entries.size());
+        std::vector<std::shared_ptr<application_pool>> app_pools(
+            tx_entries.size());
+
+        // Reasons for which entries could not be decoded, and whether each
+        // such entry is kept in the log. Only the transactions of unknown
+        // applications (which can never be restored) are removed. Others
+        // (which may be decodable by a later build, or after a transient
+        // failure) are kept, and are not restored.
+        std::vector<std::string> errors(tx_entries.size());
+        std::vector<char> keep(tx_entries.size(), 0);
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+        for (size_t i = 0; i < tx_entries.size(); ++i) {
+            try {
+                zecale_proto::NestedTransaction transaction;
+                if (!transaction.ParseFromString(*tx_entries[i]->payload)) {
+                    errors[i] = "invalid log entry";
+                    keep[i] = 1;
+                    continue;
+                }
+                const std::shared_ptr<application_pool> app_pool =
+                    application_pools.get(transaction.application_name());
+                if (!app_pool) {
+                    errors[i] = "unknown application '" +
+                                transaction.application_name() + "'";
+                    continue;
+                }
+                keep[i] = 1;
+                txs[i] = libzecale::nested_transaction_from_proto<
+                    npp,
+                    napi_handler>(transaction, app_pool->interned_name());
+                const uint64_t age_us =
+                    now_us - std::min(now_us, tx_entries[i]->timestamp);
+                txs[i].set_arrival_time(
+                    now - std::chrono::microseconds(age_us));
+                txs[i].set_id(tx_entries[i]->id);
+                hashes[i] = libzecale::nested_transaction_hash(txs[i]);
+                app_pools[i] = app_pool;
+            } catch (const std::exception &e) {
+                errors[i] = e.what();
+            } catch (...) {
+                errors[i] = "unknown error";
+            }
+        }
+
+        // Duplicates are removed from the log, as are transactions which do
+        // not fit in the pools (if the limits have been reduced).
+        std::vector<uint64_t> invalid_ids;
+        size_t num_restored = 0;
+        size_t num_evicted = 0;
+        size_t num_kept = 0;
+        for (size_t i = 0; i < txs.size(); ++i) {
+            const std::shared_ptr<application_pool> &app_pool = app_pools[i];
+            if (!app_pool) {
+                log_record(log, log_level::error, "tx_log")
+                    << "Failed to restore transaction "
+                    << std::to_string(tx_entries[i]->id)
+                    << " from the log: " << errors[i]
+                    << (keep[i] ? " (kept in the log)" : " (removed)");
+                if (keep[i]) {
+                    ++num_kept;
+                } else {
+                    invalid_ids.push_back(tx_entries[i]->id);
+                }
+                continue;
+            }
+            if (!app_pool->dedup_index.add_pending(hashes[i])) {
+                log_record(log, log_level::info, "tx_log")
+                    << "Removing duplicate transaction "
+                    << std::to_string(tx_entries[i]->id) << " from the log";
+                invalid_ids.push_back(tx_entries[i]->id);
+                continue;
+            }
+
+            std::vector<libzecale::nested_transaction<npp, nsnark>> evicted;
+            if (app_pool->add_tx(std::move(txs[i]), evicted)) {
+                ++num_restored;
+            } else {
+                app_pool->dedup_index.remove(hashes[i]);
+                invalid_ids.push_back(tx_entries[i]->id);
+                ++num_evicted;
+            }
+            num_restored -= evicted.size();
+            num_evicted += evicted.size();
+            release_transactions(*app_pool, evicted, false);
+        }
+        tx_log->remove(invalid_ids);
+
+        log_record(log, log_level::info, "tx_log")
+            << "Restored " << std::to_string(num_applications)
+            << " application(s) and " << std::to_string(num_restored)
+            << " transaction(s) from the log (" << std::to_string(num_evicted)
+            << " evicted from full pools, " << std::to_string(num_kept)
+            << " not restored and kept in the log)";
+    }
+
+    /// Release transactions which have left the pool (as part of a finished
+    /// batch, or by eviction or expiry). If they were aggregated, they are
+    /// held in the deduplication index (so that resubmissions are rejected)
+    /// until the TTL expires. Otherwise they are removed, so that they may be
+    /// resubmitted. In both cases, they are removed from the log (if
+    /// enabled). For batches, this is called only once the batch is
+    /// finished, so that the transactions of a batch interrupted by a restart
+    /// are restored.
+    void release_transactions(
+        application_pool &app_pool,
+        const std::vector<libzecale::nested_transaction<npp, nsnark>> &txs,
+        const bool aggregated)
+    {
+        if (txs.empty()) {
+            return;
+        }
+        for (const libzecale::nested_transaction<npp, nsnark> &tx : txs) {
+            const libzecale::transaction_hash tx_hash =
+                libzecale::nested_transaction_hash(tx);
+            if (aggregated) {
+                app_pool.dedup_index.set_aggregated(tx_hash);
+            } else {
+                app_pool.dedup_index.remove(tx_hash);
+            }
+        }
 
-    // The keypair is the result of the setup for the aggregation circuit
-    const wsnark::keypair &keypair;
+        if (!tx_log) {
+            return;
+        }
+        std::vector<uint64_t> ids;
+        ids.reserve(txs.size());
+        for (const libzecale::nested_transaction<npp, nsnark> &tx : txs) {
+            if (tx.id() != 0) {
+                ids.push_back(tx.id());
+            }
+        }
+        try {
+            tx_log->remove(ids);
+        } catch (const std::exception &e) {
+            log_record(log, log_level::error, "tx_log")
+                << "Removing transactions from the log: " << e.what();
+        }
+    }
 
-    // The nested verification key is the vk used to verify the nested proofs
-    std::map<std::string, application_pool *> application_pools;
+    /// True if the pool would currently accept a transaction with the given
+    /// fee (see application_pool::min_accepted_fee).
+    static bool pool_accepts(
+        const application_pool &app_pool, const uint32_t fee_wei)
+    {
+        uint32_t min_fee_wei;
+        return app_pool.min_accepted_fee(min_fee_wei) &&
+               fee_wei >= min_fee_wei;
+    }
 
-public:
-    explicit aggregator_server(
-        aggregator_circuit &aggregator, const wsnark::keypair &keypair)
-        : aggregator(aggregator), keypair(keypair)
+    /// Status returned when a transaction is rejected because its pool is
+    /// full, including the minimum fee required (if any transaction can be
+    /// accepted).
+    grpc::Status pool_full_status(const application_pool &app_pool) const
     {
+        std::string message = "transaction pool full";
+        uint32_t min_fee_wei;
+        if (app_pool.min_accepted_fee(min_fee_wei)) {
+            message += " (minimum fee: " + std::to_string(min_fee_wei) + ")";
+        }
+        log_record(log, log_level::info, "submission") << message;
+        return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, message);
     }
 
-    virtual ~aggregator_server()
+    /// Return OK if the server is ready to aggregate batches. Otherwise,
+    /// return UNAVAILABLE, with a description of the warmup progress (or of
+    /// the failure).
+    grpc::Status check_ready() const
     {
-        // Release all application_pool objects.
-        for (const auto &entry : application_pools) {
-            delete entry.second;
+        std::lock_guard<std::mutex> lock(warmup_mutex);
+        if (ready) {
+            return grpc::Status::OK;
+        }
+        if (!warmup_error.empty()) {
+            return grpc::Status(
+                grpc::StatusCode::UNAVAILABLE,
+                "warmup failed: " + warmup_error);
+        }
+
+        std::string message = "warming up: " + warmup_stage;
+        if (warmup_stage_total != 0) {
+            message += " (" +
+                       std::to_string(
+                           warmup_stage_progress * 100 / warmup_stage_total) +
+                       "%)";
         }
-        application_pools.clear();
+        message += ", " + std::to_string(num_keypairs_loaded) + " of " +
+                   std::to_string(batch_sizes.size()) + " keypairs loaded";
+        return grpc::Status(grpc::StatusCode::UNAVAILABLE, message);
     }
 
-    grpc::Status GetConfiguration(
-        grpc::ServerContext * /*context*/,
-        const proto::Empty * /*request*/,
-        zecale_proto::AggregatorConfiguration *response) override
+    void set_warmup_stage(const std::string &stage)
     {
-        std::cout << "[INFO] Request for configuration\n";
-        libzecale::aggregator_configuration_to_proto<npp, wpp, nsnark, wsnark>(
-            *response);
-        return grpc::Status::OK;
+        log_record(log, log_level::info, "warmup") << "Warmup: " << stage;
+        std::lock_guard<std::mutex> lock(warmup_mutex);
+        warmup_stage = stage;
+        warmup_stage_progress = 0;
+        warmup_stage_total = 0;
     }
 
-    grpc::Status GetVerificationKey(
-        grpc::ServerContext * /*context*/,
-        const proto::Empty * /*request*/,
-        zeth_proto::VerificationKey *response) override
+    /// Load the keypair for each batch size, then create the registration
+    /// context and compute the nested verification key witness for any
+    /// applications registered in the meantime. Runs on the warmup thread.
+    void warmup(const keypair_loader &load_keypair)
     {
-        std::cout << "[ACK] Received the request to get the verification key"
-                  << std::endl;
-        std::cout << "[DEBUG] Preparing verification key for response..."
-                  << std::endl;
         try {
-            wapi_handler::verification_key_to_proto(keypair.vk, response);
+            for (const size_t batch_size : batch_sizes) {
+                set_warmup_stage(
+                    "loading keypair for batch size " +
+                    std::to_string(batch_size));
+                wsnark::keypair &keypair = keypairs[batch_size];
+                load_keypair(
+                    batch_size,
+                    keypair,
+                    [this](size_t num_computed, size_t num_total) {
+                        std::lock_guard<std::mutex> lock(warmup_mutex);
+                        warmup_stage_progress = num_computed;
+                        warmup_stage_total = num_total;
+                    });
+
+                // The constraint system is loaded with the keypair, so
+                // circuits are only constructed as witness generators
+                // (sharing the loaded constraint system, without generating
+                // constraints). Check the keypair matches the circuit
+                // (constructing a witness-only context checks the variable
+                // layout), and that the VK is for the correct number of
+                // inputs.
+                const std::unique_ptr<aggregator_circuit> aggregator =
+                    aggregator_family::create(
+                        batch_size,
+                        num_inputs_per_nested_proof,
+                        &keypair.pk.constraint_system);
+                if (keypair.vk.ABC_g1.size() !=
+                    aggregator->num_primary_inputs()) {
+                    throw std::invalid_argument("invalid VK");
+                }
+
+                std::lock_guard<std::mutex> lock(warmup_mutex);
+                ++num_keypairs_loaded;
+            }
+
+            set_warmup_stage("computing nested verification key witnesses");
+            std::unique_ptr<aggregator_circuit> context =
+                aggregator_family::create(
+                    min_batch_size,
+                    num_inputs_per_nested_proof,
+                    &keypairs.at(min_batch_size).pk.constraint_system);
+            {
+                std::lock_guard<std::mutex> lock(registration_mutex);
+                for (const std::shared_ptr<application_pool> &app_pool :
+                     application_pools.get_all()) {
+                    app_pool->vk_witness = context->compute_nested_vk_witness(
+                        app_pool->verification_key());
+                }
+                registration_context = std::move(context);
+            }
         } catch (const std::exception &e) {
-            std::cout << "[ERROR] " << e.what() << std::endl;
-            return grpc::Status(
-                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
-        } catch (...) {
-            std::cout << "[ERROR] In catch all" << std::endl;
-            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+            log_record(log, log_level::error, "warmup")
+                << "Warmup failed: " << e.what();
+            std::lock_guard<std::mutex> lock(warmup_mutex);
+            warmup_error = e.what();
+            return;
         }
 
-        return grpc::Status::OK;
+        {
+            std::lock_guard<std::mutex> lock(warmup_mutex);
+            ready = true;
+            warmup_stage = "ready";
+            warmup_stage_progress = 0;
+            warmup_stage_total = 0;
+        }
+        log_record(log, log_level::info, "warmup")
+            << "Warmup complete, ready to aggregate batches";
+        scheduler_wakeup.notify_one();
     }
 
-    grpc::Status GetNestedVerificationKeyHash(
-        grpc::ServerContext * /*context*/,
-        const zeth_proto::VerificationKey *request,
-        zecale_proto::VerificationKeyHash *response) override
+    /// Queue a job to aggregate a batch of the given size (or the largest
+    /// size that can be filled, if batch_size is 0) for the named
+    /// application, returning the batch id. Throws if the application is
+    /// unknown, if the batch size is not supported or if there are
+    /// insufficient transactions in the pool to fill a batch (or if the pool
+    /// is empty, when partial batches are allowed).
+    uint64_t queue_batch(
+        const std::string &app_name,
+        const size_t batch_size,
+        const bool allow_partial,
+        const zecale_proto::ProofEncoding proof_encoding)
     {
-        typename nsnark::verification_key vk =
-            napi_handler::verification_key_from_proto(*request);
-        const libff::Fr<wpp> vk_hash =
-            libzecale::verification_key_hash_gadget<wpp, nverifier>::
-                compute_hash(vk, num_inputs_per_nested_proof);
-        const std::string vk_hash_str = libzeth::field_element_to_json(vk_hash);
-        response->set_hash(vk_hash_str);
+        if (batch_size != 0 && keypairs.count(batch_size) == 0) {
+            throw std::invalid_argument("unsupported batch size");
+        }
 
-        std::cout << "[DEBUG] GetNestedVerificationKeyHash: "
-                  << "vk:\n";
-        nsnark::verification_key_write_json(vk, std::cout);
-        std::cout << "\n VK hash: " << vk_hash_str << "\n";
-        return grpc::Status::OK;
+        // Get the application_pool if it exists (otherwise an exception is
+        // thrown, returning an error to the client).
+        const std::shared_ptr<application_pool> app_pool =
+            application_pools.at(app_name);
+        const size_t required_entries =
+            allow_partial ? 1 : (batch_size == 0) ? min_batch_size : batch_size;
+        if (app_pool->tx_pool_size() < required_entries) {
+            throw std::runtime_error("insufficient entries in pool");
+        }
+
+        uint64_t batch_id;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            batch_id = next_batch_id++;
+            zecale_proto::BatchStatus &status = batch_results[batch_id];
+            status.set_batch_id(batch_id);
+            status.set_application_name(app_name);
+            status.set_state(zecale_proto::BATCH_QUEUED);
+            batch_jobs.push_back(
+                {batch_id,
+                 app_pool,
+                 batch_size,
+                 allow_partial,
+                 proof_encoding});
+            ++queued_jobs_per_app[app_name];
+        }
+        batch_job_queued.notify_one();
+
+        log_record(log, log_level::debug, "batch")
+            << "Queued batch " << std::to_string(batch_id) << " for app "
+            << app_name;
+        return batch_id;
     }
 
-    grpc::Status RegisterApplication(
-        grpc::ServerContext * /*context*/,
-        const zecale_proto::ApplicationDescription *registration,
-        zecale_proto::VerificationKeyHash *response) override
+    /// Block until the given batch has either been proven or has failed, and
+    /// copy its final status. Returns NOT_FOUND if the batch is unknown (or
+    /// its result has been discarded), and CANCELLED if the call was
+    /// cancelled or the server is stopping.
+    grpc::Status wait_batch(
+        grpc::ServerContext *context,
+        const uint64_t batch_id,
+        zecale_proto::BatchStatus &status)
     {
-        std::cout << "[ACK] Received 'register application' request"
-                  << std::endl;
-        std::cout << "[DEBUG] Registering application..." << std::endl;
-
-        try {
-            // Ensure an app of the same name has not already been registered.
-            const std::string &name = registration->application_name();
-            if (application_pools.count(name)) {
+        std::unique_lock<std::mutex> lock(batch_mutex);
+        for (;;) {
+            const auto it = batch_results.find(batch_id);
+            if (it == batch_results.end()) {
                 return grpc::Status(
-                    grpc::StatusCode::INVALID_ARGUMENT,
-                    grpc::string("application already registered"));
+                    grpc::StatusCode::NOT_FOUND, "unknown batch id");
+            }
+            const zecale_proto::BatchStatus &current = it->second;
+            if (current.state() == zecale_proto::BATCH_DONE ||
+                current.state() == zecale_proto::BATCH_FAILED) {
+                status = current;
+                return grpc::Status::OK;
+            }
+            if (stopping || context->IsCancelled()) {
+                return grpc::Status(
+                    grpc::StatusCode::CANCELLED, "wait interrupted");
+            }
+            batch_finished.wait_for(lock, batch_wait_poll_interval);
+        }
+    }
+
+    void prover_worker_loop()
+    {
+        // The prover contexts of this worker, for each batch size. Created on
+        // first use, as witness-only circuits sharing the constraint system of
+        // the corresponding proving key.
+        std::map<size_t, std::unique_ptr<aggregator_circuit>> contexts;
+
+#ifdef MULTICORE
+        // The number of OpenMP threads is a per-thread setting, applying to
+        // parallel regions started by this worker (i.e. by the prover).
+        omp_set_num_threads((int)threads_per_context);
+#endif
+
+        for (;;) {
+            batch_job job;
+            {
+                std::unique_lock<std::mutex> lock(batch_mutex);
+                batch_job_queued.wait(
+                    lock, [this]() { return stopping || !batch_jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = batch_jobs.front();
+                batch_jobs.pop_front();
+                const std::string &app_name = job.app_pool->name();
+                if (--queued_jobs_per_app[app_name] == 0) {
+                    queued_jobs_per_app.erase(app_name);
+                }
+                ++num_busy_workers;
+                batch_results[job.batch_id].set_state(
+                    zecale_proto::BATCH_PROVING);
             }
 
-            // Add the application to the list of supported applications on the
-            // aggregator server.
-            const zeth_proto::VerificationKey &vk_proto = registration->vk();
-            typename nsnark::verification_key vk =
-                napi_handler::verification_key_from_proto(vk_proto);
-            application_pools[name] = new application_pool(name, vk);
-            const libff::Fr<wpp> vk_hash =
-                libzecale::verification_key_hash_gadget<wpp, nverifier>::
-                    compute_hash(vk, num_inputs_per_nested_proof);
-            const std::string vk_hash_str =
-                libzeth::field_element_to_json(vk_hash);
-            response->set_hash(vk_hash_str);
+            zecale_proto::AggregatedTransaction aggregated_tx;
+            bool success = false;
+            std::string error;
+            try {
+                prove_batch(contexts, job, aggregated_tx);
+                success = true;
+            } catch (const std::exception &e) {
+                log_record(log, log_level::error, "batch")
+                    << "batch " << std::to_string(job.batch_id) << ": "
+                    << e.what();
+                error = e.what();
+            } catch (...) {
+                log_record(log, log_level::error, "batch")
+                    << "batch " << std::to_string(job.batch_id)
+                    << ": In catch all";
+                error = "unknown error";
+            }
 
-            std::cout << "[DEBUG] Registered application '" << name
-                      << " with VK:\n";
-            nsnark::verification_key_write_json(vk, std::cout);
-            std::cout << "\n VK hash: " << vk_hash_str << "\n";
-        } catch (const std::exception &e) {
-            std::cout << "[ERROR] " << e.what() << std::endl;
-            return grpc::Status(
-                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
-        } catch (...) {
-            std::cout << "[ERROR] In catch all" << std::endl;
-            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+            finish_batch(job.batch_id, success, error, aggregated_tx);
         }
+    }
 
-        return grpc::Status::OK;
+    /// Record the final status of a batch and notify waiting threads.
+    void finish_batch(
+        const uint64_t batch_id,
+        const bool success,
+        const std::string &error,
+        zecale_proto::AggregatedTransaction &aggregated_tx)
+    {
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            zecale_proto::BatchStatus &status = batch_results[batch_id];
+            if (success) {
+                status.set_state(zecale_proto::BATCH_DONE);
+                status.mutable_aggregated_transaction()->Swap(&aggregated_tx);
+            } else {
+                status.set_state(zecale_proto::BATCH_FAILED);
+                status.set_error(error);
+            }
+
+            (success ? num_done_batches : num_failed_batches).increment();
+
+            --num_busy_workers;
+            finished_batches.push_back(batch_id);
+            ++num_finished_batches;
+            while (finished_batches.size() > max_finished_batches) {
+                batch_results.erase(finished_batches.front());
+                finished_batches.pop_front();
+            }
+        }
+        batch_finished.notify_all();
+        scheduler_wakeup.notify_one();
     }
 
-    grpc::Status SubmitNestedTransaction(
-        grpc::ServerContext * /*context*/,
-        const zecale_proto::NestedTransaction *transaction,
-        proto::Empty * /*response*/) override
+    /// Queue a nested proof for verification, and wait for the result. Runs
+    /// on the handler thread.
+    bool verify_nested_proof(
+        const std::shared_ptr<application_pool> &app_pool,
+        const libzeth::extended_proof<npp, nsnark> &proof)
     {
-        try {
-            // Get the application_pool if it exists (otherwise an exception is
-            // thrown, returning an error to the client).
-            const std::string &app_name = transaction->application_name();
-            std::cout << "[ACK] Received nested transaction, app name: "
-                      << app_name << std::endl;
-            application_pool *const app_pool = application_pools.at(app_name);
+        std::future<bool> result;
+        {
+            std::lock_guard<std::mutex> lock(verification_mutex);
+            pending_verifications.emplace_back();
+            pending_verification &pending = pending_verifications.back();
+            pending.app_pool = app_pool;
+            pending.proof = &proof;
+            result = pending.result.get_future();
+        }
+        verification_queued.notify_one();
+        return result.get();
+    }
 
-            // Sanity-check the transaction (number of inputs).
-            const libzecale::nested_transaction<npp, nsnark> tx =
-                libzecale::nested_transaction_from_proto<npp, napi_handler>(
-                    *transaction);
-            if (tx.extended_proof().get_primary_inputs().size() !=
-                num_inputs_per_nested_proof) {
-                throw std::invalid_argument("invalid number of inputs");
+    /// Take the oldest pending proof, along with any others pending for the
+    /// same application, verify them together and pass the results back to
+    /// the waiting handler threads. Runs on a verifier thread.
+    void verifier_loop()
+    {
+        for (;;) {
+            std::vector<pending_verification> batch;
+            {
+                std::unique_lock<std::mutex> lock(verification_mutex);
+                verification_queued.wait(lock, [this]() {
+                    return verifiers_stopping || !pending_verifications.empty();
+                });
+                if (verifiers_stopping) {
+                    return;
+                }
+
+                const application_pool *app_pool =
+                    pending_verifications.front().app_pool.get();
+                auto it = pending_verifications.begin();
+                while (it != pending_verifications.end() &&
+                       batch.size() < max_verification_batch) {
+                    if (it->app_pool.get() == app_pool) {
+                        batch.push_back(std::move(*it));
+                        it = pending_verifications.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
             }
 
-            // Add the proof to the pool for the named application.
-            app_pool->add_tx(tx);
+            std::vector<const libzeth::extended_proof<npp, nsnark> *> proofs;
+            proofs.reserve(batch.size());
+            for (const pending_verification &pending : batch) {
+                proofs.push_back(pending.proof);
+            }
 
-            std::cout << "[DEBUG] Registered tx with ext proof:\n";
-            tx.extended_proof().write_json(std::cout) << "\n";
+            std::vector<bool> results;
+            try {
+                // Proof elements were checked as the transactions were
+                // decoded (see submit_nested_transaction).
+                results =
+                    batch[0].app_pool->proof_verifier.verify(proofs, true);
+            } catch (...) {
+                for (pending_verification &pending : batch) {
+                    pending.result.set_exception(std::current_exception());
+                }
+                continue;
+            }
 
-            std::cout << "[DEBUG] " << std::to_string(app_pool->tx_pool_size())
-                      << " txs in pool\n";
-        } catch (const std::exception &e) {
-            std::cout << "[ERROR] " << e.what() << std::endl;
-            return grpc::Status(
-                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
-        } catch (...) {
-            std::cout << "[ERROR] In catch all" << std::endl;
-            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+            log_record(log, log_level::debug, "submission")
+                << "Verified " << std::to_string(batch.size())
+                << " nested proof(s) for app " << batch[0].app_pool->name();
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i].result.set_value(results[i]);
+            }
         }
+    }
 
-        return grpc::Status::OK;
+    /// Snapshot the registered metrics, and add gauges for the occupancy of
+    /// each pool and of the batch queue.
+    void collect_metrics(std::vector<libzecale::metrics_sample> &samples)
+    {
+        metrics.snapshot(samples);
+
+        // Samples of the same metric are grouped together (as required by
+        // the text format), so each is added for all applications in turn.
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        const std::vector<std::shared_ptr<application_pool>> app_pools =
+            application_pools.get_all();
+        for (const std::shared_ptr<application_pool> &app_pool : app_pools) {
+            add_gauge(
+                samples,
+                "zecale_pool_transactions",
+                {{"application", app_pool->name()}},
+                (double)app_pool->tx_pool_size());
+        }
+        for (const std::shared_ptr<application_pool> &app_pool : app_pools) {
+            add_gauge(
+                samples,
+                "zecale_pool_bytes",
+                {{"application", app_pool->name()}},
+                (double)app_pool->tx_pool_bytes());
+        }
+        for (const std::shared_ptr<application_pool> &app_pool : app_pools) {
+            std::chrono::steady_clock::time_point oldest;
+            const double age =
+                app_pool->oldest_arrival_time(oldest)
+                    ? std::chrono::duration<double>(now - oldest).count()
+                    : 0.0;
+            add_gauge(
+                samples,
+                "zecale_pool_oldest_age_seconds",
+                {{"application", app_pool->name()}},
+                age);
+        }
+
+        size_t num_queued_batches;
+        size_t num_proving_batches;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            num_queued_batches = batch_jobs.size();
+            num_proving_batches = num_busy_workers;
+        }
+        add_gauge(
+            samples, "zecale_batches_queued", {}, (double)num_queued_batches);
+        add_gauge(
+            samples, "zecale_batches_proving", {}, (double)num_proving_batches);
+        add_gauge(
+            samples,
+            "zecale_log_messages_dropped",
+            {},
+            (double)log.num_dropped());
+        if (tx_log) {
+            add_gauge(
+                samples,
+                "zecale_tx_log_failed_snapshots",
+                {},
+                (double)tx_log->num_failed_snapshots());
+        }
     }
 
-    grpc::Status GenerateAggregatedTransaction(
-        grpc::ServerContext * /*context*/,
-        const zecale_proto::AggregatedTransactionRequest *request,
-        zecale_proto::AggregatedTransaction *response) override
+    static void add_gauge(
+        std::vector<libzecale::metrics_sample> &samples,
+        const std::string &name,
+        const libzecale::metrics_labels &labels,
+        const double value)
     {
-        try {
-            // Get the application_pool if it exists (otherwise an exception is
-            // thrown, returning an error to the client).
-            const std::string &app_name = request->application_name();
-            std::cout << "[ACK] Aggregation tx request, app name: " << app_name
-                      << std::endl;
-            application_pool *const app_pool = application_pools.at(app_name);
+        libzecale::metrics_sample sample;
+        sample.name = name;
+        sample.labels = labels;
+        sample.type = libzecale::metrics_sample::gauge;
+        sample.gauge_value = value;
+        samples.push_back(std::move(sample));
+    }
+
+    /// Periodically write the metrics to the metrics file. The file is
+    /// replaced atomically, so that readers never see a partial write.
+    void metrics_writer_loop()
+    {
+        const std::string tmp_file = metrics_file + ".tmp";
+        std::unique_lock<std::mutex> lock(batch_mutex);
+        while (!stopping) {
+            lock.unlock();
+            try {
+                std::vector<libzecale::metrics_sample> samples;
+                collect_metrics(samples);
+                {
+                    std::ofstream out_s(tmp_file);
+                    out_s.exceptions(
+                        std::ios_base::badbit | std::ios_base::failbit);
+                    libzecale::metrics_write_text(samples, out_s);
+                }
+                if (std::rename(tmp_file.c_str(), metrics_file.c_str()) != 0) {
+                    throw std::runtime_error("failed to rename " + tmp_file);
+                }
+            } catch (const std::exception &e) {
+                log_record(log, log_level::error, "metrics")
+                    << "Writing metrics: " << e.what();
+            }
+            lock.lock();
+            if (!stopping) {
+                metrics_writer_wakeup.wait_for(lock, metrics_interval);
+            }
+        }
+    }
+
+    /// Check the application pools periodically, and whenever transactions
+    /// are submitted or a batch finishes, removing expired transactions and
+    /// (if automatic batching is enabled) queuing batches as required (see
+    /// schedule_batches).
+    void scheduler_loop()
+    {
+        std::unique_lock<std::mutex> lock(batch_mutex);
+        while (!stopping) {
+            lock.unlock();
+            remove_expired_transactions();
+            if (auto_batch) {
+                schedule_batches();
+            }
+            lock.lock();
+            if (!stopping) {
+                scheduler_wakeup.wait_for(lock, scheduler_poll_interval);
+            }
+        }
+    }
 
-            // Retrieve a batch from the pool.
-            std::array<libzecale::nested_transaction<npp, nsnark>, batch_size>
-                batch;
-            const size_t num_entries = app_pool->get_next_batch(batch);
-            std::cout << "[DEBUG] Got batch of size "
-                      << std::to_string(num_entries) << " from the pool\n";
-            if (num_entries == 0) {
-                throw std::runtime_error("insufficient entries in pool");
+    /// Remove the transactions which have been in the pools for longer than
+    /// the TTL (if set).
+    void remove_expired_transactions()
+    {
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        for (const std::shared_ptr<application_pool> &app_pool :
+             application_pools.get_all()) {
+            std::vector<libzecale::nested_transaction<npp, nsnark>> expired;
+            if (app_pool->remove_expired(now, expired) != 0) {
+                log_record(log, log_level::info, "pool")
+                    << "Expired " << std::to_string(expired.size())
+                    << " transaction(s) from the pool for app "
+                    << app_pool->name();
+                release_transactions(*app_pool, expired, false);
             }
+        }
+    }
 
-            // Extract the nested proofs
-            std::array<const libzeth::extended_proof<npp, nsnark> *, batch_size>
-                nested_proofs;
-            for (size_t i = 0; i < batch_size; ++i) {
-                nested_proofs[i] = &batch[i].extended_proof();
+    /// Queue a batch (of the largest size that can be filled) for each
+    /// application whose pool:
+    ///   - can fill the largest supported batch, or
+    ///   - holds a transaction which has waited for longer than the
+    ///     application's maximum wait (in which case a partial batch may be
+    ///     created), or
+    ///   - can fill a batch of any supported size, while a prover worker is
+    ///     idle (speculatively starting on a smaller batch, rather than
+    ///     waiting for more transactions).
+    /// Applications which already have a queued job are skipped.
+    void schedule_batches()
+    {
+        if (!check_ready().ok()) {
+            return;
+        }
 
-                std::cout << "[DEBUG] got tx " << std::to_string(i)
-                          << " with ext proof:\n";
-                nested_proofs[i]->write_json(std::cout);
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        for (const std::shared_ptr<application_pool> &app_pool :
+             application_pools.get_all()) {
+            const std::string &app_name = app_pool->name();
+            const size_t pool_size = app_pool->tx_pool_size();
+            if (pool_size == 0) {
+                continue;
             }
 
-            // Retrieve the nested verification key for this application.
-            const nsnark::verification_key &nested_vk =
-                app_pool->verification_key();
+            bool prover_idle;
+            {
+                std::lock_guard<std::mutex> lock(batch_mutex);
+                if (queued_jobs_per_app.count(app_name) != 0) {
+                    continue;
+                }
+                prover_idle = batch_jobs.empty() &&
+                              num_busy_workers < prover_workers.size();
+            }
 
-            std::cout << "[DEBUG] Generating the batched proof...\n";
-            libzeth::extended_proof<wpp, wsnark> wrapping_proof =
-                aggregator.prove(nested_vk, nested_proofs, keypair.pk);
-
-            std::cout << "[DEBUG] Generated extended proof:\n";
-            wrapping_proof.write_json(std::cout);
-
-            // Populate the response with name, extended_proof and
-            // nested_parameters.
-            response->set_application_name(app_name);
-            zeth_proto::ExtendedProof *wrapping_proof_proto =
-                new zeth_proto::ExtendedProof();
-            wapi_handler::extended_proof_to_proto(
-                wrapping_proof, wrapping_proof_proto);
-            response->set_allocated_extended_proof(wrapping_proof_proto);
-            for (size_t i = 0; i < batch_size; ++i) {
-                const std::vector<uint8_t> &parameters = batch[i].parameters();
-                response->add_nested_parameters(
-                    (const char *)parameters.data(), parameters.size());
-            }
-            std::cout << "[DEBUG] Written to response" << std::endl;
-        } catch (const std::exception &e) {
-            std::cout << "[ERROR] " << e.what() << std::endl;
-            return grpc::Status(
-                grpc::StatusCode::INVALID_ARGUMENT, grpc::string(e.what()));
+            const std::chrono::milliseconds max_wait =
+                app_pool->max_batch_wait();
+            std::chrono::steady_clock::time_point oldest;
+            const char *reason;
+            bool allow_partial = false;
+            if (pool_size >= max_batch_size) {
+                reason = "full";
+            } else if (
+                max_wait != std::chrono::milliseconds::zero() &&
+                app_pool->oldest_arrival_time(oldest) &&
+                now - oldest >= max_wait) {
+                reason = "deadline";
+                allow_partial = true;
+            } else if (prover_idle && pool_size >= min_batch_size) {
+                reason = "idle";
+            } else {
+                continue;
+            }
+
+            try {
+                const uint64_t batch_id = queue_batch(
+                    app_name,
+                    0,
+                    allow_partial,
+                    zecale_proto::PROOF_ENCODING_PROTO);
+                log_record(log, log_level::info, "batch")
+                    << "Scheduled batch " << std::to_string(batch_id)
+                    << " for app " << app_name << " (" << reason << ")";
+            } catch (const std::exception &e) {
+                log_record(log, log_level::error, "batch")
+                    << "Scheduling batch for app " << app_name << ": "
+                    << e.what();
+            }
+        }
+    }
+
+    /// Take a batch from the pool and generate the aggregated transaction,
+    /// using (and if necessary creating) the worker's prover context for the
+    /// batch size. Runs on a prover worker thread.
+    void prove_batch(
+        std::map<size_t, std::unique_ptr<aggregator_circuit>> &contexts,
+        const batch_job &job,
+        zecale_proto::AggregatedTransaction &aggregated_tx)
+    {
+        application_pool &app_pool = *job.app_pool;
+
+        // Retrieve a batch from the pool, either of the requested size or
+        // the largest supported size which the pool can fill. If partial
+        // batches are allowed and no batch can be filled, take the remaining
+        // transactions for a batch of the requested (or smallest) size.
+        std::vector<libzecale::nested_transaction<npp, nsnark>> batch;
+        size_t batch_size = job.batch_size;
+        if (batch_size != 0) {
+            app_pool.get_next_batch(batch_size, batch, job.allow_partial);
+        } else {
+            for (auto it = keypairs.rbegin();
+                 it != keypairs.rend() && batch.empty();
+                 ++it) {
+                batch_size = it->first;
+                app_pool.get_next_batch(batch_size, batch);
+            }
+            if (batch.empty() && job.allow_partial) {
+                batch_size = min_batch_size;
+                app_pool.get_next_batch(batch_size, batch, true);
+            }
+        }
+        const size_t num_entries = batch.size();
+        log_record(log, log_level::debug, "batch")
+            << "Got " << std::to_string(num_entries)
+            << " entries for batch of size " << std::to_string(batch_size)
+            << " from the pool";
+        if (num_entries == 0) {
+            throw std::runtime_error("insufficient entries in pool");
+        }
+
+        try {
+            aggregate_batch(
+                contexts,
+                app_pool,
+                batch_size,
+                batch,
+                job.proof_encoding,
+                aggregated_tx);
         } catch (...) {
-            std::cout << "[ERROR] In catch all" << std::endl;
-            return grpc::Status(grpc::StatusCode::UNKNOWN, "");
+            release_transactions(app_pool, batch, false);
+            throw;
         }
+        release_transactions(app_pool, batch, true);
+    }
 
-        return grpc::Status::OK;
+    /// Generate the aggregated transaction for a batch taken from the pool.
+    void aggregate_batch(
+        std::map<size_t, std::unique_ptr<aggregator_circuit>> &contexts,
+        const application_pool &app_pool,
+        const size_t batch_size,
+        const std::vector<libzecale::nested_transaction<npp, nsnark>> &batch,
+        const zecale_proto::ProofEncoding proof_encoding,
+        zecale_proto::AggregatedTransaction &aggregated_tx)
+    {
+        const size_t num_entries = batch.size();
+        const wsnark::keypair &keypair = keypairs.at(batch_size);
+        std::unique_ptr<aggregator_circuit> &aggregator = contexts[batch_size];
+        if (!aggregator) {
+            log_record(log, log_level::debug, "batch")
+                << "Creating prover context for batch size "
+                << std::to_string(batch_size);
+            aggregator = aggregator_family::create(
+                batch_size,
+                num_inputs_per_nested_proof,
+                &keypair.pk.constraint_system);
+        }
+
+        // Extract the nested proofs (any free slots are filled with padding
+        // proofs by the aggregator circuit).
+        std::vector<const libzeth::extended_proof<npp, nsnark> *> nested_proofs(
+            num_entries);
+        for (size_t i = 0; i < num_entries; ++i) {
+            nested_proofs[i] = &batch[i].extended_proof();
+
+            log_record record(log, log_level::trace, "batch");
+            if (record.enabled()) {
+                record << "got tx " << std::to_string(i);
+                record << " with ext proof:\n";
+                nested_proofs[i]->write_json(record.stream());
+            }
+        }
+
+        // The witness for the application's nested verification key was
+        // computed at registration.
+        log_record(log, log_level::debug, "batch")
+            << "Generating the batched proof...";
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        libzeth::extended_proof<wpp, wsnark> wrapping_proof =
+            aggregator->prove(app_pool.vk_witness, nested_proofs, keypair.pk);
+        proving_time.at(batch_size)
+            ->record(std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+        app_pool.num_aggregated_transactions.increment(num_entries);
+
+        log_record record(log, log_level::trace, "batch");
+        if (record.enabled()) {
+            record << "Generated extended proof:\n";
+            wrapping_proof.write_json(record.stream());
+        }
+
+        // Populate the aggregated transaction with name, extended_proof (in
+        // the requested encoding) and nested_parameters (empty for padding
+        // slots, so that there is an entry for every slot of the batch).
+        aggregated_tx.set_application_name(app_pool.name());
+        libzecale::aggregated_transaction_set_proof<wpp, wapi_handler>(
+            wrapping_proof, proof_encoding, aggregated_tx);
+        aggregated_tx.set_batch_size((uint32_t)batch_size);
+        aggregated_tx.set_num_nested_transactions((uint32_t)num_entries);
+        for (size_t i = 0; i < num_entries; ++i) {
+            const std::vector<uint8_t> &parameters = batch[i].parameters();
+            aggregated_tx.add_nested_parameters(
+                (const char *)parameters.data(), parameters.size());
+        }
+        for (size_t i = num_entries; i < batch_size; ++i) {
+            aggregated_tx.add_nested_parameters(std::string());
+        }
+        log_record(log, log_level::debug, "batch")
+            << "Written aggregated transaction";
     }
 };
 
@@ -388,13 +2357,50 @@ void display_server_start_message()
 }
 
 static void RunServer(
-    aggregator_circuit &aggregator, const typename wsnark::keypair &keypair)
+    libzecale::logger &log,
+    const std::vector<size_t> &batch_sizes,
+    const keypair_loader &load_keypair,
+    const size_t num_prover_contexts,
+    const size_t threads_per_context,
+    const bool auto_batch,
+    const std::chrono::milliseconds default_max_batch_wait,
+    const size_t num_verifier_threads,
+    const std::string &log_dir,
+    const size_t log_snapshot_interval,
+    const std::chrono::milliseconds dedup_ttl,
+    const libzecale::application_pool_limits &pool_limits,
+    const size_t max_total_pool_transactions,
+    const size_t max_total_pool_bytes,
+    const size_t num_submit_threads,
+    const size_t num_completion_queues,
+    const size_t max_sync_threads,
+    const size_t max_concurrent_streams,
+    const size_t max_message_size,
+    const std::string &metrics_file,
+    const std::chrono::milliseconds metrics_interval)
 {
     // Listen for incoming connections on 0.0.0.0:50052
     // TODO: Move this in a config file
     std::string server_address("0.0.0.0:50052");
 
-    aggregator_server service(aggregator, keypair);
+    aggregator_server service(
+        log,
+        batch_sizes,
+        load_keypair,
+        num_prover_contexts,
+        threads_per_context,
+        auto_batch,
+        default_max_batch_wait,
+        num_verifier_threads,
+        log_dir,
+        log_snapshot_interval,
+        dedup_ttl,
+        pool_limits,
+        max_total_pool_transactions,
+        max_total_pool_bytes,
+        num_submit_threads,
+        metrics_file,
+        metrics_interval);
 
     grpc::ServerBuilder builder;
 
@@ -402,17 +2408,42 @@ static void RunServer(
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
 
     // Register "service" as the instance through which we'll communicate with
-    // clients. In this case it corresponds to an *synchronous* service.
+    // clients. SubmitNestedTransaction is served asynchronously via the
+    // completion queues below, all other methods synchronously.
     builder.RegisterService(&service);
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> submit_queues;
+    for (size_t i = 0; i < num_completion_queues; ++i) {
+        submit_queues.push_back(builder.AddCompletionQueue());
+    }
+
+    // Bound the threads serving synchronous calls (which may block for long
+    // periods). The threads polling the completion queues above are not
+    // counted.
+    if (max_sync_threads != 0) {
+        grpc::ResourceQuota quota("aggregator_server");
+        quota.SetMaxThreads((int)max_sync_threads);
+        builder.SetResourceQuota(quota);
+    }
+
+    if (max_concurrent_streams != 0) {
+        builder.AddChannelArgument(
+            GRPC_ARG_MAX_CONCURRENT_STREAMS, (int)max_concurrent_streams);
+    }
+    if (max_message_size != 0) {
+        builder.SetMaxReceiveMessageSize((int)max_message_size);
+        builder.SetMaxSendMessageSize((int)max_message_size);
+    }
 
     // Finally assemble the server.
     std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+    service.serve_submissions(std::move(submit_queues));
     std::cout << "[DEBUG] Server listening on " << server_address << std::endl;
 
     // Wait for the server to shutdown. Note that some other thread must be
     // responsible for shutting down the server for this call to ever return.
     display_server_start_message();
     server->Wait();
+    service.stop_submissions();
 }
 
 int main(int argc, char **argv)
@@ -420,15 +2451,141 @@ int main(int argc, char **argv)
     // Options
     po::options_description options("");
     options.add_options()(
-        "keypair,k",
+        "keypair-dir,k",
+        po::value<boost::filesystem::path>(),
+        "directory holding the keypair file for each batch size");
+    options.add_options()(
+        "batch-sizes,b",
+        po::value<std::string>(),
+        "comma-separated list of batch sizes to support, the first being the "
+        "default (available: 2,4,8,16,32, default: 2)");
+    options.add_options()(
+        "prover-contexts,n",
+        po::value<size_t>(),
+        "number of batches to prove in parallel (default 1)");
+    options.add_options()(
+        "threads-per-context,t",
+        po::value<size_t>(),
+        "threads used to generate each proof (default: all available threads "
+        "split between contexts)");
+    options.add_options()(
+        "auto-batch",
+        "automatically aggregate batches when pools fill, when transactions "
+        "reach their maximum wait, or when provers are idle");
+    options.add_options()(
+        "max-batch-wait",
+        po::value<size_t>(),
+        "default maximum wait (in ms) for transactions before a (possibly "
+        "partial) batch is aggregated, when --auto-batch is given (default: "
+        "no limit)");
+    options.add_options()(
+        "verifier-threads",
+        po::value<size_t>(),
+        "number of threads verifying nested proofs as they are submitted, "
+        "rejecting invalid proofs (default: 0, no verification)");
+    options.add_options()(
+        "dedup-ttl",
+        po::value<size_t>(),
+        "time (in ms) for which aggregated transactions are remembered, and "
+        "resubmissions rejected as duplicates (default: 600000)");
+    options.add_options()(
+        "max-pool-txs",
+        po::value<size_t>(),
+        "maximum number of transactions in each application pool (default: "
+        "no limit)");
+    options.add_options()(
+        "max-pool-bytes",
+        po::value<size_t>(),
+        "maximum size (in bytes) of the transactions in each application pool "
+        "(default: no limit)");
+    options.add_options()(
+        "max-total-pool-txs",
+        po::value<size_t>(),
+        "maximum number of transactions in all application pools (default: no "
+        "limit)");
+    options.add_options()(
+        "max-total-pool-bytes",
+        po::value<size_t>(),
+        "maximum size (in bytes) of the transactions in all application pools "
+        "(default: no limit)");
+    options.add_options()(
+        "pool-tx-ttl",
+        po::value<size_t>(),
+        "time (in ms) after which transactions which have not been aggregated "
+        "are removed from the pool (default: no limit)");
+    options.add_options()(
+        "submit-threads",
+        po::value<size_t>(),
+        "number of threads processing submitted transactions (default: all "
+        "available threads)");
+    options.add_options()(
+        "cq-threads",
+        po::value<size_t>(),
+        "number of threads accepting incoming transaction submissions "
+        "(default: 2)");
+    options.add_options()(
+        "max-sync-threads",
+        po::value<size_t>(),
+        "maximum number of threads serving synchronous calls (all calls other "
+        "than SubmitNestedTransaction). Each WaitBatch, SubscribeBatches and "
+        "SubmitNestedTransactions call holds one of these threads until it "
+        "completes, and calls beyond the limit fail with RESOURCE_EXHAUSTED. "
+        "0 for no limit (default: 64)");
+    options.add_options()(
+        "max-concurrent-streams",
+        po::value<size_t>(),
+        "maximum number of concurrent calls per client connection (default: "
+        "gRPC default)");
+    options.add_options()(
+        "max-message-size",
+        po::value<size_t>(),
+        "maximum size (in bytes) of request and response messages (default: "
+        "gRPC default)");
+    options.add_options()(
+        "log-level",
+        po::value<std::string>(),
+        "level of messages logged: error, info, debug or trace (which "
+        "includes proofs and keys) (default: info)");
+    options.add_options()(
+        "log-sample",
+        po::value<std::string>(),
+        "comma-separated list of <category>=<n>, logging only 1 in n messages "
+        "of each category (submission, registration, batch, pool, keys, "
+        "tx_log, warmup), except errors");
+    options.add_options()(
+        "metrics-file",
+        po::value<boost::filesystem::path>(),
+        "file to which metrics are periodically written, in the Prometheus "
+        "text format (default: none, see also GetMetrics)");
+    options.add_options()(
+        "metrics-interval",
+        po::value<size_t>(),
+        "interval (in ms) between writes of the metrics file (default: "
+        "10000)");
+    options.add_options()(
+        "log-dir",
         po::value<boost::filesystem::path>(),
-        "file to load keypair from");
-#ifdef DEBUG
+        "directory for a write-ahead log of registered applications and pooled "
+        "transactions, which are restored at startup (default: none, not "
+        "persisted)");
+    options.add_options()(
+        "log-snapshot-interval",
+        po::value<size_t>(),
+        "number of log records between snapshots of the write-ahead log "
+        "(default: 65536)");
+    options.add_options()(
+        "prefault-keypairs",
+        "read mapped keypair files into memory in a single pass when they are "
+        "mapped, rather than as pages are accessed");
+    options.add_options()(
+        "verify-keypairs",
+        "verify the checksums of mapped keypair files when they are loaded "
+        "(a full pass over each file, which slows startup)");
     options.add_options()(
         "r1cs,r",
         po::value<boost::filesystem::path>(),
-        "file in which to export the r1cs in json format");
-#endif
+        "file in which to export the r1cs (for the default batch size) in "
+        "binary format (see r1cs-stats)");
 
     auto usage = [&]() {
         std::cout << "Usage:"
@@ -439,8 +2596,31 @@ int main(int argc, char **argv)
         std::cout << std::endl;
     };
 
-    boost::filesystem::path keypair_file;
+    boost::filesystem::path keypair_dir;
     boost::filesystem::path r1cs_file;
+    std::vector<size_t> batch_sizes;
+    size_t num_prover_contexts = 1;
+    size_t threads_per_context = 0;
+    bool auto_batch = false;
+    std::chrono::milliseconds default_max_batch_wait(0);
+    size_t num_verifier_threads = 0;
+    bool prefault_keypairs = false;
+    bool verify_keypairs = false;
+    std::chrono::milliseconds dedup_ttl = libzecale::default_dedup_ttl;
+    libzecale::application_pool_limits pool_limits;
+    size_t max_total_pool_transactions = 0;
+    size_t max_total_pool_bytes = 0;
+    size_t num_submit_threads = 0;
+    size_t num_completion_queues = 2;
+    size_t max_sync_threads = 64;
+    size_t max_concurrent_streams = 0;
+    size_t max_message_size = 0;
+    log_level level = log_level::info;
+    std::map<std::string, size_t> log_sample_rates;
+    boost::filesystem::path metrics_file;
+    std::chrono::milliseconds metrics_interval(10000);
+    boost::filesystem::path log_dir;
+    size_t log_snapshot_interval = libzecale::default_log_snapshot_interval;
     try {
         po::variables_map vm;
         po::store(
@@ -449,26 +2629,114 @@ int main(int argc, char **argv)
             usage();
             return 0;
         }
-        if (vm.count("keypair")) {
-            keypair_file = vm["keypair"].as<boost::filesystem::path>();
+        if (vm.count("keypair-dir")) {
+            keypair_dir = vm["keypair-dir"].as<boost::filesystem::path>();
         }
+        batch_sizes = parse_batch_sizes(
+            vm.count("batch-sizes") ? vm["batch-sizes"].as<std::string>()
+                                    : std::string(default_batch_sizes));
         if (vm.count("r1cs")) {
             r1cs_file = vm["r1cs"].as<boost::filesystem::path>();
         }
+        if (vm.count("prover-contexts")) {
+            num_prover_contexts = vm["prover-contexts"].as<size_t>();
+        }
+        if (vm.count("threads-per-context")) {
+            threads_per_context = vm["threads-per-context"].as<size_t>();
+        }
+        if (vm.count("auto-batch")) {
+            auto_batch = true;
+        }
+        if (vm.count("max-batch-wait")) {
+            default_max_batch_wait =
+                std::chrono::milliseconds(vm["max-batch-wait"].as<size_t>());
+        }
+        if (vm.count("verifier-threads")) {
+            num_verifier_threads = vm["verifier-threads"].as<size_t>();
+        }
+        if (vm.count("prefault-keypairs")) {
+            prefault_keypairs = true;
+        }
+        if (vm.count("verify-keypairs")) {
+            verify_keypairs = true;
+        }
+        if (vm.count("dedup-ttl")) {
+            dedup_ttl = std::chrono::milliseconds(vm["dedup-ttl"].as<size_t>());
+        }
+        if (vm.count("max-pool-txs")) {
+            pool_limits.max_transactions = vm["max-pool-txs"].as<size_t>();
+        }
+        if (vm.count("max-pool-bytes")) {
+            pool_limits.max_bytes = vm["max-pool-bytes"].as<size_t>();
+        }
+        if (vm.count("max-total-pool-txs")) {
+            max_total_pool_transactions =
+                vm["max-total-pool-txs"].as<size_t>();
+        }
+        if (vm.count("max-total-pool-bytes")) {
+            max_total_pool_bytes = vm["max-total-pool-bytes"].as<size_t>();
+        }
+        if (vm.count("pool-tx-ttl")) {
+            pool_limits.tx_ttl =
+                std::chrono::milliseconds(vm["pool-tx-ttl"].as<size_t>());
+        }
+        if (vm.count("submit-threads")) {
+            num_submit_threads = vm["submit-threads"].as<size_t>();
+        }
+        if (vm.count("cq-threads")) {
+            num_completion_queues = vm["cq-threads"].as<size_t>();
+        }
+        if (vm.count("max-sync-threads")) {
+            max_sync_threads = vm["max-sync-threads"].as<size_t>();
+        }
+        if (vm.count("max-concurrent-streams")) {
+            max_concurrent_streams = vm["max-concurrent-streams"].as<size_t>();
+        }
+        if (vm.count("max-message-size")) {
+            max_message_size = vm["max-message-size"].as<size_t>();
+        }
+        if (vm.count("log-level")) {
+            level = libzecale::log_level_from_string(
+                vm["log-level"].as<std::string>());
+        }
+        if (vm.count("log-sample")) {
+            log_sample_rates =
+                parse_log_sample_rates(vm["log-sample"].as<std::string>());
+        }
+        if (vm.count("metrics-file")) {
+            metrics_file = vm["metrics-file"].as<boost::filesystem::path>();
+        }
+        if (vm.count("metrics-interval")) {
+            metrics_interval =
+                std::chrono::milliseconds(vm["metrics-interval"].as<size_t>());
+        }
+        if (vm.count("log-dir")) {
+            log_dir = vm["log-dir"].as<boost::filesystem::path>();
+        }
+        if (vm.count("log-snapshot-interval")) {
+            log_snapshot_interval = vm["log-snapshot-interval"].as<size_t>();
+        }
     } catch (po::error &error) {
         std::cerr << " ERROR: " << error.what() << std::endl;
         usage();
         return 1;
+    } catch (std::logic_error &error) {
+        // Invalid batch sizes, log levels or sample rates
+        // (std::invalid_argument, std::out_of_range)
+        std::cerr << " ERROR: " << error.what() << std::endl;
+        usage();
+        return 1;
     }
 
-    // Default keypair_file if none given
-    if (keypair_file.empty()) {
-        boost::filesystem::path setup_dir =
-            libzeth::get_path_to_setup_directory();
-        if (!setup_dir.empty()) {
-            boost::filesystem::create_directories(setup_dir);
-        }
-        keypair_file = setup_dir / "zecale_keypair.bin";
+    // Default keypair_dir if none given
+    if (keypair_dir.empty()) {
+        keypair_dir = libzeth::get_path_to_setup_directory();
+    }
+    if (!keypair_dir.empty()) {
+        boost::filesystem::create_directories(keypair_dir);
+    }
+    if (!log_dir.empty()) {
+        boost::filesystem::create_directories(log_dir);
     }
 
     // Inititalize the curve parameters
@@ -476,52 +2744,95 @@ int main(int argc, char **argv)
     npp::init_public_params();
     wpp::init_public_params();
 
-    // Set up the aggregator circuit
-    aggregator_circuit aggregator(num_inputs_per_nested_proof);
-
-    // Load or generate the keypair
-    wsnark::keypair keypair = [&keypair_file, &aggregator]() {
-        if (boost::filesystem::exists(keypair_file)) {
-            std::cout << "[INFO] Loading keypair: " << keypair_file << "\n";
-            wsnark::keypair keypair;
-            load_keypair(keypair, keypair_file);
-
-            // Check the VK is for the correct number of inputs.
-            if (keypair.vk.ABC_g1.size() != aggregator.num_primary_inputs()) {
-                throw std::invalid_argument("invalid VK");
-            }
-
-            return keypair;
-        }
+    if (num_prover_contexts == 0) {
+        std::cerr << " ERROR: at least one prover context is required\n";
+        return 1;
+    }
 
-        std::cout << "[INFO] No keypair file " << keypair_file
-                  << ". Generating.\n";
-        const wsnark::keypair keypair = aggregator.generate_trusted_setup();
+    if (log_snapshot_interval == 0) {
+        std::cerr << " ERROR: invalid log snapshot interval\n";
+        return 1;
+    }
 
-        // Check the VK is for the correct number of inputs.
-        if (keypair.vk.ABC_g1.size() != aggregator.num_primary_inputs()) {
-            throw std::invalid_argument("invalid VK");
-        }
+    if (metrics_interval == std::chrono::milliseconds::zero()) {
+        std::cerr << " ERROR: invalid metrics interval\n";
+        return 1;
+    }
 
-        const size_t num_constraints =
-            aggregator.get_constraint_system().num_constraints();
-        std::cout << "[INFO] Circuit has " << std::to_string(num_constraints)
-                  << " constraints\n";
+    if (num_completion_queues == 0) {
+        std::cerr << " ERROR: at least one completion queue thread is "
+                     "required\n";
+        return 1;
+    }
 
-        std::cout << "[INFO] Writing new keypair to " << keypair_file << "\n";
-        write_keypair(keypair, keypair_file);
-        return keypair;
-    }();
+    // Split the available threads between the prover contexts, unless
+    // specified explicitly.
+    if (threads_per_context == 0) {
+#ifdef MULTICORE
+        threads_per_context =
+            std::max<size_t>(1, omp_get_max_threads() / num_prover_contexts);
+#else
+        threads_per_context = 1;
+#endif
+    }
+    std::cout << "[INFO] " << std::to_string(num_prover_contexts)
+              << " prover context(s), "
+              << std::to_string(threads_per_context) << " thread(s) each\n";
+
+    // Keypairs are loaded (or generated) in the background, while the server
+    // accepts requests. If a file has been given for the R1CS (in binary
+    // format), it is written out once the keypair for the default batch size
+    // is loaded.
+    const keypair_loader load_keypair =
+        [=](size_t batch_size,
+            wsnark::keypair &keypair,
+            const libzecale::setup_progress_callback &progress) {
+            load_or_generate_keypair(
+                batch_size,
+                keypair,
+                keypair_dir,
+                prefault_keypairs,
+                verify_keypairs,
+                progress);
+            if (!r1cs_file.empty() && batch_size == batch_sizes[0]) {
+                std::cout << "[INFO] Writing R1CS to " << r1cs_file
+                          << std::endl;
+                write_constraint_system(
+                    keypair.pk.constraint_system, r1cs_file);
+            }
+        };
 
-    // If a file has been given for the JSON representation of the circuit,
-    // write it out.
-    if (!r1cs_file.empty()) {
-        std::cout << "[INFO] Writing R1CS to " << std::endl;
-        write_constraint_system(aggregator, r1cs_file);
+    // Messages from the server are written asynchronously.
+    libzecale::logger log(level);
+    for (const auto &sample_rate : log_sample_rates) {
+        log.set_sample_rate(sample_rate.first, sample_rate.second);
     }
 
     // Launch the server
-    std::cout << "[INFO] Setup successful, starting the server..." << std::endl;
-    RunServer(aggregator, keypair);
+    std::cout << "[INFO] Starting the server (keypairs are loaded in the "
+                 "background)..."
+              << std::endl;
+    RunServer(
+        log,
+        batch_sizes,
+        load_keypair,
+        num_prover_contexts,
+        threads_per_context,
+        auto_batch,
+        default_max_batch_wait,
+        num_verifier_threads,
+        log_dir.string(),
+        log_snapshot_interval,
+        dedup_ttl,
+        pool_limits,
+        max_total_pool_transactions,
+        max_total_pool_bytes,
+        num_submit_threads,
+        num_completion_queues,
+        max_sync_threads,
+        max_concurrent_streams,
+        max_message_size,
+        metrics_file.string(),
+        metrics_interval);
     return 0;
 }
@@ -0,0 +1,118 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+// Standalone tool to generate the keypair for each batch size ahead of
+// starting the aggregator server. For Groth16, keypairs are streamed directly
+// to mapped keypair files in the server's keypair directory, as they are
+// computed (see generate_keypair_file).
+
+#include "aggregator_server/aggregator_config.hpp"
+#include "aggregator_server/keypair_files.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <libzeth/core/utils.hpp>
+
+namespace po = boost::program_options;
+
+int main(int argc, char **argv)
+{
+    // Options
+    po::options_description options("");
+    options.add_options()("help,h", "This help");
+    options.add_options()(
+        "keypair-dir,k",
+        po::value<boost::filesystem::path>(),
+        "directory in which to write the keypair file for each batch size");
+    options.add_options()(
+        "batch-sizes,b",
+        po::value<std::string>(),
+        "comma-separated list of batch sizes for which to generate keypairs "
+        "(available: 2,4,8,16,32, default: 2)");
+    options.add_options()(
+        "chunk-size",
+        po::value<size_t>(),
+        "number of proving key elements computed in parallel before being "
+        "written out (Groth16 only, default: 65536)");
+    options.add_options()(
+        "overwrite", "replace keypair files which already exist");
+
+    auto usage = [&]() {
+        std::cout << "Usage:"
+                  << "\n"
+                  << "  " << argv[0] << " [<options>]\n"
+                  << "\n";
+        std::cout << options;
+        std::cout << std::endl;
+    };
+
+    boost::filesystem::path keypair_dir;
+    std::vector<size_t> batch_sizes;
+    size_t chunk_size = libzecale::default_setup_chunk_size;
+    bool overwrite = false;
+    try {
+        po::variables_map vm;
+        po::store(
+            po::command_line_parser(argc, argv).options(options).run(), vm);
+        if (vm.count("help")) {
+            usage();
+            return 0;
+        }
+        if (vm.count("keypair-dir")) {
+            keypair_dir = vm["keypair-dir"].as<boost::filesystem::path>();
+        }
+        batch_sizes = parse_batch_sizes(
+            vm.count("batch-sizes") ? vm["batch-sizes"].as<std::string>()
+                                    : std::string(default_batch_sizes));
+        if (vm.count("chunk-size")) {
+            chunk_size = vm["chunk-size"].as<size_t>();
+        }
+        if (vm.count("overwrite")) {
+            overwrite = true;
+        }
+    } catch (po::error &error) {
+        std::cerr << " ERROR: " << error.what() << std::endl;
+        usage();
+        return 1;
+    } catch (std::logic_error &error) {
+        // Invalid batch sizes (std::invalid_argument, std::out_of_range)
+        std::cerr << " ERROR: " << error.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    if (chunk_size == 0) {
+        std::cerr << " ERROR: invalid chunk size\n";
+        return 1;
+    }
+
+    // Default keypair_dir if none given (as for the server)
+    if (keypair_dir.empty()) {
+        keypair_dir = libzeth::get_path_to_setup_directory();
+    }
+    if (!keypair_dir.empty()) {
+        boost::filesystem::create_directories(keypair_dir);
+    }
+
+    // Inititalize the curve parameters
+    std::cout << "[INFO] Init params of both curves" << std::endl;
+    npp::init_public_params();
+    wpp::init_public_params();
+
+    for (const size_t batch_size : batch_sizes) {
+        const boost::filesystem::path keypair_file =
+            generated_keypair_path(keypair_dir, batch_size);
+        if (boost::filesystem::exists(keypair_file) && !overwrite) {
+            std::cout << "[INFO] Keypair file " << keypair_file
+                      << " exists. Skipping.\n";
+            continue;
+        }
+
+        std::cout << "[INFO] Generating keypair " << keypair_file << "\n";
+        generate_keypair_file(batch_size, keypair_file, chunk_size);
+    }
+
+    std::cout << "[INFO] Setup complete" << std::endl;
+    return 0;
+}
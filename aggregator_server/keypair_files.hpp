@@ -0,0 +1,193 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_AGGREGATOR_SERVER_KEYPAIR_FILES_HPP__
+#define __ZECALE_AGGREGATOR_SERVER_KEYPAIR_FILES_HPP__
+
+// Keypair files, shared by the aggregator server and the setup tool.
+
+#include "aggregator_server/aggregator_config.hpp"
+#include "libzecale/core/streaming_setup.hpp"
+#include "libzecale/serialization/mapped_keypair.hpp"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+/// Path of the keypair file for the given batch size, with the given
+/// extension (".bin" for the usual serialized form, ".mmap" for the mapped
+/// form).
+inline boost::filesystem::path keypair_path(
+    const boost::filesystem::path &keypair_dir,
+    const size_t batch_size,
+    const std::string &extension)
+{
+    return keypair_dir /
+           ("zecale_keypair_" + std::to_string(batch_size) + extension);
+}
+
+/// Fingerprint of the configuration for which the keypair for the given batch
+/// size is generated. Keypair files generated for a different configuration
+/// are rejected when loaded.
+inline uint64_t keypair_config_fingerprint(const size_t batch_size)
+{
+    return libzecale::mapped_keypair_config_fingerprint(
+        std::string("wpp=") + wpp_name + ";snark=" + snark_name +
+        ";batch_size=" + std::to_string(batch_size) +
+        ";inputs_per_nested_proof=" +
+        std::to_string(num_inputs_per_nested_proof));
+}
+
+/// Write a keypair file, by calling `write` on a stream. The file is written
+/// to a temporary path and renamed, so that other processes never read (or
+/// map) a partially written file.
+template<typename WriteFnT>
+inline void write_keypair_file(
+    const boost::filesystem::path &keypair_file, const WriteFnT &write)
+{
+    const boost::filesystem::path tmp_file = keypair_file.string() + ".tmp";
+    {
+        std::ofstream out_s(
+            tmp_file.c_str(), std::ios_base::out | std::ios_base::binary);
+        out_s.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+        write(out_s);
+    }
+    boost::filesystem::rename(tmp_file, keypair_file);
+}
+
+// The mapped keypair format (and streaming setup) are only implemented for
+// Groth16. Keypairs for other snarks are generated in memory and held in the
+// usual serialized form.
+#if defined(ZECALE_SNARK_GROTH16)
+
+inline void write_mapped_keypair(
+    const typename wsnark::keypair &keypair,
+    const size_t batch_size,
+    const boost::filesystem::path &mapped_keypair_file)
+{
+    write_keypair_file(mapped_keypair_file, [&](std::ostream &out_s) {
+        libzecale::groth16_keypair_write_mapped<wpp>(
+            keypair, out_s, keypair_config_fingerprint(batch_size));
+    });
+}
+
+/// Load a mapped keypair file, checking that it was generated for the
+/// current configuration (and, if `verify_checksum` is set, that it is not
+/// corrupt).
+inline void load_mapped_keypair(
+    typename wsnark::keypair &keypair,
+    const size_t batch_size,
+    const boost::filesystem::path &mapped_keypair_file,
+    const bool prefault,
+    const bool verify_checksum)
+{
+    const libzecale::mapped_keypair_header header =
+        libzecale::groth16_keypair_read_mapped<wpp>(
+            keypair, mapped_keypair_file.string(), prefault, verify_checksum);
+    if (header.config_fingerprint != keypair_config_fingerprint(batch_size)) {
+        throw std::runtime_error(
+            "keypair file " + mapped_keypair_file.string() +
+            " was generated for a different configuration");
+    }
+}
+
+/// Generate a new keypair for the given batch size, streaming it directly to
+/// a mapped keypair file (see libzecale::groth16_generate_setup_mapped).
+/// Progress is logged at intervals of roughly 10% of the proving key, and
+/// also passed to `on_progress` (if given).
+inline void generate_mapped_keypair(
+    const size_t batch_size,
+    const boost::filesystem::path &mapped_keypair_file,
+    const size_t chunk_size = libzecale::default_setup_chunk_size,
+    const libzecale::setup_progress_callback &on_progress =
+        libzecale::setup_progress_callback())
+{
+    // Only the constraint system of the circuit is required. The circuit is
+    // destroyed before the setup starts, so that only one copy of the
+    // constraint system is held (and moved into the setup).
+    libsnark::r1cs_constraint_system<libff::Fr<wpp>> constraint_system =
+        aggregator_family::create(batch_size, num_inputs_per_nested_proof)
+            ->get_constraint_system();
+    std::cout << "[INFO] Circuit for batch size " << std::to_string(batch_size)
+              << " has " << std::to_string(constraint_system.num_constraints())
+              << " constraints\n";
+
+    size_t last_reported = 0;
+    const libzecale::setup_progress_callback progress =
+        [&](size_t num_computed, size_t num_total) {
+            if (on_progress) {
+                on_progress(num_computed, num_total);
+            }
+            const size_t percent = num_computed * 100 / num_total;
+            if (percent >= last_reported + 10 || num_computed == num_total) {
+                std::cout << "[INFO] Batch size " << std::to_string(batch_size)
+                          << ": computed " << std::to_string(num_computed)
+                          << " of " << std::to_string(num_total)
+                          << " proving key elements (" << percent << "%)"
+                          << std::endl;
+                last_reported = percent;
+            }
+        };
+
+    write_keypair_file(mapped_keypair_file, [&](std::ostream &out_s) {
+        libzecale::groth16_generate_setup_mapped<wpp>(
+            std::move(constraint_system),
+            out_s,
+            keypair_config_fingerprint(batch_size),
+            chunk_size,
+            progress);
+    });
+}
+
+#endif // defined(ZECALE_SNARK_GROTH16)
+
+/// Path of the keypair file written by generate_keypair_file.
+inline boost::filesystem::path generated_keypair_path(
+    const boost::filesystem::path &keypair_dir, const size_t batch_size)
+{
+#if defined(ZECALE_SNARK_GROTH16)
+    return keypair_path(keypair_dir, batch_size, ".mmap");
+#else
+    return keypair_path(keypair_dir, batch_size, ".bin");
+#endif
+}
+
+/// Generate a new keypair for the given batch size, and write it to
+/// `keypair_file`. For Groth16, the keypair is streamed to a mapped keypair
+/// file (see generate_mapped_keypair). Otherwise, it is generated in memory
+/// and written in the usual serialized form, `chunk_size` is ignored and
+/// progress is only reported on completion.
+inline void generate_keypair_file(
+    const size_t batch_size,
+    const boost::filesystem::path &keypair_file,
+    const size_t chunk_size = libzecale::default_setup_chunk_size,
+    const libzecale::setup_progress_callback &on_progress =
+        libzecale::setup_progress_callback())
+{
+#if defined(ZECALE_SNARK_GROTH16)
+    generate_mapped_keypair(batch_size, keypair_file, chunk_size, on_progress);
+#else
+    (void)chunk_size;
+    const std::unique_ptr<aggregator_circuit> aggregator =
+        aggregator_family::create(batch_size, num_inputs_per_nested_proof);
+    std::cout << "[INFO] Circuit for batch size " << std::to_string(batch_size)
+              << " has "
+              << std::to_string(
+                     aggregator->get_constraint_system().num_constraints())
+              << " constraints\n";
+    const wsnark::keypair keypair = aggregator->generate_trusted_setup();
+    write_keypair_file(keypair_file, [&](std::ostream &out_s) {
+        wsnark::keypair_write_bytes(keypair, out_s);
+    });
+    if (on_progress) {
+        on_progress(1, 1);
+    }
+#endif
+}
+
+#endif // __ZECALE_AGGREGATOR_SERVER_KEYPAIR_FILES_HPP__
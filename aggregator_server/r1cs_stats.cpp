@@ -0,0 +1,230 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+// Tool to compute summary statistics of a constraint system, directly from a
+// binary R1CS file (as exported by the aggregator server), reading one chunk
+// of constraints at a time.
+
+#include "libzecale/serialization/r1cs_binary.hpp"
+
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace
+{
+
+/// Minimum, maximum and mean of a set of counts.
+class count_summary
+{
+public:
+    count_summary() : _min(0), _max(0), _total(0), _num(0) {}
+
+    void add(uint64_t count)
+    {
+        _min = (_num == 0) ? count : std::min(_min, count);
+        _max = std::max(_max, count);
+        _total += count;
+        ++_num;
+    }
+
+    void print(std::ostream &out_s) const
+    {
+        const double mean = (_num == 0) ? 0.0 : (double)_total / _num;
+        out_s << "min " << _min << ", max " << _max << ", mean " << std::fixed
+              << std::setprecision(2) << mean;
+    }
+
+private:
+    uint64_t _min;
+    uint64_t _max;
+    uint64_t _total;
+    uint64_t _num;
+};
+
+struct gadget_totals {
+    uint64_t num_constraints;
+    uint64_t num_nonzeros;
+};
+
+/// The gadget of a constraint, given by the first `depth` components of its
+/// annotation. In libsnark, annotations are formed by appending
+/// space-separated names to the annotation prefix of each gadget.
+std::string annotation_gadget(const std::string &annotation, size_t depth)
+{
+    if (annotation.empty()) {
+        return "<unannotated>";
+    }
+    size_t end = 0;
+    for (size_t i = 0; i < depth; ++i) {
+        end = annotation.find(' ', end + (i == 0 ? 0 : 1));
+        if (end == std::string::npos) {
+            return annotation;
+        }
+    }
+    return annotation.substr(0, end);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    // Options
+    po::options_description options("");
+    options.add_options()("help,h", "This help");
+    options.add_options()(
+        "depth,d",
+        po::value<size_t>(),
+        "number of annotation components identifying a gadget, for per-gadget "
+        "totals (default: 1)");
+    po::options_description all_options("");
+    all_options.add(options);
+    all_options.add_options()("r1cs-file", po::value<std::string>());
+    po::positional_options_description pos;
+    pos.add("r1cs-file", 1);
+
+    auto usage = [&]() {
+        std::cout << "Usage:"
+                  << "\n"
+                  << "  " << argv[0] << " [<options>] <r1cs-file>\n"
+                  << "\n";
+        std::cout << options;
+        std::cout << std::endl;
+    };
+
+    std::string r1cs_file;
+    size_t depth = 1;
+    try {
+        po::variables_map vm;
+        po::store(
+            po::command_line_parser(argc, argv)
+                .options(all_options)
+                .positional(pos)
+                .run(),
+            vm);
+        if (vm.count("help")) {
+            usage();
+            return 0;
+        }
+        if (!vm.count("r1cs-file")) {
+            std::cerr << " ERROR: no R1CS file given\n";
+            usage();
+            return 1;
+        }
+        r1cs_file = vm["r1cs-file"].as<std::string>();
+        if (vm.count("depth")) {
+            depth = vm["depth"].as<size_t>();
+        }
+    } catch (po::error &error) {
+        std::cerr << " ERROR: " << error.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    if (depth == 0) {
+        std::cerr << " ERROR: invalid depth\n";
+        return 1;
+    }
+
+    try {
+        std::ifstream in_s(
+            r1cs_file.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!in_s) {
+            throw std::runtime_error("failed to open " + r1cs_file);
+        }
+        libzecale::r1cs_binary_reader reader(in_s);
+        const libzecale::r1cs_binary_header &header = reader.header();
+        const uint64_t num_variables =
+            header.primary_input_size + header.auxiliary_input_size;
+
+        // Occurrences of each variable (including the constant 1, at index
+        // 0), in any linear combination.
+        std::vector<uint64_t> column_nonzeros(num_variables + 1, 0);
+        uint64_t lc_nonzeros[3] = {0, 0, 0};
+        count_summary row_summary;
+        std::map<std::string, gadget_totals> gadgets;
+
+        libzecale::r1cs_binary_chunk chunk;
+        while (reader.read_chunk(chunk)) {
+            for (size_t i = 0; i < chunk.num_constraints(); ++i) {
+                uint64_t row_nonzeros = 0;
+                for (size_t lc = 0; lc < 3; ++lc) {
+                    const uint64_t begin = chunk.lc_offsets[3 * i + lc];
+                    const uint64_t end = chunk.lc_offsets[3 * i + lc + 1];
+                    for (uint64_t j = begin; j < end; ++j) {
+                        const uint64_t index = chunk.term_indices[j];
+                        if (index > num_variables) {
+                            throw std::runtime_error(
+                                "invalid variable in binary R1CS");
+                        }
+                        ++column_nonzeros[index];
+                    }
+                    lc_nonzeros[lc] += end - begin;
+                    row_nonzeros += end - begin;
+                }
+                row_summary.add(row_nonzeros);
+
+                gadget_totals &totals = gadgets[annotation_gadget(
+                    chunk.annotations[i], depth)];
+                ++totals.num_constraints;
+                totals.num_nonzeros += row_nonzeros;
+            }
+        }
+
+        count_summary column_summary;
+        uint64_t num_unused_variables = 0;
+        for (const uint64_t count : column_nonzeros) {
+            column_summary.add(count);
+            num_unused_variables += (count == 0) ? 1 : 0;
+        }
+
+        std::cout << "constraints:          " << header.num_constraints
+                  << "\n"
+                  << "primary inputs:       " << header.primary_input_size
+                  << "\n"
+                  << "auxiliary inputs:     " << header.auxiliary_input_size
+                  << "\n"
+                  << "field size (bytes):   " << header.field_size << "\n"
+                  << "nonzeros (A, B, C):   " << lc_nonzeros[0] << ", "
+                  << lc_nonzeros[1] << ", " << lc_nonzeros[2] << "\n"
+                  << "nonzeros per row:     ";
+        row_summary.print(std::cout);
+        std::cout << "\nnonzeros per column:  ";
+        column_summary.print(std::cout);
+        std::cout << "\nunused variables:     " << num_unused_variables
+                  << "\n\n";
+
+        // Per-gadget totals, by decreasing number of constraints.
+        std::vector<std::pair<std::string, gadget_totals>> sorted(
+            gadgets.begin(), gadgets.end());
+        std::sort(
+            sorted.begin(),
+            sorted.end(),
+            [](const std::pair<std::string, gadget_totals> &a,
+               const std::pair<std::string, gadget_totals> &b) {
+                return a.second.num_constraints > b.second.num_constraints;
+            });
+        std::cout << std::setw(12) << "constraints" << std::setw(14)
+                  << "nonzeros"
+                  << "  gadget\n";
+        for (const auto &entry : sorted) {
+            std::cout << std::setw(12) << entry.second.num_constraints
+                      << std::setw(14) << entry.second.num_nonzeros << "  "
+                      << entry.first << "\n";
+        }
+        std::cout << std::flush;
+    } catch (std::runtime_error &error) {
+        std::cerr << " ERROR: " << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+# Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+#
+# SPDX-License-Identifier: LGPL-3.0+
+
+from zecale.core.proto_utils import field_element_to_bytes, \
+    groth16_extended_proof_json_to_bytes
+from unittest import TestCase
+
+# Moduli of the base and scalar fields of mnt4.
+MNT4_Q = int(
+    "4759222861692613257533492496530484515451248785528235155532677357"
+    "39164647307408490559963137")
+MNT4_R = int(
+    "4759222861692613257533492496530484515451248792426947253955551285"
+    "76210262817955800483758081")
+
+# Binary encoding of a Groth16 extended proof over mnt4, with A = (1, 2),
+# B = ((3, 4), (5, 6)), C = (7, 8) and inputs (9, r - 1). The same data is
+# decoded by the server in libzecale/tests/serialization/proto_utils_test.cpp.
+GROTH16_MNT4_EXTENDED_PROOF_HEX = \
+    "5c84bbffef7a17c3881796f902c7809b5aa870accd8ddfc597517b6498401829" \
+    "c3333d22c1010000b80877ffdff52e86112f2cf3058e0137b550e1589b1bbf8b" \
+    "2fa3f6c83081305286677a4482030000138d32ff2b3c038ec6db645a010939d7" \
+    "7ab75da805e0af8638a0c1852b9de2d8d5c6fa6e860100006f11eefe1bb71a51" \
+    "4ff3fa5304d0b972d55fce54d36d8f4cd0f13ceac3ddfa0199fa379147030000" \
+    "ca95a9fe67fdee5804a033bbff4af1129bc64aa43d328047d9ee07a7bef9ac88" \
+    "e859b8bb4b010000261a65fe5778061c8db7c9b4021272aef56ebb500bc05f0d" \
+    "7140830b573ac5b1ab8df5dd0c030000819e20fea3beda234264021cfe8ca94e" \
+    "bbd537a0758450087a3d4ec851567738fbec750811010000dd22dcfd9339f2e6" \
+    "ca7b981501542aea157ea84c431230ce118fc92cea968f61be20b32ad2020000" \
+    "020000000000000038a7e755ec94a8ba52c5eabc4bbd2a329f4183fc328c20c9" \
+    "1a8c94e9e4b241e80d803355d6000000a57b0219dfbb49b01d80696d4869cb57" \
+    "a9851834dc430f05f702354305e44d79b0a07fd5fb010000"
+
+
+class TestProtoUtils(TestCase):
+
+    def test_field_element_to_bytes(self) -> None:
+        # 5 limbs of 64 bits for a 298-bit modulus.
+        self.assertEqual(40, len(field_element_to_bytes(1, MNT4_Q)))
+        self.assertEqual(bytes(40), field_element_to_bytes(0, MNT4_Q))
+
+        # The Montgomery form of 1 is 2^320 mod q.
+        self.assertEqual(
+            ((1 << 320) % MNT4_Q).to_bytes(40, byteorder="little"),
+            field_element_to_bytes(1, MNT4_Q))
+
+        # Only canonical values can be encoded.
+        with self.assertRaises(ValueError):
+            field_element_to_bytes(MNT4_Q, MNT4_Q)
+        with self.assertRaises(ValueError):
+            field_element_to_bytes(-1, MNT4_Q)
+
+    def test_groth16_extended_proof_to_bytes(self) -> None:
+        ext_proof_json = {
+            "proof": {
+                "a": ["0x1", "0x2"],
+                "b": [["0x3", "0x4"], ["0x5", "0x6"]],
+                "c": ["0x7", "0x8"],
+            },
+            "inputs": ["0x9", hex(MNT4_R - 1)],
+        }
+        self.assertEqual(
+            GROTH16_MNT4_EXTENDED_PROOF_HEX,
+            groth16_extended_proof_json_to_bytes(
+                ext_proof_json, MNT4_Q, MNT4_R).hex())
@@ -8,6 +8,8 @@ AGGREGATOR_SERVER_ENDPOINT_DEFAULT = "localhost:50052"
 
 BATCH_PROOF_FILENAME_DEFAULT = "batch.json"
 
+BATCH_SIZE_DEFAULT = 2
+
 AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT = "aggregator-vk.json"
 
 INSTANCE_FILE_DEFAULT = "zecale-instance"
@@ -17,7 +17,8 @@ from click import argument, option, command, pass_context, Context, ClickExcepti
 @pass_context
 def check_batch(ctx: Context, batch_file: str, batch_size: int) -> None:
     """
-    Exit with error if result is not 1 for any nested proof
+    Exit with error if result is not 1 for any nested proof (excluding padding
+    proofs in partial batches).
     """
     cmd_ctx: CommandContext = ctx.obj
     aggregated_tx = load_aggregated_transaction(
@@ -26,6 +27,12 @@ def check_batch(ctx: Context, batch_file: str, batch_size: int) -> None:
     results = int(inputs[1], 16)
     print(f"results={hex(results)}")
 
-    expect_results = (1 << batch_size) - 1
-    if expect_results != results:
+    # Padding slots (after the real nested transactions) are ignored.
+    if len(aggregated_tx.nested_parameters) != batch_size:
+        raise ClickException("nested parameters do not match batch size")
+    num_nested_txs = aggregated_tx.num_nested_txs
+    if num_nested_txs > batch_size:
+        raise ClickException("too many nested transactions for batch size")
+    expect_results = (1 << num_nested_txs) - 1
+    if expect_results != results & expect_results:
         raise ClickException("at least one nested proof judged as invalid")
@@ -2,7 +2,8 @@
 #
 # SPDX-License-Identifier: LGPL-3.0+
 
-from zecale.cli.defaults import AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT
+from zecale.cli.defaults import AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT, \
+    BATCH_SIZE_DEFAULT
 from zecale.cli.command_context import CommandContext
 from zecale.cli.utils import load_verification_key
 from zecale.core.dispatcher_contract import DispatcherContract
@@ -16,10 +17,17 @@ import json
     default=AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT,
     help="Aggregator verification key file (default: "
     f"{AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT})")
+@option(
+    "--batch-size",
+    type=int,
+    default=BATCH_SIZE_DEFAULT,
+    help="Number of nested proofs per batch (must match the verification key, "
+    f"default: {BATCH_SIZE_DEFAULT})")
 @pass_context
 def deploy(
         ctx: Context,
-        verification_key_file: str) -> None:
+        verification_key_file: str,
+        batch_size: int) -> None:
     """
     Deploy the zecale dispatcher contract.
     """
@@ -36,7 +44,7 @@ def deploy(
     # Deploy contract, passing the encoded key to the constructor
     web3 = cmd_ctx.get_web3()
     _dispatcher, dispatcher_instance = DispatcherContract.deploy(
-        web3, snark, pp, vk, eth_addr, eth_private_key)
+        web3, snark, pp, vk, batch_size, eth_addr, eth_private_key)
 
     # Save the contract instance description
     with open(cmd_ctx.instance_file, "w") as instance_f:
@@ -14,11 +14,23 @@ from click import option, command, pass_context, Context
     "--batch-file",
     default=BATCH_PROOF_FILENAME_DEFAULT,
     help="Batch proof output file")
+@option(
+    "--batch-size",
+    type=int,
+    default=0,
+    help="Number of nested proofs (default: the largest batch that can be "
+    "filled)")
+@option(
+    "--allow-partial",
+    is_flag=True,
+    help="Pad the batch with dummy proofs if it cannot be filled")
 @pass_context
 def get_batch(
         ctx: Context,
         name: str,
-        batch_file: str) -> None:
+        batch_file: str,
+        batch_size: int,
+        allow_partial: bool) -> None:
     """
     Request an aggregated transaction for the given application name.
     """
@@ -27,6 +39,6 @@ def get_batch(
     wrapper_snark = cmd_ctx.get_wrapper_snark()
     aggregator_client = cmd_ctx.get_aggregator_client()
     aggregated_tx = aggregator_client.get_aggregated_transaction(
-        wrapper_snark, name)
+        wrapper_snark, name, batch_size, allow_partial)
     with open(batch_file, "w") as batch_f:
         json.dump(aggregated_tx.to_json_dict(), batch_f)
@@ -14,17 +14,23 @@ from click import option, command, pass_context, Context
     "-o",
     default=AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT,
     help=f"Output file (default: {AGGREGATOR_VERIFICATION_KEY_FILE_DEFAULT})")
+@option(
+    "--batch-size",
+    type=int,
+    default=0,
+    help="Batch size (default: the default batch size of the server)")
 @pass_context
 def get_verification_key(
         ctx: Context,
-        vk_out: str) -> None:
+        vk_out: str,
+        batch_size: int) -> None:
     """
-    Get the aggregator (wrapping) verification key from the aggregation server
-    and write to a file.
+    Get the aggregator (wrapping) verification key for a given batch size from
+    the aggregation server and write to a file.
     """
     cmd_ctx: CommandContext = ctx.obj
     aggregator_client = cmd_ctx.get_aggregator_client()
     aggregator_vk = aggregator_client.get_verification_key(
-        cmd_ctx.get_wrapper_snark())
+        cmd_ctx.get_wrapper_snark(), batch_size)
     with open(vk_out, "w") as vk_f:
         json.dump(aggregator_vk.to_json_dict(), vk_f)
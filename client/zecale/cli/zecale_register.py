@@ -16,8 +16,18 @@ from click import command, option, pass_context, Context
     "--name",
     required=True,
     help="Name of the application to register")
+@option(
+    "--max-batch-wait",
+    type=int,
+    default=0,
+    help="Maximum time (in ms) that transactions wait before being aggregated "
+    "(default: server default)")
 @pass_context
-def register(ctx: Context, key: str, name: str) -> None:
+def register(
+        ctx: Context,
+        key: str,
+        name: str,
+        max_batch_wait: int) -> None:
     """
     Register an application using name and verification key
     """
@@ -27,4 +37,5 @@ def register(ctx: Context, key: str, name: str) -> None:
     nested_snark = cmd_ctx.get_nested_snark()
     vk = load_verification_key(nested_snark, key)
     aggregator_client = cmd_ctx.get_aggregator_client()
-    aggregator_client.register_application(nested_snark, vk, name)
+    aggregator_client.register_application(
+        nested_snark, vk, name, max_batch_wait)
@@ -2,22 +2,39 @@
 #
 # SPDX-License-Identifier: LGPL-3.0+
 
+from zecale.api import aggregator_pb2
 from zecale.cli.utils import load_nested_transaction
 from zecale.cli.command_context import CommandContext
-from click import command, argument, pass_context, Context
+from click import command, argument, pass_context, Context, ClickException
+from typing import Tuple
 
 
 @command()
-@argument("tx_file")
+@argument("tx_files", nargs=-1, required=True)
 @pass_context
-def submit(ctx: Context, tx_file: str) -> None:
+def submit(ctx: Context, tx_files: Tuple[str, ...]) -> None:
     """
-    Submit a nested transaction to the aggregation server
+    Submit nested transactions to the aggregation server
     """
     cmd_ctx: CommandContext = ctx.obj
 
-    # Load nested transaction and submit to the aggregation server
+    # Load nested transactions and submit to the aggregation server
     nested_snark = cmd_ctx.get_nested_snark()
-    nested_tx = load_nested_transaction(nested_snark, tx_file)
     aggregator_client = cmd_ctx.get_aggregator_client()
-    aggregator_client.submit_nested_transaction(nested_snark, nested_tx)
+    if len(tx_files) == 1:
+        nested_tx = load_nested_transaction(nested_snark, tx_files[0])
+        aggregator_client.submit_nested_transaction(nested_snark, nested_tx)
+        return
+
+    # Stream several transactions in a single call.
+    nested_txs = (
+        load_nested_transaction(nested_snark, tx_file)
+        for tx_file in tx_files)
+    summary = aggregator_client.submit_nested_transactions(
+        nested_snark, nested_txs)
+    for tx_file, result in zip(tx_files, summary.results):
+        outcome = aggregator_pb2.SubmissionOutcome.Name(result.outcome)
+        print(f"{tx_file}: {outcome} {result.reason}".rstrip())
+    if summary.num_not_accepted != 0:
+        raise ClickException(
+            f"{summary.num_not_accepted} transaction(s) not accepted")
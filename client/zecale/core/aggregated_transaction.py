@@ -4,7 +4,7 @@
 
 from __future__ import annotations
 from zeth.core.zksnark import IZKSnarkProvider, ExtendedProof
-from typing import Dict, List, Any
+from typing import Dict, List, Optional, Any
 
 
 class AggregatedTransaction:
@@ -15,10 +15,16 @@ class AggregatedTransaction:
             self,
             app_name: str,
             ext_proof: ExtendedProof,
-            nested_parameters: List[bytes]):
+            nested_parameters: List[bytes],
+            num_nested_txs: Optional[int] = None):
         self.app_name = app_name
         self.ext_proof = ext_proof
+        # One entry per slot of the batch (empty for padding slots).
         self.nested_parameters = nested_parameters
+        # Number of slots holding real nested transactions (the remaining
+        # slots hold padding proofs).
+        self.num_nested_txs = num_nested_txs \
+            if num_nested_txs is not None else len(nested_parameters)
 
     @staticmethod
     def from_json_dict(
@@ -28,11 +34,14 @@ class AggregatedTransaction:
         ext_proof = ExtendedProof.from_json_dict(zksnark, json_dict["ext_proof"])
         nested_parameters = \
             [bytes.fromhex(x) for x in json_dict["nested_parameters"]]
-        return AggregatedTransaction(app_name, ext_proof, nested_parameters)
+        num_nested_txs = json_dict.get("num_nested_txs", None)
+        return AggregatedTransaction(
+            app_name, ext_proof, nested_parameters, num_nested_txs)
 
     def to_json_dict(self) -> Dict[str, Any]:
         return {
             "app_name": self.app_name,
             "ext_proof": self.ext_proof.to_json_dict(),
             "nested_parameters":  [x.hex() for x in self.nested_parameters],
+            "num_nested_txs": self.num_nested_txs,
         }
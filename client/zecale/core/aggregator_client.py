@@ -12,6 +12,7 @@ from zecale.core.proto_utils import aggregator_configuration_from_proto, \
 from zeth.core.zksnark import IZKSnarkProvider, IVerificationKey
 import grpc
 from google.protobuf import empty_pb2
+from typing import Iterable
 import json
 
 
@@ -29,11 +30,31 @@ class AggregatorClient:
             config_proto = stub.GetConfiguration(empty_pb2.Empty())
             return aggregator_configuration_from_proto(config_proto)
 
+    def get_readiness(self) -> aggregator_pb2.Readiness:
+        """
+        Query whether the server has loaded its keypairs, and the progress of
+        loading (or generating) them if not.
+        """
+        with grpc.insecure_channel(self.endpoint) as channel:
+            stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
+            return stub.GetReadiness(empty_pb2.Empty())
+
     def get_verification_key(
-            self, wrapper_zksnark: IZKSnarkProvider) -> IVerificationKey:
+            self,
+            wrapper_zksnark: IZKSnarkProvider,
+            batch_size: int = 0) -> IVerificationKey:
+        """
+        Get the aggregator verification key for the given batch size (or for
+        the default batch size of the server, if batch_size is 0).
+        """
         with grpc.insecure_channel(self.endpoint) as channel:
             stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
-            vk_proto = stub.GetVerificationKey(empty_pb2.Empty())
+            if batch_size == 0:
+                vk_proto = stub.GetVerificationKey(empty_pb2.Empty())
+            else:
+                vk_request = aggregator_pb2.BatchVerificationKeyRequest()
+                vk_request.batch_size = batch_size
+                vk_proto = stub.GetBatchVerificationKey(vk_request)
             return wrapper_zksnark.verification_key_from_proto(vk_proto)
 
     def get_nested_verification_key_hash(
@@ -48,13 +69,16 @@ class AggregatorClient:
             self,
             nested_zksnark: IZKSnarkProvider,
             vk: IVerificationKey,
-            app_name: str) -> None:
+            app_name: str,
+            max_batch_wait_ms: int = 0) -> None:
         """
         Register an application. Throw an error with message if this fails for any
-        reason.
+        reason. `max_batch_wait_ms` is the maximum time that transactions should
+        wait before being aggregated (if 0, the server default is used).
         """
         app_desc = aggregator_pb2.ApplicationDescription()
         app_desc.application_name = app_name
+        app_desc.max_batch_wait_ms = max_batch_wait_ms
         app_desc.vk.CopyFrom(nested_zksnark.verification_key_to_proto(vk)) \
             # pylint: disable=no-member
         with grpc.insecure_channel(self.endpoint) as channel:
@@ -75,16 +99,94 @@ class AggregatorClient:
             stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
             stub.SubmitNestedTransaction(nested_tx_proto)
 
+    def submit_nested_transactions(
+            self,
+            nested_zksnark: IZKSnarkProvider,
+            nested_txs: Iterable[NestedTransaction]
+    ) -> aggregator_pb2.SubmissionSummary:
+        """
+        Submit several nested transactions to the aggregator, in a single
+        call. Returns the outcome for each transaction (in order).
+        """
+        assert isinstance(nested_zksnark, IZKSnarkProvider)
+        nested_tx_protos = (
+            nested_transaction_to_proto(nested_zksnark, nested_tx)
+            for nested_tx in nested_txs)
+        with grpc.insecure_channel(self.endpoint) as channel:
+            stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
+            return stub.SubmitNestedTransactions(nested_tx_protos)
+
+    def get_pool_status(self, name: str) -> aggregator_pb2.PoolStatus:
+        """
+        Query the occupancy of the pool for an application, and the minimum
+        fee required for a transaction to be accepted.
+        """
+        request = aggregator_pb2.PoolStatusRequest()
+        request.application_name = name
+        with grpc.insecure_channel(self.endpoint) as channel:
+            stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
+            return stub.GetPoolStatus(request)
+
+    def get_metrics(self) -> aggregator_pb2.Metrics:
+        """
+        Query the current values of the server metrics.
+        """
+        with grpc.insecure_channel(self.endpoint) as channel:
+            stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
+            return stub.GetMetrics(empty_pb2.Empty())
+
     def get_aggregated_transaction(
             self,
             wrapper_zksnark: IZKSnarkProvider,
-            name: str) -> AggregatedTransaction:
+            name: str,
+            batch_size: int = 0,
+            allow_partial: bool = False) -> AggregatedTransaction:
         """
-        Request an aggregated transaction.
+        Request an aggregated transaction. If batch_size is 0, the server uses
+        the largest batch size that can be filled from the pool. If
+        allow_partial is set, the server may pad the batch with dummy proofs
+        when the pool cannot fill it.
         """
         agg_tx_request = aggregator_pb2.AggregatedTransactionRequest()
         agg_tx_request.application_name = name
+        agg_tx_request.batch_size = batch_size
+        agg_tx_request.allow_partial = allow_partial
         with grpc.insecure_channel(self.endpoint) as channel:
             stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
             agg_tx_proto = stub.GenerateAggregatedTransaction(agg_tx_request)
         return aggregated_transaction_from_proto(wrapper_zksnark, agg_tx_proto)
+
+    def request_batch(
+            self,
+            name: str,
+            batch_size: int = 0,
+            allow_partial: bool = False) -> int:
+        """
+        Request that a batch be aggregated in the background. Returns the id of
+        the batch, to be passed to `wait_batch`.
+        """
+        agg_tx_request = aggregator_pb2.AggregatedTransactionRequest()
+        agg_tx_request.application_name = name
+        agg_tx_request.batch_size = batch_size
+        agg_tx_request.allow_partial = allow_partial
+        with grpc.insecure_channel(self.endpoint) as channel:
+            stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
+            return stub.SubmitBatchRequest(agg_tx_request).batch_id
+
+    def wait_batch(
+            self,
+            wrapper_zksnark: IZKSnarkProvider,
+            batch_id: int) -> AggregatedTransaction:
+        """
+        Wait for a batch requested via `request_batch` and return the
+        aggregated transaction. Throws if aggregation of the batch failed.
+        """
+        batch_id_proto = aggregator_pb2.BatchId()
+        batch_id_proto.batch_id = batch_id
+        with grpc.insecure_channel(self.endpoint) as channel:
+            stub = aggregator_pb2_grpc.AggregatorStub(channel)  # type: ignore
+            status = stub.WaitBatch(batch_id_proto)
+        if status.state != aggregator_pb2.BATCH_DONE:
+            raise Exception(f"batch {batch_id} failed: {status.error}")
+        return aggregated_transaction_from_proto(
+            wrapper_zksnark, status.aggregated_transaction)
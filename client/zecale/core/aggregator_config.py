@@ -5,26 +5,28 @@
 from __future__ import annotations
 from zeth.core.pairing import PairingParameters
 from zeth.core.zksnark import get_zksnark_provider
-from typing import Dict, Any, cast
+from typing import Dict, List, Any, cast
 
 
 class AggregatorConfiguration:
     """
-    The configuration (snarks and pairing parameters) to be used for
-    aggregation.
+    The configuration (snarks, pairing parameters and supported batch sizes) to
+    be used for aggregation.
     """
     def __init__(
             self,
             nested_snark_name: str,
             wrapper_snark_name: str,
             nested_pairing_parameters: PairingParameters,
-            wrapper_pairing_parameters: PairingParameters):
+            wrapper_pairing_parameters: PairingParameters,
+            batch_sizes: List[int]):
         self.nested_snark_name = nested_snark_name
         self.wrapper_snark_name = wrapper_snark_name
         self.nested_snark = get_zksnark_provider(nested_snark_name)
         self.wrapper_snark = get_zksnark_provider(wrapper_snark_name)
         self.nested_pairing_parameters = nested_pairing_parameters
         self.wrapper_pairing_parameters = wrapper_pairing_parameters
+        self.batch_sizes = batch_sizes
 
     def to_json_dict(self) -> Dict[str, Any]:
         return {
@@ -33,7 +35,8 @@ class AggregatorConfiguration:
             "nested_pairing_parameters":
             self.nested_pairing_parameters.to_json_dict(),
             "wrapper_pairing_parameters":
-            self.wrapper_pairing_parameters.to_json_dict()
+            self.wrapper_pairing_parameters.to_json_dict(),
+            "batch_sizes": self.batch_sizes,
         }
 
     @staticmethod
@@ -44,4 +47,5 @@ class AggregatorConfiguration:
             nested_pairing_parameters=PairingParameters.from_json_dict(
                 json_dict["nested_pairing_parameters"]),
             wrapper_pairing_parameters=PairingParameters.from_json_dict(
-                json_dict["wrapper_pairing_parameters"]))
+                json_dict["wrapper_pairing_parameters"]),
+            batch_sizes=cast(List[int], json_dict.get("batch_sizes", [])))
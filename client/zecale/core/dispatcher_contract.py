@@ -40,12 +40,15 @@ class DispatcherContract:
             zksnark: IZKSnarkProvider,
             pp: PairingParameters,
             vk: IVerificationKey,
+            batch_size: int,
             eth_addr: str,
             eth_private_key: Optional[bytes]
     ) -> Tuple[DispatcherContract, InstanceDescription]:
         """
-        Deploy the contract, returning an instance of this wrapper, and a
-        description (which can be saved to a file to later instantiate).
+        Deploy the contract for batches of `batch_size` nested proofs (`vk`
+        must be the aggregator verification key for this batch size),
+        returning an instance of this wrapper, and a description (which can be
+        saved to a file to later instantiate).
         """
         vk_evm = zksnark.verification_key_to_contract_parameters(vk, pp)
         instance_desc = InstanceDescription.deploy(
@@ -56,7 +59,7 @@ class DispatcherContract:
             eth_private_key,
             DISPATCHER_DEPLOY_GAS,
             {"allow_paths": CONTRACTS_DIR},
-            [vk_evm])
+            [vk_evm, batch_size])
         return DispatcherContract(web3, instance_desc, zksnark), instance_desc
 
     def process_batch(
@@ -6,8 +6,9 @@ from zecale.core.aggregated_transaction import AggregatedTransaction
 from zecale.core.aggregator_config import AggregatorConfiguration
 from zecale.core.nested_transaction import NestedTransaction
 from zecale.api import aggregator_pb2
-from zeth.core.zksnark import IZKSnarkProvider
+from zeth.core.zksnark import IZKSnarkProvider, ExtendedProof
 from zeth.core.pairing import pairing_parameters_from_proto
+from typing import Dict, List, Union, Any
 
 
 def aggregator_configuration_from_proto(
@@ -19,7 +20,8 @@ def aggregator_configuration_from_proto(
         nested_pairing_parameters=pairing_parameters_from_proto(
             aggregator_config_proto.nested_pairing_parameters),
         wrapper_pairing_parameters=pairing_parameters_from_proto(
-            aggregator_config_proto.wrapper_pairing_parameters))
+            aggregator_config_proto.wrapper_pairing_parameters),
+        batch_sizes=list(aggregator_config_proto.batch_sizes))
 
 
 def nested_transaction_to_proto(
@@ -47,4 +49,67 @@ def aggregated_transaction_from_proto(
     extproof = zksnark.extended_proof_from_proto(
         aggregated_transaction_proto.extended_proof)
     nested_parameters = list(aggregated_transaction_proto.nested_parameters)
-    return AggregatedTransaction(app_name, extproof, nested_parameters)
+    return AggregatedTransaction(
+        app_name,
+        extproof,
+        nested_parameters,
+        aggregated_transaction_proto.num_nested_transactions)
+
+
+def field_element_to_bytes(value: int, modulus: int) -> bytes:
+    """
+    Encode an element of the prime field with the given modulus, in the binary
+    encoding (see ProofEncoding in aggregator.proto). That is, the Montgomery
+    form of the element as 64-bit limbs, least-significant first.
+    """
+    if not 0 <= value < modulus:
+        raise ValueError(f"field element out of range: {value}")
+    num_limbs = (modulus.bit_length() + 63) // 64
+    montgomery = (value << (64 * num_limbs)) % modulus
+    return montgomery.to_bytes(8 * num_limbs, byteorder="little")
+
+
+def group_element_to_bytes(
+        point: List[Union[str, List[str]]], field_q: int) -> bytes:
+    """
+    Encode a group element, given as the list of (hex) affine coordinates used
+    in the JSON representation of proofs. Coordinates in extension fields are
+    lists of coefficients.
+    """
+    def _coordinate_to_bytes(coordinate: Union[str, List[str]]) -> bytes:
+        coefficients = [coordinate] if isinstance(coordinate, str) \
+            else coordinate
+        return b"".join(
+            [field_element_to_bytes(int(c, 16), field_q)
+             for c in coefficients])
+
+    if len(point) != 2:
+        raise ValueError("expected affine coordinates")
+    return b"".join([_coordinate_to_bytes(c) for c in point])
+
+
+def groth16_extended_proof_json_to_bytes(
+        ext_proof_json: Dict[str, Any], field_q: int, field_r: int) -> bytes:
+    """
+    Encode the JSON representation of a Groth16 extended proof, in the binary
+    encoding. `field_q` and `field_r` are the moduli of the base and scalar
+    fields of the nested pairing.
+    """
+    proof = ext_proof_json["proof"]
+    inputs = ext_proof_json["inputs"]
+    return \
+        group_element_to_bytes(proof["a"], field_q) + \
+        group_element_to_bytes(proof["b"], field_q) + \
+        group_element_to_bytes(proof["c"], field_q) + \
+        len(inputs).to_bytes(8, byteorder="little") + \
+        b"".join([field_element_to_bytes(int(x, 16), field_r) for x in inputs])
+
+
+def groth16_extended_proof_to_bytes(
+        ext_proof: ExtendedProof, field_q: int, field_r: int) -> bytes:
+    """
+    Encode a Groth16 extended proof, for the `extended_proof_bytes` field of
+    NestedTransaction.
+    """
+    return groth16_extended_proof_json_to_bytes(
+        ext_proof.to_json_dict(), field_q, field_r)
@@ -25,10 +25,13 @@ import "./IZecaleApplication.sol";
 
 contract ZecaleDispatcher
 {
-    uint256 constant batch_size = 2;
-
     uint256 constant scalar_size_in_words = 2;
 
+    // Number of nested proofs per batch. Each batch size has its own
+    // aggregator verification key, so a dispatcher instance is deployed for
+    // each batch size in use.
+    uint256 _batch_size;
+
     // Verification key
     uint256[] _vk;
 
@@ -38,14 +41,20 @@ contract ZecaleDispatcher
     // Number of inputs per nested proof (note that this includes the result)
     uint256 _inputs_per_nested_tx;
 
-    // Constructor for Zecale contract. Initializes the batch verification key.
-    // `vk` is passed as the verification key encoded as uint256 array, in the
-    // format described in Groth16BW6_761.sol.
-    constructor(uint256[] memory vk) public
+    // Constructor for Zecale contract. Initializes the batch verification key
+    // and batch size. `vk` is passed as the verification key encoded as
+    // uint256 array, in the format described in Groth16BW6_761.sol, and must
+    // be the aggregator key for batches of `batch_size` nested proofs.
+    constructor(uint256[] memory vk, uint256 batch_size) public
     {
+        require(batch_size > 0, "invalid batch size");
         _vk = vk;
+        _batch_size = batch_size;
         // Compute expected inputs per batch (-2 for vk_hash and results)
         _total_inputs = Groth16BW6_761.num_inputs_from_vk_length(vk.length);
+        require(
+            (_total_inputs - 2) % batch_size == 0,
+            "vk does not match batch size");
         _inputs_per_nested_tx = (_total_inputs - 2) / batch_size;
     }
 
@@ -76,6 +85,11 @@ contract ZecaleDispatcher
     // `nested_parameters` are the extra parameters required by the application
     // contract (the application contract is responsible for "binding" these to
     // the nested inputs to the nested proofs).
+    //
+    // A batch may be partially filled, in which case the remaining slots hold
+    // padding proofs, whose result bits are 0 (and whose entries in
+    // `nested_parameters` are empty). As for invalid nested proofs, these
+    // slots are skipped.
     function process_batch(
         uint256[18] memory batch_proof,
         uint256[] memory inputs,
@@ -95,7 +109,7 @@ contract ZecaleDispatcher
             inputs.length == _total_inputs * scalar_size_in_words,
             "invalid inputs length");
         require(
-            nested_parameters.length == batch_size,
+            nested_parameters.length == _batch_size,
             "invalid nested_parameters length");
 
         // Verify the wrapped proof.
@@ -122,13 +136,14 @@ contract ZecaleDispatcher
         uint256 results = inputs[3];
 
         // Pass the details of each valid proof to the application
-        for (uint256 nested_tx_idx = 0; nested_tx_idx < batch_size;
+        for (uint256 nested_tx_idx = 0; nested_tx_idx < _batch_size;
              ++nested_tx_idx) {
 
             uint256 result = results & 0x1;
             results = results >> 1;
 
-            // Skip nested transactions whose proofs are invalid.
+            // Skip nested transactions whose proofs are invalid (including
+            // padding slots).
             // emit log("result", result);
             if (result == 0) {
                 continue;
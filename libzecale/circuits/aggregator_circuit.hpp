@@ -5,6 +5,7 @@
 #ifndef __ZECALE_CORE_AGGREGATOR_CIRCUIT_HPP__
 #define __ZECALE_CORE_AGGREGATOR_CIRCUIT_HPP__
 
+#include "libzecale/circuits/aggregator_circuit_interface.hpp"
 #include "libzecale/circuits/aggregator_gadget.hpp"
 #include "libzecale/circuits/verification_key_hash_gadget.hpp"
 
@@ -29,8 +30,28 @@ namespace libzecale
 ///   N = NumProofs,
 ///   packed_results = verification result for all proofs, represented as bits
 ///   nested_inputs[i][j] = j-th input to i-th proof,
+///
+/// A circuit can be constructed either with its own constraint system (as
+/// required to generate the trusted setup), or as a "witness-only" context,
+/// which allocates the same variables and gadgets but generates no
+/// constraints, and refers to an existing (immutable) constraint system, such
+/// as the one held by the proving key. Witness-only contexts therefore only
+/// cost their witness assignment, so that many of them can share a single
+/// constraint system to generate proofs concurrently.
+///
+/// Partial batches are supported by filling the free slots with a padding
+/// proof: an (invalid) proof made up of the group generators, with all inputs
+/// set to zero. The verification result for these slots is therefore 0, and
+/// callers are expected to ignore them.
+///
+/// Variables (and linear combinations) whose values depend only on the nested
+/// verification key are allocated in a few contiguous ranges, which are
+/// recorded at construction. This allows the corresponding part of the witness
+/// to be computed once per application (see compute_nested_vk_witness), and
+/// copied into the protoboard for each batch.
 template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
 class aggregator_circuit
+    : public aggregator_circuit_interface<wppT, wsnarkT, nverifierT>
 {
 private:
     using npp = libsnark::other_curve<wppT>;
@@ -38,11 +59,24 @@ private:
     using verification_key_variable_gadget =
         typename nverifierT::verification_key_variable_gadget;
     using proof_variable_gadget = typename nverifierT::proof_variable_gadget;
+    using process_verification_key_gadget =
+        typename nverifierT::process_verification_key_gadget;
+    using processed_verification_key_variable_gadget =
+        typename nverifierT::processed_verification_key_variable_gadget;
+    using index_range = std::pair<size_t, size_t>;
 
     const size_t _num_inputs_per_nested_proof;
 
+    /// Proof used to fill the unused slots of partial batches.
+    const libzeth::extended_proof<npp, nsnark> _padding_proof;
+
     libsnark::protoboard<libff::Fr<wppT>> _pb;
 
+    /// Shared constraint system for witness-only contexts (nullptr if the
+    /// constraints are held in _pb).
+    const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
+        *_constraint_system;
+
     /// (Primary) Variable holding the hash of the verification key for nested
     /// proofs. Verified against the actual verification key values, by the
     /// _nested_vk_hash_gadget.
@@ -81,6 +115,12 @@ private:
     std::shared_ptr<verification_key_hash_gadget<wppT, nverifierT>>
         _nested_vk_hash_gadget;
 
+    /// (Auxiliary) Processed form of _nested_vk, used by the verifiers.
+    processed_verification_key_variable_gadget _nested_processed_vk;
+
+    /// Gadget to compute _nested_processed_vk from _nested_vk.
+    std::shared_ptr<process_verification_key_gadget> _nested_vk_processor;
+
     /// Gadget to aggregate proofs.
     std::shared_ptr<aggregator_gadget<wppT, nverifierT, NumProofs>>
         _aggregator_gadget;
@@ -89,20 +129,69 @@ private:
     std::shared_ptr<libsnark::packing_gadget<libff::Fr<wppT>>>
         _nested_proof_results_packer;
 
+    /// Ranges [begin, end) of the indices of variables and linear
+    /// combinations, whose values depend only on the nested verification key.
+    std::vector<index_range> _nested_vk_variable_ranges;
+    std::vector<index_range> _nested_vk_lc_ranges;
+
+    /// Index of the next variable to be allocated on _pb.
+    size_t next_variable_index() const;
+
+    /// Index of the next linear combination to be allocated on _pb. (The
+    /// protoboard does not expose its counter, so an unused linear
+    /// combination is allocated, and the index following it is returned.)
+    size_t next_lc_index();
+
+    /// Record that all variables and linear combinations allocated since
+    /// the given indices depend only on the nested verification key.
+    void add_nested_vk_ranges(size_t variable_begin, size_t lc_begin);
+
+    /// Witness the nested verification key, its hash and processed form.
+    void generate_nested_vk_witness(
+        const typename nsnark::verification_key &nested_vk);
+
+    /// Copy a previously computed nested_vk_witness into _pb.
+    void set_nested_vk_witness(const nested_vk_witness<wppT> &vk_witness);
+
+    /// Fill the free slots of a batch with the padding proof.
+    std::array<const libzeth::extended_proof<npp, nsnark> *, NumProofs>
+    pad_batch(const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+                  &extended_proofs) const;
+
+    /// Witness the nested proofs and generate the proof, assuming the nested
+    /// verification key has already been witnessed.
+    extended_proof<wppT, wsnarkT> prove_batch(
+        const std::array<
+            const libzeth::extended_proof<npp, nsnark> *,
+            NumProofs> &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key);
+
 public:
-    explicit aggregator_circuit(const size_t inputs_per_nested_proof);
+    /// Construct the circuit. If `constraint_system` is nullptr, the
+    /// constraints are generated and held by this object. Otherwise, a
+    /// witness-only context is created, which refers to `constraint_system`
+    /// (which must outlive this object, and must have been generated by a
+    /// circuit of the same type and parameters).
+    explicit aggregator_circuit(
+        const size_t inputs_per_nested_proof,
+        const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
+            *constraint_system = nullptr);
 
     aggregator_circuit(const aggregator_circuit &other) = delete;
     const aggregator_circuit &operator=(const aggregator_circuit &other) =
         delete;
 
-    typename wsnarkT::keypair generate_trusted_setup() const;
+    size_t batch_size() const override;
+
+    /// Generate the keypair. Only valid for circuits which hold their own
+    /// constraint system.
+    typename wsnarkT::keypair generate_trusted_setup() const override;
 
     // Number of primary inputs to the wrapping circuit
-    size_t num_primary_inputs() const;
+    size_t num_primary_inputs() const override;
 
     const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
-        &get_constraint_system() const;
+        &get_constraint_system() const override;
 
     /// Generate a proof and returns an extended proof
     extended_proof<wppT, wsnarkT> prove(
@@ -111,6 +200,24 @@ public:
             const libzeth::extended_proof<npp, nsnark> *,
             NumProofs> &extended_proofs,
         const typename wsnarkT::proving_key &aggregator_proving_key);
+
+    /// Generate a proof for a batch held in a vector, of between 1 and
+    /// NumProofs entries. Any remaining slots are filled with the padding
+    /// proof.
+    extended_proof<wppT, wsnarkT> prove(
+        const typename nsnark::verification_key &nested_vk,
+        const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+            &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key) override;
+
+    nested_vk_witness<wppT> compute_nested_vk_witness(
+        const typename nsnark::verification_key &nested_vk) override;
+
+    extended_proof<wppT, wsnarkT> prove(
+        const nested_vk_witness<wppT> &vk_witness,
+        const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+            &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key) override;
 };
 
 } // namespace libzecale
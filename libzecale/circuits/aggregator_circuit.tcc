@@ -16,8 +16,16 @@ namespace libzecale
 
 template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
 aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::aggregator_circuit(
-    const size_t inputs_per_nested_proof)
-    : _num_inputs_per_nested_proof(inputs_per_nested_proof), _pb()
+    const size_t inputs_per_nested_proof,
+    const libsnark::r1cs_constraint_system<libff::Fr<wppT>> *constraint_system)
+    : _num_inputs_per_nested_proof(inputs_per_nested_proof)
+    , _padding_proof(
+          // Default-constructed proofs hold the group generators.
+          typename nsnark::proof(),
+          libsnark::r1cs_primary_input<libff::Fr<npp>>(
+              inputs_per_nested_proof, libff::Fr<npp>::zero()))
+    , _pb()
+    , _constraint_system(constraint_system)
 {
     // The order of allocation here is important as it determines which inputs
     // are primary.
@@ -47,9 +55,16 @@ aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::aggregator_circuit(
             _pb, FMT("", "_nested_proof_results[%zu]", i));
     }
 
+    // The hash of the nested verification key is the first primary input.
+    _nested_vk_variable_ranges.push_back(
+        index_range(_nested_vk_hash.index, _nested_vk_hash.index + 1));
+
     // Allocate vk and the intermediate bit representation
+    size_t vk_variable_begin = next_variable_index();
+    size_t vk_lc_begin = next_lc_index();
     _nested_vk.reset(new verification_key_variable_gadget(
         _pb, _num_inputs_per_nested_proof, "_nested_vk"));
+    add_nested_vk_ranges(vk_variable_begin, vk_lc_begin);
 
     // Allocate proof variables.
     for (size_t i = 0; i < NumProofs; i++) {
@@ -57,18 +72,26 @@ aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::aggregator_circuit(
             new proof_variable_gadget(_pb, FMT("", "_nested_proofs[%zu]", i)));
     }
 
-    // Nested verification key hash gadget
+    // Nested verification key hash gadget, and processed verification key.
+    // The variables for these are allocated consecutively, and depend only on
+    // the nested verification key.
+    vk_variable_begin = next_variable_index();
+    vk_lc_begin = next_lc_index();
     _nested_vk_hash_gadget.reset(
         new verification_key_hash_gadget<wppT, nverifierT>(
             _pb,
             *_nested_vk,
             _nested_vk_hash,
             FMT("", "_nested_vk_hash_gadget")));
+    _nested_vk_processor.reset(new process_verification_key_gadget(
+        _pb, *_nested_vk, _nested_processed_vk, "_nested_vk_processor"));
+    add_nested_vk_ranges(vk_variable_begin, vk_lc_begin);
 
     // Aggregator gadget
     _aggregator_gadget.reset(new aggregator_gadget<wppT, nverifierT, NumProofs>(
         _pb,
-        *_nested_vk,
+        _nested_processed_vk,
+        _num_inputs_per_nested_proof,
         _nested_primary_inputs,
         _nested_proofs,
         _nested_proof_results_unpacked,
@@ -88,15 +111,34 @@ aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::aggregator_circuit(
             _nested_proof_results,
             "_nested_proof_results_packer"));
 
+    // A witness-only context shares the constraints generated by another
+    // instance. Ensure the variable layout is consistent with them.
+    if (_constraint_system != nullptr) {
+        if (_pb.num_variables() != _constraint_system->num_variables() ||
+            total_primary_inputs != _constraint_system->num_inputs()) {
+            throw std::invalid_argument(
+                "constraint system does not match aggregator circuit");
+        }
+        return;
+    }
+
     // Initialize all constraints in the circuit.
     for (size_t i = 0; i < NumProofs; ++i) {
         _nested_proofs[i]->generate_r1cs_constraints();
     }
     _nested_vk_hash_gadget->generate_r1cs_constraints();
+    _nested_vk_processor->generate_r1cs_constraints();
     _aggregator_gadget->generate_r1cs_constraints();
     _nested_proof_results_packer->generate_r1cs_constraints(false);
 }
 
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+size_t aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::batch_size()
+    const
+{
+    return NumProofs;
+}
+
 template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
 typename wsnarkT::keypair aggregator_circuit<
     wppT,
@@ -104,6 +146,11 @@ typename wsnarkT::keypair aggregator_circuit<
     nverifierT,
     NumProofs>::generate_trusted_setup() const
 {
+    if (_constraint_system != nullptr) {
+        throw std::runtime_error(
+            "cannot generate setup from witness-only aggregator circuit");
+    }
+
     // Generate a verification and proving key (trusted setup)
     return wsnarkT::generate_setup(_pb);
 }
@@ -113,6 +160,9 @@ const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
     &aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::
         get_constraint_system() const
 {
+    if (_constraint_system != nullptr) {
+        return *_constraint_system;
+    }
     return _pb.get_constraint_system();
 }
 
@@ -128,6 +178,189 @@ libzeth::extended_proof<wppT, wsnarkT> aggregator_circuit<
             const libzeth::extended_proof<npp, nsnark> *,
             NumProofs> &extended_proofs,
         const typename wsnarkT::proving_key &aggregator_proving_key)
+{
+    generate_nested_vk_witness(nested_vk);
+    return prove_batch(extended_proofs, aggregator_proving_key);
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+libzeth::extended_proof<wppT, wsnarkT> aggregator_circuit<
+    wppT,
+    wsnarkT,
+    nverifierT,
+    NumProofs>::
+    prove(
+        const typename nsnark::verification_key &nested_vk,
+        const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+            &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key)
+{
+    return prove(nested_vk, pad_batch(extended_proofs), aggregator_proving_key);
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+nested_vk_witness<wppT> aggregator_circuit<
+    wppT,
+    wsnarkT,
+    nverifierT,
+    NumProofs>::
+    compute_nested_vk_witness(
+        const typename nsnark::verification_key &nested_vk)
+{
+    generate_nested_vk_witness(nested_vk);
+
+    nested_vk_witness<wppT> vk_witness;
+    for (const index_range &range : _nested_vk_variable_ranges) {
+        for (size_t idx = range.first; idx < range.second; ++idx) {
+            vk_witness.variable_values.push_back(
+                _pb.val(libsnark::pb_variable<libff::Fr<wppT>>(idx)));
+        }
+    }
+
+    libsnark::pb_linear_combination<libff::Fr<wppT>> lc;
+    for (const index_range &range : _nested_vk_lc_ranges) {
+        for (size_t idx = range.first; idx < range.second; ++idx) {
+            lc.index = idx;
+            vk_witness.lc_values.push_back(_pb.lc_val(lc));
+        }
+    }
+
+    return vk_witness;
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+libzeth::extended_proof<wppT, wsnarkT> aggregator_circuit<
+    wppT,
+    wsnarkT,
+    nverifierT,
+    NumProofs>::
+    prove(
+        const nested_vk_witness<wppT> &vk_witness,
+        const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+            &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key)
+{
+    set_nested_vk_witness(vk_witness);
+    return prove_batch(pad_batch(extended_proofs), aggregator_proving_key);
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+size_t aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::
+    next_variable_index() const
+{
+    // Variable 0 is reserved for ONE.
+    return _pb.num_variables() + 1;
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+size_t aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::
+    next_lc_index()
+{
+    libsnark::pb_linear_combination<libff::Fr<wppT>> probe;
+    probe.assign(_pb, libsnark::linear_combination<libff::Fr<wppT>>());
+    return probe.index + 1;
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+void aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::
+    add_nested_vk_ranges(size_t variable_begin, size_t lc_begin)
+{
+    _nested_vk_variable_ranges.push_back(
+        index_range(variable_begin, next_variable_index()));
+
+    // The unused linear combination allocated by next_lc_index is excluded
+    // from the range, so that it is not held in (or copied from) the
+    // nested_vk_witness.
+    _nested_vk_lc_ranges.push_back(
+        index_range(lc_begin, next_lc_index() - 1));
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+void aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::
+    generate_nested_vk_witness(
+        const typename nsnark::verification_key &nested_vk)
+{
+    // Witness the verification key
+    _nested_vk->generate_r1cs_witness(nested_vk);
+
+    // Witness hash of verification keypair
+    _nested_vk_hash_gadget->generate_r1cs_witness();
+
+    // Witness the processed verification key
+    _nested_vk_processor->generate_r1cs_witness();
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+void aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::
+    set_nested_vk_witness(const nested_vk_witness<wppT> &vk_witness)
+{
+    size_t num_variables = 0;
+    for (const index_range &range : _nested_vk_variable_ranges) {
+        num_variables += range.second - range.first;
+    }
+    size_t num_lcs = 0;
+    for (const index_range &range : _nested_vk_lc_ranges) {
+        num_lcs += range.second - range.first;
+    }
+    if (vk_witness.variable_values.size() != num_variables ||
+        vk_witness.lc_values.size() != num_lcs) {
+        throw std::invalid_argument(
+            "nested vk witness does not match aggregator circuit");
+    }
+
+    auto value_it = vk_witness.variable_values.begin();
+    for (const index_range &range : _nested_vk_variable_ranges) {
+        for (size_t idx = range.first; idx < range.second; ++idx) {
+            _pb.val(libsnark::pb_variable<libff::Fr<wppT>>(idx)) = *value_it++;
+        }
+    }
+
+    auto lc_value_it = vk_witness.lc_values.begin();
+    libsnark::pb_linear_combination<libff::Fr<wppT>> lc;
+    for (const index_range &range : _nested_vk_lc_ranges) {
+        for (size_t idx = range.first; idx < range.second; ++idx) {
+            lc.index = idx;
+            _pb.lc_val(lc) = *lc_value_it++;
+        }
+    }
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+std::array<
+    const libzeth::extended_proof<
+        libsnark::other_curve<wppT>,
+        typename nverifierT::snark> *,
+    NumProofs>
+aggregator_circuit<wppT, wsnarkT, nverifierT, NumProofs>::pad_batch(
+    const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+        &extended_proofs) const
+{
+    if (extended_proofs.empty() || extended_proofs.size() > NumProofs) {
+        throw std::invalid_argument("invalid number of proofs in batch");
+    }
+
+    // Fill any free slots with the padding proof.
+    std::array<const libzeth::extended_proof<npp, nsnark> *, NumProofs>
+        extended_proofs_array;
+    extended_proofs_array.fill(&_padding_proof);
+    std::copy(
+        extended_proofs.begin(),
+        extended_proofs.end(),
+        extended_proofs_array.begin());
+    return extended_proofs_array;
+}
+
+template<typename wppT, typename wsnarkT, typename nverifierT, size_t NumProofs>
+libzeth::extended_proof<wppT, wsnarkT> aggregator_circuit<
+    wppT,
+    wsnarkT,
+    nverifierT,
+    NumProofs>::
+    prove_batch(
+        const std::array<
+            const libzeth::extended_proof<npp, nsnark> *,
+            NumProofs> &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key)
 {
     // Witness the proofs and construct the array of primary inputs (in npp).
     // These will be used to populate _nested_primary_inputs.
@@ -144,12 +377,6 @@ libzeth::extended_proof<wppT, wsnarkT> aggregator_circuit<
         _nested_proofs[i]->generate_r1cs_witness(ep.get_proof());
     }
 
-    // Witness the verification key
-    _nested_vk->generate_r1cs_witness(nested_vk);
-
-    // Witness hash of verification keypair
-    _nested_vk_hash_gadget->generate_r1cs_witness();
-
     // Pass the input values (in npp) to the aggregator gadget.
     _aggregator_gadget->generate_r1cs_witness(nested_inputs);
 
@@ -158,7 +385,8 @@ libzeth::extended_proof<wppT, wsnarkT> aggregator_circuit<
 
 #ifdef DEBUG
     // Check the validity of the circuit.
-    bool is_valid_witness = _pb.is_satisfied();
+    bool is_valid_witness = get_constraint_system().is_satisfied(
+        _pb.primary_input(), _pb.auxiliary_input());
     std::cout << "*** [DEBUG] Satisfiability result: " << is_valid_witness
               << " ***" << std::endl;
 #endif
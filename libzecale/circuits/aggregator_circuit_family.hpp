@@ -0,0 +1,54 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_FAMILY_HPP__
+#define __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_FAMILY_HPP__
+
+#include "libzecale/circuits/aggregator_circuit.hpp"
+#include "libzecale/circuits/aggregator_circuit_interface.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace libzecale
+{
+
+/// A family of aggregator circuits, one for each of the batch sizes given as
+/// template parameters. Since the batch size is a compile-time parameter of
+/// aggregator_circuit, the set of supported sizes is fixed at compile-time,
+/// but the family allows a size to be selected at runtime (e.g. from the
+/// configuration of the aggregator server), returning circuits through the
+/// aggregator_circuit_interface.
+template<
+    typename wppT,
+    typename wsnarkT,
+    typename nverifierT,
+    size_t... BatchSizes>
+class aggregator_circuit_family
+{
+public:
+    using circuit_interface =
+        aggregator_circuit_interface<wppT, wsnarkT, nverifierT>;
+
+    /// All supported batch sizes, in the order of the template parameters.
+    static std::vector<size_t> batch_sizes();
+
+    static bool supports_batch_size(size_t batch_size);
+
+    /// Create an aggregator circuit for the given batch size. See the
+    /// constructor of aggregator_circuit for the meaning of
+    /// `constraint_system`. Throws std::invalid_argument if batch_size is not
+    /// supported.
+    static std::unique_ptr<circuit_interface> create(
+        size_t batch_size,
+        size_t inputs_per_nested_proof,
+        const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
+            *constraint_system = nullptr);
+};
+
+} // namespace libzecale
+
+#include "libzecale/circuits/aggregator_circuit_family.tcc"
+
+#endif // __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_FAMILY_HPP__
@@ -0,0 +1,149 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_FAMILY_TCC__
+#define __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_FAMILY_TCC__
+
+#include "libzecale/circuits/aggregator_circuit_family.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+// Recursion over the list of batch sizes, creating the circuit whose size
+// matches the requested one.
+template<
+    typename wppT,
+    typename wsnarkT,
+    typename nverifierT,
+    size_t... BatchSizes>
+class aggregator_circuit_family_helper;
+
+template<typename wppT, typename wsnarkT, typename nverifierT>
+class aggregator_circuit_family_helper<wppT, wsnarkT, nverifierT>
+{
+public:
+    static void batch_sizes(std::vector<size_t> &)
+    {
+        // No more batch sizes
+    }
+
+    static std::unique_ptr<
+        aggregator_circuit_interface<wppT, wsnarkT, nverifierT>>
+    create(
+        size_t,
+        size_t,
+        const libsnark::r1cs_constraint_system<libff::Fr<wppT>> *)
+    {
+        throw std::invalid_argument("unsupported batch size");
+    }
+};
+
+template<
+    typename wppT,
+    typename wsnarkT,
+    typename nverifierT,
+    size_t BatchSize,
+    size_t... BatchSizes>
+class aggregator_circuit_family_helper<
+    wppT,
+    wsnarkT,
+    nverifierT,
+    BatchSize,
+    BatchSizes...>
+{
+public:
+    using next = aggregator_circuit_family_helper<
+        wppT,
+        wsnarkT,
+        nverifierT,
+        BatchSizes...>;
+
+    static void batch_sizes(std::vector<size_t> &sizes)
+    {
+        sizes.push_back(BatchSize);
+        next::batch_sizes(sizes);
+    }
+
+    static std::unique_ptr<
+        aggregator_circuit_interface<wppT, wsnarkT, nverifierT>>
+    create(
+        size_t batch_size,
+        size_t inputs_per_nested_proof,
+        const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
+            *constraint_system)
+    {
+        if (batch_size == BatchSize) {
+            return std::unique_ptr<
+                aggregator_circuit_interface<wppT, wsnarkT, nverifierT>>(
+                new aggregator_circuit<wppT, wsnarkT, nverifierT, BatchSize>(
+                    inputs_per_nested_proof, constraint_system));
+        }
+
+        return next::create(
+            batch_size, inputs_per_nested_proof, constraint_system);
+    }
+};
+
+} // namespace internal
+
+template<
+    typename wppT,
+    typename wsnarkT,
+    typename nverifierT,
+    size_t... BatchSizes>
+std::vector<size_t> aggregator_circuit_family<
+    wppT,
+    wsnarkT,
+    nverifierT,
+    BatchSizes...>::batch_sizes()
+{
+    std::vector<size_t> sizes;
+    internal::aggregator_circuit_family_helper<
+        wppT,
+        wsnarkT,
+        nverifierT,
+        BatchSizes...>::batch_sizes(sizes);
+    return sizes;
+}
+
+template<
+    typename wppT,
+    typename wsnarkT,
+    typename nverifierT,
+    size_t... BatchSizes>
+bool aggregator_circuit_family<wppT, wsnarkT, nverifierT, BatchSizes...>::
+    supports_batch_size(size_t batch_size)
+{
+    const std::vector<size_t> sizes = batch_sizes();
+    return std::find(sizes.begin(), sizes.end(), batch_size) != sizes.end();
+}
+
+template<
+    typename wppT,
+    typename wsnarkT,
+    typename nverifierT,
+    size_t... BatchSizes>
+std::unique_ptr<aggregator_circuit_interface<wppT, wsnarkT, nverifierT>>
+aggregator_circuit_family<wppT, wsnarkT, nverifierT, BatchSizes...>::create(
+    size_t batch_size,
+    size_t inputs_per_nested_proof,
+    const libsnark::r1cs_constraint_system<libff::Fr<wppT>> *constraint_system)
+{
+    return internal::aggregator_circuit_family_helper<
+        wppT,
+        wsnarkT,
+        nverifierT,
+        BatchSizes...>::
+        create(batch_size, inputs_per_nested_proof, constraint_system);
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_FAMILY_TCC__
@@ -0,0 +1,68 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_INTERFACE_HPP__
+#define __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_INTERFACE_HPP__
+
+#include "libzecale/circuits/nested_vk_witness.hpp"
+
+#include <libsnark/gadgetlib1/gadgets/pairing/pairing_params.hpp>
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+#include <libzeth/core/extended_proof.hpp>
+#include <vector>
+
+namespace libzecale
+{
+
+/// Interface to an aggregator circuit, independent of the number of proofs
+/// in a batch. This allows aggregator circuits for several batch sizes
+/// (which are distinct types) to be selected and used at runtime.
+template<typename wppT, typename wsnarkT, typename nverifierT>
+class aggregator_circuit_interface
+{
+public:
+    using npp = libsnark::other_curve<wppT>;
+    using nsnark = typename nverifierT::snark;
+
+    virtual ~aggregator_circuit_interface() = default;
+
+    /// Number of nested proofs aggregated by the circuit
+    virtual size_t batch_size() const = 0;
+
+    /// Number of primary inputs to the wrapping circuit
+    virtual size_t num_primary_inputs() const = 0;
+
+    virtual typename wsnarkT::keypair generate_trusted_setup() const = 0;
+
+    virtual const libsnark::r1cs_constraint_system<libff::Fr<wppT>>
+        &get_constraint_system() const = 0;
+
+    /// Generate a proof for a batch of between 1 and `batch_size()` nested
+    /// proofs and return an extended proof. Any remaining slots in the batch
+    /// are filled with padding proofs (see aggregator_circuit).
+    virtual libzeth::extended_proof<wppT, wsnarkT> prove(
+        const typename nsnark::verification_key &nested_vk,
+        const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+            &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key) = 0;
+
+    /// Compute the part of the witness which depends only on the nested
+    /// verification key. The result can be passed to `prove` (for this or any
+    /// other circuit with the same parameters, regardless of batch size) to
+    /// avoid recomputing it for every batch.
+    virtual nested_vk_witness<wppT> compute_nested_vk_witness(
+        const typename nsnark::verification_key &nested_vk) = 0;
+
+    /// As above, using a witness for the nested verification key previously
+    /// returned by `compute_nested_vk_witness`.
+    virtual libzeth::extended_proof<wppT, wsnarkT> prove(
+        const nested_vk_witness<wppT> &vk_witness,
+        const std::vector<const libzeth::extended_proof<npp, nsnark> *>
+            &extended_proofs,
+        const typename wsnarkT::proving_key &aggregator_proving_key) = 0;
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_CIRCUITS_AGGREGATOR_CIRCUIT_INTERFACE_HPP__
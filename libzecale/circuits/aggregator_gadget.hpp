@@ -28,18 +28,18 @@ namespace libzecale
 /// In order to aggregate proofs, we require that the base field of the curve
 /// used in the nested proof (nppT here) be the scalar field for the wrapping
 /// pairing (wppT).
+///
+/// The processed form of the nested verification key is computed outside of
+/// this gadget (see aggregator_circuit), since it is fixed for a given
+/// application, and its witness can therefore be cached.
 template<typename wppT, typename nverifierT, size_t NumProofs>
 class aggregator_gadget : libsnark::gadget<libff::Fr<wppT>>
 {
 private:
     using npp = libsnark::other_curve<wppT>;
     using nsnark = typename nverifierT::snark;
-    using process_verification_key_gadget =
-        typename nverifierT::process_verification_key_gadget;
     using online_verifier_gadget = typename nverifierT::online_verifier_gadget;
     using proof_variable_gadget = typename nverifierT::proof_variable_gadget;
-    using verification_key_variable_gadget =
-        typename nverifierT::verification_key_variable_gadget;
     using processed_verification_key_variable_gadget =
         typename nverifierT::processed_verification_key_variable_gadget;
     using input_packing_gadget = libsnark::multipacking_gadget<libff::Fr<wppT>>;
@@ -48,8 +48,8 @@ private:
 
     // TODO: Remove unused variables
 
-    /// Processed verification key
-    processed_verification_key_variable_gadget processed_vk;
+    /// Processed verification key (witnessed by the caller)
+    const processed_verification_key_variable_gadget &processed_vk;
 
     // Required in order to generate the bit strings from instance value.
     std::array<libsnark::pb_variable_array<libff::Fr<wppT>>, NumProofs>
@@ -61,9 +61,6 @@ private:
     std::array<libsnark::pb_variable_array<libff::Fr<wppT>>, NumProofs>
         nested_primary_inputs_bits;
 
-    /// Verification key processor
-    process_verification_key_gadget vk_processor;
-
     /// Gadgets checking the binary representation of the nested inputs.
     std::vector<std::shared_ptr<input_packing_gadget>>
         nested_primary_input_packers;
@@ -74,7 +71,8 @@ private:
 public:
     aggregator_gadget(
         libsnark::protoboard<libff::Fr<wppT>> &pb,
-        const verification_key_variable_gadget &vk,
+        const processed_verification_key_variable_gadget &processed_vk,
+        const size_t num_inputs_per_nested_proof,
         const std::array<
             libsnark::pb_variable_array<libff::Fr<wppT>>,
             NumProofs> &inputs,
@@ -86,8 +84,8 @@ public:
 
     void generate_r1cs_constraints();
 
-    /// Set the wppT scalar variables based on the nested verification key,
-    /// proofs and inputs in nppT.
+    /// Set the wppT scalar variables based on the nested proofs and inputs in
+    /// nppT. The processed verification key must already be witnessed.
     void generate_r1cs_witness(
         const std::array<
             const libsnark::r1cs_primary_input<libff::Fr<npp>> *,
@@ -13,7 +13,8 @@ namespace libzecale
 template<typename wppT, typename nverifierT, size_t NumProofs>
 aggregator_gadget<wppT, nverifierT, NumProofs>::aggregator_gadget(
     libsnark::protoboard<libff::Fr<wppT>> &pb,
-    const verification_key_variable_gadget &vk,
+    const processed_verification_key_variable_gadget &processed_vk,
+    const size_t num_inputs_per_nested_proof,
     const std::array<libsnark::pb_variable_array<libff::Fr<wppT>>, NumProofs>
         &inputs,
     const std::array<std::shared_ptr<proof_variable_gadget>, NumProofs> &proofs,
@@ -21,11 +22,9 @@ aggregator_gadget<wppT, nverifierT, NumProofs>::aggregator_gadget(
         &proof_results,
     const std::string &annotation_prefix)
     : libsnark::gadget<libff::Fr<wppT>>(pb, annotation_prefix)
-    , num_inputs_per_nested_proof(vk.num_primary_inputs())
-    , processed_vk()
+    , num_inputs_per_nested_proof(num_inputs_per_nested_proof)
+    , processed_vk(processed_vk)
     , nested_primary_inputs(inputs)
-    , vk_processor(
-          pb, vk, processed_vk, FMT(annotation_prefix, " vk_processor"))
 {
     // Assert that a single input of a nested proof (element of
     // libff::Fr<nppT>) can be encoded in a single input of the wrapping proof
@@ -74,8 +73,6 @@ aggregator_gadget<wppT, nverifierT, NumProofs>::aggregator_gadget(
 template<typename wppT, typename nverifierT, size_t NumProofs>
 void aggregator_gadget<wppT, nverifierT, NumProofs>::generate_r1cs_constraints()
 {
-    vk_processor.generate_r1cs_constraints();
-
     // Generate constraints (including boolean-ness of the bit representations)
     // for input packers, nested proofs and the proof verifiers.
     for (size_t i = 0; i < NumProofs; i++) {
@@ -90,8 +87,6 @@ void aggregator_gadget<wppT, nverifierT, NumProofs>::generate_r1cs_witness(
         const libsnark::r1cs_primary_input<libff::Fr<npp>> *,
         NumProofs> &nested_inputs)
 {
-    vk_processor.generate_r1cs_witness();
-
     for (size_t i = 0; i < NumProofs; i++) {
         // Witness the nested_primary_inputs. This is done by input values are
         // of type libff::Fr<nppT>. They are converted to bit arrays to
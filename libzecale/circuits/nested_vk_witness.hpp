@@ -0,0 +1,38 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CIRCUITS_NESTED_VK_WITNESS_HPP__
+#define __ZECALE_CIRCUITS_NESTED_VK_WITNESS_HPP__
+
+#include <libff/algebra/curves/public_params.hpp>
+#include <vector>
+
+namespace libzecale
+{
+
+/// The part of the witness of an aggregator circuit which depends only on the
+/// nested verification key: the values of the variables (and linear
+/// combinations) for the verification key itself, its hash and the processed
+/// verification key. These are expensive to compute (requiring the key to be
+/// hashed and precomputations to be performed on its group elements), but are
+/// fixed for a given application. They can therefore be computed once (see
+/// aggregator_circuit::compute_nested_vk_witness) and copied into the
+/// protoboard for each batch.
+///
+/// The values are held in order of allocation, and do not depend on the batch
+/// size, so that a single nested_vk_witness can be used with aggregator
+/// circuits of any size (for the same wppT, nverifierT and number of inputs
+/// per nested proof).
+template<typename wppT> class nested_vk_witness
+{
+public:
+    using FieldT = libff::Fr<wppT>;
+
+    std::vector<FieldT> variable_values;
+    std::vector<FieldT> lc_values;
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_CIRCUITS_NESTED_VK_WITNESS_HPP__
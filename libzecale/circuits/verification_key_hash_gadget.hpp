@@ -40,6 +40,10 @@ public:
     void generate_r1cs_constraints();
     void generate_r1cs_witness();
 
+    /// Compute the hash of a verification key natively, without generating
+    /// the constraints of the hash gadget. The key is encoded as scalars by
+    /// the same verification_key_variable gadget as in the circuit, so that the
+    /// result matches the output of this gadget.
     // TODO: should not require the second parameter, but there is no generic
     // method to extract the number of inputs from the verification key.
     static FieldT compute_hash(
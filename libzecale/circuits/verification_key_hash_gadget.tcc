@@ -43,19 +43,16 @@ template<typename wppT, typename nverifierT>
 libff::Fr<wppT> verification_key_hash_gadget<wppT, nverifierT>::compute_hash(
     const typename nsnark::verification_key &vk, size_t num_inputs)
 {
+    // Only the verification key variables are required, in order to obtain
+    // the scalars which are hashed.
     libsnark::protoboard<FieldT> pb;
-    libsnark::pb_variable<libff::Fr<wppT>> nvk_hash;
-    nvk_hash.allocate(pb, "nvk_hash");
     verification_key_variable nvk(pb, num_inputs, "nvk");
-    libzecale::verification_key_hash_gadget<wppT, nverifierT> nvk_hash_gadget(
-        pb, nvk, nvk_hash, "nvk_hash_gadget");
-
-    nvk_hash_gadget.generate_r1cs_constraints();
-
     nvk.generate_r1cs_witness(vk);
-    nvk_hash_gadget.generate_r1cs_witness();
 
-    return pb.val(nvk_hash);
+    libsnark::pb_linear_combination_array<FieldT> nvk_scalars(
+        nvk.get_all_vars());
+    nvk_scalars.evaluate(pb);
+    return scalarHasherT::compute_hash(nvk_scalars.get_vals(pb));
 }
 
 } // namespace libzecale
@@ -6,34 +6,168 @@
 #define __ZECALE_CORE_APPLICATION_POOL_HPP__
 
 #include "nested_transaction.hpp"
+#include "pool_capacity.hpp"
 
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 
 namespace libzecale
 {
 
+/// Limits on the transactions held in an application_pool. A value of 0 means
+/// no limit.
+struct application_pool_limits {
+    /// Maximum number of transactions in the pool.
+    size_t max_transactions;
+
+    /// Maximum total size of the transactions in the pool (see
+    /// nested_transaction::size_bytes).
+    size_t max_bytes;
+
+    /// Time after which transactions expire (see
+    /// application_pool::remove_expired).
+    std::chrono::milliseconds tx_ttl;
+
+    application_pool_limits();
+};
+
 /// An `application_pool` represents the pool of proofs to be aggregated that
 /// are for the same relation.
 ///
 /// For example, we can have an `application_pool` to aggregate `Zeth` proofs
 /// and an other `aggregation_pool` to aggregate proofs for other type
 /// of statements.
-template<typename nppT, typename nsnarkT, size_t NumProofs>
+///
+/// All methods may be called concurrently. The pool is split into shards,
+/// each protected by its own mutex, and each submitting thread adds
+/// transactions to a single shard, so that concurrent submitters rarely
+/// contend. Extracting a batch locks all shards (always in the same order)
+/// and takes the highest-fee transactions across all of them.
+///
+/// The size of the pool may be bounded (see application_pool_limits), as may
+/// the total size of a group of pools (by passing them the same
+/// pool_capacity). When a transaction does not fit, lower-fee transactions
+/// are evicted to make room for it, or it is rejected if there are not
+/// enough of them. This is the only case in which all shards are locked when
+/// adding a transaction.
+template<typename nppT, typename nsnarkT>
 class application_pool
 {
 private:
-    /// Name/Identifier of the application (E.g. "zeth")
-    const std::string _name;
+    /// A transaction in a shard, with the fields used to order it. The
+    /// transaction itself is mutable, so that it can be moved out of the set
+    /// before its entry is erased (which does not affect the order).
+    struct tx_entry {
+        uint32_t fee_wei;
+        std::chrono::steady_clock::time_point arrival_time;
+        size_t size_bytes;
+        mutable nested_transaction<nppT, nsnarkT> tx;
+
+        explicit tx_entry(nested_transaction<nppT, nsnarkT> &&tx);
+    };
+
+    /// Order of transactions within a shard: by increasing fee then, for
+    /// equal fees, by decreasing age. The last transaction is therefore the
+    /// next to be batched, and the first the next to be evicted.
+    struct tx_order {
+        bool operator()(const tx_entry &a, const tx_entry &b) const;
+    };
+
+    using tx_set = std::multiset<tx_entry, tx_order>;
+
+    /// A subset of the transactions in the pool, with its own lock. The
+    /// arrival times of all transactions in the shard are also held (with
+    /// the position of the transaction), in order to determine the oldest
+    /// and to expire transactions.
+    struct shard {
+        std::mutex mutex;
+        tx_set tx_pool;
+        std::multimap<
+            std::chrono::steady_clock::time_point,
+            typename tx_set::iterator>
+            arrival_times;
+    };
+
+    /// Name/Identifier of the application (E.g. "zeth"), shared with
+    /// transactions decoded for this pool.
+    const std::shared_ptr<const std::string> _name;
 
     /// Verification key used to verify the nested proofs
     const typename nsnarkT::verification_key _verification_key;
 
-    /// Pool of transactions to aggregate
-    std::priority_queue<nested_transaction<nppT, nsnarkT>> _tx_pool;
+    /// Maximum time that transactions should wait in the pool before being
+    /// aggregated (zero if no limit is set).
+    const std::chrono::milliseconds _max_batch_wait;
+
+    const application_pool_limits _limits;
+
+    /// Space used by this pool, bounded by _limits.
+    pool_capacity _capacity;
+
+    /// Space used by the group of pools this pool belongs to (null if
+    /// unbounded).
+    const std::shared_ptr<pool_capacity> _shared_capacity;
+
+    /// Pool of transactions to aggregate, split into shards.
+    std::vector<std::unique_ptr<shard>> _shards;
+
+    /// Total number of transactions across all shards.
+    std::atomic<size_t> _tx_pool_size;
+
+    /// Shard to be used by the calling thread.
+    shard &get_shard();
+
+    std::vector<std::unique_lock<std::mutex>> lock_all_shards() const;
+
+    /// Reserve (or release) space for a transaction in both _capacity and
+    /// _shared_capacity.
+    bool reserve(size_t tx_bytes);
+    void release(size_t tx_bytes);
+
+    /// True if a transaction of the given size would fit after removing the
+    /// given number of transactions of the given total size.
+    bool fits(
+        size_t tx_bytes,
+        size_t num_removed_transactions,
+        size_t num_removed_bytes) const;
+
+    /// Insert a transaction (for which space is reserved) into a locked
+    /// shard.
+    void insert_tx(shard &s, nested_transaction<nppT, nsnarkT> &&tx);
+
+    /// Move a transaction out of a locked shard, erasing its entry and
+    /// releasing its space.
+    nested_transaction<nppT, nsnarkT> erase_tx(
+        shard &s, typename tx_set::iterator it);
+
+    /// With all shards locked, evict (and append to `evicted`) the
+    /// lowest-fee transactions, all with a lower fee than `tx`, until `tx`
+    /// fits, and reserve space for it. Returns false (evicting nothing) if
+    /// this is not possible.
+    bool make_room(
+        const nested_transaction<nppT, nsnarkT> &tx,
+        size_t tx_bytes,
+        std::vector<nested_transaction<nppT, nsnarkT>> &evicted);
 
 public:
+    /// Construct a pool with the given maximum wait time (see
+    /// max_batch_wait()) and number of shards. By default, the number of
+    /// shards is the number of hardware threads. If `shared_capacity` is
+    /// given, it bounds the total size of this pool and any others sharing
+    /// it.
     application_pool(
-        const std::string &name, const typename nsnarkT::verification_key &vk);
+        const std::string &name,
+        const typename nsnarkT::verification_key &vk,
+        std::chrono::milliseconds max_batch_wait =
+            std::chrono::milliseconds::zero(),
+        size_t num_shards = 0,
+        const application_pool_limits &limits = application_pool_limits(),
+        std::shared_ptr<pool_capacity> shared_capacity = nullptr);
 
     // Prevent some operations which may have unintended consequences and
     // unnecessary allocation and copying.
@@ -43,24 +177,72 @@ public:
 
     const std::string &name() const;
 
+    /// The name of the application, to be shared by its transactions (see
+    /// nested_transaction_from_proto), so that each does not hold a copy.
+    const std::shared_ptr<const std::string> &interned_name() const;
+
     /// Function that returns the verification key associated with this
     /// application. This constitutes part of the witness of the aggregator
     /// circuit.
     const typename nsnarkT::verification_key &verification_key() const;
 
-    /// Add transaction to the pool
-    void add_tx(const nested_transaction<nppT, nsnarkT> &tx);
+    /// Latency target for the application: the maximum time for which
+    /// transactions should wait in the pool before a (possibly partial) batch
+    /// is aggregated. Zero if no target is set. (Used by the caller when
+    /// scheduling batches. The pool itself does not enforce it.)
+    std::chrono::milliseconds max_batch_wait() const;
+
+    const application_pool_limits &limits() const;
+
+    /// If the pool is non-empty, set `arrival_time` to the arrival time of
+    /// the oldest transaction in the pool and return true. Otherwise, return
+    /// false.
+    bool oldest_arrival_time(
+        std::chrono::steady_clock::time_point &arrival_time) const;
+
+    /// Add transaction to the pool (moving it in, if passed as an rvalue).
+    /// If the pool is full, lower-fee transactions are evicted to make room
+    /// for it, and appended to `evicted`. Returns false (leaving the pool
+    /// unchanged) if the transaction is rejected, because there are not
+    /// enough lower-fee transactions to evict.
+    bool add_tx(
+        nested_transaction<nppT, nsnarkT> tx,
+        std::vector<nested_transaction<nppT, nsnarkT>> &evicted);
+
+    /// Add transaction to the pool, discarding any evicted transactions.
+    bool add_tx(nested_transaction<nppT, nsnarkT> tx);
+
+    /// Remove the transactions which arrived more than the TTL (see
+    /// application_pool_limits) before `now`, appending them to `expired`.
+    /// Returns the number of transactions removed.
+    size_t remove_expired(
+        std::chrono::steady_clock::time_point now,
+        std::vector<nested_transaction<nppT, nsnarkT>> &expired);
 
     /// Returns the number of transactions in the _tx_pool
     size_t tx_pool_size() const;
 
-    // TODO: Use better types to make it safer to retrieve smaller batches.
-
-    /// Fill the array with transactions popped from the queue. Returns the
-    /// number of transactions placed in the array. Any remaining entries are
-    /// unntouched, and should be ignored by the caller.
+    /// Total size of the transactions in the pool (see
+    /// nested_transaction::size_bytes).
+    size_t tx_pool_bytes() const;
+
+    /// Set `fee_wei` to the minimum fee a transaction currently requires to
+    /// be accepted: 0 if the pool has space, otherwise 1 more than the
+    /// lowest fee in the pool (for a transaction of similar size). Returns
+    /// false if no transaction can currently be accepted (if the pool is
+    /// empty but the group of pools it belongs to is full).
+    bool min_accepted_fee(uint32_t &fee_wei) const;
+
+    /// Replace the contents of `batch` with the `batch_size` highest-fee
+    /// transactions moved out of the pool, and return the number of
+    /// transactions extracted. If the pool holds fewer than `batch_size`
+    /// transactions then, unless `allow_partial` is set, nothing is extracted,
+    /// `batch` is left empty and 0 is returned. If `allow_partial` is set, all
+    /// transactions in the pool are extracted as a partial batch.
     size_t get_next_batch(
-        std::array<nested_transaction<nppT, nsnarkT>, NumProofs> &batch);
+        size_t batch_size,
+        std::vector<nested_transaction<nppT, nsnarkT>> &batch,
+        bool allow_partial = false);
 };
 
 } // namespace libzecale
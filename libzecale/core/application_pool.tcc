@@ -7,59 +7,388 @@
 
 #include "libzecale/core/application_pool.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <thread>
+
 namespace libzecale
 {
 
-template<typename nppT, typename nsnarkT, size_t NumProofs>
-application_pool<nppT, nsnarkT, NumProofs>::application_pool(
-    const std::string &name, const typename nsnarkT::verification_key &vk)
-    : _name(name), _verification_key(vk), _tx_pool()
+inline application_pool_limits::application_pool_limits()
+    : max_transactions(0), max_bytes(0), tx_ttl(0)
+{
+}
+
+template<typename nppT, typename nsnarkT>
+application_pool<nppT, nsnarkT>::tx_entry::tx_entry(
+    nested_transaction<nppT, nsnarkT> &&tx)
+    : fee_wei(tx.fee_wei())
+    , arrival_time(tx.arrival_time())
+    , size_bytes(tx.size_bytes())
+    , tx(std::move(tx))
+{
+}
+
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::tx_order::operator()(
+    const tx_entry &a, const tx_entry &b) const
+{
+    if (a.fee_wei != b.fee_wei) {
+        return a.fee_wei < b.fee_wei;
+    }
+    return b.arrival_time < a.arrival_time;
+}
+
+template<typename nppT, typename nsnarkT>
+application_pool<nppT, nsnarkT>::application_pool(
+    const std::string &name,
+    const typename nsnarkT::verification_key &vk,
+    std::chrono::milliseconds max_batch_wait,
+    size_t num_shards,
+    const application_pool_limits &limits,
+    std::shared_ptr<pool_capacity> shared_capacity)
+    : _name(std::make_shared<const std::string>(name))
+    , _verification_key(vk)
+    , _max_batch_wait(max_batch_wait)
+    , _limits(limits)
+    , _capacity(limits.max_transactions, limits.max_bytes)
+    , _shared_capacity(shared_capacity)
+    , _shards()
+    , _tx_pool_size(0)
+{
+    if (num_shards == 0) {
+        num_shards = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    _shards.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+        _shards.emplace_back(new shard());
+    }
+}
+
+template<typename nppT, typename nsnarkT>
+typename application_pool<nppT, nsnarkT>::shard &application_pool<
+    nppT,
+    nsnarkT>::get_shard()
+{
+    // Each thread consistently uses the same shard, keeping its lock (and the
+    // shard data) local to the core where possible.
+    const size_t thread_hash =
+        std::hash<std::thread::id>()(std::this_thread::get_id());
+    return *_shards[thread_hash % _shards.size()];
+}
+
+template<typename nppT, typename nsnarkT>
+std::vector<std::unique_lock<std::mutex>> application_pool<nppT, nsnarkT>::
+    lock_all_shards() const
 {
+    // Always lock in the same order, so that concurrent calls cannot
+    // deadlock.
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(_shards.size());
+    for (const std::unique_ptr<shard> &s : _shards) {
+        locks.emplace_back(s->mutex);
+    }
+    return locks;
 }
 
-template<typename nppT, typename nsnarkT, size_t NumProofs>
-const std::string &application_pool<nppT, nsnarkT, NumProofs>::name() const
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::reserve(size_t tx_bytes)
+{
+    if (!_capacity.try_reserve(tx_bytes)) {
+        return false;
+    }
+    if (_shared_capacity && !_shared_capacity->try_reserve(tx_bytes)) {
+        _capacity.release(tx_bytes);
+        return false;
+    }
+    return true;
+}
+
+template<typename nppT, typename nsnarkT>
+void application_pool<nppT, nsnarkT>::release(size_t tx_bytes)
+{
+    _capacity.release(tx_bytes);
+    if (_shared_capacity) {
+        _shared_capacity->release(tx_bytes);
+    }
+}
+
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::fits(
+    size_t tx_bytes,
+    size_t num_removed_transactions,
+    size_t num_removed_bytes) const
+{
+    return _capacity.fits(
+               tx_bytes, num_removed_transactions, num_removed_bytes) &&
+           (!_shared_capacity ||
+            _shared_capacity->fits(
+                tx_bytes, num_removed_transactions, num_removed_bytes));
+}
+
+template<typename nppT, typename nsnarkT>
+void application_pool<nppT, nsnarkT>::insert_tx(
+    shard &s, nested_transaction<nppT, nsnarkT> &&tx)
+{
+    const typename tx_set::iterator it =
+        s.tx_pool.insert(tx_entry(std::move(tx)));
+    s.arrival_times.insert(std::make_pair(it->arrival_time, it));
+    ++_tx_pool_size;
+}
+
+template<typename nppT, typename nsnarkT>
+nested_transaction<nppT, nsnarkT> application_pool<nppT, nsnarkT>::erase_tx(
+    shard &s, typename tx_set::iterator it)
+{
+    auto arrival_it = s.arrival_times.lower_bound(it->arrival_time);
+    while (arrival_it->second != it) {
+        ++arrival_it;
+    }
+    s.arrival_times.erase(arrival_it);
+
+    nested_transaction<nppT, nsnarkT> tx = std::move(it->tx);
+    release(it->size_bytes);
+    s.tx_pool.erase(it);
+    --_tx_pool_size;
+    return tx;
+}
+
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::make_room(
+    const nested_transaction<nppT, nsnarkT> &tx,
+    size_t tx_bytes,
+    std::vector<nested_transaction<nppT, nsnarkT>> &evicted)
+{
+    tx_order order;
+    for (;;) {
+        if (reserve(tx_bytes)) {
+            return true;
+        }
+
+        // Determine which transactions must be evicted (the lowest-fee
+        // transactions across all shards), and check that evicting them
+        // would make room, before evicting any.
+        std::vector<typename tx_set::iterator> next;
+        next.reserve(_shards.size());
+        for (const std::unique_ptr<shard> &s : _shards) {
+            next.push_back(s->tx_pool.begin());
+        }
+        std::vector<std::pair<shard *, typename tx_set::iterator>> victims;
+        size_t victims_bytes = 0;
+        while (!fits(tx_bytes, victims.size(), victims_bytes)) {
+            size_t lowest = _shards.size();
+            for (size_t i = 0; i < _shards.size(); ++i) {
+                if (next[i] != _shards[i]->tx_pool.end() &&
+                    (lowest == _shards.size() ||
+                     order(*next[i], *next[lowest]))) {
+                    lowest = i;
+                }
+            }
+            if (lowest == _shards.size() ||
+                next[lowest]->fee_wei >= tx.fee_wei()) {
+                return false;
+            }
+
+            victims.emplace_back(_shards[lowest].get(), next[lowest]);
+            victims_bytes += next[lowest]->size_bytes;
+            ++next[lowest];
+        }
+
+        for (const std::pair<shard *, typename tx_set::iterator> &victim :
+             victims) {
+            evicted.push_back(erase_tx(*victim.first, victim.second));
+        }
+
+        // Concurrent submitters may take the space released before it can be
+        // reserved, in which case further transactions are evicted.
+    }
+}
+
+template<typename nppT, typename nsnarkT>
+const std::string &application_pool<nppT, nsnarkT>::name() const
+{
+    return *_name;
+}
+
+template<typename nppT, typename nsnarkT>
+const std::shared_ptr<const std::string> &application_pool<
+    nppT,
+    nsnarkT>::interned_name() const
 {
     return _name;
 }
 
-template<typename nppT, typename nsnarkT, size_t NumProofs>
+template<typename nppT, typename nsnarkT>
 const typename nsnarkT::verification_key &application_pool<
     nppT,
-    nsnarkT,
-    NumProofs>::verification_key() const
+    nsnarkT>::verification_key() const
 {
     return _verification_key;
 }
 
-template<typename nppT, typename nsnarkT, size_t NumProofs>
-void application_pool<nppT, nsnarkT, NumProofs>::add_tx(
-    const nested_transaction<nppT, nsnarkT> &tx)
+template<typename nppT, typename nsnarkT>
+std::chrono::milliseconds application_pool<nppT, nsnarkT>::max_batch_wait()
+    const
+{
+    return _max_batch_wait;
+}
+
+template<typename nppT, typename nsnarkT>
+const application_pool_limits &application_pool<nppT, nsnarkT>::limits() const
 {
-    _tx_pool.push(tx);
+    return _limits;
 }
 
-template<typename nppT, typename nsnarkT, size_t NumProofs>
-size_t application_pool<nppT, nsnarkT, NumProofs>::tx_pool_size() const
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::oldest_arrival_time(
+    std::chrono::steady_clock::time_point &arrival_time) const
 {
-    return _tx_pool.size();
+    // Shards are locked one at a time, so the result may not reflect
+    // concurrent modifications.
+    bool found = false;
+    for (const std::unique_ptr<shard> &s : _shards) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        if (!s->arrival_times.empty() &&
+            (!found || s->arrival_times.begin()->first < arrival_time)) {
+            arrival_time = s->arrival_times.begin()->first;
+            found = true;
+        }
+    }
+
+    return found;
 }
 
-template<typename nppT, typename nsnarkT, size_t NumProofs>
-size_t application_pool<nppT, nsnarkT, NumProofs>::get_next_batch(
-    std::array<nested_transaction<nppT, nsnarkT>, NumProofs> &batch)
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::add_tx(
+    nested_transaction<nppT, nsnarkT> tx,
+    std::vector<nested_transaction<nppT, nsnarkT>> &evicted)
 {
-    // TODO: For now, only return whole batches (to avoid nasty errors where
-    // elements in the array are not initialized properly). Later, clean up the
-    // data structures to support partial-batches in a safe way.
-    if (_tx_pool.size() < NumProofs) {
+    const size_t tx_bytes = tx.size_bytes();
+    shard &s = get_shard();
+    if (reserve(tx_bytes)) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        insert_tx(s, std::move(tx));
+        return true;
+    }
+
+    // The pool (or the group of pools) is full.
+    const std::vector<std::unique_lock<std::mutex>> locks = lock_all_shards();
+    if (!make_room(tx, tx_bytes, evicted)) {
+        return false;
+    }
+    insert_tx(s, std::move(tx));
+    return true;
+}
+
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::add_tx(
+    nested_transaction<nppT, nsnarkT> tx)
+{
+    std::vector<nested_transaction<nppT, nsnarkT>> evicted;
+    return add_tx(std::move(tx), evicted);
+}
+
+template<typename nppT, typename nsnarkT>
+size_t application_pool<nppT, nsnarkT>::remove_expired(
+    std::chrono::steady_clock::time_point now,
+    std::vector<nested_transaction<nppT, nsnarkT>> &expired)
+{
+    if (_limits.tx_ttl == std::chrono::milliseconds::zero()) {
         return 0;
     }
-    for (size_t entry_idx = 0; entry_idx < NumProofs; ++entry_idx) {
-        batch[entry_idx] = _tx_pool.top();
-        _tx_pool.pop();
+
+    size_t num_expired = 0;
+    const std::chrono::steady_clock::time_point cutoff = now - _limits.tx_ttl;
+    for (const std::unique_ptr<shard> &s : _shards) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        while (!s->arrival_times.empty() &&
+               s->arrival_times.begin()->first <= cutoff) {
+            expired.push_back(
+                erase_tx(*s, s->arrival_times.begin()->second));
+            ++num_expired;
+        }
+    }
+
+    return num_expired;
+}
+
+template<typename nppT, typename nsnarkT>
+size_t application_pool<nppT, nsnarkT>::tx_pool_size() const
+{
+    return _tx_pool_size.load();
+}
+
+template<typename nppT, typename nsnarkT>
+size_t application_pool<nppT, nsnarkT>::tx_pool_bytes() const
+{
+    return _capacity.num_bytes();
+}
+
+template<typename nppT, typename nsnarkT>
+bool application_pool<nppT, nsnarkT>::min_accepted_fee(uint32_t &fee_wei) const
+{
+    if (!_capacity.full() && !(_shared_capacity && _shared_capacity->full())) {
+        fee_wei = 0;
+        return true;
+    }
+
+    // A transaction must displace the lowest-fee transaction in the pool.
+    // Shards are locked one at a time, as in oldest_arrival_time.
+    bool found = false;
+    uint32_t lowest_fee_wei = 0;
+    for (const std::unique_ptr<shard> &s : _shards) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        if (!s->tx_pool.empty() &&
+            (!found || s->tx_pool.begin()->fee_wei < lowest_fee_wei)) {
+            lowest_fee_wei = s->tx_pool.begin()->fee_wei;
+            found = true;
+        }
     }
-    return NumProofs;
+
+    if (!found || lowest_fee_wei == std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    fee_wei = lowest_fee_wei + 1;
+    return true;
+}
+
+template<typename nppT, typename nsnarkT>
+size_t application_pool<nppT, nsnarkT>::get_next_batch(
+    size_t batch_size,
+    std::vector<nested_transaction<nppT, nsnarkT>> &batch,
+    bool allow_partial)
+{
+    batch.clear();
+    const std::vector<std::unique_lock<std::mutex>> locks = lock_all_shards();
+
+    // Only return whole batches of the requested size, unless partial batches
+    // are allowed.
+    if (_tx_pool_size.load() < batch_size) {
+        if (!allow_partial) {
+            return 0;
+        }
+        batch_size = _tx_pool_size.load();
+    }
+
+    // Repeatedly take the highest-fee transaction at the end of any shard.
+    tx_order order;
+    batch.reserve(batch_size);
+    for (size_t entry_idx = 0; entry_idx < batch_size; ++entry_idx) {
+        shard *best = nullptr;
+        for (const std::unique_ptr<shard> &s : _shards) {
+            if (!s->tx_pool.empty() &&
+                (best == nullptr ||
+                 order(*best->tx_pool.rbegin(), *s->tx_pool.rbegin()))) {
+                best = s.get();
+            }
+        }
+
+        batch.push_back(erase_tx(*best, std::prev(best->tx_pool.end())));
+    }
+
+    return batch_size;
 }
 
 } // namespace libzecale
@@ -0,0 +1,74 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_APPLICATION_REGISTRY_HPP__
+#define __ZECALE_CORE_APPLICATION_REGISTRY_HPP__
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace libzecale
+{
+
+/// Thread-safe registry of application pools, indexed by application name.
+///
+/// Lookups vastly outnumber registrations, and are performed concurrently by
+/// every submission. Entries are therefore split across a fixed number of
+/// shards (selected by a hash of the name), each with its own lock, so that
+/// concurrent lookups of different applications do not contend, and lookups
+/// of the same application hold a lock only for the duration of the map
+/// search. Pools are held by shared pointer, so that callers can continue to
+/// use a pool without holding any lock on the registry.
+template<typename applicationPoolT> class application_registry
+{
+public:
+    using pool_ptr = std::shared_ptr<applicationPoolT>;
+
+    static const size_t num_shards = 16;
+
+    application_registry() = default;
+
+    application_registry(const application_registry &other) = delete;
+    application_registry &operator=(const application_registry &other) =
+        delete;
+
+    /// Add a pool, indexed by its name. Returns false (leaving the registry
+    /// unchanged) if an application of the same name is already registered.
+    bool add(const pool_ptr &pool);
+
+    /// Return the pool for the named application, or nullptr if no such
+    /// application has been registered.
+    pool_ptr get(const std::string &name) const;
+
+    /// Return the pool for the named application. Throws std::out_of_range if
+    /// no such application has been registered.
+    pool_ptr at(const std::string &name) const;
+
+    /// Number of registered applications.
+    size_t size() const;
+
+    /// Return all registered pools (in no particular order).
+    std::vector<pool_ptr> get_all() const;
+
+private:
+    struct shard {
+        mutable std::mutex mutex;
+        std::map<std::string, pool_ptr> pools;
+    };
+
+    std::array<shard, num_shards> _shards;
+
+    shard &get_shard(const std::string &name);
+    const shard &get_shard(const std::string &name) const;
+};
+
+} // namespace libzecale
+
+#include "libzecale/core/application_registry.tcc"
+
+#endif // __ZECALE_CORE_APPLICATION_REGISTRY_HPP__
@@ -0,0 +1,93 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_APPLICATION_REGISTRY_TCC__
+#define __ZECALE_CORE_APPLICATION_REGISTRY_TCC__
+
+#include "libzecale/core/application_registry.hpp"
+
+#include <functional>
+#include <stdexcept>
+
+namespace libzecale
+{
+
+template<typename applicationPoolT>
+const size_t application_registry<applicationPoolT>::num_shards;
+
+template<typename applicationPoolT>
+typename application_registry<applicationPoolT>::shard &application_registry<
+    applicationPoolT>::get_shard(const std::string &name)
+{
+    return _shards[std::hash<std::string>()(name) % num_shards];
+}
+
+template<typename applicationPoolT>
+const typename application_registry<applicationPoolT>::shard &
+application_registry<applicationPoolT>::get_shard(
+    const std::string &name) const
+{
+    return _shards[std::hash<std::string>()(name) % num_shards];
+}
+
+template<typename applicationPoolT>
+bool application_registry<applicationPoolT>::add(const pool_ptr &pool)
+{
+    shard &s = get_shard(pool->name());
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.pools.insert(std::make_pair(pool->name(), pool)).second;
+}
+
+template<typename applicationPoolT>
+typename application_registry<applicationPoolT>::pool_ptr application_registry<
+    applicationPoolT>::get(const std::string &name) const
+{
+    const shard &s = get_shard(name);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.pools.find(name);
+    if (it == s.pools.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+template<typename applicationPoolT>
+typename application_registry<applicationPoolT>::pool_ptr application_registry<
+    applicationPoolT>::at(const std::string &name) const
+{
+    pool_ptr pool = get(name);
+    if (!pool) {
+        throw std::out_of_range("unknown application: " + name);
+    }
+    return pool;
+}
+
+template<typename applicationPoolT>
+size_t application_registry<applicationPoolT>::size() const
+{
+    size_t total = 0;
+    for (const shard &s : _shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        total += s.pools.size();
+    }
+    return total;
+}
+
+template<typename applicationPoolT>
+std::vector<typename application_registry<applicationPoolT>::pool_ptr>
+application_registry<applicationPoolT>::get_all() const
+{
+    std::vector<pool_ptr> pools;
+    for (const shard &s : _shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (const auto &entry : s.pools) {
+            pools.push_back(entry.second);
+        }
+    }
+    return pools;
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_APPLICATION_REGISTRY_TCC__
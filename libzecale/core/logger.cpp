@@ -0,0 +1,181 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/logger.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace libzecale
+{
+
+namespace
+{
+
+// Maximum time for which queued messages may wait to be written.
+const std::chrono::milliseconds log_write_interval(10);
+
+const char *log_level_prefix(log_level level)
+{
+    switch (level) {
+    case log_level::error:
+        return "[ERROR] ";
+    case log_level::info:
+        return "[INFO] ";
+    case log_level::debug:
+        return "[DEBUG] ";
+    case log_level::trace:
+        return "[TRACE] ";
+    }
+    return "";
+}
+
+} // namespace
+
+log_level log_level_from_string(const std::string &name)
+{
+    if (name == "error") {
+        return log_level::error;
+    }
+    if (name == "info") {
+        return log_level::info;
+    }
+    if (name == "debug") {
+        return log_level::debug;
+    }
+    if (name == "trace") {
+        return log_level::trace;
+    }
+    throw std::invalid_argument("invalid log level: " + name);
+}
+
+logger::logger(log_level level, size_t buffer_size, std::ostream &out)
+    : _level(level)
+    , _out(out)
+    , _buffer(buffer_size)
+    , _num_dropped(0)
+    , _stopping(false)
+{
+    _writer = std::thread([this]() { writer_loop(); });
+}
+
+logger::~logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_one();
+    _writer.join();
+}
+
+log_level logger::level() const { return _level; }
+
+void logger::set_sample_rate(const std::string &category, size_t rate)
+{
+    if (rate == 0) {
+        throw std::invalid_argument("sample rate must be non-zero");
+    }
+
+    std::unique_ptr<sampler> &s = _samplers[category];
+    s.reset(new sampler());
+    s->rate = rate;
+    s->count = 0;
+}
+
+bool logger::enabled(log_level level) const { return level <= _level; }
+
+bool logger::should_log(log_level level, const std::string &category)
+{
+    if (!enabled(level)) {
+        return false;
+    }
+    if (level == log_level::error || _samplers.empty()) {
+        return true;
+    }
+
+    const auto it = _samplers.find(category);
+    if (it == _samplers.end()) {
+        return true;
+    }
+    sampler &s = *it->second;
+    return (s.count++ % s.rate) == 0;
+}
+
+void logger::write(log_level level, std::string message)
+{
+    entry e{level, std::move(message)};
+    if (!_buffer.try_push(e)) {
+        ++_num_dropped;
+        return;
+    }
+
+    // The writer also wakes periodically, so a notification which arrives
+    // before it waits is not lost for long.
+    _wakeup.notify_one();
+}
+
+uint64_t logger::num_dropped() const { return _num_dropped.load(); }
+
+void logger::writer_loop()
+{
+    uint64_t num_dropped_reported = 0;
+    for (;;) {
+        write_queued(num_dropped_reported);
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_stopping) {
+            break;
+        }
+        _wakeup.wait_for(lock, log_write_interval);
+    }
+
+    // Messages queued before the logger was destroyed.
+    write_queued(num_dropped_reported);
+}
+
+void logger::write_queued(uint64_t &num_dropped_reported)
+{
+    entry e;
+    bool written = false;
+    while (_buffer.try_pop(e)) {
+        _out << log_level_prefix(e.level) << e.message << "\n";
+        written = true;
+    }
+
+    const uint64_t num_dropped = _num_dropped.load();
+    if (num_dropped != num_dropped_reported) {
+        _out << log_level_prefix(log_level::error)
+             << std::to_string(num_dropped - num_dropped_reported)
+             << " log message(s) dropped\n";
+        num_dropped_reported = num_dropped;
+        written = true;
+    }
+
+    if (written) {
+        _out.flush();
+    }
+}
+
+log_record::log_record(
+    logger &log, log_level level, const std::string &category)
+    : _log(log), _level(level)
+{
+    if (_log.should_log(level, category)) {
+        _stream.reset(new std::ostringstream());
+    }
+}
+
+log_record::~log_record()
+{
+    if (_stream) {
+        _log.write(_level, _stream->str());
+    }
+}
+
+bool log_record::enabled() const { return (bool)_stream; }
+
+std::ostream &log_record::stream() { return *_stream; }
+
+} // namespace libzecale
@@ -0,0 +1,146 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_LOGGER_HPP__
+#define __ZECALE_CORE_LOGGER_HPP__
+
+#include "libzecale/core/ring_buffer.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace libzecale
+{
+
+/// Severity of log messages, in increasing order of verbosity.
+enum class log_level { error, info, debug, trace };
+
+/// Parse a log level name ("error", "info", "debug" or "trace"). Throws
+/// std::invalid_argument for any other name.
+log_level log_level_from_string(const std::string &name);
+
+/// Default number of messages which may be queued before messages are
+/// dropped.
+static const size_t default_log_buffer_size = 8192;
+
+/// Asynchronous logger. Messages below the configured level are discarded
+/// without being formatted. Others are queued in a lock-free ring_buffer, and
+/// written (each prefixed with its level) by a background thread, so that
+/// threads handling requests do not wait for output. If the buffer is full,
+/// messages are dropped (and the number dropped is reported).
+///
+/// Messages of a given category can be sampled, so that only 1 in every n of
+/// them is logged (errors are always logged). Sample rates must be set before
+/// the logger is used by multiple threads.
+///
+/// On destruction, all queued messages are written.
+class logger
+{
+public:
+    explicit logger(
+        log_level level = log_level::info,
+        size_t buffer_size = default_log_buffer_size,
+        std::ostream &out = std::cout);
+
+    ~logger();
+
+    logger(const logger &other) = delete;
+    logger &operator=(const logger &other) = delete;
+
+    log_level level() const;
+
+    /// Log only 1 in every `rate` messages of the given category.
+    void set_sample_rate(const std::string &category, size_t rate);
+
+    /// True if messages at the given level are logged (before sampling).
+    bool enabled(log_level level) const;
+
+    /// True if a message of the given level and category should be logged.
+    /// Each call counts as a message for the purposes of sampling.
+    bool should_log(log_level level, const std::string &category);
+
+    /// Queue a message, regardless of level and sampling. Callers should
+    /// first check should_log (see log_record).
+    void write(log_level level, std::string message);
+
+    /// Number of messages dropped since the logger was created.
+    uint64_t num_dropped() const;
+
+private:
+    struct entry {
+        log_level level;
+        std::string message;
+    };
+
+    struct sampler {
+        size_t rate;
+        std::atomic<uint64_t> count;
+    };
+
+    const log_level _level;
+    std::ostream &_out;
+    std::map<std::string, std::unique_ptr<sampler>> _samplers;
+    ring_buffer<entry> _buffer;
+    std::atomic<uint64_t> _num_dropped;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stopping;
+    std::thread _writer;
+
+    void writer_loop();
+    void write_queued(uint64_t &num_dropped_reported);
+};
+
+/// A single log message, built using stream insertion and queued when the
+/// record is destroyed. If the message is not to be logged (see
+/// logger::should_log), insertions are ignored without being formatted:
+///
+///   log_record(log, log_level::debug, "submission") << "tx " << tx_id;
+///
+/// Expensive output (such as dumps of proofs) should be guarded by enabled():
+///
+///   log_record record(log, log_level::trace, "submission");
+///   if (record.enabled()) {
+///       proof.write_json(record.stream());
+///   }
+class log_record
+{
+public:
+    log_record(logger &log, log_level level, const std::string &category);
+
+    ~log_record();
+
+    log_record(const log_record &other) = delete;
+    log_record &operator=(const log_record &other) = delete;
+
+    bool enabled() const;
+
+    /// The stream holding the message. Only valid if enabled().
+    std::ostream &stream();
+
+    template<typename T> log_record &operator<<(const T &value)
+    {
+        if (_stream) {
+            *_stream << value;
+        }
+        return *this;
+    }
+
+private:
+    logger &_log;
+    const log_level _level;
+    std::unique_ptr<std::ostringstream> _stream;
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_LOGGER_HPP__
@@ -0,0 +1,280 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/metrics.hpp"
+
+#include <algorithm>
+
+namespace libzecale
+{
+
+namespace
+{
+
+// Quantiles reported for each histogram (see metrics_histogram_snapshot).
+const size_t num_histogram_quantiles = 4;
+const double histogram_quantiles[num_histogram_quantiles] = {
+    0.5, 0.9, 0.99, 0.999};
+const char *const histogram_quantile_labels[num_histogram_quantiles] = {
+    "0.5", "0.9", "0.99", "0.999"};
+
+// Write a label value, escaping backslashes, double quotes and newlines as
+// required by the text exposition format. (Values such as application names
+// are supplied by clients.)
+void write_label_value(const std::string &value, std::ostream &out_s)
+{
+    for (const char c : value) {
+        switch (c) {
+        case '\\':
+            out_s << "\\\\";
+            break;
+        case '"':
+            out_s << "\\\"";
+            break;
+        case '\n':
+            out_s << "\\n";
+            break;
+        default:
+            out_s << c;
+            break;
+        }
+    }
+}
+
+void write_labels(
+    const metrics_labels &labels,
+    const std::string &extra_name,
+    const std::string &extra_value,
+    std::ostream &out_s)
+{
+    if (labels.empty() && extra_name.empty()) {
+        return;
+    }
+
+    const char *separator = "{";
+    for (const auto &label : labels) {
+        out_s << separator << label.first << "=\"";
+        write_label_value(label.second, out_s);
+        out_s << "\"";
+        separator = ",";
+    }
+    if (!extra_name.empty()) {
+        out_s << separator << extra_name << "=\"";
+        write_label_value(extra_value, out_s);
+        out_s << "\"";
+    }
+    out_s << "}";
+}
+
+void write_type(
+    const std::string &name,
+    const char *type,
+    std::string &last_name,
+    std::ostream &out_s)
+{
+    if (name != last_name) {
+        out_s << "# TYPE " << name << " " << type << "\n";
+        last_name = name;
+    }
+}
+
+} // namespace
+
+metrics_counter::metrics_counter() : _value(0) {}
+
+void metrics_counter::increment(uint64_t n)
+{
+    _value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t metrics_counter::value() const
+{
+    return _value.load(std::memory_order_relaxed);
+}
+
+const size_t metrics_histogram::sub_bucket_bits;
+const size_t metrics_histogram::num_sub_buckets;
+const size_t metrics_histogram::num_buckets;
+
+metrics_histogram::metrics_histogram() : _count(0), _sum(0), _max(0)
+{
+    for (std::atomic<uint64_t> &bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void metrics_histogram::record(uint64_t value)
+{
+    _buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(
+                              max, value, std::memory_order_relaxed)) {
+    }
+}
+
+metrics_histogram_snapshot metrics_histogram::snapshot() const
+{
+    std::array<uint64_t, num_buckets> counts;
+    uint64_t count = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        count += counts[i];
+    }
+
+    // Find the bucket holding each quantile, in a single pass.
+    std::array<uint64_t, num_histogram_quantiles> values{};
+    size_t quantile_idx = 0;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < num_buckets && count != 0; ++i) {
+        cumulative += counts[i];
+        while (quantile_idx < num_histogram_quantiles &&
+               (double)cumulative >=
+                   histogram_quantiles[quantile_idx] * (double)count) {
+            values[quantile_idx++] = bucket_upper_bound(i);
+        }
+    }
+
+    // Quantiles may not exceed the maximum recorded value.
+    const uint64_t max = _max.load(std::memory_order_relaxed);
+    for (uint64_t &value : values) {
+        value = std::min(value, max);
+    }
+
+    metrics_histogram_snapshot snapshot;
+    snapshot.count = count;
+    snapshot.sum = _sum.load(std::memory_order_relaxed);
+    snapshot.max = max;
+    snapshot.p50 = values[0];
+    snapshot.p90 = values[1];
+    snapshot.p99 = values[2];
+    snapshot.p999 = values[3];
+    return snapshot;
+}
+
+size_t metrics_histogram::bucket_index(uint64_t value)
+{
+    if (value < num_sub_buckets) {
+        return (size_t)value;
+    }
+
+    // Values in [2^e, 2^(e+1)) are split into num_sub_buckets buckets of
+    // width 2^(e - sub_bucket_bits).
+    size_t exponent = 0;
+    for (uint64_t v = value; v > 1; v >>= 1) {
+        ++exponent;
+    }
+    const size_t shift = exponent - sub_bucket_bits;
+    const size_t sub_bucket = (size_t)(value >> shift) - num_sub_buckets;
+    return num_sub_buckets + shift * num_sub_buckets + sub_bucket;
+}
+
+uint64_t metrics_histogram::bucket_upper_bound(size_t index)
+{
+    if (index < num_sub_buckets) {
+        return (uint64_t)index;
+    }
+
+    const size_t shift = (index - num_sub_buckets) / num_sub_buckets;
+    const size_t sub_bucket = (index - num_sub_buckets) % num_sub_buckets;
+    const uint64_t lower = (uint64_t)(num_sub_buckets + sub_bucket) << shift;
+    return lower + (((uint64_t)1 << shift) - 1);
+}
+
+metrics_registry::metrics_registry() {}
+
+metrics_counter &metrics_registry::counter(
+    const std::string &name, const metrics_labels &labels)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unique_ptr<metrics_counter> &counter =
+        _counters[metric_key(name, labels)];
+    if (!counter) {
+        counter.reset(new metrics_counter());
+    }
+    return *counter;
+}
+
+metrics_histogram &metrics_registry::histogram(
+    const std::string &name, const metrics_labels &labels)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unique_ptr<metrics_histogram> &histogram =
+        _histograms[metric_key(name, labels)];
+    if (!histogram) {
+        histogram.reset(new metrics_histogram());
+    }
+    return *histogram;
+}
+
+void metrics_registry::snapshot(std::vector<metrics_sample> &samples) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &entry : _counters) {
+        metrics_sample sample;
+        sample.name = entry.first.first;
+        sample.labels = entry.first.second;
+        sample.type = metrics_sample::counter;
+        sample.counter_value = entry.second->value();
+        samples.push_back(std::move(sample));
+    }
+    for (const auto &entry : _histograms) {
+        metrics_sample sample;
+        sample.name = entry.first.first;
+        sample.labels = entry.first.second;
+        sample.type = metrics_sample::histogram;
+        sample.histogram_value = entry.second->snapshot();
+        samples.push_back(std::move(sample));
+    }
+}
+
+void metrics_write_text(
+    const std::vector<metrics_sample> &samples, std::ostream &out_s)
+{
+    std::string last_name;
+    for (const metrics_sample &sample : samples) {
+        switch (sample.type) {
+        case metrics_sample::counter:
+            write_type(sample.name, "counter", last_name, out_s);
+            out_s << sample.name;
+            write_labels(sample.labels, "", "", out_s);
+            out_s << " " << std::to_string(sample.counter_value) << "\n";
+            break;
+        case metrics_sample::gauge:
+            write_type(sample.name, "gauge", last_name, out_s);
+            out_s << sample.name;
+            write_labels(sample.labels, "", "", out_s);
+            out_s << " " << std::to_string(sample.gauge_value) << "\n";
+            break;
+        case metrics_sample::histogram: {
+            const metrics_histogram_snapshot &h = sample.histogram_value;
+            const uint64_t values[num_histogram_quantiles] = {
+                h.p50, h.p90, h.p99, h.p999};
+            write_type(sample.name, "summary", last_name, out_s);
+            for (size_t i = 0; i < num_histogram_quantiles; ++i) {
+                out_s << sample.name;
+                write_labels(
+                    sample.labels,
+                    "quantile",
+                    histogram_quantile_labels[i],
+                    out_s);
+                out_s << " " << std::to_string(values[i]) << "\n";
+            }
+            out_s << sample.name << "_count";
+            write_labels(sample.labels, "", "", out_s);
+            out_s << " " << std::to_string(h.count) << "\n";
+            out_s << sample.name << "_sum";
+            write_labels(sample.labels, "", "", out_s);
+            out_s << " " << std::to_string(h.sum) << "\n";
+            out_s << sample.name << "_max";
+            write_labels(sample.labels, "", "", out_s);
+            out_s << " " << std::to_string(h.max) << "\n";
+            break;
+        }
+        }
+    }
+}
+
+} // namespace libzecale
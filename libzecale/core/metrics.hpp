@@ -0,0 +1,142 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_METRICS_HPP__
+#define __ZECALE_CORE_METRICS_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace libzecale
+{
+
+/// Monotonic count of events, updated without locking.
+class metrics_counter
+{
+public:
+    metrics_counter();
+
+    metrics_counter(const metrics_counter &other) = delete;
+    metrics_counter &operator=(const metrics_counter &other) = delete;
+
+    void increment(uint64_t n = 1);
+
+    uint64_t value() const;
+
+private:
+    std::atomic<uint64_t> _value;
+};
+
+/// Summary of the values recorded in a metrics_histogram.
+struct metrics_histogram_snapshot {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    /// Upper bounds of the buckets holding the 50th, 90th, 99th and 99.9th
+    /// percentiles.
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+/// Distribution of non-negative integer values (for example, latencies in
+/// microseconds), updated without locking. Values are counted in buckets
+/// whose width grows with the value (as in HDR histograms): each power of 2
+/// is divided into 2^sub_bucket_bits buckets, so quantiles are reported with
+/// a relative error of at most 1/2^sub_bucket_bits over the full range of
+/// values, using a fixed amount of memory.
+class metrics_histogram
+{
+public:
+    static const size_t sub_bucket_bits = 3;
+    static const size_t num_sub_buckets = 1 << sub_bucket_bits;
+    static const size_t num_buckets =
+        num_sub_buckets + (64 - sub_bucket_bits) * num_sub_buckets;
+
+    metrics_histogram();
+
+    metrics_histogram(const metrics_histogram &other) = delete;
+    metrics_histogram &operator=(const metrics_histogram &other) = delete;
+
+    void record(uint64_t value);
+
+    /// Summarize the recorded values. Values recorded concurrently may or
+    /// may not be included.
+    metrics_histogram_snapshot snapshot() const;
+
+    /// Index of the bucket holding a value.
+    static size_t bucket_index(uint64_t value);
+
+    /// Largest value held in a bucket.
+    static uint64_t bucket_upper_bound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, num_buckets> _buckets;
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+};
+
+/// Labels distinguishing instances of a metric (for example, the application
+/// or batch size).
+using metrics_labels = std::map<std::string, std::string>;
+
+/// Value of a metric at a point in time.
+struct metrics_sample {
+    enum sample_type { counter, gauge, histogram };
+
+    std::string name;
+    metrics_labels labels;
+    sample_type type;
+    uint64_t counter_value;
+    double gauge_value;
+    metrics_histogram_snapshot histogram_value;
+};
+
+/// Thread-safe set of named counters and histograms. Metrics are created on
+/// first use and live as long as the registry, so references to them may be
+/// held to avoid repeated lookups. Values which are cheap to compute on
+/// demand (such as pool sizes) are added to snapshots as gauges by the caller,
+/// rather than being held in the registry.
+class metrics_registry
+{
+public:
+    metrics_registry();
+
+    metrics_registry(const metrics_registry &other) = delete;
+    metrics_registry &operator=(const metrics_registry &other) = delete;
+
+    metrics_counter &counter(
+        const std::string &name, const metrics_labels &labels = {});
+
+    metrics_histogram &histogram(
+        const std::string &name, const metrics_labels &labels = {});
+
+    /// Append the current value of each metric, ordered by name and labels.
+    void snapshot(std::vector<metrics_sample> &samples) const;
+
+private:
+    using metric_key = std::pair<std::string, metrics_labels>;
+
+    mutable std::mutex _mutex;
+    std::map<metric_key, std::unique_ptr<metrics_counter>> _counters;
+    std::map<metric_key, std::unique_ptr<metrics_histogram>> _histograms;
+};
+
+/// Write samples in the Prometheus text exposition format. Histograms are
+/// written as summaries (count, sum and quantiles), along with their maximum.
+void metrics_write_text(
+    const std::vector<metrics_sample> &samples, std::ostream &out_s);
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_METRICS_HPP__
@@ -0,0 +1,107 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_NESTED_PROOF_VERIFIER_HPP__
+#define __ZECALE_CORE_NESTED_PROOF_VERIFIER_HPP__
+
+#include <libzeth/core/extended_proof.hpp>
+#include <libzeth/snarks/groth16/groth16_snark.hpp>
+#include <vector>
+
+namespace libzecale
+{
+
+/// Native (out-of-circuit) verification of nested proofs against a fixed
+/// verification key, used to reject invalid proofs before they are added to
+/// an application_pool.
+///
+/// The generic implementation verifies each proof individually, using
+/// nsnarkT::verify.
+///
+/// check_points is a cheaper check (not requiring the verification key) of
+/// the group elements of a single proof, used to reject malformed proofs as
+/// they are decoded. Callers which have already done so can pass
+/// `points_checked` to verify, to avoid repeating the check.
+template<typename nppT, typename nsnarkT> class nested_proof_verifier
+{
+public:
+    using extended_proof = libzeth::extended_proof<nppT, nsnarkT>;
+
+    explicit nested_proof_verifier(
+        const typename nsnarkT::verification_key &vk);
+
+    /// True if the group elements of the proof lie on the curve.
+    static bool check_points(const typename nsnarkT::proof &proof);
+
+    /// Verify a set of proofs, returning the result for each. If
+    /// `points_checked` is true, the caller guarantees that check_points
+    /// holds for each proof.
+    std::vector<bool> verify(
+        const std::vector<const extended_proof *> &extended_proofs,
+        bool points_checked = false) const;
+
+private:
+    const typename nsnarkT::verification_key _vk;
+};
+
+/// Verifier for Groth16 proofs. The G2 elements of the verification key are
+/// prepared (precomputed for the Miller loop) at construction. A set of n
+/// proofs is verified with a single check, using a random linear combination
+/// of the verification equations:
+///
+///   prod_j e(r_j A_j, B_j) = e(sum_j r_j alpha, beta)
+///                            e(sum_j r_j acc_j, g2)
+///                            e(sum_j r_j C_j, delta)
+///
+/// where acc_j is the input accumulator for the j-th proof, and r_j are random
+/// scalars. This requires n + 3 Miller loops and a single final
+/// exponentiation (rather than 4n Miller loops and n final exponentiations).
+/// If the combined check fails, each proof is checked individually to
+/// determine which are invalid.
+///
+/// The combined check is only sound if all proof elements lie in the
+/// prime-order subgroups (otherwise components in small subgroups may cancel
+/// with non-negligible probability), so proofs are first checked with
+/// check_points (unless the caller has already done so).
+template<typename nppT>
+class nested_proof_verifier<nppT, libzeth::groth16_snark<nppT>>
+{
+public:
+    using snark = libzeth::groth16_snark<nppT>;
+    using extended_proof = libzeth::extended_proof<nppT, snark>;
+
+    explicit nested_proof_verifier(const typename snark::verification_key &vk);
+
+    /// True if the group elements of the proof lie on the curve and in the
+    /// prime-order subgroup.
+    static bool check_points(const typename snark::proof &proof);
+
+    /// Verify a set of proofs, returning the result for each. If
+    /// `points_checked` is true, the caller guarantees that check_points
+    /// holds for each proof, and the (relatively expensive) subgroup checks
+    /// are skipped.
+    std::vector<bool> verify(
+        const std::vector<const extended_proof *> &extended_proofs,
+        bool points_checked = false) const;
+
+private:
+    const typename snark::verification_key _vk;
+    const libff::G2_precomp<nppT> _beta_g2_precomp;
+    const libff::G2_precomp<nppT> _delta_g2_precomp;
+    const libff::G2_precomp<nppT> _generator_g2_precomp;
+
+    /// Check the (combined) verification equation for a set of proofs, all of
+    /// which are well-formed, with the correct number of inputs. If
+    /// `randomize` is false, all coefficients are 1 (only useful for a single
+    /// proof).
+    bool check(
+        const std::vector<const extended_proof *> &extended_proofs,
+        bool randomize) const;
+};
+
+} // namespace libzecale
+
+#include "libzecale/core/nested_proof_verifier.tcc"
+
+#endif // __ZECALE_CORE_NESTED_PROOF_VERIFIER_HPP__
@@ -0,0 +1,195 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_NESTED_PROOF_VERIFIER_TCC__
+#define __ZECALE_CORE_NESTED_PROOF_VERIFIER_TCC__
+
+#include "libzecale/core/nested_proof_verifier.hpp"
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+/// True if a (well-formed) group element lies in the subgroup of order r,
+/// where r is the characteristic of the scalar field.
+template<typename nppT, typename GroupT>
+bool is_in_prime_order_subgroup(const GroupT &element)
+{
+    return (libff::Fr<nppT>::field_char() * element).is_zero();
+}
+
+} // namespace internal
+
+template<typename nppT, typename nsnarkT>
+nested_proof_verifier<nppT, nsnarkT>::nested_proof_verifier(
+    const typename nsnarkT::verification_key &vk)
+    : _vk(vk)
+{
+}
+
+template<typename nppT, typename nsnarkT>
+bool nested_proof_verifier<nppT, nsnarkT>::check_points(
+    const typename nsnarkT::proof &proof)
+{
+    return proof.is_well_formed();
+}
+
+template<typename nppT, typename nsnarkT>
+std::vector<bool> nested_proof_verifier<nppT, nsnarkT>::verify(
+    const std::vector<const extended_proof *> &extended_proofs,
+    bool points_checked) const
+{
+    // nsnarkT::verify does not rely on the proof elements having been checked.
+    (void)points_checked;
+    std::vector<bool> results(extended_proofs.size());
+    for (size_t i = 0; i < extended_proofs.size(); ++i) {
+        results[i] = nsnarkT::verify(
+            extended_proofs[i]->get_primary_inputs(),
+            extended_proofs[i]->get_proof(),
+            _vk);
+    }
+    return results;
+}
+
+template<typename nppT>
+nested_proof_verifier<nppT, libzeth::groth16_snark<nppT>>::
+    nested_proof_verifier(const typename snark::verification_key &vk)
+    : _vk(vk)
+    , _beta_g2_precomp(nppT::precompute_G2(vk.beta_g2))
+    , _delta_g2_precomp(nppT::precompute_G2(vk.delta_g2))
+    , _generator_g2_precomp(nppT::precompute_G2(libff::G2<nppT>::one()))
+{
+}
+
+template<typename nppT>
+bool nested_proof_verifier<nppT, libzeth::groth16_snark<nppT>>::check_points(
+    const typename snark::proof &proof)
+{
+    return proof.is_well_formed() &&
+           internal::is_in_prime_order_subgroup<nppT>(proof.g_A) &&
+           internal::is_in_prime_order_subgroup<nppT>(proof.g_B) &&
+           internal::is_in_prime_order_subgroup<nppT>(proof.g_C);
+}
+
+template<typename nppT>
+std::vector<bool> nested_proof_verifier<nppT, libzeth::groth16_snark<nppT>>::
+    verify(
+        const std::vector<const extended_proof *> &extended_proofs,
+        bool points_checked) const
+{
+    // Proofs which are malformed, or have the wrong number of inputs, are
+    // rejected immediately. The rest are checked together.
+    std::vector<bool> results(extended_proofs.size(), false);
+    std::vector<uint8_t> well_formed(extended_proofs.size());
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < extended_proofs.size(); ++i) {
+        const extended_proof &ep = *extended_proofs[i];
+        well_formed[i] =
+            ep.get_primary_inputs().size() == _vk.ABC_g1.size() &&
+            (points_checked || check_points(ep.get_proof()));
+    }
+
+    std::vector<size_t> candidate_indices;
+    std::vector<const extended_proof *> candidates;
+    for (size_t i = 0; i < extended_proofs.size(); ++i) {
+        if (well_formed[i]) {
+            candidate_indices.push_back(i);
+            candidates.push_back(extended_proofs[i]);
+        }
+    }
+
+    if (candidates.empty()) {
+        return results;
+    }
+
+    if (check(candidates, candidates.size() > 1)) {
+        for (const size_t idx : candidate_indices) {
+            results[idx] = true;
+        }
+        return results;
+    }
+
+    // At least one proof is invalid. Fall back to checking individually
+    // (unless there was only one).
+    if (candidates.size() > 1) {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            results[candidate_indices[i]] = check({candidates[i]}, false);
+        }
+    }
+    return results;
+}
+
+template<typename nppT>
+bool nested_proof_verifier<nppT, libzeth::groth16_snark<nppT>>::check(
+    const std::vector<const extended_proof *> &extended_proofs,
+    bool randomize) const
+{
+    const size_t num_proofs = extended_proofs.size();
+
+    // Random coefficients for each equation. (Generated up front, since the
+    // random source is not thread-safe.)
+    std::vector<libff::Fr<nppT>> coefficients(
+        num_proofs, libff::Fr<nppT>::one());
+    if (randomize) {
+        for (libff::Fr<nppT> &r : coefficients) {
+            r = libff::Fr<nppT>::random_element();
+        }
+    }
+
+    // Compute the Miller loop e(r_j A_j, B_j) and the scaled G1 terms for
+    // each proof.
+    std::vector<libff::Fqk<nppT>> proof_terms(num_proofs);
+    std::vector<libff::G1<nppT>> acc_terms(num_proofs);
+    std::vector<libff::G1<nppT>> C_terms(num_proofs);
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+    for (size_t j = 0; j < num_proofs; ++j) {
+        const typename snark::proof &proof = extended_proofs[j]->get_proof();
+        const libsnark::r1cs_primary_input<libff::Fr<nppT>> &inputs =
+            extended_proofs[j]->get_primary_inputs();
+        const libff::G1<nppT> acc =
+            _vk.ABC_g1
+                .template accumulate_chunk<libff::Fr<nppT>>(
+                    inputs.begin(), inputs.end(), 0)
+                .first;
+
+        proof_terms[j] = nppT::miller_loop(
+            nppT::precompute_G1(coefficients[j] * proof.g_A),
+            nppT::precompute_G2(proof.g_B));
+        acc_terms[j] = coefficients[j] * acc;
+        C_terms[j] = coefficients[j] * proof.g_C;
+    }
+
+    libff::Fr<nppT> coefficient_sum = libff::Fr<nppT>::zero();
+    libff::G1<nppT> acc_sum = libff::G1<nppT>::zero();
+    libff::G1<nppT> C_sum = libff::G1<nppT>::zero();
+    libff::Fqk<nppT> product = libff::Fqk<nppT>::one();
+    for (size_t j = 0; j < num_proofs; ++j) {
+        coefficient_sum = coefficient_sum + coefficients[j];
+        acc_sum = acc_sum + acc_terms[j];
+        C_sum = C_sum + C_terms[j];
+        product = product * proof_terms[j];
+    }
+
+    // Multiply by the inverse of the right-hand side, and check for 1.
+    product = product *
+              nppT::miller_loop(
+                  nppT::precompute_G1(-(coefficient_sum * _vk.alpha_g1)),
+                  _beta_g2_precomp) *
+              nppT::double_miller_loop(
+                  nppT::precompute_G1(-acc_sum),
+                  _generator_g2_precomp,
+                  nppT::precompute_G1(-C_sum),
+                  _delta_g2_precomp);
+    return nppT::final_exponentiation(product) == libff::GT<nppT>::one();
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_NESTED_PROOF_VERIFIER_TCC__
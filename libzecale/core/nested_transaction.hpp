@@ -6,6 +6,7 @@
 #define __ZECALE_CORE_NESTED_TRANSACTION_HPP__
 
 #include <array>
+#include <chrono>
 #include <libzeth/core/extended_proof.hpp>
 
 namespace libzecale
@@ -13,27 +14,47 @@ namespace libzecale
 
 /// This class represents transactions to be aggregated using zecale. The
 /// application name is used to determine which verification key needs to be
-/// used to verify the proof in the transaction.
+/// used to verify the proof in the transaction. The arrival time (by default,
+/// the time of construction) is used to bound the time that transactions wait
+/// to be aggregated.
+///
+/// Copies are cheap: the application name (which may be shared by all
+/// transactions for an application) and the extended proof are held by
+/// shared pointer, so only the parameters are copied. Transactions may also
+/// be constructed by transferring ownership of the proof and parameters, and
+/// moved.
 template<typename nppT, typename nsnarkT> class nested_transaction
 {
 private:
-    std::string _application_name;
+    std::shared_ptr<const std::string> _application_name;
     std::shared_ptr<libzeth::extended_proof<nppT, nsnarkT>> _extended_proof;
     std::vector<uint8_t> _parameters;
     uint32_t _fee_wei;
+    std::chrono::steady_clock::time_point _arrival_time;
+    uint64_t _id;
 
 public:
     // TODO: explicitly delete this to remove the possibility of undefined
     // object.
     nested_transaction();
 
-    // TODO: support move semantics for application_name, parameters and
-    // extended_proof.
     nested_transaction(
         const std::string &application_name,
         const libzeth::extended_proof<nppT, nsnarkT> &extended_proof,
         const std::vector<uint8_t> &parameters,
-        uint32_t fee_wei = 0);
+        uint32_t fee_wei = 0,
+        std::chrono::steady_clock::time_point arrival_time =
+            std::chrono::steady_clock::now());
+
+    /// Construct a transaction taking ownership of the extended proof and
+    /// parameters, with a shared (e.g. interned) application name.
+    nested_transaction(
+        std::shared_ptr<const std::string> application_name,
+        libzeth::extended_proof<nppT, nsnarkT> &&extended_proof,
+        std::vector<uint8_t> &&parameters,
+        uint32_t fee_wei = 0,
+        std::chrono::steady_clock::time_point arrival_time =
+            std::chrono::steady_clock::now());
 
     const std::string &application_name() const;
 
@@ -43,11 +64,21 @@ public:
 
     uint32_t fee_wei() const;
 
-    std::ostream &write_json(std::ostream &) const;
+    std::chrono::steady_clock::time_point arrival_time() const;
+
+    void set_arrival_time(std::chrono::steady_clock::time_point arrival_time);
 
-    /// Overload the less-than operator in order to compare objects in priority
-    /// queue
-    bool operator<(const nested_transaction<nppT, nsnarkT> &right) const;
+    /// Identifier assigned by the caller (for example, to track the
+    /// transaction in a write_ahead_log). Zero if not set.
+    uint64_t id() const;
+
+    void set_id(uint64_t id);
+
+    /// Approximate memory used by the transaction (used to bound the size of
+    /// transaction pools).
+    size_t size_bytes() const;
+
+    std::ostream &write_json(std::ostream &) const;
 };
 
 } // namespace libzecale
@@ -14,7 +14,12 @@ namespace libzecale
 
 template<typename nppT, typename nsnarkT>
 nested_transaction<nppT, nsnarkT>::nested_transaction()
+    : _application_name(), _fee_wei(0), _id(0)
 {
+    // All default-constructed transactions share the same empty name.
+    static const std::shared_ptr<const std::string> empty_name =
+        std::make_shared<const std::string>();
+    _application_name = empty_name;
 }
 
 template<typename nppT, typename nsnarkT>
@@ -22,20 +27,39 @@ nested_transaction<nppT, nsnarkT>::nested_transaction(
     const std::string &application_name,
     const libzeth::extended_proof<nppT, nsnarkT> &extended_proof,
     const std::vector<uint8_t> &parameters,
-    uint32_t fee_wei)
-    : _application_name(application_name)
+    uint32_t fee_wei,
+    std::chrono::steady_clock::time_point arrival_time)
+    : _application_name(std::make_shared<const std::string>(application_name))
+    , _extended_proof(std::make_shared<libzeth::extended_proof<nppT, nsnarkT>>(
+          extended_proof))
     , _parameters(parameters)
     , _fee_wei(fee_wei)
+    , _arrival_time(arrival_time)
+    , _id(0)
+{
+}
+
+template<typename nppT, typename nsnarkT>
+nested_transaction<nppT, nsnarkT>::nested_transaction(
+    std::shared_ptr<const std::string> application_name,
+    libzeth::extended_proof<nppT, nsnarkT> &&extended_proof,
+    std::vector<uint8_t> &&parameters,
+    uint32_t fee_wei,
+    std::chrono::steady_clock::time_point arrival_time)
+    : _application_name(std::move(application_name))
+    , _extended_proof(std::make_shared<libzeth::extended_proof<nppT, nsnarkT>>(
+          std::move(extended_proof)))
+    , _parameters(std::move(parameters))
+    , _fee_wei(fee_wei)
+    , _arrival_time(arrival_time)
+    , _id(0)
 {
-    this->_extended_proof =
-        std::make_shared<libzeth::extended_proof<nppT, nsnarkT>>(
-            extended_proof);
 }
 
 template<typename nppT, typename nsnarkT>
 const std::string &nested_transaction<nppT, nsnarkT>::application_name() const
 {
-    return _application_name;
+    return *_application_name;
 };
 
 template<typename nppT, typename nsnarkT>
@@ -58,13 +82,50 @@ uint32_t nested_transaction<nppT, nsnarkT>::fee_wei() const
     return _fee_wei;
 }
 
+template<typename nppT, typename nsnarkT>
+std::chrono::steady_clock::time_point nested_transaction<nppT, nsnarkT>::
+    arrival_time() const
+{
+    return _arrival_time;
+}
+
+template<typename nppT, typename nsnarkT>
+void nested_transaction<nppT, nsnarkT>::set_arrival_time(
+    std::chrono::steady_clock::time_point arrival_time)
+{
+    _arrival_time = arrival_time;
+}
+
+template<typename nppT, typename nsnarkT>
+uint64_t nested_transaction<nppT, nsnarkT>::id() const
+{
+    return _id;
+}
+
+template<typename nppT, typename nsnarkT>
+void nested_transaction<nppT, nsnarkT>::set_id(uint64_t id)
+{
+    _id = id;
+}
+
+template<typename nppT, typename nsnarkT>
+size_t nested_transaction<nppT, nsnarkT>::size_bytes() const
+{
+    const std::vector<libff::Fr<nppT>> &inputs =
+        _extended_proof->get_primary_inputs();
+    return sizeof(*this) + _parameters.size() +
+           sizeof(libzeth::extended_proof<nppT, nsnarkT>) +
+           sizeof(typename nsnarkT::proof) +
+           inputs.size() * sizeof(libff::Fr<nppT>);
+}
+
 template<typename nppT, typename nsnarkT>
 std::ostream &nested_transaction<nppT, nsnarkT>::write_json(
     std::ostream &os) const
 {
     os << "{\n"
           "\t\"app_name\": "
-       << "\"" << _application_name << "\"";
+       << "\"" << *_application_name << "\"";
     os << ",\n"
           "\t\"ext_proof\": ";
     _extended_proof->write_json(os);
@@ -75,13 +136,6 @@ std::ostream &nested_transaction<nppT, nsnarkT>::write_json(
     return os;
 }
 
-template<typename nppT, typename nsnarkT>
-bool nested_transaction<nppT, nsnarkT>::operator<(
-    const nested_transaction<nppT, nsnarkT> &right) const
-{
-    return fee_wei() < right.fee_wei();
-}
-
 } // namespace libzecale
 
 #endif // __ZECALE_CORE_NESTED_TRANSACTION_TCC__
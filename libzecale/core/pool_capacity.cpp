@@ -0,0 +1,75 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/pool_capacity.hpp"
+
+#include <algorithm>
+
+namespace libzecale
+{
+
+pool_capacity::pool_capacity(size_t max_transactions, size_t max_bytes)
+    : _max_transactions(max_transactions)
+    , _max_bytes(max_bytes)
+    , _num_transactions(0)
+    , _num_bytes(0)
+{
+}
+
+size_t pool_capacity::max_transactions() const { return _max_transactions; }
+
+size_t pool_capacity::max_bytes() const { return _max_bytes; }
+
+size_t pool_capacity::num_transactions() const
+{
+    return _num_transactions.load();
+}
+
+size_t pool_capacity::num_bytes() const { return _num_bytes.load(); }
+
+bool pool_capacity::full() const
+{
+    return (_max_transactions != 0 &&
+            _num_transactions.load() >= _max_transactions) ||
+           (_max_bytes != 0 && _num_bytes.load() >= _max_bytes);
+}
+
+bool pool_capacity::fits(
+    size_t tx_bytes,
+    size_t num_released_transactions,
+    size_t num_released_bytes) const
+{
+    const size_t num_transactions = _num_transactions.load();
+    const size_t num_bytes = _num_bytes.load();
+    const size_t remaining_transactions =
+        num_transactions -
+        std::min(num_transactions, num_released_transactions);
+    const size_t remaining_bytes =
+        num_bytes - std::min(num_bytes, num_released_bytes);
+    return (_max_transactions == 0 ||
+            remaining_transactions + 1 <= _max_transactions) &&
+           (_max_bytes == 0 || remaining_bytes + tx_bytes <= _max_bytes);
+}
+
+bool pool_capacity::try_reserve(size_t tx_bytes)
+{
+    // Optimistically reserve, and back out if either limit is exceeded.
+    const size_t num_transactions = ++_num_transactions;
+    const size_t num_bytes = (_num_bytes += tx_bytes);
+    if ((_max_transactions != 0 && num_transactions > _max_transactions) ||
+        (_max_bytes != 0 && num_bytes > _max_bytes)) {
+        release(tx_bytes);
+        return false;
+    }
+
+    return true;
+}
+
+void pool_capacity::release(size_t tx_bytes)
+{
+    _num_bytes -= tx_bytes;
+    --_num_transactions;
+}
+
+} // namespace libzecale
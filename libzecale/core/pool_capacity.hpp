@@ -0,0 +1,64 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_POOL_CAPACITY_HPP__
+#define __ZECALE_CORE_POOL_CAPACITY_HPP__
+
+#include <atomic>
+#include <cstddef>
+
+namespace libzecale
+{
+
+/// Thread-safe count of the transactions (and their size in bytes) held in
+/// one or more transaction pools, with optional limits on each. Space for a
+/// transaction is reserved before it is added to a pool, and released when it
+/// is removed. A limit of 0 means no limit.
+///
+/// Reservations do not take a lock. Concurrent reservations close to a limit
+/// may fail spuriously, but the limits are never exceeded.
+class pool_capacity
+{
+public:
+    explicit pool_capacity(size_t max_transactions = 0, size_t max_bytes = 0);
+
+    pool_capacity(const pool_capacity &other) = delete;
+    pool_capacity &operator=(const pool_capacity &other) = delete;
+
+    size_t max_transactions() const;
+
+    size_t max_bytes() const;
+
+    size_t num_transactions() const;
+
+    size_t num_bytes() const;
+
+    /// True if either limit has been reached.
+    bool full() const;
+
+    /// True if a transaction of the given size could be reserved, after
+    /// releasing `num_released_transactions` transactions totalling
+    /// `num_released_bytes`.
+    bool fits(
+        size_t tx_bytes,
+        size_t num_released_transactions = 0,
+        size_t num_released_bytes = 0) const;
+
+    /// Reserve space for a transaction of the given size, returning false
+    /// (without reserving anything) if this would exceed either limit.
+    bool try_reserve(size_t tx_bytes);
+
+    /// Release the space reserved for a transaction of the given size.
+    void release(size_t tx_bytes);
+
+private:
+    const size_t _max_transactions;
+    const size_t _max_bytes;
+    std::atomic<size_t> _num_transactions;
+    std::atomic<size_t> _num_bytes;
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_POOL_CAPACITY_HPP__
@@ -0,0 +1,57 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_RING_BUFFER_HPP__
+#define __ZECALE_CORE_RING_BUFFER_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace libzecale
+{
+
+/// Bounded, lock-free queue of elements, which may be pushed and popped by
+/// any number of threads concurrently. Each slot carries a sequence number
+/// indicating whether it is ready to be written or read at a given position,
+/// so that producers and consumers only contend on the position counters.
+/// Push fails (rather than blocking) when the buffer is full.
+///
+/// The capacity is rounded up to a power of 2. T must be default
+/// constructible and move assignable.
+template<typename T> class ring_buffer
+{
+public:
+    explicit ring_buffer(size_t capacity);
+
+    ring_buffer(const ring_buffer &other) = delete;
+    ring_buffer &operator=(const ring_buffer &other) = delete;
+
+    size_t capacity() const;
+
+    /// Move an element into the buffer. Returns false (leaving `value`
+    /// unchanged) if the buffer is full.
+    bool try_push(T &value);
+
+    /// Move the oldest element out of the buffer into `value`. Returns false
+    /// if the buffer is empty.
+    bool try_pop(T &value);
+
+private:
+    struct slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t _mask;
+    std::unique_ptr<slot[]> _slots;
+    std::atomic<size_t> _push_position;
+    std::atomic<size_t> _pop_position;
+};
+
+} // namespace libzecale
+
+#include "libzecale/core/ring_buffer.tcc"
+
+#endif // __ZECALE_CORE_RING_BUFFER_HPP__
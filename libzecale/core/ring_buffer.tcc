@@ -0,0 +1,108 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_RING_BUFFER_TCC__
+#define __ZECALE_CORE_RING_BUFFER_TCC__
+
+#include "libzecale/core/ring_buffer.hpp"
+
+#include <stdexcept>
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+inline size_t ring_buffer_size(size_t capacity)
+{
+    if (capacity == 0) {
+        throw std::invalid_argument("ring buffer capacity must be non-zero");
+    }
+
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+} // namespace internal
+
+template<typename T>
+ring_buffer<T>::ring_buffer(size_t capacity)
+    : _mask(internal::ring_buffer_size(capacity) - 1)
+    , _slots(new slot[_mask + 1])
+    , _push_position(0)
+    , _pop_position(0)
+{
+    // Slot i is initially ready to be written at position i.
+    for (size_t i = 0; i <= _mask; ++i) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T> size_t ring_buffer<T>::capacity() const
+{
+    return _mask + 1;
+}
+
+template<typename T> bool ring_buffer<T>::try_push(T &value)
+{
+    // Claim the next position, once its slot has been read at the previous
+    // position around the buffer.
+    size_t position = _push_position.load(std::memory_order_relaxed);
+    slot *s;
+    for (;;) {
+        s = &_slots[position & _mask];
+        const size_t sequence = s->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff =
+            (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+        if (diff == 0) {
+            if (_push_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = _push_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    s->value = std::move(value);
+    s->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T> bool ring_buffer<T>::try_pop(T &value)
+{
+    // Claim the next position, once its slot has been written.
+    size_t position = _pop_position.load(std::memory_order_relaxed);
+    slot *s;
+    for (;;) {
+        s = &_slots[position & _mask];
+        const size_t sequence = s->sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t diff =
+            (std::ptrdiff_t)sequence - (std::ptrdiff_t)(position + 1);
+        if (diff == 0) {
+            if (_pop_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = _pop_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    value = std::move(s->value);
+    s->sequence.store(position + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_RING_BUFFER_TCC__
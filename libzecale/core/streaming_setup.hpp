@@ -0,0 +1,50 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_STREAMING_SETUP_HPP__
+#define __ZECALE_CORE_STREAMING_SETUP_HPP__
+
+#include "libzecale/serialization/mapped_keypair.hpp"
+
+#include <functional>
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+#include <ostream>
+
+namespace libzecale
+{
+
+/// Called as the proving key is generated, with the number of group elements
+/// of the proving key queries computed so far, and the total number.
+using setup_progress_callback =
+    std::function<void(size_t num_computed, size_t num_total)>;
+
+/// Default number of group elements computed (in parallel) before being
+/// written out, by groth16_generate_setup_mapped.
+static const size_t default_setup_chunk_size = 1 << 16;
+
+/// Generate a Groth16 keypair (a trusted setup) for the given constraint
+/// system, writing it directly to `out_s` in the mapped format (see
+/// mapped_keypair.hpp). The proving key is identical in form to that of
+/// libsnark's generator, but its queries are computed in chunks of
+/// `chunk_size` group elements, each written to the stream once complete.
+/// The full proving key is therefore never held in memory. The file header
+/// holds `config_fingerprint`. Returns the verification key.
+///
+/// The constraint system is taken by value, and modified (see
+/// r1cs_constraint_system::swap_AB_if_beneficial), so that callers which no
+/// longer need it can move it in, rather than holding two copies.
+template<typename ppT>
+typename libzeth::groth16_snark<ppT>::verification_key
+groth16_generate_setup_mapped(
+    libsnark::r1cs_constraint_system<libff::Fr<ppT>> constraint_system,
+    std::ostream &out_s,
+    uint64_t config_fingerprint = 0,
+    size_t chunk_size = default_setup_chunk_size,
+    const setup_progress_callback &progress = setup_progress_callback());
+
+} // namespace libzecale
+
+#include "libzecale/core/streaming_setup.tcc"
+
+#endif // __ZECALE_CORE_STREAMING_SETUP_HPP__
@@ -0,0 +1,288 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_STREAMING_SETUP_TCC__
+#define __ZECALE_CORE_STREAMING_SETUP_TCC__
+
+#include "libzecale/core/streaming_setup.hpp"
+
+#include <algorithm>
+#include <libff/algebra/scalar_multiplication/multiexp.hpp>
+#include <libff/common/utils.hpp>
+#include <libsnark/knowledge_commitment/knowledge_commitment.hpp>
+#include <libsnark/reductions/r1cs_to_qap/r1cs_to_qap.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+/// Tracks the number of proving key elements computed, and reports to the
+/// caller's callback (if any).
+class setup_progress
+{
+public:
+    setup_progress(const setup_progress_callback &callback, size_t num_total)
+        : _callback(callback), _num_computed(0), _num_total(num_total)
+    {
+    }
+
+    void advance(size_t num_computed)
+    {
+        _num_computed += num_computed;
+        if (_callback) {
+            _callback(_num_computed, _num_total);
+        }
+    }
+
+private:
+    const setup_progress_callback &_callback;
+    size_t _num_computed;
+    size_t _num_total;
+};
+
+template<typename GroupT> void setup_to_special(std::vector<GroupT> &chunk)
+{
+#ifdef USE_MIXED_ADDITION
+    libff::batch_to_special(chunk);
+#else
+    libff::UNUSED(chunk);
+#endif
+}
+
+template<typename T1, typename T2>
+void setup_to_special(
+    std::vector<libsnark::knowledge_commitment<T1, T2>> &chunk)
+{
+#ifdef USE_MIXED_ADDITION
+    std::vector<T1> g(chunk.size());
+    std::vector<T2> h(chunk.size());
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        g[i] = chunk[i].g;
+        h[i] = chunk[i].h;
+    }
+    libff::batch_to_special(g);
+    libff::batch_to_special(h);
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        chunk[i] = libsnark::knowledge_commitment<T1, T2>(g[i], h[i]);
+    }
+#else
+    libff::UNUSED(chunk);
+#endif
+}
+
+/// Write a record of `count` elements, where `element(i)` computes the i-th
+/// element. Elements are computed in parallel, in chunks of `chunk_size`,
+/// and each chunk is written before the next is computed. As in libsnark's
+/// generator, elements are converted to special form if mixed addition is
+/// used.
+template<typename T, typename ElementFnT>
+void setup_write_computed_record(
+    mapped_keypair_writer &writer,
+    const size_t count,
+    const ElementFnT &element,
+    const size_t chunk_size,
+    setup_progress &progress)
+{
+    writer.begin_record(count, sizeof(T));
+    std::vector<T> chunk;
+    for (size_t begin = 0; begin < count; begin += chunk_size) {
+        const size_t end = std::min(count, begin + chunk_size);
+        chunk.resize(end - begin);
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+        for (size_t i = begin; i < end; ++i) {
+            chunk[i - begin] = element(i);
+        }
+        setup_to_special(chunk);
+        writer.write_record_data(chunk.data(), chunk.size() * sizeof(T));
+        progress.advance(chunk.size());
+    }
+    writer.end_record();
+}
+
+} // namespace internal
+
+template<typename ppT>
+typename libzeth::groth16_snark<ppT>::verification_key
+groth16_generate_setup_mapped(
+    libsnark::r1cs_constraint_system<libff::Fr<ppT>> constraint_system,
+    std::ostream &out_s,
+    const uint64_t config_fingerprint,
+    const size_t chunk_size,
+    const setup_progress_callback &progress)
+{
+    using FieldT = libff::Fr<ppT>;
+    using G1 = libff::G1<ppT>;
+    using G2 = libff::G2<ppT>;
+    using knowledge_commitment = libsnark::knowledge_commitment<G2, G1>;
+
+    if (chunk_size == 0) {
+        throw std::invalid_argument("invalid setup chunk size");
+    }
+
+    // As in libsnark's generator, make B_query lighter if possible.
+    libsnark::r1cs_constraint_system<FieldT> &r1cs = constraint_system;
+    r1cs.swap_AB_if_beneficial();
+
+    // Secret randomness
+    const FieldT t = FieldT::random_element();
+    const FieldT alpha = FieldT::random_element();
+    const FieldT beta = FieldT::random_element();
+    const FieldT delta = FieldT::random_element();
+    const FieldT delta_inverse = delta.inverse();
+
+    // The QAP evaluated at t. Only these field elements (and not the group
+    // elements computed from them) are held for the whole setup.
+    libsnark::qap_instance_evaluation<FieldT> qap =
+        libsnark::r1cs_to_qap_instance_map_with_evaluation(r1cs, t);
+    const size_t num_variables = qap.num_variables();
+    const size_t num_inputs = qap.num_inputs();
+    const std::vector<FieldT> At = std::move(qap.At);
+    const std::vector<FieldT> Bt = std::move(qap.Bt);
+    std::vector<FieldT> Ct = std::move(qap.Ct);
+    std::vector<FieldT> Ht = std::move(qap.Ht);
+
+    // Replace C_i(t) by beta * A_i(t) + alpha * B_i(t) + C_i(t). The first
+    // num_inputs + 1 entries give the verification key (ABC_g1), and the
+    // remaining entries (scaled by delta^{-1}) give L_query.
+    for (size_t i = 0; i < Ct.size(); ++i) {
+        Ct[i] = beta * At[i] + alpha * Bt[i] + Ct[i];
+    }
+
+    // H for Groth16 has degree d-2, while the QAP reduction gives the
+    // coefficients of a degree d polynomial.
+    Ht.resize(Ht.size() - 2);
+    const FieldT Zt_delta_inverse = qap.Zt * delta_inverse;
+
+    std::vector<size_t> B_indices;
+    for (size_t i = 0; i < Bt.size(); ++i) {
+        if (!Bt[i].is_zero()) {
+            B_indices.push_back(i);
+        }
+    }
+
+    const size_t A_query_size = At.size();
+    const size_t H_query_size = Ht.size();
+    const size_t L_query_size = num_variables - num_inputs;
+    const size_t L_offset = num_inputs + 1;
+    const size_t num_query_elements =
+        A_query_size + B_indices.size() + H_query_size + L_query_size;
+
+    // Fixed-base exponentiation tables, used for all chunks.
+    const size_t scalar_size = FieldT::size_in_bits();
+    const size_t g1_window_size =
+        libff::get_exp_window_size<G1>(num_query_elements);
+    const size_t g2_window_size =
+        libff::get_exp_window_size<G2>(B_indices.size());
+    const libff::window_table<G1> g1_table =
+        libff::get_window_table(scalar_size, g1_window_size, G1::one());
+    const libff::window_table<G2> g2_table =
+        libff::get_window_table(scalar_size, g2_window_size, G2::one());
+
+    // The verification key, which is small.
+    typename libzeth::groth16_snark<ppT>::verification_key vk;
+    vk.alpha_g1 = alpha * G1::one();
+    vk.beta_g2 = beta * G2::one();
+    vk.delta_g2 = delta * G2::one();
+    std::vector<G1> ABC_rest;
+    ABC_rest.reserve(num_inputs);
+    for (size_t i = 1; i < L_offset; ++i) {
+        ABC_rest.push_back(libff::windowed_exp(
+            scalar_size, g1_window_size, g1_table, Ct[i]));
+    }
+    vk.ABC_g1 = libsnark::accumulation_vector<G1>(
+        libff::windowed_exp(scalar_size, g1_window_size, g1_table, Ct[0]),
+        std::move(ABC_rest));
+
+    internal::setup_progress progress_tracker(progress, num_query_elements);
+
+    // Write the body after space for the header, which is written last.
+    const std::streampos header_pos = out_s.tellp();
+    out_s.seekp(header_pos + (std::streamoff)mapped_keypair_body_offset);
+
+    internal::mapped_keypair_writer writer(out_s);
+    internal::mapped_write_representation_check<ppT>(writer);
+
+    internal::mapped_write_object(writer, vk.alpha_g1);
+    internal::mapped_write_object<G1>(writer, beta * G1::one());
+    internal::mapped_write_object(writer, vk.beta_g2);
+    internal::mapped_write_object<G1>(writer, delta * G1::one());
+    internal::mapped_write_object(writer, vk.delta_g2);
+
+    // A_query
+    internal::setup_write_computed_record<G1>(
+        writer,
+        A_query_size,
+        [&](size_t i) {
+            return libff::windowed_exp(
+                scalar_size, g1_window_size, g1_table, At[i]);
+        },
+        chunk_size,
+        progress_tracker);
+
+    // B_query (sparse, holding only the non-zero entries)
+    internal::mapped_write_object<uint64_t>(writer, Bt.size());
+    internal::mapped_write_vector(writer, B_indices);
+    internal::setup_write_computed_record<knowledge_commitment>(
+        writer,
+        B_indices.size(),
+        [&](size_t i) {
+            const FieldT &B_i = Bt[B_indices[i]];
+            return knowledge_commitment(
+                libff::windowed_exp(scalar_size, g2_window_size, g2_table, B_i),
+                libff::windowed_exp(
+                    scalar_size, g1_window_size, g1_table, B_i));
+        },
+        chunk_size,
+        progress_tracker);
+
+    // H_query
+    internal::setup_write_computed_record<G1>(
+        writer,
+        H_query_size,
+        [&](size_t i) {
+            return libff::windowed_exp(
+                scalar_size,
+                g1_window_size,
+                g1_table,
+                Ht[i] * Zt_delta_inverse);
+        },
+        chunk_size,
+        progress_tracker);
+
+    // L_query
+    internal::setup_write_computed_record<G1>(
+        writer,
+        L_query_size,
+        [&](size_t i) {
+            return libff::windowed_exp(
+                scalar_size,
+                g1_window_size,
+                g1_table,
+                Ct[L_offset + i] * delta_inverse);
+        },
+        chunk_size,
+        progress_tracker);
+
+    internal::mapped_write_constraint_system<ppT>(writer, r1cs);
+
+    internal::mapped_write_object(writer, vk.alpha_g1);
+    internal::mapped_write_object(writer, vk.beta_g2);
+    internal::mapped_write_object(writer, vk.delta_g2);
+    internal::mapped_write_object(writer, vk.ABC_g1.first);
+    internal::mapped_write_sparse_vector(writer, vk.ABC_g1.rest);
+
+    internal::mapped_write_header<ppT>(
+        out_s, header_pos, r1cs, config_fingerprint, writer);
+    return vk;
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_STREAMING_SETUP_TCC__
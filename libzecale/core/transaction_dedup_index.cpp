@@ -0,0 +1,87 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/transaction_dedup_index.hpp"
+
+#include <cstring>
+
+namespace libzecale
+{
+
+size_t transaction_dedup_index::hash_hasher::operator()(
+    const transaction_hash &hash) const
+{
+    // The content hash is uniformly distributed, so any bytes will do.
+    size_t value;
+    memcpy(&value, hash.data(), sizeof(value));
+    return value;
+}
+
+transaction_dedup_index::transaction_dedup_index(
+    std::chrono::milliseconds ttl, size_t max_aggregated)
+    : _ttl(ttl), _max_aggregated(max_aggregated)
+{
+}
+
+bool transaction_dedup_index::add_pending(const transaction_hash &hash)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    expire(std::chrono::steady_clock::now());
+    entry e;
+    e.pending = true;
+    return _entries.insert(std::make_pair(hash, e)).second;
+}
+
+void transaction_dedup_index::set_aggregated(const transaction_hash &hash)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    expire(now);
+
+    const auto it = _entries.find(hash);
+    if (it != _entries.end() && !it->second.pending) {
+        return;
+    }
+    if (_max_aggregated == 0 || _ttl.count() <= 0) {
+        if (it != _entries.end()) {
+            _entries.erase(it);
+        }
+        return;
+    }
+
+    entry &e = _entries[hash];
+    e.pending = false;
+    e.expiry = now + _ttl;
+    _aggregated.push_back(hash);
+    expire(now);
+}
+
+void transaction_dedup_index::remove(const transaction_hash &hash)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _entries.find(hash);
+    if (it != _entries.end() && it->second.pending) {
+        _entries.erase(it);
+    }
+}
+
+size_t transaction_dedup_index::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+void transaction_dedup_index::expire(std::chrono::steady_clock::time_point now)
+{
+    // All aggregated entries have the same TTL, so expire in insertion order.
+    while (!_aggregated.empty() &&
+           (_aggregated.size() > _max_aggregated ||
+            _entries.at(_aggregated.front()).expiry <= now)) {
+        _entries.erase(_aggregated.front());
+        _aggregated.pop_front();
+    }
+}
+
+} // namespace libzecale
@@ -0,0 +1,94 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_TRANSACTION_DEDUP_INDEX_HPP__
+#define __ZECALE_CORE_TRANSACTION_DEDUP_INDEX_HPP__
+
+#include "libzecale/core/nested_transaction.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace libzecale
+{
+
+/// Content hash (BLAKE2b, 256 bits) of a nested transaction.
+using transaction_hash = std::array<uint8_t, 32>;
+
+/// Compute the content hash of a transaction, covering its proof, primary
+/// inputs and parameters (but not its fee, so that resubmitting a proof with
+/// a different fee is detected as a duplicate).
+template<typename nppT, typename nsnarkT>
+transaction_hash nested_transaction_hash(
+    const nested_transaction<nppT, nsnarkT> &tx);
+
+/// Default time for which aggregated transactions are remembered.
+static const std::chrono::milliseconds default_dedup_ttl(10 * 60 * 1000);
+
+/// Default maximum number of aggregated transactions remembered.
+static const size_t default_dedup_max_aggregated = 1 << 16;
+
+/// Thread-safe index of the content hashes of an application's transactions,
+/// used to reject duplicates. A transaction is a duplicate if it is pending
+/// (in the pool), or was aggregated less than `ttl` ago. Pending entries are
+/// held while the transaction is in the pool. Aggregated entries are held for
+/// at most `ttl`, and at most `max_aggregated` of them are held, the oldest
+/// being evicted first.
+class transaction_dedup_index
+{
+public:
+    explicit transaction_dedup_index(
+        std::chrono::milliseconds ttl = default_dedup_ttl,
+        size_t max_aggregated = default_dedup_max_aggregated);
+
+    transaction_dedup_index(const transaction_dedup_index &other) = delete;
+    transaction_dedup_index &operator=(const transaction_dedup_index &other) =
+        delete;
+
+    /// Add a pending transaction. Returns false (leaving the index unchanged)
+    /// if the transaction is a duplicate.
+    bool add_pending(const transaction_hash &hash);
+
+    /// Mark a pending transaction as aggregated.
+    void set_aggregated(const transaction_hash &hash);
+
+    /// Remove a pending transaction (for example, if it is rejected after
+    /// being added, or its batch fails), so that it may be resubmitted.
+    void remove(const transaction_hash &hash);
+
+    /// Number of pending and aggregated transactions held.
+    size_t size() const;
+
+private:
+    struct hash_hasher {
+        size_t operator()(const transaction_hash &hash) const;
+    };
+
+    /// Pending entries have no expiry time.
+    struct entry {
+        bool pending;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    const std::chrono::milliseconds _ttl;
+    const size_t _max_aggregated;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<transaction_hash, entry, hash_hasher> _entries;
+
+    /// Hashes of aggregated entries, in order of expiry.
+    std::deque<transaction_hash> _aggregated;
+
+    void expire(std::chrono::steady_clock::time_point now);
+};
+
+} // namespace libzecale
+
+#include "libzecale/core/transaction_dedup_index.tcc"
+
+#endif // __ZECALE_CORE_TRANSACTION_DEDUP_INDEX_HPP__
@@ -0,0 +1,55 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_TRANSACTION_DEDUP_INDEX_TCC__
+#define __ZECALE_CORE_TRANSACTION_DEDUP_INDEX_TCC__
+
+#include "libzecale/core/transaction_dedup_index.hpp"
+
+#include <libzeth/core/field_element_utils.hpp>
+#include <sodium/crypto_generichash_blake2b.h>
+#include <sstream>
+
+namespace libzecale
+{
+
+template<typename nppT, typename nsnarkT>
+transaction_hash nested_transaction_hash(
+    const nested_transaction<nppT, nsnarkT> &tx)
+{
+    // The proof and inputs are hashed in their canonical serialized form,
+    // and the number of inputs and size of the parameters are included so
+    // that the encoding is unambiguous.
+    const libzeth::extended_proof<nppT, nsnarkT> &extended_proof =
+        tx.extended_proof();
+    const std::vector<libff::Fr<nppT>> &inputs =
+        extended_proof.get_primary_inputs();
+    const std::vector<uint8_t> &parameters = tx.parameters();
+
+    std::ostringstream data;
+    nsnarkT::proof_write_bytes(extended_proof.get_proof(), data);
+    const uint64_t num_inputs = inputs.size();
+    data.write((const char *)&num_inputs, sizeof(num_inputs));
+    for (const libff::Fr<nppT> &input : inputs) {
+        libzeth::field_element_write_bytes(input, data);
+    }
+    const uint64_t parameters_size = parameters.size();
+    data.write((const char *)&parameters_size, sizeof(parameters_size));
+    data.write((const char *)parameters.data(), parameters.size());
+    const std::string bytes = data.str();
+
+    transaction_hash hash;
+    crypto_generichash_blake2b(
+        hash.data(),
+        hash.size(),
+        (const unsigned char *)bytes.data(),
+        bytes.size(),
+        nullptr,
+        0);
+    return hash;
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_TRANSACTION_DEDUP_INDEX_TCC__
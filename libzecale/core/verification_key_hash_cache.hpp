@@ -0,0 +1,60 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_VERIFICATION_KEY_HASH_CACHE_HPP__
+#define __ZECALE_CORE_VERIFICATION_KEY_HASH_CACHE_HPP__
+
+#include "libzecale/circuits/verification_key_hash_gadget.hpp"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace libzecale
+{
+
+/// Thread-safe cache of the hashes of nested verification keys (as computed
+/// by verification_key_hash_gadget::compute_hash), addressed by the content
+/// (serialized bytes) of the key. At most `max_entries` hashes are held, the
+/// oldest being evicted first.
+template<typename wppT, typename nverifierT> class verification_key_hash_cache
+{
+public:
+    using FieldT = libff::Fr<wppT>;
+    using nsnark = typename nverifierT::snark;
+
+    static const size_t default_max_entries = 1024;
+
+    verification_key_hash_cache(
+        size_t num_inputs_per_nested_proof,
+        size_t max_entries = default_max_entries);
+
+    verification_key_hash_cache(const verification_key_hash_cache &other) =
+        delete;
+    verification_key_hash_cache &operator=(
+        const verification_key_hash_cache &other) = delete;
+
+    /// Return the hash of `vk`, computing it if it is not in the cache.
+    FieldT get_hash(const typename nsnark::verification_key &vk);
+
+    /// Number of hashes currently held.
+    size_t size() const;
+
+private:
+    const size_t _num_inputs_per_nested_proof;
+    const size_t _max_entries;
+
+    mutable std::mutex _mutex;
+    std::map<std::string, FieldT> _hashes;
+
+    /// Keys of _hashes, in order of insertion.
+    std::deque<std::string> _insertion_order;
+};
+
+} // namespace libzecale
+
+#include "libzecale/core/verification_key_hash_cache.tcc"
+
+#endif // __ZECALE_CORE_VERIFICATION_KEY_HASH_CACHE_HPP__
@@ -0,0 +1,71 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_VERIFICATION_KEY_HASH_CACHE_TCC__
+#define __ZECALE_CORE_VERIFICATION_KEY_HASH_CACHE_TCC__
+
+#include "libzecale/core/verification_key_hash_cache.hpp"
+
+#include <sstream>
+
+namespace libzecale
+{
+
+template<typename wppT, typename nverifierT>
+const size_t verification_key_hash_cache<wppT, nverifierT>::default_max_entries;
+
+template<typename wppT, typename nverifierT>
+verification_key_hash_cache<wppT, nverifierT>::verification_key_hash_cache(
+    size_t num_inputs_per_nested_proof, size_t max_entries)
+    : _num_inputs_per_nested_proof(num_inputs_per_nested_proof)
+    , _max_entries(max_entries)
+{
+}
+
+template<typename wppT, typename nverifierT>
+libff::Fr<wppT> verification_key_hash_cache<wppT, nverifierT>::get_hash(
+    const typename nsnark::verification_key &vk)
+{
+    std::ostringstream vk_stream;
+    nsnark::verification_key_write_bytes(vk, vk_stream);
+    std::string vk_bytes = vk_stream.str();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto it = _hashes.find(vk_bytes);
+        if (it != _hashes.end()) {
+            return it->second;
+        }
+    }
+
+    // Compute the hash without holding the lock. If several threads compute
+    // the hash of the same key concurrently, the first to finish inserts it.
+    const FieldT hash =
+        verification_key_hash_gadget<wppT, nverifierT>::compute_hash(
+            vk, _num_inputs_per_nested_proof);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_max_entries == 0) {
+        return hash;
+    }
+    if (_hashes.insert(std::make_pair(vk_bytes, hash)).second) {
+        _insertion_order.push_back(std::move(vk_bytes));
+        if (_insertion_order.size() > _max_entries) {
+            _hashes.erase(_insertion_order.front());
+            _insertion_order.pop_front();
+        }
+    }
+    return hash;
+}
+
+template<typename wppT, typename nverifierT>
+size_t verification_key_hash_cache<wppT, nverifierT>::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hashes.size();
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_VERIFICATION_KEY_HASH_CACHE_TCC__
@@ -0,0 +1,71 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/worker_pool.hpp"
+
+#include <algorithm>
+
+namespace libzecale
+{
+
+worker_pool::worker_pool(size_t num_threads) : _stopping(false)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    _threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        _threads.emplace_back([this]() { run(); });
+    }
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _task_posted.notify_all();
+    for (std::thread &thread : _threads) {
+        thread.join();
+    }
+}
+
+size_t worker_pool::num_threads() const { return _threads.size(); }
+
+size_t worker_pool::num_queued() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tasks.size();
+}
+
+void worker_pool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _task_posted.notify_one();
+}
+
+void worker_pool::run()
+{
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _task_posted.wait(
+                lock, [this]() { return _stopping || !_tasks.empty(); });
+            if (_tasks.empty()) {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace libzecale
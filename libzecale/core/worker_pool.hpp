@@ -0,0 +1,53 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_WORKER_POOL_HPP__
+#define __ZECALE_CORE_WORKER_POOL_HPP__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libzecale
+{
+
+/// A fixed set of threads running tasks from a shared queue, in the order in
+/// which they are posted. Tasks must not throw. On destruction, all tasks
+/// already posted are run before the threads are joined.
+class worker_pool
+{
+public:
+    /// Create a pool with the given number of threads (by default, the number
+    /// of hardware threads).
+    explicit worker_pool(size_t num_threads = 0);
+
+    ~worker_pool();
+
+    worker_pool(const worker_pool &other) = delete;
+    worker_pool &operator=(const worker_pool &other) = delete;
+
+    size_t num_threads() const;
+
+    /// Number of tasks waiting for a thread.
+    size_t num_queued() const;
+
+    /// Queue a task to be run by one of the threads.
+    void post(std::function<void()> task);
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _task_posted;
+    bool _stopping;
+    std::deque<std::function<void()>> _tasks;
+    std::vector<std::thread> _threads;
+
+    void run();
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_WORKER_POOL_HPP__
@@ -0,0 +1,601 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/write_ahead_log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace libzecale
+{
+
+namespace
+{
+
+/// Header of each record. The checksum (64-bit FNV-1a) covers the remaining
+/// fields of the header and the payload. Removal records have type 0, and
+/// their payload is the array of ids of the removed entries.
+struct log_record_header {
+    uint64_t checksum;
+    uint64_t id;
+    uint64_t timestamp;
+    uint32_t type;
+    uint32_t size;
+};
+
+/// Header of the snapshot file, which is followed by a record for each live
+/// entry. Replay continues from segment `first_segment`.
+struct log_snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t first_segment;
+    uint64_t next_id;
+    uint64_t num_entries;
+};
+
+const char log_snapshot_magic[8] = {'Z', 'E', 'C', 'W', 'A', 'L', 0, 0};
+const uint32_t log_snapshot_version = 1;
+const uint32_t log_remove_type = 0;
+const char log_segment_prefix[] = "segment-";
+
+uint64_t log_checksum(const log_record_header &header, const char *payload)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto update = [&hash](const void *data, size_t size) {
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        }
+    };
+    update(
+        (const uint8_t *)&header + sizeof(header.checksum),
+        sizeof(header) - sizeof(header.checksum));
+    update(payload, header.size);
+    return hash;
+}
+
+void log_encode_record(
+    std::string &out,
+    uint64_t id,
+    uint64_t timestamp,
+    uint32_t type,
+    const std::string &payload)
+{
+    if (payload.size() > UINT32_MAX) {
+        throw std::invalid_argument("log entry too large");
+    }
+    log_record_header header;
+    memset(&header, 0, sizeof(header));
+    header.id = id;
+    header.timestamp = timestamp;
+    header.type = type;
+    header.size = (uint32_t)payload.size();
+    header.checksum = log_checksum(header, payload.data());
+    out.append((const char *)&header, sizeof(header));
+    out.append(payload);
+}
+
+/// Records decoded from a file, up to the first incomplete or corrupt record
+/// (if any), in which case `complete` is false.
+struct log_decoded_records {
+    std::vector<log_record_header> headers;
+    std::vector<std::string> payloads;
+    size_t valid_size;
+    bool complete;
+};
+
+void log_decode_records(
+    const std::string &data, size_t offset, log_decoded_records &records)
+{
+    records.complete = true;
+    while (offset < data.size()) {
+        log_record_header header;
+        if (data.size() - offset < sizeof(header)) {
+            records.complete = false;
+            break;
+        }
+        memcpy(&header, data.data() + offset, sizeof(header));
+        const char *payload = data.data() + offset + sizeof(header);
+        if (data.size() - offset - sizeof(header) < header.size ||
+            header.checksum != log_checksum(header, payload)) {
+            records.complete = false;
+            break;
+        }
+        records.headers.push_back(header);
+        records.payloads.emplace_back(payload, header.size);
+        offset += sizeof(header) + header.size;
+    }
+    records.valid_size = offset;
+}
+
+uint64_t log_now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string log_error(const std::string &message, const std::string &path)
+{
+    return message + " " + path + ": " + std::strerror(errno);
+}
+
+std::string log_read_file(const std::string &path)
+{
+    std::ifstream in_s(path.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!in_s) {
+        throw std::runtime_error(log_error("failed to open", path));
+    }
+    std::ostringstream data;
+    data << in_s.rdbuf();
+    return data.str();
+}
+
+/// Write all data to a file descriptor and sync it. Returns an error message
+/// on failure.
+std::string log_write_and_sync(int fd, const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t n =
+            ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return std::string("write failed: ") + std::strerror(errno);
+        }
+        written += (size_t)n;
+    }
+#ifdef __APPLE__
+    const int result = ::fsync(fd);
+#else
+    const int result = ::fdatasync(fd);
+#endif
+    if (result != 0) {
+        return std::string("sync failed: ") + std::strerror(errno);
+    }
+    return std::string();
+}
+
+/// Sync a directory, so that files created or renamed in it are durable.
+void log_sync_dir(const std::string &dir)
+{
+    const int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+/// Numbers of all segment files in the directory, in increasing order.
+std::vector<uint64_t> log_list_segments(const std::string &dir)
+{
+    DIR *d = ::opendir(dir.c_str());
+    if (d == nullptr) {
+        throw std::runtime_error(log_error("failed to list", dir));
+    }
+    std::vector<uint64_t> segments;
+    const size_t prefix_size = sizeof(log_segment_prefix) - 1;
+    while (const struct dirent *e = ::readdir(d)) {
+        const char *name = e->d_name;
+        if (strncmp(name, log_segment_prefix, prefix_size) == 0) {
+            char *end = nullptr;
+            const uint64_t segment = strtoull(name + prefix_size, &end, 10);
+            if (end != name + prefix_size && *end == '\0') {
+                segments.push_back(segment);
+            }
+        }
+    }
+    ::closedir(d);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+} // namespace
+
+write_ahead_log::write_ahead_log(
+    const std::string &dir, size_t snapshot_interval)
+    : _dir(dir)
+    , _snapshot_interval(snapshot_interval)
+    , _entries()
+    , _next_id(1)
+    , _pending()
+    , _appended_seq(0)
+    , _durable_seq(0)
+    , _flushing(false)
+    , _error()
+    , _segment_fd(-1)
+    , _segment(0)
+    , _records_since_snapshot(0)
+    , _replayed(false)
+    , _snapshot_job()
+    , _snapshot_failure_handler()
+    , _num_failed_snapshots(0)
+    , _stopping(false)
+{
+    if (snapshot_interval == 0) {
+        throw std::invalid_argument("invalid snapshot interval");
+    }
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error(log_error("failed to create", dir));
+    }
+    _snapshot_thread = std::thread([this]() { snapshot_loop(); });
+}
+
+write_ahead_log::~write_ahead_log()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _snapshot_queued.notify_all();
+    _snapshot_thread.join();
+    if (_segment_fd >= 0) {
+        ::close(_segment_fd);
+    }
+}
+
+std::vector<write_ahead_log::entry> write_ahead_log::replay()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_replayed) {
+        throw std::logic_error("log already replayed");
+    }
+
+    // Read the snapshot, if any.
+    uint64_t first_segment = 0;
+    const std::string snapshot_file = snapshot_path();
+    if (::access(snapshot_file.c_str(), F_OK) == 0) {
+        const std::string data = log_read_file(snapshot_file);
+        log_snapshot_header header;
+        if (data.size() < sizeof(header)) {
+            throw std::runtime_error("invalid log snapshot");
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, log_snapshot_magic, sizeof(header.magic)) !=
+                0 ||
+            header.version != log_snapshot_version) {
+            throw std::runtime_error("invalid log snapshot");
+        }
+
+        log_decoded_records records;
+        log_decode_records(data, sizeof(header), records);
+        if (!records.complete ||
+            records.headers.size() != header.num_entries) {
+            throw std::runtime_error("corrupt log snapshot");
+        }
+        for (size_t i = 0; i < records.headers.size(); ++i) {
+            const log_record_header &r = records.headers[i];
+            _entries[r.id] = entry{
+                r.id,
+                r.type,
+                r.timestamp,
+                std::make_shared<const std::string>(
+                    std::move(records.payloads[i]))};
+        }
+        first_segment = header.first_segment;
+        _next_id = header.next_id;
+    }
+
+    // Segments older than the snapshot remain if the process stopped before
+    // they were deleted.
+    std::vector<uint64_t> segments;
+    for (const uint64_t segment : log_list_segments(_dir)) {
+        if (segment < first_segment) {
+            ::unlink(segment_path(segment).c_str());
+        } else {
+            segments.push_back(segment);
+        }
+    }
+
+    // Read and check the segments in parallel, then apply them in order.
+    std::vector<log_decoded_records> decoded(segments.size());
+    std::vector<std::string> errors(segments.size());
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+    for (size_t i = 0; i < segments.size(); ++i) {
+        try {
+            log_decode_records(
+                log_read_file(segment_path(segments[i])), 0, decoded[i]);
+        } catch (const std::exception &e) {
+            errors[i] = e.what();
+        }
+    }
+
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (!errors[i].empty()) {
+            throw std::runtime_error(errors[i]);
+        }
+        const bool last = (i + 1 == segments.size());
+        if (!decoded[i].complete) {
+            if (!last) {
+                throw std::runtime_error(
+                    "corrupt log segment " + segment_path(segments[i]));
+            }
+            // Discard a partially written record at the end of the log.
+            if (::truncate(
+                    segment_path(segments[i]).c_str(),
+                    (off_t)decoded[i].valid_size) != 0) {
+                throw std::runtime_error(
+                    log_error("failed to truncate", segment_path(segments[i])));
+            }
+        }
+
+        // Applying records is idempotent, since records appended while a
+        // snapshot is taken may be reflected in both the snapshot and the
+        // following segment.
+        for (size_t j = 0; j < decoded[i].headers.size(); ++j) {
+            const log_record_header &r = decoded[i].headers[j];
+            std::string &payload = decoded[i].payloads[j];
+            if (r.type == log_remove_type) {
+                const size_t num_ids = payload.size() / sizeof(uint64_t);
+                for (size_t k = 0; k < num_ids; ++k) {
+                    uint64_t id;
+                    memcpy(&id, payload.data() + k * sizeof(id), sizeof(id));
+                    _entries.erase(id);
+                }
+            } else {
+                _entries[r.id] = entry{
+                    r.id,
+                    r.type,
+                    r.timestamp,
+                    std::make_shared<const std::string>(std::move(payload))};
+                _next_id = std::max(_next_id, r.id + 1);
+            }
+            ++_records_since_snapshot;
+        }
+    }
+
+    // New records are appended to a new segment.
+    start_segment(segments.empty() ? first_segment : segments.back() + 1);
+    _replayed = true;
+
+    std::vector<entry> entries;
+    entries.reserve(_entries.size());
+    for (const auto &e : _entries) {
+        entries.push_back(e.second);
+    }
+    return entries;
+}
+
+uint64_t write_ahead_log::add(uint32_t type, const std::string &payload)
+{
+    if (type == log_remove_type) {
+        throw std::invalid_argument("invalid log entry type");
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    const uint64_t id = _next_id++;
+    const uint64_t timestamp = log_now();
+    const uint64_t seq = append(type, id, payload);
+    _entries[id] = entry{
+        id, type, timestamp, std::make_shared<const std::string>(payload)};
+    wait_durable(lock, seq);
+    return id;
+}
+
+void write_ahead_log::remove(const std::vector<uint64_t> &ids)
+{
+    if (ids.empty()) {
+        return;
+    }
+    const std::string payload(
+        (const char *)ids.data(), ids.size() * sizeof(uint64_t));
+    std::unique_lock<std::mutex> lock(_mutex);
+    const uint64_t seq = append(log_remove_type, 0, payload);
+    for (const uint64_t id : ids) {
+        _entries.erase(id);
+    }
+    wait_durable(lock, seq);
+}
+
+size_t write_ahead_log::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+void write_ahead_log::set_snapshot_failure_handler(
+    std::function<void(const std::string &error)> handler)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _snapshot_failure_handler = std::move(handler);
+}
+
+size_t write_ahead_log::num_failed_snapshots() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _num_failed_snapshots;
+}
+
+uint64_t write_ahead_log::append(
+    uint32_t type, uint64_t id, const std::string &payload)
+{
+    if (!_replayed) {
+        throw std::logic_error("log must be replayed before use");
+    }
+    if (!_error.empty()) {
+        throw std::runtime_error("log write failed: " + _error);
+    }
+    log_encode_record(_pending, id, log_now(), type, payload);
+    ++_records_since_snapshot;
+    return ++_appended_seq;
+}
+
+void write_ahead_log::wait_durable(
+    std::unique_lock<std::mutex> &lock, uint64_t seq)
+{
+    while (_durable_seq < seq) {
+        if (!_error.empty()) {
+            throw std::runtime_error("log write failed: " + _error);
+        }
+        if (_flushing) {
+            _durable.wait(lock);
+            continue;
+        }
+
+        // Write all pending records (of this and any other threads) and sync.
+        _flushing = true;
+        std::string data;
+        data.swap(_pending);
+        const uint64_t flushed_seq = _appended_seq;
+        const int fd = _segment_fd;
+        lock.unlock();
+        const std::string error = log_write_and_sync(fd, data);
+        lock.lock();
+        _flushing = false;
+
+        if (!error.empty()) {
+            _error = error;
+        } else {
+            _durable_seq = flushed_seq;
+
+            // Start a new segment and snapshot the live entries, unless the
+            // previous snapshot is still being written. Records appended
+            // during the write are written to the new segment.
+            if (_records_since_snapshot >= _snapshot_interval &&
+                !_snapshot_job) {
+                try {
+                    ::close(_segment_fd);
+                    _segment_fd = -1;
+                    start_segment(_segment + 1);
+                    _snapshot_job.reset(new snapshot_job());
+                    _snapshot_job->first_segment = _segment;
+                    _snapshot_job->next_id = _next_id;
+                    _snapshot_job->entries.reserve(_entries.size());
+                    for (const auto &e : _entries) {
+                        _snapshot_job->entries.push_back(e.second);
+                    }
+                    _records_since_snapshot = 0;
+                    _snapshot_queued.notify_one();
+                } catch (const std::exception &e) {
+                    _error = e.what();
+                }
+            }
+        }
+        _durable.notify_all();
+    }
+}
+
+void write_ahead_log::start_segment(uint64_t segment)
+{
+    const std::string path = segment_path(segment);
+    const int fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error(log_error("failed to open", path));
+    }
+    log_sync_dir(_dir);
+    _segment_fd = fd;
+    _segment = segment;
+}
+
+void write_ahead_log::snapshot_loop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _snapshot_queued.wait(
+            lock, [this]() { return _stopping || _snapshot_job; });
+        if (!_snapshot_job) {
+            return;
+        }
+
+        // If the snapshot fails, no entries are lost (the segments are
+        // kept), and the next snapshot covers them. The failure is counted
+        // and reported to the handler (if any), but appends continue.
+        const snapshot_job &job = *_snapshot_job;
+        lock.unlock();
+        std::string error;
+        try {
+            write_snapshot(job);
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+        lock.lock();
+        _snapshot_job.reset();
+        if (!error.empty()) {
+            ++_num_failed_snapshots;
+            const std::function<void(const std::string &)> handler =
+                _snapshot_failure_handler;
+            if (handler) {
+                lock.unlock();
+                handler(error);
+                lock.lock();
+            }
+        }
+    }
+}
+
+void write_ahead_log::write_snapshot(const snapshot_job &job)
+{
+    std::string data;
+    log_snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, log_snapshot_magic, sizeof(header.magic));
+    header.version = log_snapshot_version;
+    header.first_segment = job.first_segment;
+    header.next_id = job.next_id;
+    header.num_entries = job.entries.size();
+    data.append((const char *)&header, sizeof(header));
+    for (const entry &e : job.entries) {
+        log_encode_record(data, e.id, e.timestamp, e.type, *e.payload);
+    }
+
+    // Write to a temporary file, and rename once durable.
+    const std::string path = snapshot_path();
+    const std::string tmp_path = path + ".tmp";
+    const int fd = ::open(
+        tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error(log_error("failed to open", tmp_path));
+    }
+    const std::string error = log_write_and_sync(fd, data);
+    ::close(fd);
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error(log_error("failed to rename", tmp_path));
+    }
+    log_sync_dir(_dir);
+
+    for (const uint64_t segment : log_list_segments(_dir)) {
+        if (segment < job.first_segment) {
+            ::unlink(segment_path(segment).c_str());
+        }
+    }
+}
+
+std::string write_ahead_log::segment_path(uint64_t segment) const
+{
+    char name[64];
+    snprintf(
+        name,
+        sizeof(name),
+        "%s%020llu",
+        log_segment_prefix,
+        (unsigned long long)segment);
+    return _dir + "/" + name;
+}
+
+std::string write_ahead_log::snapshot_path() const
+{
+    return _dir + "/snapshot";
+}
+
+} // namespace libzecale
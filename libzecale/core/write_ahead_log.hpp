@@ -0,0 +1,150 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_CORE_WRITE_AHEAD_LOG_HPP__
+#define __ZECALE_CORE_WRITE_AHEAD_LOG_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace libzecale
+{
+
+/// Default number of records appended between snapshots.
+static const size_t default_log_snapshot_interval = 1 << 16;
+
+/// Append-only log of entries (opaque payloads, each with a caller-defined
+/// type), which are added and later removed, so that the set of live entries
+/// (added and not yet removed) can be restored after a restart or crash.
+///
+/// Records are appended to segment files in the log directory. Appends are
+/// group-committed: each call returns once its record is durable, and the
+/// first waiting thread writes and syncs the records of all threads which
+/// have appended since the last sync, so that concurrent callers share the
+/// cost of each sync.
+///
+/// Every `snapshot_interval` records, a new segment is started and a
+/// snapshot, holding only the live entries, is written in the background.
+/// Segments covered by the snapshot are then deleted. At startup, replay()
+/// reads the snapshot and the remaining segments (the latter in parallel). If
+/// a snapshot cannot be written, its segments are kept (so nothing is lost)
+/// and the snapshot is retried after the next `snapshot_interval` records.
+///
+/// Files use the native byte order, and are not intended to be moved between
+/// machines.
+class write_ahead_log
+{
+public:
+    /// An entry in the log. The timestamp is the (system clock) time at which
+    /// the entry was added, in microseconds since the epoch.
+    struct entry {
+        uint64_t id;
+        uint32_t type;
+        uint64_t timestamp;
+        std::shared_ptr<const std::string> payload;
+    };
+
+    /// Open (creating if necessary) the log in directory `dir`. Throws
+    /// std::runtime_error on failure.
+    explicit write_ahead_log(
+        const std::string &dir,
+        size_t snapshot_interval = default_log_snapshot_interval);
+    ~write_ahead_log();
+
+    write_ahead_log(const write_ahead_log &other) = delete;
+    write_ahead_log &operator=(const write_ahead_log &other) = delete;
+
+    /// Read the log, returning the live entries in the order they were
+    /// added. Must be called once, before any entries are added or removed.
+    /// A partially written record at the end of the last segment (from a
+    /// crash during a write) is discarded. Throws std::runtime_error if the
+    /// log is otherwise corrupt.
+    std::vector<entry> replay();
+
+    /// Add an entry with the given type (which must be non-zero) and
+    /// payload, returning its id once the record is durable. Throws
+    /// std::runtime_error if a previous write failed.
+    uint64_t add(uint32_t type, const std::string &payload);
+
+    /// Remove the given entries, returning once the record is durable.
+    void remove(const std::vector<uint64_t> &ids);
+
+    /// Number of live entries.
+    size_t size() const;
+
+    /// Set a function to be called (on the background thread) with the
+    /// error, whenever a snapshot cannot be written.
+    void set_snapshot_failure_handler(
+        std::function<void(const std::string &error)> handler);
+
+    /// Number of snapshots which could not be written.
+    size_t num_failed_snapshots() const;
+
+private:
+    struct snapshot_job {
+        uint64_t first_segment;
+        uint64_t next_id;
+        std::vector<entry> entries;
+    };
+
+    const std::string _dir;
+    const size_t _snapshot_interval;
+
+    mutable std::mutex _mutex;
+
+    // Signalled when records become durable.
+    std::condition_variable _durable;
+
+    // Live entries, by id.
+    std::map<uint64_t, entry> _entries;
+
+    uint64_t _next_id;
+
+    // Records appended (encoded) but not yet written, and the sequence
+    // numbers of the last record appended and the last record made durable.
+    std::string _pending;
+    uint64_t _appended_seq;
+    uint64_t _durable_seq;
+
+    // Set while a thread is writing and syncing records.
+    bool _flushing;
+
+    // Set if a write failed, after which all appends fail.
+    std::string _error;
+
+    // Current segment, and the number of records appended since the last
+    // snapshot.
+    int _segment_fd;
+    uint64_t _segment;
+    size_t _records_since_snapshot;
+
+    bool _replayed;
+
+    // Snapshots are written by a background thread.
+    std::unique_ptr<snapshot_job> _snapshot_job;
+    std::condition_variable _snapshot_queued;
+    std::function<void(const std::string &error)> _snapshot_failure_handler;
+    size_t _num_failed_snapshots;
+    bool _stopping;
+    std::thread _snapshot_thread;
+
+    uint64_t append(uint32_t type, uint64_t id, const std::string &payload);
+    void wait_durable(std::unique_lock<std::mutex> &lock, uint64_t seq);
+    void start_segment(uint64_t segment);
+    void snapshot_loop();
+    void write_snapshot(const snapshot_job &job);
+    std::string segment_path(uint64_t segment) const;
+    std::string snapshot_path() const;
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_CORE_WRITE_AHEAD_LOG_HPP__
@@ -0,0 +1,71 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/serialization/mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace libzecale
+{
+
+mapped_file::mapped_file(const std::string &path, bool prefault)
+    : _data(nullptr), _size(0)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(
+            "failed to open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        throw std::runtime_error(
+            "failed to stat " + path + ": " + std::strerror(err));
+    }
+    _size = (size_t)st.st_size;
+    if (_size == 0) {
+        ::close(fd);
+        throw std::runtime_error("empty file " + path);
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (prefault) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void *data = ::mmap(nullptr, _size, PROT_READ, flags, fd, 0);
+    const int err = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(
+            "failed to map " + path + ": " + std::strerror(err));
+    }
+
+    // Data is generally read sequentially.
+    ::madvise(data, _size, prefault ? MADV_WILLNEED : MADV_SEQUENTIAL);
+    _data = (const uint8_t *)data;
+}
+
+mapped_file::~mapped_file() { ::munmap((void *)_data, _size); }
+
+const uint8_t *mapped_file::data() const { return _data; }
+
+size_t mapped_file::size() const { return _size; }
+
+memory_streambuf::memory_streambuf(const uint8_t *data, size_t size)
+{
+    char *begin = (char *)data;
+    setg(begin, begin, begin + size);
+}
+
+} // namespace libzecale
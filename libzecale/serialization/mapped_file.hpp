@@ -0,0 +1,48 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_SERIALIZATION_MAPPED_FILE_HPP__
+#define __ZECALE_SERIALIZATION_MAPPED_FILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+
+namespace libzecale
+{
+
+/// A file mapped read-only into memory. The mapping is shared, so that
+/// processes mapping the same file share its pages (via the page cache).
+class mapped_file
+{
+public:
+    /// Map the file at `path`. If `prefault` is set, all pages are read in
+    /// when the file is mapped, rather than on first access. Throws
+    /// std::runtime_error on failure.
+    explicit mapped_file(const std::string &path, bool prefault = false);
+    ~mapped_file();
+
+    mapped_file(const mapped_file &other) = delete;
+    mapped_file &operator=(const mapped_file &other) = delete;
+
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    const uint8_t *_data;
+    size_t _size;
+};
+
+/// Read-only stream buffer over a region of memory, allowing data in a
+/// mapped_file to be read by stream-based deserializers without copying.
+class memory_streambuf : public std::streambuf
+{
+public:
+    memory_streambuf(const uint8_t *data, size_t size);
+};
+
+} // namespace libzecale
+
+#endif // __ZECALE_SERIALIZATION_MAPPED_FILE_HPP__
@@ -0,0 +1,172 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/serialization/mapped_keypair.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+static const uint64_t fnv_offset_basis = 0xcbf29ce484222325ull;
+static const uint64_t fnv_prime = 0x100000001b3ull;
+
+static size_t align_size(size_t size)
+{
+    return (size + mapped_keypair_record_alignment - 1) /
+           mapped_keypair_record_alignment * mapped_keypair_record_alignment;
+}
+
+static uint64_t checksum_update(
+    uint64_t checksum, const uint8_t *data, size_t size)
+{
+    // `size` is a multiple of 8.
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(uint64_t));
+        checksum = (checksum ^ word) * fnv_prime;
+    }
+    return checksum;
+}
+
+mapped_keypair_writer::mapped_keypair_writer(std::ostream &out_s)
+    : _out_s(out_s)
+    , _size(0)
+    , _checksum(fnv_offset_basis)
+    , _record_remaining(0)
+    , _tail()
+    , _tail_size(0)
+{
+}
+
+void mapped_keypair_writer::write_record(
+    const void *data, uint64_t count, size_t element_size)
+{
+    begin_record(count, element_size);
+    write_record_data(data, count * element_size);
+    end_record();
+}
+
+void mapped_keypair_writer::begin_record(uint64_t count, size_t element_size)
+{
+    if (_record_remaining != 0) {
+        throw std::logic_error("previous mapped keypair record incomplete");
+    }
+    const uint64_t record_header[2] = {count, element_size};
+    write_data(record_header, sizeof(record_header));
+    pad();
+    _record_remaining = count * element_size;
+}
+
+void mapped_keypair_writer::write_record_data(const void *data, size_t size)
+{
+    if (size > _record_remaining) {
+        throw std::logic_error("mapped keypair record overflow");
+    }
+    write_data(data, size);
+    _record_remaining -= size;
+}
+
+void mapped_keypair_writer::end_record()
+{
+    if (_record_remaining != 0) {
+        throw std::logic_error("mapped keypair record incomplete");
+    }
+    pad();
+}
+
+uint64_t mapped_keypair_writer::size() const { return _size; }
+
+uint64_t mapped_keypair_writer::checksum() const { return _checksum; }
+
+void mapped_keypair_writer::write_data(const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    // Data may arrive in pieces which are not multiples of 64-bit words.
+    // Complete any partial word held from the previous call, checksum the
+    // whole words, and hold any remaining bytes.
+    size_t offset = 0;
+    if (_tail_size != 0) {
+        offset = std::min(size, sizeof(uint64_t) - _tail_size);
+        memcpy(_tail + _tail_size, bytes, offset);
+        _tail_size += offset;
+        if (_tail_size == sizeof(uint64_t)) {
+            _checksum = checksum_update(_checksum, _tail, sizeof(uint64_t));
+            _tail_size = 0;
+        }
+    }
+    const size_t remaining = size - offset;
+    const size_t words_size = remaining - remaining % sizeof(uint64_t);
+    _checksum = checksum_update(_checksum, bytes + offset, words_size);
+    const size_t tail_size = remaining - words_size;
+    memcpy(_tail + _tail_size, bytes + offset + words_size, tail_size);
+    _tail_size += tail_size;
+
+    _out_s.write((const char *)bytes, size);
+    _size += size;
+}
+
+void mapped_keypair_writer::pad()
+{
+    static const uint8_t zeros[mapped_keypair_record_alignment] = {0};
+    write_data(zeros, align_size(_size) - _size);
+}
+
+mapped_keypair_reader::mapped_keypair_reader(const uint8_t *data, size_t size)
+    : _data(data), _size(size), _offset(0)
+{
+}
+
+const uint8_t *mapped_keypair_reader::read_record(
+    size_t element_size, uint64_t &count)
+{
+    uint64_t record_header[2];
+    memcpy(record_header, read_aligned(sizeof(record_header)), 16);
+    if (record_header[1] != element_size) {
+        throw std::runtime_error("unexpected element size in mapped keypair");
+    }
+    if (element_size != 0 && record_header[0] > _size / element_size) {
+        throw std::runtime_error("invalid record size in mapped keypair");
+    }
+    count = record_header[0];
+    return read_aligned(count * element_size);
+}
+
+bool mapped_keypair_reader::at_end() const { return _offset == _size; }
+
+const uint8_t *mapped_keypair_reader::read_aligned(size_t size)
+{
+    const size_t aligned_size = align_size(size);
+    if (aligned_size > _size - _offset) {
+        throw std::runtime_error("truncated mapped keypair");
+    }
+    const uint8_t *data = _data + _offset;
+    _offset += aligned_size;
+    return data;
+}
+
+uint64_t mapped_keypair_checksum(const uint8_t *data, size_t size)
+{
+    return checksum_update(fnv_offset_basis, data, size);
+}
+
+} // namespace internal
+
+uint64_t mapped_keypair_config_fingerprint(const std::string &config)
+{
+    // 64-bit FNV-1a, applied to bytes.
+    uint64_t fingerprint = internal::fnv_offset_basis;
+    for (const char c : config) {
+        fingerprint = (fingerprint ^ (uint8_t)c) * internal::fnv_prime;
+    }
+    return fingerprint;
+}
+
+} // namespace libzecale
@@ -0,0 +1,146 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_SERIALIZATION_MAPPED_KEYPAIR_HPP__
+#define __ZECALE_SERIALIZATION_MAPPED_KEYPAIR_HPP__
+
+#include "libzecale/serialization/mapped_file.hpp"
+
+#include <libzeth/snarks/groth16/groth16_snark.hpp>
+#include <ostream>
+#include <string>
+
+namespace libzecale
+{
+
+/// Header of a mapped keypair file. The header is followed (at offset
+/// mapped_keypair_body_offset) by the body, holding the keypair data as a
+/// sequence of records. Each record is a count, followed by the raw in-memory
+/// representation of that many objects (group elements in Montgomery form,
+/// indices, or the terms of the constraints), aligned to
+/// mapped_keypair_record_alignment bytes.
+///
+/// Since the raw representation of field elements depends on the build (limb
+/// size, endianness), the body starts with a record holding known values
+/// (generators of G1 and G2, and one in Fr), which are checked when the file
+/// is read. The header holds a checksum of the body, a fingerprint of the
+/// circuit (the sizes of its constraint system), and a fingerprint of the
+/// configuration for which the keypair was generated (see
+/// mapped_keypair_config_fingerprint).
+struct mapped_keypair_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t fr_size;
+    uint32_t g1_size;
+    uint32_t g2_size;
+    uint32_t reserved;
+    uint64_t num_inputs;
+    uint64_t num_variables;
+    uint64_t num_constraints;
+    uint64_t body_size;
+    uint64_t body_checksum;
+    uint64_t config_fingerprint;
+};
+
+static const char mapped_keypair_magic[8] = {
+    'Z', 'E', 'C', 'K', 'E', 'Y', 0, 0};
+static const uint32_t mapped_keypair_version = 2;
+static const size_t mapped_keypair_body_offset = 4096;
+static const size_t mapped_keypair_record_alignment = 64;
+
+namespace internal
+{
+
+/// Writes the body of a mapped keypair file, computing its checksum (64-bit
+/// FNV-1a, applied to 64-bit words).
+class mapped_keypair_writer
+{
+public:
+    explicit mapped_keypair_writer(std::ostream &out_s);
+
+    /// Write a record of `count` objects of `element_size` bytes each.
+    void write_record(const void *data, uint64_t count, size_t element_size);
+
+    /// Begin a record of `count` objects of `element_size` bytes each. The
+    /// data is then written (in one or more pieces) by write_record_data,
+    /// followed by a call to end_record. This allows records to be written
+    /// as their contents are computed.
+    void begin_record(uint64_t count, size_t element_size);
+    void write_record_data(const void *data, size_t size);
+    void end_record();
+
+    uint64_t size() const;
+    uint64_t checksum() const;
+
+private:
+    std::ostream &_out_s;
+    uint64_t _size;
+    uint64_t _checksum;
+    uint64_t _record_remaining;
+    uint8_t _tail[sizeof(uint64_t)];
+    size_t _tail_size;
+
+    void write_data(const void *data, size_t size);
+    void pad();
+};
+
+/// Reads records from the body of a mapped keypair file, in place.
+class mapped_keypair_reader
+{
+public:
+    mapped_keypair_reader(const uint8_t *data, size_t size);
+
+    /// Return a pointer to the data of the next record, which must contain
+    /// objects of `element_size` bytes, and set `count` to the number of
+    /// objects.
+    const uint8_t *read_record(size_t element_size, uint64_t &count);
+
+    bool at_end() const;
+
+private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _offset;
+
+    const uint8_t *read_aligned(size_t size);
+};
+
+/// Compute the checksum of a body, as written by mapped_keypair_writer.
+uint64_t mapped_keypair_checksum(const uint8_t *data, size_t size);
+
+} // namespace internal
+
+/// Compute a fingerprint of a configuration description (for example, the
+/// curve, snark and circuit parameters), for mapped_keypair_header.
+uint64_t mapped_keypair_config_fingerprint(const std::string &config);
+
+/// Write a Groth16 keypair in the mapped format, with the given configuration
+/// fingerprint.
+template<typename ppT>
+void groth16_keypair_write_mapped(
+    const typename libzeth::groth16_snark<ppT>::keypair &keypair,
+    std::ostream &out_s,
+    uint64_t config_fingerprint = 0);
+
+/// Read a Groth16 keypair from a file in the mapped format. The file is
+/// mapped into memory and its contents copied directly into the keypair,
+/// without any parsing or conversion of group elements. If `prefault` is set,
+/// all pages of the file are read in when it is mapped. The checksum of the
+/// body (a serial pass over the whole file) is only verified if
+/// `verify_checksum` is set. Throws std::runtime_error if the file is invalid,
+/// corrupt (if checked) or was written by an incompatible build. Returns the
+/// header, holding the configuration fingerprint which callers should check.
+template<typename ppT>
+mapped_keypair_header groth16_keypair_read_mapped(
+    typename libzeth::groth16_snark<ppT>::keypair &keypair,
+    const std::string &path,
+    bool prefault = false,
+    bool verify_checksum = false);
+
+} // namespace libzecale
+
+#include "libzecale/serialization/mapped_keypair.tcc"
+
+#endif // __ZECALE_SERIALIZATION_MAPPED_KEYPAIR_HPP__
@@ -0,0 +1,337 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_SERIALIZATION_MAPPED_KEYPAIR_TCC__
+#define __ZECALE_SERIALIZATION_MAPPED_KEYPAIR_TCC__
+
+#include "libzecale/serialization/mapped_keypair.hpp"
+
+#include <cstring>
+#include <initializer_list>
+#include <libsnark/common/data_structures/sparse_vector.hpp>
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+template<typename T>
+void mapped_write_object(mapped_keypair_writer &writer, const T &object)
+{
+    writer.write_record(&object, 1, sizeof(T));
+}
+
+template<typename T>
+void mapped_write_vector(
+    mapped_keypair_writer &writer, const std::vector<T> &vector)
+{
+    writer.write_record(vector.data(), vector.size(), sizeof(T));
+}
+
+template<typename T>
+void mapped_write_sparse_vector(
+    mapped_keypair_writer &writer, const libsnark::sparse_vector<T> &vector)
+{
+    mapped_write_object<uint64_t>(writer, vector.domain_size_);
+    mapped_write_vector(writer, vector.indices);
+    mapped_write_vector(writer, vector.values);
+}
+
+template<typename T> T mapped_read_object(mapped_keypair_reader &reader)
+{
+    uint64_t count;
+    const uint8_t *data = reader.read_record(sizeof(T), count);
+    if (count != 1) {
+        throw std::runtime_error("unexpected record in mapped keypair");
+    }
+    T object;
+    memcpy((void *)&object, data, sizeof(T));
+    return object;
+}
+
+template<typename T>
+void mapped_read_vector(mapped_keypair_reader &reader, std::vector<T> &vector)
+{
+    uint64_t count;
+    const uint8_t *data = reader.read_record(sizeof(T), count);
+    vector.resize(count);
+    memcpy((void *)vector.data(), data, count * sizeof(T));
+}
+
+template<typename T>
+void mapped_read_sparse_vector(
+    mapped_keypair_reader &reader, libsnark::sparse_vector<T> &vector)
+{
+    vector.domain_size_ = mapped_read_object<uint64_t>(reader);
+    mapped_read_vector(reader, vector.indices);
+    mapped_read_vector(reader, vector.values);
+    if (vector.indices.size() != vector.values.size()) {
+        throw std::runtime_error("invalid sparse vector in mapped keypair");
+    }
+}
+
+/// Check that a value read from the file has the same raw representation as
+/// the expected value in this build.
+template<typename T>
+void mapped_check_object(mapped_keypair_reader &reader, const T &expected)
+{
+    const T actual = mapped_read_object<T>(reader);
+    if (memcmp((const void *)&actual, (const void *)&expected, sizeof(T)) !=
+        0) {
+        throw std::runtime_error("incompatible mapped keypair representation");
+    }
+}
+
+/// Write the values (in Fr, G1 and G2) checked by
+/// groth16_keypair_read_mapped to detect an incompatible representation.
+template<typename ppT>
+void mapped_write_representation_check(mapped_keypair_writer &writer)
+{
+    mapped_write_object(writer, libff::Fr<ppT>::one());
+    mapped_write_object(writer, libff::G1<ppT>::one());
+    mapped_write_object(writer, libff::G2<ppT>::one());
+}
+
+/// Write a constraint system in raw form: the input sizes, the number of
+/// terms in each linear combination (A, B and C of each constraint in turn),
+/// and then all terms (index and coefficient) in the same order.
+template<typename ppT>
+void mapped_write_constraint_system(
+    mapped_keypair_writer &writer,
+    const libsnark::r1cs_constraint_system<libff::Fr<ppT>> &constraint_system)
+{
+    using linear_term = libsnark::linear_term<libff::Fr<ppT>>;
+
+    mapped_write_object<uint64_t>(writer, constraint_system.primary_input_size);
+    mapped_write_object<uint64_t>(
+        writer, constraint_system.auxiliary_input_size);
+
+    std::vector<uint64_t> lc_sizes;
+    lc_sizes.reserve(3 * constraint_system.constraints.size());
+    uint64_t num_terms = 0;
+    for (const auto &constraint : constraint_system.constraints) {
+        lc_sizes.push_back(constraint.a.terms.size());
+        lc_sizes.push_back(constraint.b.terms.size());
+        lc_sizes.push_back(constraint.c.terms.size());
+        num_terms += constraint.a.terms.size() + constraint.b.terms.size() +
+                     constraint.c.terms.size();
+    }
+    mapped_write_vector(writer, lc_sizes);
+
+    // Terms are written directly from each linear combination.
+    writer.begin_record(num_terms, sizeof(linear_term));
+    for (const auto &constraint : constraint_system.constraints) {
+        for (const auto *lc : {&constraint.a, &constraint.b, &constraint.c}) {
+            writer.write_record_data(
+                lc->terms.data(), lc->terms.size() * sizeof(linear_term));
+        }
+    }
+    writer.end_record();
+}
+
+template<typename ppT>
+void mapped_read_constraint_system(
+    mapped_keypair_reader &reader,
+    libsnark::r1cs_constraint_system<libff::Fr<ppT>> &constraint_system)
+{
+    using linear_term = libsnark::linear_term<libff::Fr<ppT>>;
+
+    constraint_system.primary_input_size =
+        mapped_read_object<uint64_t>(reader);
+    constraint_system.auxiliary_input_size =
+        mapped_read_object<uint64_t>(reader);
+
+    uint64_t num_lcs;
+    const uint8_t *lc_sizes_data =
+        reader.read_record(sizeof(uint64_t), num_lcs);
+    if (num_lcs % 3 != 0) {
+        throw std::runtime_error("invalid constraint system in mapped keypair");
+    }
+    uint64_t num_terms;
+    const uint8_t *terms_data =
+        reader.read_record(sizeof(linear_term), num_terms);
+
+    constraint_system.constraints.resize(num_lcs / 3);
+    uint64_t term_idx = 0;
+    size_t lc_idx = 0;
+    for (auto &constraint : constraint_system.constraints) {
+        for (auto *lc : {&constraint.a, &constraint.b, &constraint.c}) {
+            uint64_t lc_size;
+            memcpy(
+                &lc_size,
+                lc_sizes_data + sizeof(uint64_t) * lc_idx++,
+                sizeof(uint64_t));
+            if (lc_size > num_terms - term_idx) {
+                throw std::runtime_error(
+                    "invalid constraint system in mapped keypair");
+            }
+            lc->terms.resize(lc_size);
+            memcpy(
+                (void *)lc->terms.data(),
+                terms_data + sizeof(linear_term) * term_idx,
+                lc_size * sizeof(linear_term));
+            term_idx += lc_size;
+        }
+    }
+    if (term_idx != num_terms) {
+        throw std::runtime_error("invalid constraint system in mapped keypair");
+    }
+}
+
+/// Write the header at `header_pos`, for a body (starting at
+/// mapped_keypair_body_offset from `header_pos`) written by `writer`. The
+/// stream is left at the end of the body.
+template<typename ppT>
+void mapped_write_header(
+    std::ostream &out_s,
+    const std::streampos header_pos,
+    const libsnark::r1cs_constraint_system<libff::Fr<ppT>> &constraint_system,
+    const uint64_t config_fingerprint,
+    const mapped_keypair_writer &writer)
+{
+    mapped_keypair_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, mapped_keypair_magic, sizeof(header.magic));
+    header.version = mapped_keypair_version;
+    header.header_size = sizeof(header);
+    header.fr_size = sizeof(libff::Fr<ppT>);
+    header.g1_size = sizeof(libff::G1<ppT>);
+    header.g2_size = sizeof(libff::G2<ppT>);
+    header.num_inputs = constraint_system.num_inputs();
+    header.num_variables = constraint_system.num_variables();
+    header.num_constraints = constraint_system.num_constraints();
+    header.body_size = writer.size();
+    header.body_checksum = writer.checksum();
+    header.config_fingerprint = config_fingerprint;
+
+    const std::streampos end_pos = out_s.tellp();
+    out_s.seekp(header_pos);
+    out_s.write((const char *)&header, sizeof(header));
+    out_s.seekp(end_pos);
+}
+
+} // namespace internal
+
+template<typename ppT>
+void groth16_keypair_write_mapped(
+    const typename libzeth::groth16_snark<ppT>::keypair &keypair,
+    std::ostream &out_s,
+    const uint64_t config_fingerprint)
+{
+    const typename libzeth::groth16_snark<ppT>::proving_key &pk = keypair.pk;
+    const typename libzeth::groth16_snark<ppT>::verification_key &vk =
+        keypair.vk;
+
+    // Write the body after space for the header, which is written last
+    // (since it holds the size and checksum of the body).
+    const std::streampos header_pos = out_s.tellp();
+    out_s.seekp(header_pos + (std::streamoff)mapped_keypair_body_offset);
+
+    internal::mapped_keypair_writer writer(out_s);
+    internal::mapped_write_representation_check<ppT>(writer);
+
+    internal::mapped_write_object(writer, pk.alpha_g1);
+    internal::mapped_write_object(writer, pk.beta_g1);
+    internal::mapped_write_object(writer, pk.beta_g2);
+    internal::mapped_write_object(writer, pk.delta_g1);
+    internal::mapped_write_object(writer, pk.delta_g2);
+    internal::mapped_write_vector(writer, pk.A_query);
+    internal::mapped_write_sparse_vector(writer, pk.B_query);
+    internal::mapped_write_vector(writer, pk.H_query);
+    internal::mapped_write_vector(writer, pk.L_query);
+
+    internal::mapped_write_constraint_system<ppT>(writer, pk.constraint_system);
+
+    internal::mapped_write_object(writer, vk.alpha_g1);
+    internal::mapped_write_object(writer, vk.beta_g2);
+    internal::mapped_write_object(writer, vk.delta_g2);
+    internal::mapped_write_object(writer, vk.ABC_g1.first);
+    internal::mapped_write_sparse_vector(writer, vk.ABC_g1.rest);
+
+    internal::mapped_write_header<ppT>(
+        out_s, header_pos, pk.constraint_system, config_fingerprint, writer);
+}
+
+template<typename ppT>
+mapped_keypair_header groth16_keypair_read_mapped(
+    typename libzeth::groth16_snark<ppT>::keypair &keypair,
+    const std::string &path,
+    bool prefault,
+    bool verify_checksum)
+{
+    typename libzeth::groth16_snark<ppT>::proving_key &pk = keypair.pk;
+    typename libzeth::groth16_snark<ppT>::verification_key &vk = keypair.vk;
+
+    const mapped_file file(path, prefault);
+    if (file.size() < mapped_keypair_body_offset) {
+        throw std::runtime_error("invalid mapped keypair file");
+    }
+
+    mapped_keypair_header header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, mapped_keypair_magic, sizeof(header.magic)) !=
+            0 ||
+        header.version != mapped_keypair_version ||
+        header.header_size != sizeof(header)) {
+        throw std::runtime_error("invalid mapped keypair header");
+    }
+    if (header.fr_size != sizeof(libff::Fr<ppT>) ||
+        header.g1_size != sizeof(libff::G1<ppT>) ||
+        header.g2_size != sizeof(libff::G2<ppT>)) {
+        throw std::runtime_error("incompatible mapped keypair representation");
+    }
+    if (header.body_size != file.size() - mapped_keypair_body_offset) {
+        throw std::runtime_error("truncated mapped keypair");
+    }
+
+    const uint8_t *body = file.data() + mapped_keypair_body_offset;
+    if (verify_checksum &&
+        internal::mapped_keypair_checksum(body, header.body_size) !=
+            header.body_checksum) {
+        throw std::runtime_error("mapped keypair checksum mismatch");
+    }
+
+    internal::mapped_keypair_reader reader(body, header.body_size);
+    internal::mapped_check_object(reader, libff::Fr<ppT>::one());
+    internal::mapped_check_object(reader, libff::G1<ppT>::one());
+    internal::mapped_check_object(reader, libff::G2<ppT>::one());
+
+    pk.alpha_g1 = internal::mapped_read_object<libff::G1<ppT>>(reader);
+    pk.beta_g1 = internal::mapped_read_object<libff::G1<ppT>>(reader);
+    pk.beta_g2 = internal::mapped_read_object<libff::G2<ppT>>(reader);
+    pk.delta_g1 = internal::mapped_read_object<libff::G1<ppT>>(reader);
+    pk.delta_g2 = internal::mapped_read_object<libff::G2<ppT>>(reader);
+    internal::mapped_read_vector(reader, pk.A_query);
+    internal::mapped_read_sparse_vector(reader, pk.B_query);
+    internal::mapped_read_vector(reader, pk.H_query);
+    internal::mapped_read_vector(reader, pk.L_query);
+
+    internal::mapped_read_constraint_system<ppT>(
+        reader, pk.constraint_system);
+    if (pk.constraint_system.num_inputs() != header.num_inputs ||
+        pk.constraint_system.num_variables() != header.num_variables ||
+        pk.constraint_system.num_constraints() != header.num_constraints) {
+        throw std::runtime_error("mapped keypair circuit fingerprint mismatch");
+    }
+
+    vk.alpha_g1 = internal::mapped_read_object<libff::G1<ppT>>(reader);
+    vk.beta_g2 = internal::mapped_read_object<libff::G2<ppT>>(reader);
+    vk.delta_g2 = internal::mapped_read_object<libff::G2<ppT>>(reader);
+    vk.ABC_g1.first = internal::mapped_read_object<libff::G1<ppT>>(reader);
+    internal::mapped_read_sparse_vector(reader, vk.ABC_g1.rest);
+
+    if (!reader.at_end()) {
+        throw std::runtime_error("unexpected data in mapped keypair");
+    }
+
+    return header;
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_SERIALIZATION_MAPPED_KEYPAIR_TCC__
@@ -7,6 +7,7 @@
 
 #include "libzecale/core/nested_transaction.hpp"
 
+#include <iostream>
 #include <zecale/api/aggregator.pb.h>
 
 namespace libzecale
@@ -14,12 +15,50 @@ namespace libzecale
 
 template<typename nppT, typename wppT, typename nsnarkT, typename wsnarkT>
 void aggregator_configuration_to_proto(
+    const std::vector<size_t> &batch_sizes,
     zecale_proto::AggregatorConfiguration &config);
 
+/// Write an extended proof in the binary encoding (see ProofEncoding in
+/// aggregator.proto).
+template<typename ppT, typename snarkT>
+void extended_proof_write_bytes(
+    const libzeth::extended_proof<ppT, snarkT> &extended_proof,
+    std::ostream &out_s);
+
+/// Read an extended proof in the binary encoding. Throws if the data is
+/// truncated, or holds a field element which is not in canonical form.
+template<typename ppT, typename snarkT>
+libzeth::extended_proof<ppT, snarkT> extended_proof_read_bytes(
+    std::istream &in_s);
+
+/// Decode the verification key of an application, in either encoding. As for
+/// extended proofs, non-canonical field elements in the binary encoding are
+/// rejected.
+template<typename ppT, typename apiHandlerT>
+typename apiHandlerT::snark::verification_key verification_key_from_proto(
+    const zecale_proto::ApplicationDescription &application);
+
+/// Set the proof of an aggregated transaction, in the given encoding.
+template<typename ppT, typename apiHandlerT>
+void aggregated_transaction_set_proof(
+    const libzeth::extended_proof<ppT, typename apiHandlerT::snark>
+        &extended_proof,
+    zecale_proto::ProofEncoding encoding,
+    zecale_proto::AggregatedTransaction &transaction);
+
+/// Decode a nested transaction (with its proof in either encoding).
 template<typename ppT, typename apiHandlerT>
 nested_transaction<ppT, typename apiHandlerT::snark> nested_transaction_from_proto(
     const zecale_proto::NestedTransaction &transaction);
 
+/// Decode a nested transaction, using the given (shared) application name
+/// rather than allocating a copy of the name in the message. The proof is
+/// decoded directly into the transaction.
+template<typename ppT, typename apiHandlerT>
+nested_transaction<ppT, typename apiHandlerT::snark> nested_transaction_from_proto(
+    const zecale_proto::NestedTransaction &transaction,
+    std::shared_ptr<const std::string> application_name);
+
 } // namespace libzecale
 
 #include "libzecale/serialization/proto_utils.tcc"
@@ -5,18 +5,132 @@
 #ifndef __ZECALE_SERIALIZATION_PROTO_UTILS_TCC__
 #define __ZECALE_SERIALIZATION_PROTO_UTILS_TCC__
 
+#include "libzecale/serialization/mapped_file.hpp"
 #include "libzecale/serialization/proto_utils.hpp"
 
 #include <cstring>
 #include <libff/algebra/curves/public_params.hpp>
+#include <libff/algebra/fields/fp.hpp>
+#include <libff/algebra/fields/fp2.hpp>
+#include <libff/algebra/fields/fp3.hpp>
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_gg_ppzksnark/r1cs_gg_ppzksnark.hpp>
+#include <libsnark/zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp>
 #include <libzeth/core/extended_proof.hpp>
+#include <libzeth/core/field_element_utils.hpp>
 #include <libzeth/serialization/proto_utils.hpp>
+#include <sstream>
 
 namespace libzecale
 {
 
+namespace internal
+{
+
+/// Read an object, from data held in a protobuf bytes field, using a
+/// stream-based deserializer. The data is read in place, and must be consumed
+/// exactly.
+template<typename ResultT, typename ReadFnT>
+ResultT read_bytes_field(const std::string &bytes, const ReadFnT &read)
+{
+    memory_streambuf buf((const uint8_t *)bytes.data(), bytes.size());
+    std::istream in_s(&buf);
+    ResultT result = read(in_s);
+    if (!in_s || in_s.peek() != std::char_traits<char>::eof()) {
+        throw std::invalid_argument("invalid binary encoding");
+    }
+    return result;
+}
+
+/// True if a field element, read from the binary encoding, is held in
+/// canonical form (that is, its Montgomery representation is less than the
+/// modulus). The binary encoding holds the Montgomery representation
+/// directly, so this is not guaranteed by the decoder.
+template<mp_size_t n, const libff::bigint<n> &modulus>
+bool is_canonical(const libff::Fp_model<n, modulus> &element)
+{
+    return mpn_cmp(element.mont_repr.data, modulus.data, n) < 0;
+}
+
+template<mp_size_t n, const libff::bigint<n> &modulus>
+bool is_canonical(const libff::Fp2_model<n, modulus> &element)
+{
+    return is_canonical(element.c0) && is_canonical(element.c1);
+}
+
+template<mp_size_t n, const libff::bigint<n> &modulus>
+bool is_canonical(const libff::Fp3_model<n, modulus> &element)
+{
+    return is_canonical(element.c0) && is_canonical(element.c1) &&
+           is_canonical(element.c2);
+}
+
+template<typename GroupT> bool group_element_is_canonical(const GroupT &element)
+{
+    return is_canonical(element.X) && is_canonical(element.Y) &&
+           is_canonical(element.Z);
+}
+
+template<typename GroupT>
+bool group_elements_are_canonical(const std::vector<GroupT> &elements)
+{
+    for (const GroupT &element : elements) {
+        if (!group_element_is_canonical(element)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename ppT>
+bool is_canonical(const libsnark::r1cs_gg_ppzksnark_proof<ppT> &proof)
+{
+    return group_element_is_canonical(proof.g_A) &&
+           group_element_is_canonical(proof.g_B) &&
+           group_element_is_canonical(proof.g_C);
+}
+
+template<typename ppT>
+bool is_canonical(const libsnark::r1cs_ppzksnark_proof<ppT> &proof)
+{
+    return group_element_is_canonical(proof.g_A.g) &&
+           group_element_is_canonical(proof.g_A.h) &&
+           group_element_is_canonical(proof.g_B.g) &&
+           group_element_is_canonical(proof.g_B.h) &&
+           group_element_is_canonical(proof.g_C.g) &&
+           group_element_is_canonical(proof.g_C.h) &&
+           group_element_is_canonical(proof.g_H) &&
+           group_element_is_canonical(proof.g_K);
+}
+
+template<typename ppT>
+bool is_canonical(const libsnark::r1cs_gg_ppzksnark_verification_key<ppT> &vk)
+{
+    return group_element_is_canonical(vk.alpha_g1) &&
+           group_element_is_canonical(vk.beta_g2) &&
+           group_element_is_canonical(vk.delta_g2) &&
+           group_element_is_canonical(vk.ABC_g1.first) &&
+           group_elements_are_canonical(vk.ABC_g1.rest.values);
+}
+
+template<typename ppT>
+bool is_canonical(const libsnark::r1cs_ppzksnark_verification_key<ppT> &vk)
+{
+    return group_element_is_canonical(vk.alphaA_g2) &&
+           group_element_is_canonical(vk.alphaB_g1) &&
+           group_element_is_canonical(vk.alphaC_g2) &&
+           group_element_is_canonical(vk.gamma_g2) &&
+           group_element_is_canonical(vk.gamma_beta_g1) &&
+           group_element_is_canonical(vk.gamma_beta_g2) &&
+           group_element_is_canonical(vk.rC_Z_g2) &&
+           group_element_is_canonical(vk.encoded_IC_query.first) &&
+           group_elements_are_canonical(vk.encoded_IC_query.rest.values);
+}
+
+} // namespace internal
+
 template<typename nppT, typename wppT, typename nsnarkT, typename wsnarkT>
 void aggregator_configuration_to_proto(
+    const std::vector<size_t> &batch_sizes,
     zecale_proto::AggregatorConfiguration &config)
 {
     config.set_nested_snark_name(nsnarkT::name);
@@ -25,24 +139,145 @@ void aggregator_configuration_to_proto(
         *config.mutable_nested_pairing_parameters());
     libzeth::pairing_parameters_to_proto<wppT>(
         *config.mutable_wrapper_pairing_parameters());
+    for (const size_t batch_size : batch_sizes) {
+        config.add_batch_sizes((uint32_t)batch_size);
+    }
+    config.add_proof_encodings(zecale_proto::PROOF_ENCODING_PROTO);
+    config.add_proof_encodings(zecale_proto::PROOF_ENCODING_BINARY);
+}
+
+template<typename ppT, typename snarkT>
+void extended_proof_write_bytes(
+    const libzeth::extended_proof<ppT, snarkT> &extended_proof,
+    std::ostream &out_s)
+{
+    const std::vector<libff::Fr<ppT>> &inputs =
+        extended_proof.get_primary_inputs();
+    snarkT::proof_write_bytes(extended_proof.get_proof(), out_s);
+
+    uint8_t num_inputs[8];
+    for (size_t i = 0; i < sizeof(num_inputs); ++i) {
+        num_inputs[i] = (uint8_t)((uint64_t)inputs.size() >> (8 * i));
+    }
+    out_s.write((const char *)num_inputs, sizeof(num_inputs));
+    for (const libff::Fr<ppT> &input : inputs) {
+        libzeth::field_element_write_bytes(input, out_s);
+    }
+}
+
+template<typename ppT, typename snarkT>
+libzeth::extended_proof<ppT, snarkT> extended_proof_read_bytes(
+    std::istream &in_s)
+{
+    typename snarkT::proof proof;
+    snarkT::proof_read_bytes(proof, in_s);
+    if (in_s && !internal::is_canonical(proof)) {
+        throw std::invalid_argument("non-canonical field element in proof");
+    }
+
+    uint8_t num_inputs_bytes[8];
+    in_s.read((char *)num_inputs_bytes, sizeof(num_inputs_bytes));
+    uint64_t num_inputs = 0;
+    for (size_t i = 0; i < sizeof(num_inputs_bytes); ++i) {
+        num_inputs |= (uint64_t)num_inputs_bytes[i] << (8 * i);
+    }
+
+    // The number of inputs is untrusted, so inputs are read (and the stream
+    // checked) one at a time, rather than allocated up front.
+    libsnark::r1cs_primary_input<libff::Fr<ppT>> inputs;
+    for (uint64_t i = 0; i < num_inputs && in_s; ++i) {
+        libff::Fr<ppT> input;
+        libzeth::field_element_read_bytes(input, in_s);
+        if (in_s && !internal::is_canonical(input)) {
+            throw std::invalid_argument("non-canonical primary input");
+        }
+        inputs.push_back(input);
+    }
+    if (!in_s) {
+        throw std::invalid_argument("truncated extended proof");
+    }
+
+    return libzeth::extended_proof<ppT, snarkT>(
+        std::move(proof), std::move(inputs));
+}
+
+template<typename ppT, typename apiHandlerT>
+typename apiHandlerT::snark::verification_key verification_key_from_proto(
+    const zecale_proto::ApplicationDescription &application)
+{
+    using snark = typename apiHandlerT::snark;
+    if (application.verification_key_case() ==
+        zecale_proto::ApplicationDescription::kVkBytes) {
+        return internal::read_bytes_field<typename snark::verification_key>(
+            application.vk_bytes(), [](std::istream &in_s) {
+                typename snark::verification_key vk;
+                snark::verification_key_read_bytes(vk, in_s);
+                if (in_s && !internal::is_canonical(vk)) {
+                    throw std::invalid_argument(
+                        "non-canonical field element in verification key");
+                }
+                return vk;
+            });
+    }
+
+    return apiHandlerT::verification_key_from_proto(application.vk());
+}
+
+template<typename ppT, typename apiHandlerT>
+void aggregated_transaction_set_proof(
+    const libzeth::extended_proof<ppT, typename apiHandlerT::snark>
+        &extended_proof,
+    zecale_proto::ProofEncoding encoding,
+    zecale_proto::AggregatedTransaction &transaction)
+{
+    if (encoding == zecale_proto::PROOF_ENCODING_BINARY) {
+        std::ostringstream out_s;
+        extended_proof_write_bytes(extended_proof, out_s);
+        transaction.set_extended_proof_bytes(out_s.str());
+        return;
+    }
+
+    zeth_proto::ExtendedProof *extended_proof_proto =
+        new zeth_proto::ExtendedProof();
+    apiHandlerT::extended_proof_to_proto(extended_proof, extended_proof_proto);
+    transaction.set_allocated_extended_proof(extended_proof_proto);
 }
 
 template<typename ppT, typename apiHandlerT>
 nested_transaction<ppT, typename apiHandlerT::snark> nested_transaction_from_proto(
     const zecale_proto::NestedTransaction &grpc_transaction_obj)
+{
+    return nested_transaction_from_proto<ppT, apiHandlerT>(
+        grpc_transaction_obj,
+        std::make_shared<const std::string>(
+            grpc_transaction_obj.application_name()));
+}
+
+template<typename ppT, typename apiHandlerT>
+nested_transaction<ppT, typename apiHandlerT::snark> nested_transaction_from_proto(
+    const zecale_proto::NestedTransaction &grpc_transaction_obj,
+    std::shared_ptr<const std::string> application_name)
 {
     using snark = typename apiHandlerT::snark;
-    std::string app_name = grpc_transaction_obj.application_name();
     libzeth::extended_proof<ppT, snark> ext_proof =
-        apiHandlerT::extended_proof_from_proto(
-            grpc_transaction_obj.extended_proof());
+        (grpc_transaction_obj.proof_case() ==
+         zecale_proto::NestedTransaction::kExtendedProofBytes)
+            ? internal::read_bytes_field<libzeth::extended_proof<ppT, snark>>(
+                  grpc_transaction_obj.extended_proof_bytes(),
+                  extended_proof_read_bytes<ppT, snark>)
+            : apiHandlerT::extended_proof_from_proto(
+                  grpc_transaction_obj.extended_proof());
     const std::string &parameters_str(grpc_transaction_obj.parameters());
     std::vector<uint8_t> parameters(
         (const uint8_t *)(parameters_str.data()),
         (const uint8_t *)(parameters_str.data() + parameters_str.size()));
 
     const uint32_t fee = uint32_t(grpc_transaction_obj.fee_in_wei());
-    return nested_transaction<ppT, snark>(app_name, ext_proof, parameters, fee);
+    return nested_transaction<ppT, snark>(
+        std::move(application_name),
+        std::move(ext_proof),
+        std::move(parameters),
+        fee);
 }
 
 } // namespace libzecale
@@ -0,0 +1,184 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/serialization/r1cs_binary.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+// Size of the fixed part of the header (magic, version, field_size and the
+// three sizes), which is followed by the modulus.
+static const size_t r1cs_binary_fixed_header_size = 8 + 4 + 4 + 3 * 8;
+
+// Size of the count and byte size at the start of each chunk.
+static const size_t r1cs_binary_chunk_header_size = 2 * 8;
+
+void r1cs_binary_append_uint(std::vector<uint8_t> &out, uint64_t v, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+uint64_t r1cs_binary_decode_uint(const uint8_t *data, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        v |= ((uint64_t)data[i]) << (8 * i);
+    }
+    return v;
+}
+
+void r1cs_binary_write_header(
+    std::ostream &out_s, const r1cs_binary_header &header)
+{
+    std::vector<uint8_t> data(
+        r1cs_binary_magic, r1cs_binary_magic + sizeof(r1cs_binary_magic));
+    r1cs_binary_append_uint(data, header.version, 4);
+    r1cs_binary_append_uint(data, header.field_size, 4);
+    r1cs_binary_append_uint(data, header.primary_input_size, 8);
+    r1cs_binary_append_uint(data, header.auxiliary_input_size, 8);
+    r1cs_binary_append_uint(data, header.num_constraints, 8);
+    data.insert(data.end(), header.modulus.begin(), header.modulus.end());
+    out_s.write((const char *)data.data(), data.size());
+}
+
+/// Sequential decoding of the data of a chunk, with bounds checks.
+class r1cs_binary_chunk_decoder
+{
+public:
+    r1cs_binary_chunk_decoder(const uint8_t *data, size_t size)
+        : _data(data), _size(size), _offset(0)
+    {
+    }
+
+    const uint8_t *read(size_t size)
+    {
+        if (size > _size - _offset) {
+            throw std::runtime_error("invalid chunk in binary R1CS");
+        }
+        const uint8_t *data = _data + _offset;
+        _offset += size;
+        return data;
+    }
+
+    uint64_t read_uint(size_t n) { return r1cs_binary_decode_uint(read(n), n); }
+
+    bool at_end() const { return _offset == _size; }
+
+private:
+    const uint8_t *_data;
+    size_t _size;
+    size_t _offset;
+};
+
+} // namespace internal
+
+size_t r1cs_binary_chunk::num_constraints() const
+{
+    return annotations.size();
+}
+
+r1cs_binary_reader::r1cs_binary_reader(std::istream &in_s)
+    : _in_s(in_s), _header(), _num_constraints_read(0), _buffer()
+{
+    uint8_t data[internal::r1cs_binary_fixed_header_size];
+    if (!_in_s.read((char *)data, sizeof(data)) ||
+        memcmp(data, r1cs_binary_magic, sizeof(r1cs_binary_magic)) != 0) {
+        throw std::runtime_error("not a binary R1CS file");
+    }
+
+    const uint8_t *fields = data + sizeof(r1cs_binary_magic);
+    _header.version = (uint32_t)internal::r1cs_binary_decode_uint(fields, 4);
+    _header.field_size =
+        (uint32_t)internal::r1cs_binary_decode_uint(fields + 4, 4);
+    _header.primary_input_size =
+        internal::r1cs_binary_decode_uint(fields + 8, 8);
+    _header.auxiliary_input_size =
+        internal::r1cs_binary_decode_uint(fields + 16, 8);
+    _header.num_constraints = internal::r1cs_binary_decode_uint(fields + 24, 8);
+    if (_header.version != r1cs_binary_version) {
+        throw std::runtime_error("unsupported binary R1CS version");
+    }
+    if (_header.field_size == 0) {
+        throw std::runtime_error("invalid field size in binary R1CS");
+    }
+
+    _header.modulus.resize(_header.field_size);
+    if (!_in_s.read((char *)_header.modulus.data(), _header.field_size)) {
+        throw std::runtime_error("truncated binary R1CS header");
+    }
+}
+
+const r1cs_binary_header &r1cs_binary_reader::header() const
+{
+    return _header;
+}
+
+bool r1cs_binary_reader::read_chunk(r1cs_binary_chunk &chunk)
+{
+    chunk.lc_offsets.clear();
+    chunk.term_indices.clear();
+    chunk.term_coefficients.clear();
+    chunk.annotations.clear();
+    if (_num_constraints_read == _header.num_constraints) {
+        return false;
+    }
+
+    uint8_t chunk_header[internal::r1cs_binary_chunk_header_size];
+    if (!_in_s.read((char *)chunk_header, sizeof(chunk_header))) {
+        throw std::runtime_error("truncated binary R1CS");
+    }
+    const uint64_t num_constraints =
+        internal::r1cs_binary_decode_uint(chunk_header, 8);
+    const uint64_t num_bytes =
+        internal::r1cs_binary_decode_uint(chunk_header + 8, 8);
+    if (num_constraints == 0 ||
+        num_constraints > _header.num_constraints - _num_constraints_read) {
+        throw std::runtime_error("invalid chunk in binary R1CS");
+    }
+
+    _buffer.resize(num_bytes);
+    if (!_in_s.read((char *)_buffer.data(), num_bytes)) {
+        throw std::runtime_error("truncated binary R1CS");
+    }
+
+    const size_t field_size = _header.field_size;
+    internal::r1cs_binary_chunk_decoder decoder(_buffer.data(), num_bytes);
+    chunk.lc_offsets.reserve(3 * num_constraints + 1);
+    chunk.lc_offsets.push_back(0);
+    chunk.annotations.reserve(num_constraints);
+    for (uint64_t i = 0; i < num_constraints; ++i) {
+        for (size_t lc = 0; lc < 3; ++lc) {
+            const size_t num_terms = decoder.read_uint(4);
+            for (size_t j = 0; j < num_terms; ++j) {
+                chunk.term_indices.push_back(decoder.read_uint(8));
+                const uint8_t *coefficient = decoder.read(field_size);
+                chunk.term_coefficients.insert(
+                    chunk.term_coefficients.end(),
+                    coefficient,
+                    coefficient + field_size);
+            }
+            chunk.lc_offsets.push_back(chunk.term_indices.size());
+        }
+
+        const size_t annotation_size = decoder.read_uint(4);
+        const char *annotation = (const char *)decoder.read(annotation_size);
+        chunk.annotations.emplace_back(annotation, annotation_size);
+    }
+    if (!decoder.at_end()) {
+        throw std::runtime_error("invalid chunk in binary R1CS");
+    }
+
+    _num_constraints_read += num_constraints;
+    return true;
+}
+
+} // namespace libzecale
@@ -0,0 +1,115 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_SERIALIZATION_R1CS_BINARY_HPP__
+#define __ZECALE_SERIALIZATION_R1CS_BINARY_HPP__
+
+#include <cstdint>
+#include <istream>
+#include <libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace libzecale
+{
+
+/// Header of a binary R1CS file. All integers are little-endian, and field
+/// elements (the modulus and the coefficients) are written as `field_size`
+/// bytes holding their canonical (not Montgomery) value, little-endian, so
+/// files are independent of the build.
+///
+/// The header is followed by the constraints, in chunks. Each chunk is the
+/// number of constraints it holds and its size in bytes (both uint64_t),
+/// followed by the constraints. Each constraint is its linear combinations A,
+/// B and C, each given as a number of terms (uint32_t) followed by the terms
+/// (variable index as uint64_t, and coefficient), and then its annotation
+/// (uint32_t length followed by the characters, empty if the constraint
+/// system was built without annotations).
+struct r1cs_binary_header {
+    uint32_t version;
+    uint32_t field_size;
+    uint64_t primary_input_size;
+    uint64_t auxiliary_input_size;
+    uint64_t num_constraints;
+    std::vector<uint8_t> modulus;
+};
+
+static const char r1cs_binary_magic[8] = {'Z', 'E', 'C', 'R', '1', 'C', 'S', 0};
+static const uint32_t r1cs_binary_version = 1;
+
+/// Default number of constraints per chunk. Chunks are encoded (and decoded)
+/// independently, so memory use is bounded by a few chunks at a time.
+static const size_t default_r1cs_binary_chunk_size = 1 << 14;
+
+/// A chunk of constraints as read from a binary R1CS file, with coefficients
+/// left in their encoded form. The terms of all linear combinations (A, B and
+/// C of each constraint in turn) are held contiguously, those of the i-th
+/// linear combination being in the range [lc_offsets[i], lc_offsets[i+1]).
+struct r1cs_binary_chunk {
+    std::vector<uint64_t> lc_offsets;
+    std::vector<uint64_t> term_indices;
+    std::vector<uint8_t> term_coefficients;
+    std::vector<std::string> annotations;
+
+    size_t num_constraints() const;
+};
+
+/// Reads a binary R1CS file, one chunk at a time. This does not depend on
+/// the field, so can be used to analyse any constraint system.
+class r1cs_binary_reader
+{
+public:
+    /// Read the header. Throws std::runtime_error if the stream does not
+    /// hold a binary R1CS file.
+    explicit r1cs_binary_reader(std::istream &in_s);
+
+    const r1cs_binary_header &header() const;
+
+    /// Read the next chunk, returning false (leaving `chunk` empty) once all
+    /// constraints have been read. Throws std::runtime_error if the file is
+    /// truncated or invalid.
+    bool read_chunk(r1cs_binary_chunk &chunk);
+
+private:
+    std::istream &_in_s;
+    r1cs_binary_header _header;
+    uint64_t _num_constraints_read;
+    std::vector<uint8_t> _buffer;
+};
+
+namespace internal
+{
+
+/// Little-endian encoding of integers, shared by the writer and reader.
+void r1cs_binary_append_uint(std::vector<uint8_t> &out, uint64_t v, size_t n);
+uint64_t r1cs_binary_decode_uint(const uint8_t *data, size_t n);
+
+void r1cs_binary_write_header(
+    std::ostream &out_s, const r1cs_binary_header &header);
+
+} // namespace internal
+
+/// Write a constraint system in the binary R1CS format, encoding chunks of
+/// `chunk_size` constraints (in parallel if MULTICORE is enabled) and writing
+/// each once encoded. Annotations are only available (and so written) in
+/// DEBUG builds.
+template<typename FieldT>
+void r1cs_write_binary(
+    const libsnark::r1cs_constraint_system<FieldT> &constraint_system,
+    std::ostream &out_s,
+    size_t chunk_size = default_r1cs_binary_chunk_size);
+
+/// Read a constraint system from a binary R1CS file. Throws
+/// std::runtime_error if the file is invalid, or is for a different field.
+template<typename FieldT>
+void r1cs_read_binary(
+    libsnark::r1cs_constraint_system<FieldT> &constraint_system,
+    std::istream &in_s);
+
+} // namespace libzecale
+
+#include "libzecale/serialization/r1cs_binary.tcc"
+
+#endif // __ZECALE_SERIALIZATION_R1CS_BINARY_HPP__
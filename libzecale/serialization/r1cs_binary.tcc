@@ -0,0 +1,229 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#ifndef __ZECALE_SERIALIZATION_R1CS_BINARY_TCC__
+#define __ZECALE_SERIALIZATION_R1CS_BINARY_TCC__
+
+#include "libzecale/serialization/r1cs_binary.hpp"
+
+#include <algorithm>
+#include <initializer_list>
+#include <libff/algebra/fields/bigint.hpp>
+#include <libff/common/utils.hpp>
+#include <stdexcept>
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
+namespace libzecale
+{
+
+namespace internal
+{
+
+template<typename FieldT> size_t r1cs_binary_field_size()
+{
+    return FieldT::num_limbs * sizeof(mp_limb_t);
+}
+
+template<typename FieldT>
+void r1cs_binary_append_field(
+    std::vector<uint8_t> &out, const libff::bigint<FieldT::num_limbs> &value)
+{
+    for (size_t i = 0; i < FieldT::num_limbs; ++i) {
+        r1cs_binary_append_uint(out, value.data[i], sizeof(mp_limb_t));
+    }
+}
+
+template<typename FieldT> FieldT r1cs_binary_decode_field(const uint8_t *data)
+{
+    libff::bigint<FieldT::num_limbs> value;
+    for (size_t i = 0; i < FieldT::num_limbs; ++i) {
+        value.data[i] = (mp_limb_t)r1cs_binary_decode_uint(
+            data + i * sizeof(mp_limb_t), sizeof(mp_limb_t));
+    }
+    return FieldT(value);
+}
+
+template<typename FieldT>
+std::string r1cs_binary_annotation(
+    const libsnark::r1cs_constraint_system<FieldT> &constraint_system,
+    const size_t constraint_idx)
+{
+#ifdef DEBUG
+    const auto it =
+        constraint_system.constraint_annotations.find(constraint_idx);
+    if (it != constraint_system.constraint_annotations.end()) {
+        return it->second;
+    }
+#else
+    libff::UNUSED(constraint_system, constraint_idx);
+#endif
+    return std::string();
+}
+
+/// Encode the constraints in the range [begin, end) as a chunk (including
+/// the count and size which precede the constraints).
+template<typename FieldT>
+std::vector<uint8_t> r1cs_binary_encode_chunk(
+    const libsnark::r1cs_constraint_system<FieldT> &constraint_system,
+    const size_t begin,
+    const size_t end)
+{
+    std::vector<uint8_t> chunk;
+    r1cs_binary_append_uint(chunk, end - begin, 8);
+    r1cs_binary_append_uint(chunk, 0, 8);
+    for (size_t i = begin; i < end; ++i) {
+        const libsnark::r1cs_constraint<FieldT> &constraint =
+            constraint_system.constraints[i];
+        for (const auto *lc : {&constraint.a, &constraint.b, &constraint.c}) {
+            r1cs_binary_append_uint(chunk, lc->terms.size(), 4);
+            for (const auto &term : lc->terms) {
+                r1cs_binary_append_uint(chunk, term.index, 8);
+                r1cs_binary_append_field<FieldT>(
+                    chunk, term.coeff.as_bigint());
+            }
+        }
+
+        const std::string annotation =
+            r1cs_binary_annotation(constraint_system, i);
+        r1cs_binary_append_uint(chunk, annotation.size(), 4);
+        chunk.insert(chunk.end(), annotation.begin(), annotation.end());
+    }
+
+    // Fill in the size of the chunk data.
+    std::vector<uint8_t> num_bytes;
+    r1cs_binary_append_uint(num_bytes, chunk.size() - 16, 8);
+    std::copy(num_bytes.begin(), num_bytes.end(), chunk.begin() + 8);
+    return chunk;
+}
+
+/// Decode the i-th constraint of a chunk.
+template<typename FieldT>
+void r1cs_binary_decode_constraint(
+    const r1cs_binary_chunk &chunk,
+    const size_t field_size,
+    const size_t constraint_idx,
+    libsnark::r1cs_constraint<FieldT> &constraint)
+{
+    libsnark::linear_combination<FieldT> *lcs[] = {
+        &constraint.a, &constraint.b, &constraint.c};
+    for (size_t lc = 0; lc < 3; ++lc) {
+        const uint64_t begin = chunk.lc_offsets[3 * constraint_idx + lc];
+        const uint64_t end = chunk.lc_offsets[3 * constraint_idx + lc + 1];
+        std::vector<libsnark::linear_term<FieldT>> &terms = lcs[lc]->terms;
+        terms.resize(end - begin);
+        for (uint64_t j = begin; j < end; ++j) {
+            terms[j - begin].index = chunk.term_indices[j];
+            terms[j - begin].coeff = r1cs_binary_decode_field<FieldT>(
+                chunk.term_coefficients.data() + j * field_size);
+        }
+    }
+}
+
+} // namespace internal
+
+template<typename FieldT>
+void r1cs_write_binary(
+    const libsnark::r1cs_constraint_system<FieldT> &constraint_system,
+    std::ostream &out_s,
+    const size_t chunk_size)
+{
+    if (chunk_size == 0) {
+        throw std::invalid_argument("invalid R1CS chunk size");
+    }
+
+    r1cs_binary_header header;
+    header.version = r1cs_binary_version;
+    header.field_size = internal::r1cs_binary_field_size<FieldT>();
+    header.primary_input_size = constraint_system.primary_input_size;
+    header.auxiliary_input_size = constraint_system.auxiliary_input_size;
+    header.num_constraints = constraint_system.constraints.size();
+    internal::r1cs_binary_append_field<FieldT>(header.modulus, FieldT::mod);
+    internal::r1cs_binary_write_header(out_s, header);
+
+    // Chunks are encoded in groups (one chunk per thread), each group being
+    // written out in order before the next is encoded.
+#ifdef MULTICORE
+    const size_t group_size = (size_t)omp_get_max_threads();
+#else
+    const size_t group_size = 1;
+#endif
+    const size_t num_constraints = constraint_system.constraints.size();
+    const size_t num_chunks = (num_constraints + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<uint8_t>> encoded(group_size);
+    for (size_t group = 0; group < num_chunks; group += group_size) {
+        const size_t group_end = std::min(num_chunks, group + group_size);
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+        for (size_t c = group; c < group_end; ++c) {
+            encoded[c - group] = internal::r1cs_binary_encode_chunk(
+                constraint_system,
+                c * chunk_size,
+                std::min(num_constraints, (c + 1) * chunk_size));
+        }
+
+        for (size_t c = group; c < group_end; ++c) {
+            const std::vector<uint8_t> &chunk = encoded[c - group];
+            out_s.write((const char *)chunk.data(), chunk.size());
+        }
+    }
+}
+
+template<typename FieldT>
+void r1cs_read_binary(
+    libsnark::r1cs_constraint_system<FieldT> &constraint_system,
+    std::istream &in_s)
+{
+    r1cs_binary_reader reader(in_s);
+    const r1cs_binary_header &header = reader.header();
+    const size_t field_size = internal::r1cs_binary_field_size<FieldT>();
+    std::vector<uint8_t> modulus;
+    internal::r1cs_binary_append_field<FieldT>(modulus, FieldT::mod);
+    if (header.field_size != field_size || header.modulus != modulus) {
+        throw std::runtime_error("binary R1CS is for a different field");
+    }
+
+    constraint_system = libsnark::r1cs_constraint_system<FieldT>();
+    constraint_system.primary_input_size = header.primary_input_size;
+    constraint_system.auxiliary_input_size = header.auxiliary_input_size;
+    constraint_system.constraints.reserve(header.num_constraints);
+    const uint64_t num_variables =
+        header.primary_input_size + header.auxiliary_input_size;
+
+    r1cs_binary_chunk chunk;
+    while (reader.read_chunk(chunk)) {
+        for (const uint64_t index : chunk.term_indices) {
+            if (index > num_variables) {
+                throw std::runtime_error("invalid variable in binary R1CS");
+            }
+        }
+
+        const size_t begin = constraint_system.constraints.size();
+        const size_t num_chunk_constraints = chunk.num_constraints();
+        constraint_system.constraints.resize(begin + num_chunk_constraints);
+#ifdef MULTICORE
+#pragma omp parallel for
+#endif
+        for (size_t i = 0; i < num_chunk_constraints; ++i) {
+            internal::r1cs_binary_decode_constraint(
+                chunk, field_size, i, constraint_system.constraints[begin + i]);
+        }
+
+#ifdef DEBUG
+        for (size_t i = 0; i < num_chunk_constraints; ++i) {
+            if (!chunk.annotations[i].empty()) {
+                constraint_system.constraint_annotations[begin + i] =
+                    chunk.annotations[i];
+            }
+        }
+#endif
+    }
+}
+
+} // namespace libzecale
+
+#endif // __ZECALE_SERIALIZATION_R1CS_BINARY_TCC__
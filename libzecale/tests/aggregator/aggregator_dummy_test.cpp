@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: LGPL-3.0+
 
 #include "libzecale/circuits/aggregator_circuit.hpp"
+#include "libzecale/circuits/aggregator_circuit_family.hpp"
 #include "libzecale/circuits/groth16_verifier/groth16_verifier_parameters.hpp"
 #include "libzecale/circuits/null_hash_gadget.hpp"
 #include "libzecale/circuits/pghr13_verifier/pghr13_verifier_parameters.hpp"
@@ -135,6 +136,19 @@ void test_aggregate_dummy_application()
         wkeypair,
         aggregator,
         {libff::Fr<wppT>::one(), libff::Fr<wppT>::one()});
+
+    // A witness-only context, sharing the constraint system held by the
+    // proving key, must produce equivalent proofs.
+    aggregator_circuit<wppT, wsnarkT, nverifierT, batch_size> witness_context(
+        public_inputs_per_proof, &wkeypair.pk.constraint_system);
+    ASSERT_THROW(witness_context.generate_trusted_setup(), std::runtime_error);
+    test_aggregator_with_batch(
+        public_inputs_per_proof,
+        nkp,
+        {{&npf2, &npf1}},
+        wkeypair,
+        witness_context,
+        {libff::Fr<wppT>::one(), libff::Fr<wppT>::one()});
 }
 
 template<typename wppT, typename wsnarkT, typename nverifierT>
@@ -186,6 +200,101 @@ void test_aggregate_dummy_application_with_invalid_proof()
         {libff::Fr<wppT>::one(), libff::Fr<wppT>::zero()});
 }
 
+template<typename wppT, typename wsnarkT, typename nverifierT>
+void test_aggregate_dummy_application_runtime_batch_size()
+{
+    using npp = libsnark::other_curve<wppT>;
+    using nsnark = typename nverifierT::snark;
+    using family = aggregator_circuit_family<wppT, wsnarkT, nverifierT, 2, 3>;
+    using circuit_interface = typename family::circuit_interface;
+
+    static const size_t public_inputs_per_proof = 1;
+
+    ASSERT_EQ(std::vector<size_t>({2, 3}), family::batch_sizes());
+    ASSERT_TRUE(family::supports_batch_size(3));
+    ASSERT_FALSE(family::supports_batch_size(4));
+    ASSERT_THROW(
+        family::create(4, public_inputs_per_proof), std::invalid_argument);
+
+    // Nested keypair and proofs
+    test::dummy_app_wrapper<npp, nsnark> dummy_app;
+    const typename nsnark::keypair nkp = dummy_app.generate_keypair();
+    const libzeth::extended_proof<npp, nsnark> npf1 =
+        dummy_app.prove(5, nkp.pk);
+    const libzeth::extended_proof<npp, nsnark> npf2 =
+        dummy_app.prove(9, nkp.pk);
+    const libzeth::extended_proof<npp, nsnark> npf3 =
+        dummy_app.prove(11, nkp.pk);
+
+    // Select the batch size at runtime, and prove through the interface.
+    const std::unique_ptr<circuit_interface> aggregator =
+        family::create(3, public_inputs_per_proof);
+    ASSERT_EQ((size_t)3, aggregator->batch_size());
+    ASSERT_EQ(
+        2 + 3 * public_inputs_per_proof, aggregator->num_primary_inputs());
+    const typename wsnarkT::keypair wkeypair =
+        aggregator->generate_trusted_setup();
+
+    const std::unique_ptr<circuit_interface> witness_context = family::create(
+        3, public_inputs_per_proof, &wkeypair.pk.constraint_system);
+    ASSERT_THROW(
+        witness_context->prove(nkp.vk, {}, wkeypair.pk),
+        std::invalid_argument);
+    ASSERT_THROW(
+        witness_context->prove(
+            nkp.vk, {&npf1, &npf2, &npf3, &npf1}, wkeypair.pk),
+        std::invalid_argument);
+
+    const libzeth::extended_proof<wppT, wsnarkT> wpf =
+        witness_context->prove(nkp.vk, {&npf1, &npf2, &npf3}, wkeypair.pk);
+    ASSERT_TRUE(wsnarkT::verify(
+        wpf.get_primary_inputs(), wpf.get_proof(), wkeypair.vk));
+    ASSERT_EQ(
+        fp_from_bits<libff::Fr<wppT>, 3>(
+            {libff::Fr<wppT>::one(),
+             libff::Fr<wppT>::one(),
+             libff::Fr<wppT>::one()}),
+        wpf.get_primary_inputs()[1]);
+
+    // A partial batch is padded with (invalid) padding proofs, with zero
+    // inputs.
+    const libzeth::extended_proof<wppT, wsnarkT> partial_wpf =
+        witness_context->prove(nkp.vk, {&npf1, &npf2}, wkeypair.pk);
+    ASSERT_TRUE(wsnarkT::verify(
+        partial_wpf.get_primary_inputs(),
+        partial_wpf.get_proof(),
+        wkeypair.vk));
+    ASSERT_EQ(
+        fp_from_bits<libff::Fr<wppT>, 3>(
+            {libff::Fr<wppT>::one(),
+             libff::Fr<wppT>::one(),
+             libff::Fr<wppT>::zero()}),
+        partial_wpf.get_primary_inputs()[1]);
+    ASSERT_EQ(
+        libff::Fr<wppT>::zero(),
+        partial_wpf.get_primary_inputs()[2 + 2 * public_inputs_per_proof]);
+
+    // The nested vk witness can be computed once (by a circuit of any size)
+    // and reused for each batch.
+    const std::unique_ptr<circuit_interface> vk_witness_context =
+        family::create(2, public_inputs_per_proof);
+    const nested_vk_witness<wppT> vk_witness =
+        vk_witness_context->compute_nested_vk_witness(nkp.vk);
+    ASSERT_EQ(
+        (verification_key_hash_gadget<wppT, nverifierT>::compute_hash(
+            nkp.vk, public_inputs_per_proof)),
+        vk_witness.variable_values[0]);
+    const libzeth::extended_proof<wppT, wsnarkT> cached_wpf =
+        witness_context->prove(vk_witness, {&npf1, &npf2, &npf3}, wkeypair.pk);
+    ASSERT_TRUE(wsnarkT::verify(
+        cached_wpf.get_primary_inputs(), cached_wpf.get_proof(), wkeypair.vk));
+    ASSERT_EQ(wpf.get_primary_inputs(), cached_wpf.get_primary_inputs());
+    ASSERT_THROW(
+        witness_context->prove(
+            nested_vk_witness<wppT>(), {&npf1, &npf2, &npf3}, wkeypair.pk),
+        std::invalid_argument);
+}
+
 TEST(AggregatorTest, AggregateDummyApplicationMnt4Groth16Mnt6Groth16)
 {
     using wpp = libff::mnt6_pp;
@@ -196,6 +305,10 @@ TEST(AggregatorTest, AggregateDummyApplicationMnt4Groth16Mnt6Groth16)
         wpp,
         wsnark,
         nverifier>();
+    test_aggregate_dummy_application_runtime_batch_size<
+        wpp,
+        wsnark,
+        nverifier>();
 }
 
 TEST(AggregatorTest, AggregateDummyApplicationBls12Groth16Bw6Groth16)
@@ -74,7 +74,8 @@ void verification_key_hash_gadget_test()
     libzecale::test::dummy_app_wrapper<npp, nsnark> dummy_app;
     const typename nsnark::keypair nkeypair = dummy_app.generate_keypair();
 
-    // Compute the hash via the static compute method.
+    // Compute the hash natively, via the static compute method. This must
+    // match the output of the gadget below.
     const FieldT nvk_hash_value =
         libzecale::verification_key_hash_gadget<wppT, nverifierT>::compute_hash(
             nkeypair.vk, num_nested_inputs);
@@ -7,8 +7,11 @@
 #include "libzecale/core/application_pool.hpp"
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
 #include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
 #include <stdio.h>
+#include <thread>
 
 using namespace libzecale;
 
@@ -86,7 +89,7 @@ void test_add_and_retrieve_transactions()
     std::string dummy_app_name = std::string("test_application");
     typename snarkT::verification_key vk =
         dummy_provider<snarkT>::get_verification_key(42);
-    application_pool<ppT, snarkT, BATCH_SIZE> pool(dummy_app_name, vk);
+    application_pool<ppT, snarkT> pool(dummy_app_name, vk);
 
     // Get size of the pool before any addition
     ASSERT_EQ(pool.tx_pool_size(), (size_t)0);
@@ -124,17 +127,288 @@ void test_add_and_retrieve_transactions()
     ASSERT_EQ(pool.tx_pool_size(), (size_t)5);
 
     // 2. Retrieve a batch
-    std::array<libzecale::nested_transaction<ppT, snarkT>, BATCH_SIZE> batch;
-    const size_t batch_size = pool.get_next_batch(batch);
+    std::vector<libzecale::nested_transaction<ppT, snarkT>> batch;
+    const size_t batch_size = pool.get_next_batch(BATCH_SIZE, batch);
     ASSERT_EQ(batch_size, BATCH_SIZE);
+    ASSERT_EQ(BATCH_SIZE, batch.size());
 
     for (size_t i = 0; i < BATCH_SIZE; ++i) {
         std::cout << "i: " << i << " val: ";
         batch[i].write_json(std::cout);
     }
 
+    // The batch holds the highest-fee transactions, in decreasing fee order.
+    ASSERT_EQ((uint32_t)120, batch[0].fee_wei());
+    ASSERT_EQ((uint32_t)20, batch[1].fee_wei());
+
     // Get size of the pool after batch retrieval
     ASSERT_EQ(pool.tx_pool_size(), (size_t)5 - BATCH_SIZE);
+
+    // Batches larger than the pool cannot be filled, and leave the pool
+    // untouched.
+    ASSERT_EQ((size_t)0, pool.get_next_batch(4, batch));
+    ASSERT_TRUE(batch.empty());
+    ASSERT_EQ(pool.tx_pool_size(), (size_t)3);
+
+    // Batches of other sizes can be retrieved from the same pool.
+    ASSERT_EQ((size_t)3, pool.get_next_batch(3, batch));
+    ASSERT_EQ((size_t)3, batch.size());
+    ASSERT_EQ((uint32_t)12, batch[0].fee_wei());
+    ASSERT_EQ((uint32_t)3, batch[1].fee_wei());
+    ASSERT_EQ((uint32_t)1, batch[2].fee_wei());
+    ASSERT_EQ(pool.tx_pool_size(), (size_t)0);
+
+    // Partial batches take all remaining transactions (if any).
+    ASSERT_EQ((size_t)0, pool.get_next_batch(BATCH_SIZE, batch, true));
+    ASSERT_TRUE(batch.empty());
+    pool.add_tx(tx_a);
+    ASSERT_EQ((size_t)1, pool.get_next_batch(BATCH_SIZE, batch, true));
+    ASSERT_EQ((size_t)1, batch.size());
+    ASSERT_EQ((uint32_t)1, batch[0].fee_wei());
+    ASSERT_EQ(pool.tx_pool_size(), (size_t)0);
+}
+
+template<typename ppT, typename snarkT>
+void test_concurrent_add_and_retrieve_transactions()
+{
+    static const size_t num_inputs = 1;
+    static const size_t num_submitters = 32;
+    static const size_t txs_per_submitter = 500;
+    const size_t BATCH_SIZE = 4;
+
+    std::string dummy_app_name = std::string("test_application");
+    typename snarkT::verification_key vk =
+        dummy_provider<snarkT>::get_verification_key(42);
+    application_pool<ppT, snarkT> pool(dummy_app_name, vk);
+
+    typename snarkT::proof proof = dummy_provider<snarkT>::get_proof();
+    std::vector<libff::Fr<ppT>> dummy_inputs(
+        num_inputs, libff::Fr<ppT>::random_element());
+    const libzeth::extended_proof<ppT, snarkT> dummy_extended_proof(
+        std::move(proof), std::move(dummy_inputs));
+
+    // A single consumer repeatedly extracts batches while all submitters are
+    // adding transactions, and continues until the pool cannot fill a batch.
+    std::atomic<bool> submitters_done(false);
+    std::atomic<size_t> num_batched(0);
+    std::thread consumer([&]() {
+        std::vector<nested_transaction<ppT, snarkT>> batch;
+        for (;;) {
+            const bool done = submitters_done.load();
+            const size_t num_entries = pool.get_next_batch(BATCH_SIZE, batch);
+            if (num_entries == 0) {
+                if (done) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            EXPECT_EQ(BATCH_SIZE, num_entries);
+            for (size_t i = 1; i < num_entries; ++i) {
+                EXPECT_GE(batch[i - 1].fee_wei(), batch[i].fee_wei());
+            }
+            num_batched += num_entries;
+        }
+    });
+
+    std::vector<std::thread> submitters;
+    for (size_t i = 0; i < num_submitters; ++i) {
+        submitters.emplace_back([&, i]() {
+            for (size_t j = 0; j < txs_per_submitter; ++j) {
+                const uint32_t fee = (uint32_t)(i * txs_per_submitter + j);
+                pool.add_tx(nested_transaction<ppT, snarkT>(
+                    dummy_app_name, dummy_extended_proof, {}, fee));
+            }
+        });
+    }
+    for (std::thread &submitter : submitters) {
+        submitter.join();
+    }
+    submitters_done = true;
+    consumer.join();
+
+    // Every transaction has either been batched or remains in the pool, and
+    // the remainder is too small to fill a batch.
+    ASSERT_EQ(
+        num_submitters * txs_per_submitter,
+        num_batched.load() + pool.tx_pool_size());
+    ASSERT_LT(pool.tx_pool_size(), BATCH_SIZE);
+}
+
+template<typename ppT, typename snarkT> void test_oldest_arrival_time()
+{
+    using clock = std::chrono::steady_clock;
+    const std::string dummy_app_name("test_application");
+    application_pool<ppT, snarkT> pool(
+        dummy_app_name,
+        dummy_provider<snarkT>::get_verification_key(42),
+        std::chrono::milliseconds(250));
+    ASSERT_EQ(std::chrono::milliseconds(250), pool.max_batch_wait());
+
+    clock::time_point oldest;
+    ASSERT_FALSE(pool.oldest_arrival_time(oldest));
+
+    const libzeth::extended_proof<ppT, snarkT> dummy_extended_proof(
+        dummy_provider<snarkT>::get_proof(), {libff::Fr<ppT>::one()});
+    const clock::time_point t0 = clock::now();
+    const clock::time_point t1 = t0 + std::chrono::seconds(1);
+    const clock::time_point t2 = t0 + std::chrono::seconds(2);
+
+    // The oldest transaction has the highest fee, and is taken first.
+    pool.add_tx(nested_transaction<ppT, snarkT>(
+        dummy_app_name, dummy_extended_proof, {}, 30, t0));
+    pool.add_tx(nested_transaction<ppT, snarkT>(
+        dummy_app_name, dummy_extended_proof, {}, 10, t2));
+    pool.add_tx(nested_transaction<ppT, snarkT>(
+        dummy_app_name, dummy_extended_proof, {}, 20, t1));
+
+    ASSERT_TRUE(pool.oldest_arrival_time(oldest));
+    ASSERT_EQ(t0, oldest);
+
+    std::vector<nested_transaction<ppT, snarkT>> batch;
+    ASSERT_EQ((size_t)1, pool.get_next_batch(1, batch));
+    ASSERT_EQ(t0, batch[0].arrival_time());
+    ASSERT_TRUE(pool.oldest_arrival_time(oldest));
+    ASSERT_EQ(t1, oldest);
+
+    ASSERT_EQ((size_t)2, pool.get_next_batch(2, batch));
+    ASSERT_FALSE(pool.oldest_arrival_time(oldest));
+}
+
+template<typename ppT, typename snarkT> void test_bounded_pool()
+{
+    using clock = std::chrono::steady_clock;
+    using tx_type = nested_transaction<ppT, snarkT>;
+    const std::string dummy_app_name("test_application");
+    application_pool_limits limits;
+    limits.max_transactions = 3;
+    limits.tx_ttl = std::chrono::seconds(10);
+    application_pool<ppT, snarkT> pool(
+        dummy_app_name,
+        dummy_provider<snarkT>::get_verification_key(42),
+        std::chrono::milliseconds::zero(),
+        4,
+        limits);
+
+    const libzeth::extended_proof<ppT, snarkT> dummy_extended_proof(
+        dummy_provider<snarkT>::get_proof(), {libff::Fr<ppT>::one()});
+    const clock::time_point now = clock::now();
+    std::vector<tx_type> evicted;
+    uint32_t min_fee;
+
+    ASSERT_TRUE(pool.min_accepted_fee(min_fee));
+    ASSERT_EQ((uint32_t)0, min_fee);
+    ASSERT_TRUE(pool.add_tx(
+        tx_type(dummy_app_name, dummy_extended_proof, {}, 10, now), evicted));
+    ASSERT_TRUE(pool.add_tx(
+        tx_type(dummy_app_name, dummy_extended_proof, {}, 20, now), evicted));
+    ASSERT_TRUE(pool.add_tx(
+        tx_type(
+            dummy_app_name,
+            dummy_extended_proof,
+            {},
+            30,
+            now - std::chrono::seconds(20)),
+        evicted));
+    ASSERT_TRUE(evicted.empty());
+
+    // The pool is full. Transactions without a higher fee than the lowest in
+    // the pool are rejected, and others evict it.
+    ASSERT_TRUE(pool.min_accepted_fee(min_fee));
+    ASSERT_EQ((uint32_t)11, min_fee);
+    ASSERT_FALSE(pool.add_tx(
+        tx_type(dummy_app_name, dummy_extended_proof, {}, 10, now), evicted));
+    ASSERT_TRUE(evicted.empty());
+    ASSERT_TRUE(pool.add_tx(
+        tx_type(dummy_app_name, dummy_extended_proof, {}, 15, now), evicted));
+    ASSERT_EQ((size_t)1, evicted.size());
+    ASSERT_EQ((uint32_t)10, evicted[0].fee_wei());
+    ASSERT_EQ((size_t)3, pool.tx_pool_size());
+
+    // Transactions older than the TTL expire.
+    std::vector<tx_type> expired;
+    ASSERT_EQ((size_t)1, pool.remove_expired(now, expired));
+    ASSERT_EQ((size_t)1, expired.size());
+    ASSERT_EQ((uint32_t)30, expired[0].fee_wei());
+    ASSERT_EQ((size_t)2, pool.tx_pool_size());
+
+    std::vector<tx_type> batch;
+    ASSERT_EQ((size_t)2, pool.get_next_batch(2, batch));
+    ASSERT_EQ((uint32_t)20, batch[0].fee_wei());
+    ASSERT_EQ((uint32_t)15, batch[1].fee_wei());
+    ASSERT_EQ((size_t)0, pool.tx_pool_bytes());
+}
+
+template<typename ppT, typename snarkT> void test_shared_capacity()
+{
+    using tx_type = nested_transaction<ppT, snarkT>;
+    const typename snarkT::verification_key vk =
+        dummy_provider<snarkT>::get_verification_key(42);
+    const libzeth::extended_proof<ppT, snarkT> dummy_extended_proof(
+        dummy_provider<snarkT>::get_proof(), {libff::Fr<ppT>::one()});
+
+    // Two pools, holding at most 2 transactions between them.
+    const std::shared_ptr<pool_capacity> capacity =
+        std::make_shared<pool_capacity>(2);
+    application_pool<ppT, snarkT> pool_a(
+        "app_a",
+        vk,
+        std::chrono::milliseconds::zero(),
+        0,
+        application_pool_limits(),
+        capacity);
+    application_pool<ppT, snarkT> pool_b(
+        "app_b",
+        vk,
+        std::chrono::milliseconds::zero(),
+        0,
+        application_pool_limits(),
+        capacity);
+
+    ASSERT_TRUE(pool_a.add_tx(tx_type("app_a", dummy_extended_proof, {}, 5)));
+    ASSERT_TRUE(pool_a.add_tx(tx_type("app_a", dummy_extended_proof, {}, 6)));
+    ASSERT_TRUE(capacity->full());
+
+    // The empty pool cannot evict transactions from the other.
+    uint32_t min_fee;
+    ASSERT_FALSE(pool_b.min_accepted_fee(min_fee));
+    ASSERT_FALSE(
+        pool_b.add_tx(tx_type("app_b", dummy_extended_proof, {}, 100)));
+    ASSERT_TRUE(pool_a.min_accepted_fee(min_fee));
+    ASSERT_EQ((uint32_t)6, min_fee);
+
+    // Space released by one pool can be used by the other.
+    std::vector<tx_type> batch;
+    ASSERT_EQ((size_t)1, pool_a.get_next_batch(1, batch));
+    ASSERT_TRUE(pool_b.add_tx(tx_type("app_b", dummy_extended_proof, {}, 1)));
+    ASSERT_EQ((size_t)2, capacity->num_transactions());
+}
+
+template<typename ppT, typename snarkT> void test_move_transactions()
+{
+    using tx_type = nested_transaction<ppT, snarkT>;
+    application_pool<ppT, snarkT> pool(
+        "test_application", dummy_provider<snarkT>::get_verification_key(42));
+
+    // A transaction moved into the pool is moved out again in the batch,
+    // holding the same parameters buffer and application name.
+    std::vector<uint8_t> parameters{1, 2, 3};
+    const uint8_t *parameters_data = parameters.data();
+    tx_type tx(
+        pool.interned_name(),
+        libzeth::extended_proof<ppT, snarkT>(
+            dummy_provider<snarkT>::get_proof(), {libff::Fr<ppT>::one()}),
+        std::move(parameters),
+        10);
+    ASSERT_EQ(pool.interned_name().get(), &tx.application_name());
+    ASSERT_TRUE(pool.add_tx(std::move(tx)));
+
+    std::vector<tx_type> batch;
+    ASSERT_EQ((size_t)1, pool.get_next_batch(1, batch));
+    ASSERT_EQ(parameters_data, batch[0].parameters().data());
+    ASSERT_EQ(pool.interned_name().get(), &batch[0].application_name());
+    ASSERT_EQ("test_application", batch[0].application_name());
 }
 
 template<typename ppT> void test_add_and_retrieve_transactions_groth16()
@@ -157,6 +431,39 @@ TEST(ApplicationPoolTests, AddAndRetrieveTransactionsMnt4Pghr13)
     test_add_and_retrieve_transactions_pghr13<libff::mnt4_pp>();
 }
 
+TEST(ApplicationPoolTests, ConcurrentAddAndRetrieveTransactionsMnt4Groth16)
+{
+    test_concurrent_add_and_retrieve_transactions<
+        libff::mnt4_pp,
+        libzeth::groth16_snark<libff::mnt4_pp>>();
+}
+
+TEST(ApplicationPoolTests, OldestArrivalTimeMnt4Groth16)
+{
+    test_oldest_arrival_time<
+        libff::mnt4_pp,
+        libzeth::groth16_snark<libff::mnt4_pp>>();
+}
+
+TEST(ApplicationPoolTests, BoundedPoolMnt4Groth16)
+{
+    test_bounded_pool<libff::mnt4_pp, libzeth::groth16_snark<libff::mnt4_pp>>();
+}
+
+TEST(ApplicationPoolTests, SharedCapacityMnt4Groth16)
+{
+    test_shared_capacity<
+        libff::mnt4_pp,
+        libzeth::groth16_snark<libff::mnt4_pp>>();
+}
+
+TEST(ApplicationPoolTests, MoveTransactionsMnt4Groth16)
+{
+    test_move_transactions<
+        libff::mnt4_pp,
+        libzeth::groth16_snark<libff::mnt4_pp>>();
+}
+
 } // namespace
 
 int main(int argc, char **argv)
@@ -0,0 +1,109 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/application_pool.hpp"
+#include "libzecale/core/application_registry.hpp"
+
+#include <atomic>
+#include <gtest/gtest.h>
+#include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
+#include <libzeth/snarks/groth16/groth16_snark.hpp>
+#include <thread>
+
+using namespace libzecale;
+
+namespace
+{
+
+using pp = libff::mnt4_pp;
+using snark = libzeth::groth16_snark<pp>;
+using test_application_pool = application_pool<pp, snark>;
+using test_application_registry = application_registry<test_application_pool>;
+
+std::shared_ptr<test_application_pool> make_pool(const std::string &name)
+{
+    return std::make_shared<test_application_pool>(
+        name,
+        libsnark::r1cs_gg_ppzksnark_verification_key<
+            pp>::dummy_verification_key(1));
+}
+
+TEST(ApplicationRegistryTest, AddAndGet)
+{
+    test_application_registry registry;
+    ASSERT_EQ((size_t)0, registry.size());
+    ASSERT_EQ(nullptr, registry.get("app1"));
+    ASSERT_THROW(registry.at("app1"), std::out_of_range);
+
+    std::shared_ptr<test_application_pool> app1 = make_pool("app1");
+    ASSERT_TRUE(registry.add(app1));
+    ASSERT_TRUE(registry.add(make_pool("app2")));
+    ASSERT_EQ((size_t)2, registry.size());
+    ASSERT_EQ(app1, registry.get("app1"));
+    ASSERT_EQ(app1, registry.at("app1"));
+    ASSERT_EQ("app2", registry.at("app2")->name());
+
+    // Registering a second app of the same name leaves the original.
+    ASSERT_FALSE(registry.add(make_pool("app1")));
+    ASSERT_EQ(app1, registry.get("app1"));
+    ASSERT_EQ((size_t)2, registry.get_all().size());
+}
+
+TEST(ApplicationRegistryTest, ConcurrentRegistrationAndLookup)
+{
+    static const size_t num_threads = 32;
+    static const size_t num_apps = 64;
+    static const size_t lookups_per_thread = 20000;
+
+    // Every thread attempts to register every app, while also looking up
+    // apps. Exactly one registration per app must succeed, and lookups must
+    // only ever return the registered pool (or nullptr before
+    // registration).
+    test_application_registry registry;
+    std::atomic<size_t> num_registered(0);
+    std::atomic<size_t> num_found(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = 0; i < lookups_per_thread; ++i) {
+                const size_t app_idx = (t * 7 + i) % num_apps;
+                const std::string name = "app" + std::to_string(app_idx);
+                if (i < num_apps) {
+                    if (registry.add(make_pool(name))) {
+                        ++num_registered;
+                    }
+                }
+
+                std::shared_ptr<test_application_pool> pool =
+                    registry.get(name);
+                if (pool) {
+                    EXPECT_EQ(name, pool->name());
+                    ++num_found;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(num_apps, num_registered.load());
+    ASSERT_EQ(num_apps, registry.size());
+    ASSERT_LT((size_t)0, num_found.load());
+    for (size_t app_idx = 0; app_idx < num_apps; ++app_idx) {
+        const std::string name = "app" + std::to_string(app_idx);
+        ASSERT_EQ(name, registry.at(name)->name());
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    // Initialize the curve parameters before running the tests
+    libff::mnt4_pp::init_public_params();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
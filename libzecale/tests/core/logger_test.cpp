@@ -0,0 +1,67 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/logger.hpp"
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace libzecale;
+
+namespace
+{
+
+TEST(LoggerTest, Levels)
+{
+    std::ostringstream out;
+    {
+        logger log(log_level::debug, 16, out);
+        ASSERT_TRUE(log.enabled(log_level::error));
+        ASSERT_TRUE(log.enabled(log_level::debug));
+        ASSERT_FALSE(log.enabled(log_level::trace));
+
+        log_record(log, log_level::info, "test") << "info " << 1;
+        log_record(log, log_level::debug, "test") << "debug " << 2;
+
+        log_record trace(log, log_level::trace, "test");
+        ASSERT_FALSE(trace.enabled());
+        trace << "trace";
+    }
+
+    // All queued messages are written when the logger is destroyed.
+    ASSERT_EQ("[INFO] info 1\n[DEBUG] debug 2\n", out.str());
+}
+
+TEST(LoggerTest, Sampling)
+{
+    std::ostringstream out;
+    {
+        logger log(log_level::debug, 16, out);
+        log.set_sample_rate("sampled", 3);
+        for (size_t i = 0; i < 7; ++i) {
+            log_record(log, log_level::debug, "sampled") << "s" << i;
+        }
+        log_record(log, log_level::error, "sampled") << "error";
+        log_record(log, log_level::debug, "other") << "other";
+    }
+
+    ASSERT_EQ(
+        "[DEBUG] s0\n[DEBUG] s3\n[DEBUG] s6\n[ERROR] error\n[DEBUG] other\n",
+        out.str());
+}
+
+TEST(LoggerTest, LogLevelFromString)
+{
+    ASSERT_EQ(log_level::error, log_level_from_string("error"));
+    ASSERT_EQ(log_level::trace, log_level_from_string("trace"));
+    ASSERT_THROW(log_level_from_string("verbose"), std::invalid_argument);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/metrics.hpp"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+
+using namespace libzecale;
+
+namespace
+{
+
+TEST(MetricsTest, HistogramBuckets)
+{
+    // Small values have their own buckets.
+    for (uint64_t v = 0; v < metrics_histogram::num_sub_buckets; ++v) {
+        ASSERT_EQ(v, metrics_histogram::bucket_index(v));
+        ASSERT_EQ(v, metrics_histogram::bucket_upper_bound(v));
+    }
+
+    // Every value lies in its bucket, and bucket bounds are contiguous.
+    uint64_t lower = 0;
+    for (size_t i = 0; i < metrics_histogram::num_buckets; ++i) {
+        const uint64_t upper = metrics_histogram::bucket_upper_bound(i);
+        ASSERT_LE(lower, upper);
+        ASSERT_EQ(i, metrics_histogram::bucket_index(lower));
+        ASSERT_EQ(i, metrics_histogram::bucket_index(upper));
+        lower = upper + 1;
+    }
+    ASSERT_EQ((uint64_t)0, lower);
+
+    // Relative width of buckets is bounded.
+    const size_t idx = metrics_histogram::bucket_index(1000000);
+    const uint64_t width = metrics_histogram::bucket_upper_bound(idx) -
+                           metrics_histogram::bucket_upper_bound(idx - 1);
+    ASSERT_LE(width * metrics_histogram::num_sub_buckets, (uint64_t)1000000);
+}
+
+TEST(MetricsTest, HistogramQuantiles)
+{
+    metrics_histogram histogram;
+    for (uint64_t v = 1; v <= 1000; ++v) {
+        histogram.record(v);
+    }
+
+    const metrics_histogram_snapshot snapshot = histogram.snapshot();
+    ASSERT_EQ((uint64_t)1000, snapshot.count);
+    ASSERT_EQ((uint64_t)500500, snapshot.sum);
+    ASSERT_EQ((uint64_t)1000, snapshot.max);
+    ASSERT_LE((uint64_t)500, snapshot.p50);
+    ASSERT_GE((uint64_t)500 * 9 / 8, snapshot.p50);
+    ASSERT_LE((uint64_t)990, snapshot.p99);
+    ASSERT_GE((uint64_t)1000, snapshot.p999);
+}
+
+TEST(MetricsTest, ConcurrentUpdates)
+{
+    metrics_registry registry;
+    const size_t num_threads = 4;
+    const size_t num_updates = 10000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&registry, num_updates]() {
+            for (size_t i = 0; i < num_updates; ++i) {
+                registry.counter("events", {{"kind", "a"}}).increment();
+                registry.histogram("latency").record(i);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<metrics_sample> samples;
+    registry.snapshot(samples);
+    ASSERT_EQ((size_t)2, samples.size());
+    ASSERT_EQ("events", samples[0].name);
+    ASSERT_EQ(num_threads * num_updates, samples[0].counter_value);
+    ASSERT_EQ(num_threads * num_updates, samples[1].histogram_value.count);
+    ASSERT_EQ(num_updates - 1, samples[1].histogram_value.max);
+}
+
+TEST(MetricsTest, WriteText)
+{
+    metrics_registry registry;
+    registry.counter("zecale_events_total", {{"kind", "a"}}).increment(3);
+    registry.histogram("zecale_latency_us").record(5);
+
+    std::vector<metrics_sample> samples;
+    registry.snapshot(samples);
+    metrics_sample gauge;
+    gauge.name = "zecale_depth";
+    gauge.labels = {{"app", "zeth"}};
+    gauge.type = metrics_sample::gauge;
+    gauge.gauge_value = 2;
+    samples.push_back(gauge);
+
+    std::ostringstream out;
+    metrics_write_text(samples, out);
+    ASSERT_EQ(
+        "# TYPE zecale_events_total counter\n"
+        "zecale_events_total{kind=\"a\"} 3\n"
+        "# TYPE zecale_latency_us summary\n"
+        "zecale_latency_us{quantile=\"0.5\"} 5\n"
+        "zecale_latency_us{quantile=\"0.9\"} 5\n"
+        "zecale_latency_us{quantile=\"0.99\"} 5\n"
+        "zecale_latency_us{quantile=\"0.999\"} 5\n"
+        "zecale_latency_us_count 1\n"
+        "zecale_latency_us_sum 5\n"
+        "zecale_latency_us_max 5\n"
+        "# TYPE zecale_depth gauge\n"
+        "zecale_depth{app=\"zeth\"} 2.000000\n",
+        out.str());
+}
+
+TEST(MetricsTest, WriteTextEscapesLabelValues)
+{
+    metrics_sample gauge;
+    gauge.name = "zecale_depth";
+    gauge.labels = {{"app", "a\\b\"c\nd"}};
+    gauge.type = metrics_sample::gauge;
+    gauge.gauge_value = 1;
+
+    std::ostringstream out;
+    metrics_write_text({gauge}, out);
+    ASSERT_EQ(
+        "# TYPE zecale_depth gauge\n"
+        "zecale_depth{app=\"a\\\\b\\\"c\\nd\"} 1.000000\n",
+        out.str());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/nested_proof_verifier.hpp"
+#include "libzecale/tests/circuits/dummy_application.hpp"
+
+#include <gtest/gtest.h>
+#include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
+#include <libzeth/snarks/groth16/groth16_snark.hpp>
+#include <libzeth/snarks/pghr13/pghr13_snark.hpp>
+
+using namespace libzecale;
+
+namespace
+{
+
+template<typename ppT, typename snarkT> void nested_proof_verifier_test()
+{
+    using extended_proof = libzeth::extended_proof<ppT, snarkT>;
+
+    test::dummy_app_wrapper<ppT, snarkT> dummy_app;
+    const typename snarkT::keypair keypair = dummy_app.generate_keypair();
+    const extended_proof pf1 = dummy_app.prove(5, keypair.pk);
+    const extended_proof pf2 = dummy_app.prove(9, keypair.pk);
+    const extended_proof pf3 = dummy_app.prove(11, keypair.pk);
+
+    // Proof with modified input.
+    libsnark::r1cs_primary_input<libff::Fr<ppT>> inputs2 =
+        pf2.get_primary_inputs();
+    inputs2[0] = inputs2[0] + libff::Fr<ppT>::one();
+    const extended_proof pf2_invalid(
+        typename snarkT::proof(pf2.get_proof()), std::move(inputs2));
+
+    const nested_proof_verifier<ppT, snarkT> verifier(keypair.vk);
+    ASSERT_EQ(std::vector<bool>({true}), verifier.verify({&pf1}));
+    ASSERT_EQ(
+        std::vector<bool>({true, true, true}),
+        verifier.verify({&pf1, &pf2, &pf3}));
+    ASSERT_EQ(std::vector<bool>({false}), verifier.verify({&pf2_invalid}));
+    ASSERT_EQ(
+        std::vector<bool>({true, false, true}),
+        verifier.verify({&pf1, &pf2_invalid, &pf3}));
+    ASSERT_EQ(std::vector<bool>(), verifier.verify({}));
+
+    // Same results when the proof elements are known to be valid.
+    ASSERT_EQ(
+        std::vector<bool>({true, false, true}),
+        verifier.verify({&pf1, &pf2_invalid, &pf3}, true));
+}
+
+TEST(NestedProofVerifierTest, Mnt4Groth16)
+{
+    using pp = libff::mnt4_pp;
+    nested_proof_verifier_test<pp, libzeth::groth16_snark<pp>>();
+}
+
+TEST(NestedProofVerifierTest, Mnt4Groth16InvalidNumInputs)
+{
+    using pp = libff::mnt4_pp;
+    using snark = libzeth::groth16_snark<pp>;
+    using extended_proof = libzeth::extended_proof<pp, snark>;
+
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const snark::keypair keypair = dummy_app.generate_keypair();
+    const extended_proof pf1 = dummy_app.prove(5, keypair.pk);
+    const extended_proof pf1_extra_input(
+        snark::proof(pf1.get_proof()),
+        {pf1.get_primary_inputs()[0], libff::Fr<pp>::one()});
+
+    // Proofs with the wrong number of inputs are rejected without affecting
+    // the others.
+    const nested_proof_verifier<pp, snark> verifier(keypair.vk);
+    ASSERT_EQ(
+        std::vector<bool>({false, true}),
+        verifier.verify({&pf1_extra_input, &pf1}));
+}
+
+TEST(NestedProofVerifierTest, Mnt4Groth16CheckPoints)
+{
+    using pp = libff::mnt4_pp;
+    using snark = libzeth::groth16_snark<pp>;
+    using extended_proof = libzeth::extended_proof<pp, snark>;
+    using verifier = nested_proof_verifier<pp, snark>;
+
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const snark::keypair keypair = dummy_app.generate_keypair();
+    const extended_proof pf1 = dummy_app.prove(5, keypair.pk);
+    ASSERT_TRUE(verifier::check_points(pf1.get_proof()));
+
+    // Proof with an element which is not on the curve.
+    snark::proof invalid_proof(pf1.get_proof());
+    invalid_proof.g_C.to_affine_coordinates();
+    invalid_proof.g_C.X = invalid_proof.g_C.X + libff::Fq<pp>::one();
+    ASSERT_FALSE(verifier::check_points(invalid_proof));
+
+    // Such proofs are rejected by verify, without affecting the others.
+    const extended_proof pf1_invalid(
+        std::move(invalid_proof),
+        libsnark::r1cs_primary_input<libff::Fr<pp>>(
+            pf1.get_primary_inputs()));
+    ASSERT_EQ(
+        std::vector<bool>({true, false}),
+        verifier(keypair.vk).verify({&pf1, &pf1_invalid}));
+}
+
+TEST(NestedProofVerifierTest, Mnt4Pghr13)
+{
+    using pp = libff::mnt4_pp;
+    nested_proof_verifier_test<pp, libzeth::pghr13_snark<pp>>();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    libff::mnt4_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/ring_buffer.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace libzecale;
+
+namespace
+{
+
+TEST(RingBufferTest, PushPop)
+{
+    ring_buffer<std::string> buffer(3);
+    ASSERT_EQ((size_t)4, buffer.capacity());
+
+    std::string value;
+    ASSERT_FALSE(buffer.try_pop(value));
+
+    // Fill the buffer, wrapping around more than once.
+    for (size_t round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < 4; ++i) {
+            std::string in = std::to_string(i);
+            ASSERT_TRUE(buffer.try_push(in));
+        }
+        std::string overflow = "overflow";
+        ASSERT_FALSE(buffer.try_push(overflow));
+        ASSERT_EQ("overflow", overflow);
+
+        for (size_t i = 0; i < 4; ++i) {
+            ASSERT_TRUE(buffer.try_pop(value));
+            ASSERT_EQ(std::to_string(i), value);
+        }
+        ASSERT_FALSE(buffer.try_pop(value));
+    }
+}
+
+TEST(RingBufferTest, ConcurrentProducers)
+{
+    // Several producers push a sequence of values each, while a single
+    // consumer pops them. Each producer's values are received in order.
+    const size_t num_producers = 4;
+    const size_t num_values = 10000;
+    ring_buffer<size_t> buffer(16);
+
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < num_producers; ++p) {
+        producers.emplace_back([&buffer, p, num_values]() {
+            for (size_t i = 0; i < num_values; ++i) {
+                size_t value = p * num_values + i;
+                while (!buffer.try_push(value)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<size_t> next(num_producers, 0);
+    for (size_t received = 0; received < num_producers * num_values;) {
+        size_t value;
+        if (!buffer.try_pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const size_t p = value / num_values;
+        ASSERT_EQ(next[p], value % num_values);
+        ++next[p];
+        ++received;
+    }
+
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/streaming_setup.hpp"
+#include "libzecale/tests/circuits/dummy_application.hpp"
+
+#include "gtest/gtest.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
+#include <sstream>
+
+using namespace libzecale;
+
+namespace
+{
+
+using pp = libff::mnt4_pp;
+using snark = libzeth::groth16_snark<pp>;
+
+boost::filesystem::path temp_file_path()
+{
+    return boost::filesystem::temp_directory_path() /
+           boost::filesystem::unique_path("zecale_streaming_setup_%%%%%%%%");
+}
+
+void test_streaming_setup(const size_t chunk_size)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const boost::filesystem::path keypair_file = temp_file_path();
+    const uint64_t config_fingerprint =
+        mapped_keypair_config_fingerprint("streaming_setup_test");
+
+    size_t num_progress_calls = 0;
+    size_t last_computed = 0;
+    size_t last_total = 0;
+    const setup_progress_callback progress = [&](size_t num_computed,
+                                                 size_t num_total) {
+        ASSERT_GT(num_computed, last_computed);
+        ASSERT_LE(num_computed, num_total);
+        ++num_progress_calls;
+        last_computed = num_computed;
+        last_total = num_total;
+    };
+
+    snark::verification_key vk;
+    {
+        std::ofstream out_s(
+            keypair_file.c_str(), std::ios_base::out | std::ios_base::binary);
+        vk = groth16_generate_setup_mapped<pp>(
+            dummy_app._pb.get_constraint_system(),
+            out_s,
+            config_fingerprint,
+            chunk_size,
+            progress);
+    }
+    ASSERT_LT(0, num_progress_calls);
+    ASSERT_EQ(last_total, last_computed);
+
+    // The streamed file is a valid mapped keypair, holding the returned
+    // verification key.
+    snark::keypair keypair;
+    const mapped_keypair_header header =
+        groth16_keypair_read_mapped<pp>(keypair, keypair_file.string());
+    ASSERT_EQ(config_fingerprint, header.config_fingerprint);
+    ASSERT_EQ(vk, keypair.vk);
+
+    // Proofs generated with the proving key are valid.
+    const libzeth::extended_proof<pp, snark> proof =
+        dummy_app.prove(5, keypair.pk);
+    ASSERT_TRUE(
+        snark::verify(proof.get_primary_inputs(), proof.get_proof(), vk));
+
+    boost::filesystem::remove(keypair_file);
+}
+
+TEST(StreamingSetupTest, SingleChunk)
+{
+    test_streaming_setup(default_setup_chunk_size);
+}
+
+TEST(StreamingSetupTest, MultipleChunks) { test_streaming_setup(1); }
+
+TEST(StreamingSetupTest, InvalidChunkSize)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    std::ostringstream out_s;
+    ASSERT_THROW(
+        groth16_generate_setup_mapped<pp>(
+            dummy_app._pb.get_constraint_system(), out_s, 0, 0),
+        std::invalid_argument);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    libff::mnt4_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/transaction_dedup_index.hpp"
+
+#include <gtest/gtest.h>
+#include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
+#include <libzeth/snarks/groth16/groth16_snark.hpp>
+#include <thread>
+
+using namespace libzecale;
+
+namespace
+{
+
+using pp = libff::mnt4_pp;
+using snark = libzeth::groth16_snark<pp>;
+using tx_type = nested_transaction<pp, snark>;
+
+libzeth::extended_proof<pp, snark> dummy_extended_proof()
+{
+    snark::proof proof(
+        libff::G1<pp>::random_element(),
+        libff::G2<pp>::random_element(),
+        libff::G1<pp>::random_element());
+    std::vector<libff::Fr<pp>> inputs{libff::Fr<pp>::random_element(),
+                                      libff::Fr<pp>::random_element()};
+    return libzeth::extended_proof<pp, snark>(
+        std::move(proof), std::move(inputs));
+}
+
+transaction_hash test_hash(uint8_t value)
+{
+    transaction_hash hash;
+    hash.fill(value);
+    return hash;
+}
+
+TEST(TransactionDedupIndexTest, TransactionHash)
+{
+    const libzeth::extended_proof<pp, snark> proof = dummy_extended_proof();
+    const tx_type tx("app", proof, {1, 2, 3}, 10);
+
+    // The fee and arrival time are not covered by the hash.
+    ASSERT_EQ(
+        nested_transaction_hash(tx),
+        nested_transaction_hash(tx_type("app", proof, {1, 2, 3}, 20)));
+
+    // The parameters and proof are.
+    ASSERT_NE(
+        nested_transaction_hash(tx),
+        nested_transaction_hash(tx_type("app", proof, {1, 2, 4}, 10)));
+    ASSERT_NE(
+        nested_transaction_hash(tx),
+        nested_transaction_hash(
+            tx_type("app", dummy_extended_proof(), {1, 2, 3}, 10)));
+}
+
+TEST(TransactionDedupIndexTest, PendingAndAggregated)
+{
+    transaction_dedup_index index;
+    const transaction_hash hash1 = test_hash(1);
+    const transaction_hash hash2 = test_hash(2);
+
+    ASSERT_TRUE(index.add_pending(hash1));
+    ASSERT_FALSE(index.add_pending(hash1));
+    ASSERT_TRUE(index.add_pending(hash2));
+    ASSERT_EQ((size_t)2, index.size());
+
+    // Removed transactions may be resubmitted.
+    index.remove(hash2);
+    ASSERT_TRUE(index.add_pending(hash2));
+
+    // Aggregated transactions are still duplicates, and are not removed.
+    index.set_aggregated(hash1);
+    ASSERT_FALSE(index.add_pending(hash1));
+    index.remove(hash1);
+    ASSERT_FALSE(index.add_pending(hash1));
+}
+
+TEST(TransactionDedupIndexTest, ExpireAggregated)
+{
+    transaction_dedup_index index(std::chrono::milliseconds(50));
+    const transaction_hash hash = test_hash(1);
+
+    ASSERT_TRUE(index.add_pending(hash));
+    index.set_aggregated(hash);
+    ASSERT_FALSE(index.add_pending(hash));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(index.add_pending(hash));
+}
+
+TEST(TransactionDedupIndexTest, BoundedAggregated)
+{
+    transaction_dedup_index index(default_dedup_ttl, 2);
+    for (uint8_t i = 0; i < 4; ++i) {
+        ASSERT_TRUE(index.add_pending(test_hash(i)));
+        index.set_aggregated(test_hash(i));
+    }
+
+    // Only the 2 most recently aggregated are held.
+    ASSERT_EQ((size_t)2, index.size());
+    ASSERT_TRUE(index.add_pending(test_hash(0)));
+    ASSERT_TRUE(index.add_pending(test_hash(1)));
+    ASSERT_FALSE(index.add_pending(test_hash(2)));
+    ASSERT_FALSE(index.add_pending(test_hash(3)));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    libff::mnt4_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/circuits/groth16_verifier/groth16_verifier_parameters.hpp"
+#include "libzecale/core/verification_key_hash_cache.hpp"
+#include "libzecale/tests/circuits/dummy_application.hpp"
+
+#include <gtest/gtest.h>
+#include <libsnark/gadgetlib1/gadgets/pairing/mnt/mnt_pairing_params.hpp>
+
+using namespace libzecale;
+
+namespace
+{
+
+using wpp = libff::mnt6_pp;
+using npp = libsnark::other_curve<wpp>;
+using nverifier = groth16_verifier_parameters<wpp>;
+using nsnark = typename nverifier::snark;
+using hash_gadget = verification_key_hash_gadget<wpp, nverifier>;
+using hash_cache = verification_key_hash_cache<wpp, nverifier>;
+
+static const size_t num_inputs =
+    test::dummy_app_wrapper<npp, nsnark>::num_primary_inputs;
+
+TEST(VerificationKeyHashCacheTest, GetHash)
+{
+    test::dummy_app_wrapper<npp, nsnark> dummy_app;
+    const nsnark::keypair nkeypair1 = dummy_app.generate_keypair();
+    const nsnark::keypair nkeypair2 = dummy_app.generate_keypair();
+    const libff::Fr<wpp> vk1_hash =
+        hash_gadget::compute_hash(nkeypair1.vk, num_inputs);
+    const libff::Fr<wpp> vk2_hash =
+        hash_gadget::compute_hash(nkeypair2.vk, num_inputs);
+
+    hash_cache cache(num_inputs);
+    ASSERT_EQ((size_t)0, cache.size());
+    ASSERT_EQ(vk1_hash, cache.get_hash(nkeypair1.vk));
+    ASSERT_EQ((size_t)1, cache.size());
+
+    // Hits do not add entries.
+    ASSERT_EQ(vk1_hash, cache.get_hash(nkeypair1.vk));
+    ASSERT_EQ((size_t)1, cache.size());
+
+    ASSERT_EQ(vk2_hash, cache.get_hash(nkeypair2.vk));
+    ASSERT_EQ((size_t)2, cache.size());
+}
+
+TEST(VerificationKeyHashCacheTest, Eviction)
+{
+    test::dummy_app_wrapper<npp, nsnark> dummy_app;
+    const nsnark::keypair nkeypair1 = dummy_app.generate_keypair();
+    const nsnark::keypair nkeypair2 = dummy_app.generate_keypair();
+    const libff::Fr<wpp> vk1_hash =
+        hash_gadget::compute_hash(nkeypair1.vk, num_inputs);
+
+    hash_cache cache(num_inputs, 1);
+    cache.get_hash(nkeypair1.vk);
+    cache.get_hash(nkeypair2.vk);
+    ASSERT_EQ((size_t)1, cache.size());
+
+    // Evicted entries are recomputed.
+    ASSERT_EQ(vk1_hash, cache.get_hash(nkeypair1.vk));
+    ASSERT_EQ((size_t)1, cache.size());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    libff::mnt4_pp::init_public_params();
+    libff::mnt6_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/worker_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <set>
+
+using namespace libzecale;
+
+namespace
+{
+
+TEST(WorkerPoolTest, RunAllTasks)
+{
+    const size_t num_tasks = 1000;
+    std::atomic<size_t> num_run(0);
+    std::mutex thread_ids_mutex;
+    std::set<std::thread::id> thread_ids;
+    {
+        worker_pool pool(4);
+        ASSERT_EQ((size_t)4, pool.num_threads());
+        for (size_t i = 0; i < num_tasks; ++i) {
+            pool.post([&]() {
+                ++num_run;
+                std::lock_guard<std::mutex> lock(thread_ids_mutex);
+                thread_ids.insert(std::this_thread::get_id());
+            });
+        }
+
+        // Tasks still queued are run before the pool is destroyed.
+    }
+
+    ASSERT_EQ(num_tasks, num_run.load());
+    ASSERT_GE((size_t)4, thread_ids.size());
+    ASSERT_EQ((size_t)0, thread_ids.count(std::this_thread::get_id()));
+}
+
+TEST(WorkerPoolTest, TasksRunConcurrently)
+{
+    // Each task waits until all have started, which requires them to run on
+    // different threads.
+    const size_t num_threads = 4;
+    std::mutex mutex;
+    std::condition_variable all_started;
+    size_t num_started = 0;
+    worker_pool pool(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        pool.post([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++num_started;
+            all_started.notify_all();
+            all_started.wait(
+                lock, [&]() { return num_started == num_threads; });
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(all_started.wait_for(lock, std::chrono::seconds(10), [&]() {
+        return num_started == num_threads;
+    }));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/core/write_ahead_log.hpp"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <thread>
+
+using namespace libzecale;
+
+namespace
+{
+
+boost::filesystem::path temp_log_dir()
+{
+    return boost::filesystem::temp_directory_path() /
+           boost::filesystem::unique_path("zecale_log_%%%%%%%%");
+}
+
+TEST(WriteAheadLogTest, AddRemoveReplay)
+{
+    const boost::filesystem::path dir = temp_log_dir();
+    uint64_t id1;
+    uint64_t id2;
+    uint64_t id3;
+    {
+        write_ahead_log log(dir.string());
+        ASSERT_TRUE(log.replay().empty());
+        id1 = log.add(1, "entry1");
+        id2 = log.add(2, "entry2");
+        id3 = log.add(1, std::string("entry\0" "3", 7));
+        log.remove({id2});
+        ASSERT_EQ((size_t)2, log.size());
+    }
+
+    write_ahead_log log(dir.string());
+    const std::vector<write_ahead_log::entry> entries = log.replay();
+    ASSERT_EQ((size_t)2, entries.size());
+    ASSERT_EQ(id1, entries[0].id);
+    ASSERT_EQ((uint32_t)1, entries[0].type);
+    ASSERT_EQ("entry1", *entries[0].payload);
+    ASSERT_EQ(id3, entries[1].id);
+    ASSERT_EQ(std::string("entry\0" "3", 7), *entries[1].payload);
+
+    // Ids are not reused after a restart.
+    ASSERT_LT(id3, log.add(1, "entry4"));
+
+    // Replay is only possible once, and entries of type 0 are invalid.
+    ASSERT_THROW(log.replay(), std::logic_error);
+    ASSERT_THROW(log.add(0, "invalid"), std::invalid_argument);
+
+    boost::filesystem::remove_all(dir);
+}
+
+TEST(WriteAheadLogTest, ConcurrentAddsWithSnapshots)
+{
+    const boost::filesystem::path dir = temp_log_dir();
+    const size_t num_threads = 8;
+    const size_t num_adds = 50;
+    std::vector<uint64_t> ids;
+    {
+        // Small snapshot interval, so that several snapshots are taken while
+        // entries are added.
+        write_ahead_log log(dir.string(), 32);
+        log.replay();
+
+        std::mutex ids_mutex;
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&log, &ids, &ids_mutex, t]() {
+                for (size_t i = 0; i < num_adds; ++i) {
+                    const uint64_t id = log.add(
+                        1, std::to_string(t) + "_" + std::to_string(i));
+                    std::lock_guard<std::mutex> lock(ids_mutex);
+                    ids.push_back(id);
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        std::sort(ids.begin(), ids.end());
+        ASSERT_EQ(ids.end(), std::unique(ids.begin(), ids.end()));
+        log.remove(std::vector<uint64_t>(ids.begin(), ids.begin() + 100));
+    }
+
+    write_ahead_log log(dir.string(), 32);
+    const std::vector<write_ahead_log::entry> entries = log.replay();
+    ASSERT_EQ(num_threads * num_adds - 100, entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ASSERT_EQ(ids[100 + i], entries[i].id);
+    }
+    ASSERT_TRUE(boost::filesystem::exists(dir / "snapshot"));
+
+    boost::filesystem::remove_all(dir);
+}
+
+TEST(WriteAheadLogTest, DiscardPartialRecord)
+{
+    const boost::filesystem::path dir = temp_log_dir();
+    {
+        write_ahead_log log(dir.string());
+        log.replay();
+        log.add(1, "entry1");
+        log.add(1, "entry2");
+    }
+
+    // Simulate a crash during a write, by appending part of a record.
+    boost::filesystem::path segment;
+    for (const boost::filesystem::directory_entry &entry :
+         boost::filesystem::directory_iterator(dir)) {
+        segment = std::max(segment, entry.path());
+    }
+    {
+        std::ofstream out_s(
+            segment.c_str(), std::ios_base::app | std::ios_base::binary);
+        out_s << "partial";
+    }
+
+    {
+        write_ahead_log log(dir.string());
+        ASSERT_EQ((size_t)2, log.replay().size());
+        log.add(1, "entry3");
+    }
+
+    write_ahead_log log(dir.string());
+    const std::vector<write_ahead_log::entry> entries = log.replay();
+    ASSERT_EQ((size_t)3, entries.size());
+    ASSERT_EQ("entry3", *entries[2].payload);
+
+    boost::filesystem::remove_all(dir);
+}
+
+TEST(WriteAheadLogTest, RetryFailedSnapshot)
+{
+    const boost::filesystem::path dir = temp_log_dir();
+    const boost::filesystem::path snapshot = dir / "snapshot";
+    const boost::filesystem::path snapshot_tmp = dir / "snapshot.tmp";
+    {
+        write_ahead_log log(dir.string(), 4);
+        log.replay();
+        std::mutex errors_mutex;
+        std::vector<std::string> errors;
+        log.set_snapshot_failure_handler([&](const std::string &error) {
+            std::lock_guard<std::mutex> lock(errors_mutex);
+            errors.push_back(error);
+        });
+
+        // Prevent snapshots from being written, by occupying the path of
+        // their temporary file. Entries can still be added.
+        boost::filesystem::create_directories(snapshot_tmp);
+        for (size_t i = 0; i < 20 && log.num_failed_snapshots() == 0; ++i) {
+            log.add(1, "entry" + std::to_string(i));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_LT((size_t)0, log.num_failed_snapshots());
+        {
+            std::lock_guard<std::mutex> lock(errors_mutex);
+            ASSERT_EQ(log.num_failed_snapshots(), errors.size());
+        }
+        ASSERT_FALSE(boost::filesystem::exists(snapshot));
+
+        // Once the problem is resolved, a later snapshot succeeds.
+        boost::filesystem::remove(snapshot_tmp);
+        for (size_t i = 0; i < 20 && !boost::filesystem::exists(snapshot);
+             ++i) {
+            log.add(1, "later_entry" + std::to_string(i));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_TRUE(boost::filesystem::exists(snapshot));
+    }
+
+    // No entries are lost.
+    write_ahead_log log(dir.string(), 4);
+    const std::vector<write_ahead_log::entry> entries = log.replay();
+    ASSERT_LE((size_t)5, entries.size());
+    ASSERT_EQ("entry0", *entries[0].payload);
+
+    boost::filesystem::remove_all(dir);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
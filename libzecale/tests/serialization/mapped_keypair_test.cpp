@@ -0,0 +1,101 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/serialization/mapped_keypair.hpp"
+#include "libzecale/tests/circuits/dummy_application.hpp"
+
+#include "gtest/gtest.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
+
+using namespace libzecale;
+
+namespace
+{
+
+using pp = libff::mnt4_pp;
+using snark = libzeth::groth16_snark<pp>;
+
+boost::filesystem::path temp_file_path()
+{
+    return boost::filesystem::temp_directory_path() /
+           boost::filesystem::unique_path("zecale_mapped_keypair_%%%%%%%%");
+}
+
+TEST(MappedKeypairTest, WriteReadKeypair)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const snark::keypair keypair = dummy_app.generate_keypair();
+
+    const boost::filesystem::path keypair_file = temp_file_path();
+    const uint64_t config_fingerprint =
+        mapped_keypair_config_fingerprint("mapped_keypair_test");
+    ASSERT_NE(
+        config_fingerprint, mapped_keypair_config_fingerprint("other_config"));
+    {
+        std::ofstream out_s(
+            keypair_file.c_str(), std::ios_base::out | std::ios_base::binary);
+        groth16_keypair_write_mapped<pp>(keypair, out_s, config_fingerprint);
+    }
+
+    snark::keypair keypair2;
+    const mapped_keypair_header header =
+        groth16_keypair_read_mapped<pp>(keypair2, keypair_file.string());
+    ASSERT_EQ(config_fingerprint, header.config_fingerprint);
+    ASSERT_EQ(keypair.pk, keypair2.pk);
+    ASSERT_EQ(keypair.vk, keypair2.vk);
+
+    snark::keypair keypair3;
+    groth16_keypair_read_mapped<pp>(
+        keypair3, keypair_file.string(), true, true);
+    ASSERT_EQ(keypair.pk, keypair3.pk);
+
+    // Proofs generated with the loaded keypair are valid.
+    const libzeth::extended_proof<pp, snark> proof =
+        dummy_app.prove(5, keypair2.pk);
+    ASSERT_TRUE(snark::verify(
+        proof.get_primary_inputs(), proof.get_proof(), keypair.vk));
+
+    boost::filesystem::remove(keypair_file);
+}
+
+TEST(MappedKeypairTest, RejectCorruptKeypair)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const snark::keypair keypair = dummy_app.generate_keypair();
+
+    const boost::filesystem::path keypair_file = temp_file_path();
+    {
+        std::ofstream out_s(
+            keypair_file.c_str(), std::ios_base::out | std::ios_base::binary);
+        groth16_keypair_write_mapped<pp>(keypair, out_s);
+    }
+
+    // Modify a byte of the body.
+    {
+        std::fstream io_s(
+            keypair_file.c_str(),
+            std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        io_s.seekp(mapped_keypair_body_offset + 200);
+        io_s.put(0x5a);
+    }
+
+    snark::keypair keypair2;
+    ASSERT_THROW(
+        groth16_keypair_read_mapped<pp>(
+            keypair2, keypair_file.string(), false, true),
+        std::runtime_error);
+
+    boost::filesystem::remove(keypair_file);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    libff::mnt4_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -13,7 +13,9 @@
 #include <libzeth/serialization/proto_utils.hpp>
 #include <libzeth/snarks/groth16/groth16_api_handler.hpp>
 #include <libzeth/snarks/pghr13/pghr13_api_handler.hpp>
+#include <sstream>
 #include <stdio.h>
+#include <string>
 #include <zecale/api/aggregator.pb.h>
 #include <zeth/api/ec_group_messages.pb.h>
 
@@ -49,6 +51,51 @@ void test_parse_nested_transaction(
     ASSERT_EQ(nested_tx_decoded.application_name(), "zeth");
     ASSERT_EQ(nested_tx_decoded.fee_wei(), 12);
 
+    // The application name may be shared, rather than copied.
+    const std::shared_ptr<const std::string> app_name =
+        std::make_shared<const std::string>("zeth");
+    const nested_transaction<ppT, snarkT> nested_tx_shared_name =
+        nested_transaction_from_proto<ppT, api_handlerT>(
+            nested_tx_proto, app_name);
+    ASSERT_EQ(app_name.get(), &nested_tx_shared_name.application_name());
+    ASSERT_EQ(
+        nested_tx_shared_name.extended_proof().get_proof(),
+        mock_extended_proof.get_proof());
+
+    // The same transaction, with the proof in the binary encoding, decodes
+    // to the same proof.
+    std::ostringstream ext_proof_bytes;
+    extended_proof_write_bytes(mock_extended_proof, ext_proof_bytes);
+    zecale_proto::NestedTransaction nested_tx_binary_proto;
+    nested_tx_binary_proto.set_application_name("zeth");
+    nested_tx_binary_proto.set_fee_in_wei(12);
+    nested_tx_binary_proto.set_extended_proof_bytes(ext_proof_bytes.str());
+    ASSERT_LT(
+        nested_tx_binary_proto.ByteSizeLong(), nested_tx_proto.ByteSizeLong());
+    const nested_transaction<ppT, snarkT> nested_tx_binary_decoded =
+        nested_transaction_from_proto<ppT, api_handlerT>(
+            nested_tx_binary_proto);
+    ASSERT_EQ(
+        nested_tx_binary_decoded.extended_proof().get_primary_inputs(),
+        mock_extended_proof.get_primary_inputs());
+    ASSERT_EQ(
+        nested_tx_binary_decoded.extended_proof().get_proof(),
+        mock_extended_proof.get_proof());
+
+    // Truncated or padded encodings are rejected.
+    const std::string &binary = ext_proof_bytes.str();
+    nested_tx_binary_proto.set_extended_proof_bytes(
+        binary.substr(0, binary.size() - 1));
+    ASSERT_THROW(
+        (nested_transaction_from_proto<ppT, api_handlerT>(
+            nested_tx_binary_proto)),
+        std::invalid_argument);
+    nested_tx_binary_proto.set_extended_proof_bytes(binary + "x");
+    ASSERT_THROW(
+        (nested_transaction_from_proto<ppT, api_handlerT>(
+            nested_tx_binary_proto)),
+        std::invalid_argument);
+
     // ext_proof_proto will be deleted by the zecale_proto::NestedTransaction
     // destructor.
 }
@@ -101,6 +148,82 @@ template<typename ppT> void test_parse_nested_transaction_groth16()
         libzeth::groth16_api_handler<ppT>>(mock_extended_proof);
 }
 
+// Binary encoding of a Groth16 extended proof over mnt4, as produced by the
+// client encoder (see client/tests/test_proto_utils.py, which holds the same
+// data).
+const char *const groth16_mnt4_extended_proof_hex =
+    "5c84bbffef7a17c3881796f902c7809b5aa870accd8ddfc597517b6498401829"
+    "c3333d22c1010000b80877ffdff52e86112f2cf3058e0137b550e1589b1bbf8b"
+    "2fa3f6c83081305286677a4482030000138d32ff2b3c038ec6db645a010939d7"
+    "7ab75da805e0af8638a0c1852b9de2d8d5c6fa6e860100006f11eefe1bb71a51"
+    "4ff3fa5304d0b972d55fce54d36d8f4cd0f13ceac3ddfa0199fa379147030000"
+    "ca95a9fe67fdee5804a033bbff4af1129bc64aa43d328047d9ee07a7bef9ac88"
+    "e859b8bb4b010000261a65fe5778061c8db7c9b4021272aef56ebb500bc05f0d"
+    "7140830b573ac5b1ab8df5dd0c030000819e20fea3beda234264021cfe8ca94e"
+    "bbd537a0758450087a3d4ec851567738fbec750811010000dd22dcfd9339f2e6"
+    "ca7b981501542aea157ea84c431230ce118fc92cea968f61be20b32ad2020000"
+    "020000000000000038a7e755ec94a8ba52c5eabc4bbd2a329f4183fc328c20c9"
+    "1a8c94e9e4b241e80d803355d6000000a57b0219dfbb49b01d80696d4869cb57"
+    "a9851834dc430f05f702354305e44d79b0a07fd5fb010000";
+
+std::string hex_to_binary(const std::string &hex)
+{
+    std::string binary;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        binary.push_back((char)std::stoul(hex.substr(i, 2), nullptr, 16));
+    }
+    return binary;
+}
+
+TEST(MainTests, DecodeClientEncodedProofGROTH16Mnt4)
+{
+    using pp = libff::mnt4_pp;
+    using snark = libzeth::groth16_snark<pp>;
+    using Fq = libff::Fq<pp>;
+    using Fqe = libff::Fqe<pp>;
+    using Fr = libff::Fr<pp>;
+
+    // The encoded proof has A = (1, 2), B = ((3, 4), (5, 6)), C = (7, 8) and
+    // inputs (9, r - 1).
+    const std::string binary = hex_to_binary(groth16_mnt4_extended_proof_hex);
+    const libzeth::extended_proof<pp, snark> ext_proof =
+        internal::read_bytes_field<libzeth::extended_proof<pp, snark>>(
+            binary, extended_proof_read_bytes<pp, snark>);
+    ASSERT_EQ(
+        libff::G1<pp>(Fq(1), Fq(2), Fq::one()), ext_proof.get_proof().g_A);
+    ASSERT_EQ(
+        libff::G2<pp>(Fqe(Fq(3), Fq(4)), Fqe(Fq(5), Fq(6)), Fqe::one()),
+        ext_proof.get_proof().g_B);
+    ASSERT_EQ(
+        libff::G1<pp>(Fq(7), Fq(8), Fq::one()), ext_proof.get_proof().g_C);
+    ASSERT_EQ(
+        std::vector<Fr>({Fr(9), -Fr::one()}), ext_proof.get_primary_inputs());
+
+    // Re-encoding gives the same data.
+    std::ostringstream out_s;
+    extended_proof_write_bytes(ext_proof, out_s);
+    ASSERT_EQ(binary, out_s.str());
+
+    // Non-canonical field elements (here, the last input) are rejected.
+    const size_t fr_size = sizeof(Fr().mont_repr);
+    const std::string non_canonical_input =
+        binary.substr(0, binary.size() - fr_size) +
+        std::string(fr_size, (char)0xff);
+    ASSERT_THROW(
+        (internal::read_bytes_field<libzeth::extended_proof<pp, snark>>(
+            non_canonical_input, extended_proof_read_bytes<pp, snark>)),
+        std::invalid_argument);
+
+    // Likewise for the coordinates of proof elements (here, A.X).
+    const size_t fq_size = sizeof(Fq().mont_repr);
+    const std::string non_canonical_point =
+        std::string(fq_size, (char)0xff) + binary.substr(fq_size);
+    ASSERT_THROW(
+        (internal::read_bytes_field<libzeth::extended_proof<pp, snark>>(
+            non_canonical_point, extended_proof_read_bytes<pp, snark>)),
+        std::invalid_argument);
+}
+
 TEST(MainTests, ParseTransactionToAggregatePGHR13Mnt4)
 {
     test_parse_nested_transaction_pghr13<libff::mnt4_pp>();
@@ -0,0 +1,131 @@
+// Copyright (c) 2015-2021 Clearmatics Technologies Ltd
+//
+// SPDX-License-Identifier: LGPL-3.0+
+
+#include "libzecale/serialization/r1cs_binary.hpp"
+#include "libzecale/tests/circuits/dummy_application.hpp"
+
+#include "gtest/gtest.h"
+#include <libff/algebra/curves/mnt/mnt4/mnt4_pp.hpp>
+#include <libff/algebra/curves/mnt/mnt6/mnt6_pp.hpp>
+#include <sstream>
+
+using namespace libzecale;
+
+namespace
+{
+
+using pp = libff::mnt4_pp;
+using snark = libzeth::groth16_snark<pp>;
+using Field = libff::Fr<pp>;
+
+void test_write_read_r1cs(const size_t chunk_size)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const libsnark::r1cs_constraint_system<Field> &constraint_system =
+        dummy_app._pb.get_constraint_system();
+
+    std::stringstream ss;
+    r1cs_write_binary(constraint_system, ss, chunk_size);
+
+    libsnark::r1cs_constraint_system<Field> constraint_system2;
+    r1cs_read_binary(constraint_system2, ss);
+    ASSERT_EQ(constraint_system, constraint_system2);
+}
+
+TEST(R1CSBinaryTest, WriteReadSingleChunk)
+{
+    test_write_read_r1cs(default_r1cs_binary_chunk_size);
+}
+
+TEST(R1CSBinaryTest, WriteReadMultipleChunks) { test_write_read_r1cs(3); }
+
+TEST(R1CSBinaryTest, ReadChunks)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    const libsnark::r1cs_constraint_system<Field> &constraint_system =
+        dummy_app._pb.get_constraint_system();
+    const size_t chunk_size = 2;
+
+    std::stringstream ss;
+    r1cs_write_binary(constraint_system, ss, chunk_size);
+
+    r1cs_binary_reader reader(ss);
+    ASSERT_EQ(
+        constraint_system.num_constraints(), reader.header().num_constraints);
+    ASSERT_EQ(
+        constraint_system.primary_input_size,
+        reader.header().primary_input_size);
+    ASSERT_EQ(
+        constraint_system.auxiliary_input_size,
+        reader.header().auxiliary_input_size);
+
+    // Chunks hold the terms of each constraint, in order.
+    r1cs_binary_chunk chunk;
+    size_t constraint_idx = 0;
+    size_t num_chunks = 0;
+    while (reader.read_chunk(chunk)) {
+        ASSERT_LE(chunk.num_constraints(), chunk_size);
+        for (size_t i = 0; i < chunk.num_constraints(); ++i) {
+            const libsnark::r1cs_constraint<Field> &constraint =
+                constraint_system.constraints[constraint_idx++];
+            ASSERT_EQ(
+                constraint.a.terms.size(),
+                chunk.lc_offsets[3 * i + 1] - chunk.lc_offsets[3 * i]);
+            ASSERT_EQ(
+                constraint.c.terms.size(),
+                chunk.lc_offsets[3 * i + 3] - chunk.lc_offsets[3 * i + 2]);
+            if (!constraint.a.terms.empty()) {
+                ASSERT_EQ(
+                    constraint.a.terms[0].index,
+                    chunk.term_indices[chunk.lc_offsets[3 * i]]);
+            }
+        }
+        ++num_chunks;
+    }
+    ASSERT_EQ(constraint_system.num_constraints(), constraint_idx);
+    ASSERT_EQ(
+        (constraint_system.num_constraints() + chunk_size - 1) / chunk_size,
+        num_chunks);
+}
+
+TEST(R1CSBinaryTest, RejectInvalidFile)
+{
+    test::dummy_app_wrapper<pp, snark> dummy_app;
+    std::stringstream ss;
+    r1cs_write_binary(dummy_app._pb.get_constraint_system(), ss);
+    const std::string data = ss.str();
+
+    // A different field.
+    {
+        std::stringstream in_s(data);
+        libsnark::r1cs_constraint_system<libff::Fr<libff::mnt6_pp>>
+            constraint_system;
+        ASSERT_THROW(
+            r1cs_read_binary(constraint_system, in_s), std::runtime_error);
+    }
+
+    // A truncated file.
+    {
+        std::stringstream in_s(data.substr(0, data.size() - 1));
+        libsnark::r1cs_constraint_system<Field> constraint_system;
+        ASSERT_THROW(
+            r1cs_read_binary(constraint_system, in_s), std::runtime_error);
+    }
+
+    // Not an R1CS file.
+    {
+        std::stringstream in_s(std::string(64, 'x'));
+        ASSERT_THROW(r1cs_binary_reader reader(in_s), std::runtime_error);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    libff::mnt4_pp::init_public_params();
+    libff::mnt6_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}